@@ -1,5 +1,9 @@
 #include "Batch.h"
 
+#include <algorithm>
+
+#include "dali/tensor/MatOps.h"
+
 template<typename R>
 void Batch<R>::insert_example(const std::vector<std::string>& example,
                               const utils::Vocab& vocab,
@@ -43,3 +47,171 @@ size_t Batch<R>::max_length() const {
 
 template class Batch<float>;
 template class Batch<double>;
+
+template<typename R>
+PackedBatch<R>::PackedBatch(const Batch<R>& batch) : total_codes(batch.total_codes) {
+    const int num_examples = batch.size();
+    ASSERT2(batch.code_lengths.size() == num_examples,
+        utils::MS() << "Packing a batch of " << num_examples << " examples with "
+                    << batch.code_lengths.size() << " code lengths.");
+    ASSERT2(batch.target.dims(1) == num_examples && batch.mask.dims(1) == num_examples,
+        "Packing a batch requires one target and mask column per example.");
+
+    order = std::vector<int>(num_examples);
+    for (int example = 0; example < num_examples; ++example) {
+        order[example] = example;
+        ASSERT2(batch.code_lengths[example] <= batch.max_length(),
+            utils::MS() << "Example " << example << " is longer ("
+                        << batch.code_lengths[example] << ") than the batch ("
+                        << batch.max_length() << ")");
+    }
+    // stable, so that examples of equal length keep their order.
+    std::stable_sort(order.begin(), order.end(), [&batch](int a, int b) {
+        return batch.code_lengths[a] > batch.code_lengths[b];
+    });
+
+    const int length = num_examples > 0 ? batch.code_lengths[order[0]] : 0;
+    batch_sizes = std::vector<int>(length, 0);
+    for (int example : order) {
+        for (int timestep = 0; timestep < batch.code_lengths[example]; ++timestep) {
+            batch_sizes[timestep]++;
+        }
+    }
+
+    data     = Mat<int>(length, num_examples);
+    target   = Mat<int>(std::min<int>(batch.target.dims(0), length), num_examples);
+    mask     = Mat<R>(target.dims(0), num_examples);
+    positions = Mat<int>(1, num_examples);
+    for (int position = 0; position < num_examples; ++position) {
+        const int example = order[position];
+        positions.w(example) = position;
+        for (int timestep = 0; timestep < length; ++timestep) {
+            data.w(timestep, position) = batch.data.w(timestep, example);
+        }
+        for (int timestep = 0; timestep < target.dims(0); ++timestep) {
+            target.w(timestep, position) = batch.target.w(timestep, example);
+            mask.w(timestep, position)   = batch.mask.w(timestep, example);
+        }
+    }
+}
+
+template<typename R>
+size_t PackedBatch<R>::size() const {
+    return order.size();
+}
+
+template<typename R>
+size_t PackedBatch<R>::max_length() const {
+    return batch_sizes.size();
+}
+
+template<typename R>
+int PackedBatch<R>::running(int timestep) const {
+    return timestep < batch_sizes.size() ? batch_sizes[timestep] : 0;
+}
+
+template<typename R>
+Mat<int> PackedBatch<R>::inputs(int timestep, int rows) const {
+    ASSERT2(rows <= running(timestep),
+        utils::MS() << "Only " << running(timestep) << " examples are running at timestep "
+                    << timestep << " (asked for " << rows << ")");
+    Mat<int> out(1, rows);
+    for (int row = 0; row < rows; ++row) {
+        out.w(row) = data.w(timestep, row);
+    }
+    return out;
+}
+
+template<typename R>
+Mat<int> PackedBatch<R>::targets(int timestep, int rows) const {
+    ASSERT2(timestep < target.dims(0) && rows <= size(),
+        utils::MS() << "No targets for " << rows << " examples at timestep " << timestep);
+    Mat<int> out(1, rows);
+    for (int row = 0; row < rows; ++row) {
+        out.w(row) = target.w(timestep, row);
+    }
+    return out;
+}
+
+template<typename R>
+Mat<R> PackedBatch<R>::masks(int timestep, int rows) const {
+    ASSERT2(timestep < mask.dims(0) && rows <= size(),
+        utils::MS() << "No mask for " << rows << " examples at timestep " << timestep);
+    Mat<R> out(rows, 1);
+    for (int row = 0; row < rows; ++row) {
+        out.w(row) = mask.w(timestep, row);
+    }
+    out.constant = true;
+    return out;
+}
+
+template<typename R>
+Mat<R> PackedBatch<R>::unsort(Mat<R> sorted) const {
+    ASSERT2(sorted.dims(0) == size(),
+        utils::MS() << "Cannot unsort " << sorted.dims(0) << " rows for a batch of "
+                    << size() << " examples.");
+    return MatOps<R>::rows_pluck(sorted, positions);
+}
+
+template class PackedBatch<float>;
+template class PackedBatch<double>;
+
+int TreeBatch::add_leaf(uint word, uint label) {
+    if (levels.empty()) {
+        levels.emplace_back();
+    }
+    auto& leaves = levels[0];
+    nodes.emplace_back(0, leaves.labels.size());
+    leaves.words.emplace_back(word);
+    leaves.children.emplace_back();
+    leaves.labels.emplace_back(label);
+    return nodes.size() - 1;
+}
+
+int TreeBatch::add_node(const std::vector<int>& children, uint label) {
+    ASSERT2(children.size() > 0, "Tree nodes without children must be added as leaves.");
+    int level = 0;
+    for (auto child : children) {
+        ASSERT2(0 <= child && child < nodes.size(),
+            utils::MS() << "Unknown child node " << child << " (children must be added first).");
+        level = std::max(level, nodes[child].first + 1);
+    }
+    if (level >= levels.size()) {
+        levels.resize(level + 1);
+    }
+    nodes.emplace_back(level, levels[level].labels.size());
+    levels[level].children.emplace_back(children);
+    levels[level].labels.emplace_back(label);
+    return nodes.size() - 1;
+}
+
+int TreeBatch::size() const {
+    return nodes.size();
+}
+
+int TreeBatch::max_children() const {
+    int most = 0;
+    for (auto& level : levels) {
+        for (auto& children : level.children) {
+            most = std::max(most, (int)children.size());
+        }
+    }
+    return most;
+}
+
+int TreeBatch::row(int node) const {
+    int offset = 0;
+    for (int level = 0; level < nodes[node].first; ++level) {
+        offset += levels[level].labels.size();
+    }
+    return offset + nodes[node].second;
+}
+
+std::vector<uint> TreeBatch::labels() const {
+    std::vector<uint> all_labels;
+    all_labels.reserve(size());
+    for (auto& level : levels) {
+        all_labels.insert(all_labels.end(), level.labels.begin(), level.labels.end());
+    }
+    return all_labels;
+}
@@ -31,4 +31,81 @@ struct Batch {
 
 };
 
+// Batch whose examples are sorted by decreasing length (packed
+// sequences): at each timestep the examples still running are the
+// first ones, so a model can work on those rows only instead of
+// padding every example to max_length and masking the padding.
+// data, target and mask keep the layout of Batch, with their columns
+// in sorted order.
+template<typename R>
+struct PackedBatch {
+    // inputs (timestep x example)
+    Mat<int> data;
+    // labels (timestep x example)
+    Mat<int> target;
+    // when the labels must be used (timestep x example)
+    Mat<R> mask;
+    // number of examples still running at each timestep
+    std::vector<int> batch_sizes;
+    // example of the original batch at each sorted position
+    std::vector<int> order;
+    // sorted position of each example of the original batch
+    Mat<int> positions;
+    // number of unique target-example pairs
+    int total_codes;
+
+    PackedBatch() = default;
+    explicit PackedBatch(const Batch<R>& batch);
+
+    size_t size() const;
+    // length of the longest example (no timestep is all padding).
+    size_t max_length() const;
+    // number of examples still running at `timestep`.
+    int running(int timestep) const;
+
+    // inputs, labels and mask of the first `rows` examples at
+    // `timestep` (1 x rows, 1 x rows, rows x 1).
+    Mat<int> inputs(int timestep, int rows) const;
+    Mat<int> targets(int timestep, int rows) const;
+    Mat<R> masks(int timestep, int rows) const;
+
+    // puts the rows of a matrix with one row per sorted example back
+    // in the order of the original batch.
+    Mat<R> unsort(Mat<R> sorted) const;
+};
+
+// Nodes of a minibatch of trees grouped by height: a level holds the
+// nodes (of every tree) whose children all sit in lower levels, so
+// that a model can compute a whole level at once (see
+// `tree_batching::activate`). Leaves make up level 0, and nodes are
+// added children first.
+struct TreeBatch {
+    struct Level {
+        // word of each leaf (level 0 only)
+        std::vector<uint> words;
+        // children of each node (node ids)
+        std::vector<std::vector<int>> children;
+        // label of each node
+        std::vector<uint> labels;
+    };
+    std::vector<Level> levels;
+    // level of each node, and its position in that level
+    std::vector<std::pair<int, int>> nodes;
+    // root node of each tree
+    std::vector<int> roots;
+
+    // add a node and return its id.
+    int add_leaf(uint word, uint label);
+    int add_node(const std::vector<int>& children, uint label);
+
+    // number of nodes.
+    int size() const;
+    // most children of any node.
+    int max_children() const;
+    // outputs have one row per node, level by level: `row` is the
+    // row of a node and `labels` the label of each row.
+    int row(int node) const;
+    std::vector<uint> labels() const;
+};
+
 #endif
@@ -1,6 +1,10 @@
 #include "dali/data_processing/Glove.h"
 #include "dali/tensor/__MatMacros__.h"
+#include "dali/utils/parallel_parsing.h"
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 
 using std::string;
 using utils::Vocab;
@@ -9,106 +13,286 @@ using std::vector;
 using utils::from_string;
 
 namespace glove {
+    // the numbers of [begin, end), anything unreadable counting
+    // as 0 (like atof).
     template<typename T>
-    void collect_numericals_from_line(const std::string& line, int* offset_ptr, vector<T>* res) {
-        int& offset = *offset_ptr;
-        while (offset < line.size()) {
-            res->push_back(atof(line.c_str() + offset));
-            offset++;
-            while (offset < line.size() && *(line.begin() + offset) != ' ') {
-                offset++;
+    void collect_numericals(const char* begin, const char* end, vector<T>* res) {
+        while (true) {
+            while (begin < end && *begin == ' ') {
+                begin++;
+            }
+            if (begin == end) {
+                break;
+            }
+            res->push_back(utils::parallel_parsing::parse_double(&begin, end));
+            while (begin < end && *begin != ' ') {
+                begin++;
             }
         }
     }
 
-    void collect_name_from_line(const std::string& line, int* offset_ptr, std::string* word) {
-        int& offset = *offset_ptr;
-        for (const char& c : line) {
-            offset++;
-            if (c == ' ')
-                break;
+    // the word at the start of [begin, end), returns where it ends.
+    const char* collect_name(const char* begin, const char* end, std::string* word) {
+        auto space = (const char*)std::memchr(begin, ' ', end - begin);
+        if (space == NULL) {
+            space = end;
         }
-        (*word) = std::string(line.begin(), line.begin() + (offset > 0 ? offset - 1 : 0));
+        word->assign(begin, space);
+        return space;
     }
 
     template<typename T>
-    void convert_line_to_embedding(const std::string& line, std::string* word, vector<T>* embedding) {    // int offset = 0;
-        int offset = 0;
-        collect_name_from_line(line, &offset, word);
+    void convert_line_to_embedding(const char* begin, const char* end, std::string* word, vector<T>* embedding) {
+        auto numbers = collect_name(begin, end, word);
         embedding->clear();
-        collect_numericals_from_line(line, &offset, embedding);
+        collect_numericals(numbers, end, embedding);
     }
 
     template<typename T>
-    void convert_line_to_embedding_if(const std::string& line, std::function<bool(const std::string&)> checker, std::string* word, vector<T>* embedding) {
-        int offset = 0;
-        collect_name_from_line(line, &offset, word);
+    void convert_line_to_embedding_if(const char* begin, const char* end, std::function<bool(const std::string&)> checker, std::string* word, vector<T>* embedding) {
+        auto numbers = collect_name(begin, end, word);
         embedding->clear();
         if (checker(*word)) {
-            collect_numericals_from_line(line, &offset, embedding);
+            collect_numericals(numbers, end, embedding);
         }
     }
 
+    // lines to parse for a threshold on the number of words.
+    int max_lines(int threshold) {
+        return threshold > 0 ? threshold : -1;
+    }
 
+    namespace {
+        const char BINARY_MAGIC[] = "DALIEMB1";
+        // the vectors start at a multiple of this many bytes.
+        const int BINARY_ALIGNMENT = 64;
 
+        struct binary_header_t {
+            char magic[8];
+            uint64_t num_words;
+            uint64_t dims;
+            uint64_t vocab_bytes;
+        };
 
-    template<typename T>
-    void load(string fname, Mat<T>* underlying_mat, Vocab* vocab, int threshold) {
-        ASSERT2(utils::file_exists(fname), "Cannot open file with glove vectors.");
+        // a binary file mapped in memory.
+        struct binary_embedding_t {
+            std::shared_ptr<utils::MappedFile> file;
+            vector<string> words;
+            int dims;
+            // words.size() + 1 rows, the last one zeros.
+            float* vectors;
+        };
 
-        std::fstream fp(fname);
-        std::string line;
+        binary_embedding_t map_binary(const string& fname) {
+            binary_embedding_t embedding;
+            embedding.file = std::make_shared<utils::MappedFile>(fname);
+            const auto& file = *embedding.file;
+            binary_header_t header;
+            ASSERT2(file.size >= sizeof(header) && std::memcmp(file.data, BINARY_MAGIC, 8) == 0,
+                utils::MS() << fname << " is not a binary embedding file.");
+            std::memcpy(&header, file.data, sizeof(header));
 
-        int observed_size = underlying_mat->dims(1);
-        int capacity      = underlying_mat->dims(0);
+            const size_t vectors_offset = sizeof(header) + header.vocab_bytes;
+            ASSERT2(vectors_offset % BINARY_ALIGNMENT == 0 &&
+                    file.size == vectors_offset + (header.num_words + 1) * header.dims * sizeof(float),
+                utils::MS() << "Binary embedding file " << fname << " is truncated or corrupted.");
+            embedding.dims    = header.dims;
+            embedding.vectors = (float*)(file.data + vectors_offset);
 
-        if (capacity == 0) {
-            underlying_mat->resize(1, std::max(observed_size, 1));
-            capacity = 1;
+            embedding.words.reserve(header.num_words);
+            const char* word      = file.data + sizeof(header);
+            const char* vocab_end = file.data + vectors_offset;
+            while (embedding.words.size() < header.num_words) {
+                auto word_end = (const char*)std::memchr(word, '\n', vocab_end - word);
+                ASSERT2(word_end != NULL,
+                    utils::MS() << "Binary embedding file " << fname << " has fewer words than announced.");
+                embedding.words.emplace_back(word, word_end);
+                word = word_end + 1;
+            }
+            return embedding;
         }
-        auto& mat         = underlying_mat->w();
-        int vocab_size = 0;
-        vector<string> vocabulary;
-        std::string word;
-        vector<T> embedding;
-        // // use mat for assigning elements
-        while (std::getline(fp, line)) {
-            convert_line_to_embedding<T>(line, &word, &embedding);
-
-            vocabulary.emplace_back(word);
-            vocab_size += 1;
-            if (vocab_size > capacity) {
-                // increase matrix by 10%
-                mat.resize(mshadow::Shape2(std::max((int)(capacity * 1.1), capacity + 1), observed_size));
-                capacity = std::max((int)(capacity * 1.1), capacity + 1);
+
+        // makes the mapped vectors the memory of mat (only possible
+        // for floats).
+        bool map_vectors(const binary_embedding_t& embedding, Mat<float>* mat) {
+            *mat = Mat<float>(embedding.words.size() + 1, embedding.dims, weights<float>::empty());
+            MAT(*mat).memory().adopt_cpu(embedding.vectors, embedding.file);
+            return true;
+        }
+
+        template<typename T>
+        bool map_vectors(const binary_embedding_t& embedding, Mat<T>* mat) {
+            return false;
+        }
+
+        template<typename T>
+        void load_binary(const string& fname, Mat<T>* mat, Vocab* vocab, int threshold) {
+            auto embedding = map_binary(fname);
+            const int dims = embedding.dims;
+            int num_words  = embedding.words.size();
+            if (threshold != -1 && threshold < num_words) {
+                num_words = threshold;
             }
+            (*vocab) = Vocab(vector<string>(embedding.words.begin(), embedding.words.begin() + num_words));
+            if (dims == 0) {
+                mat->forget_w();
+                mat->forget_dw();
+                return;
+            }
+            if (num_words == embedding.words.size() && map_vectors(embedding, mat)) {
+                return;
+            }
+            *mat = Mat<T>(num_words + 1, dims, weights<T>::empty());
+            auto data = MAT(*mat).overwrite_cpu_data();
+            for (int row = 0; row < num_words; ++row) {
+                const float* source = embedding.vectors + (size_t)row * dims;
+                for (int col = 0; col < dims; ++col) {
+                    data[row][col] = source[col];
+                }
+            }
+            for (int col = 0; col < dims; ++col) {
+                data[num_words][col] = 0;
+            }
+        }
 
-            if (observed_size == 0 && embedding.size() > mat.shape[1]) {
-                mat.resize(mshadow::Shape2(capacity, embedding.size()));
+        template<typename T>
+        int load_relevant_binary_vectors(const string& fname,
+                                         Mat<T>* target,
+                                         const Vocab& vocab,
+                                         int threshold) {
+            auto embedding = map_binary(fname);
+            const int dims = embedding.dims;
+            int num_words  = embedding.words.size();
+            if (threshold != -1 && threshold < num_words) {
+                num_words = threshold;
             }
-            for (int col_idx = 0 ; col_idx < embedding.size(); ++col_idx) {
-                mat(vocab_size-1, col_idx) = embedding[col_idx];
+            int words_matched_so_far = 0;
+            for (int word_idx = 0; dims > 0 && word_idx < num_words; ++word_idx) {
+                auto found = vocab.word2index.find(embedding.words[word_idx]);
+                if (found == vocab.word2index.end()) {
+                    continue;
+                }
+                // ensure matrix is the right size
+                if (words_matched_so_far == 0 &&
+                        (target->dims(0) != vocab.word2index.size() || target->dims(1) != dims)) {
+                    *target = Mat<T>(vocab.size(), dims, weights<T>::uniform(1.0/dims));
+                }
+                // only the matched rows are copied.
+                auto data = MAT(*target).mutable_cpu_data();
+                const float* source = embedding.vectors + (size_t)word_idx * dims;
+                for (int col = 0; col < dims; ++col) {
+                    data[found->second][col] = source[col];
+                }
+                ++words_matched_so_far;
             }
+            return words_matched_so_far;
+        }
+    }
 
-            if (observed_size == 0) {
-                // actualize size of matrix
-                observed_size = embedding.size();
-                mat.resize(mshadow::Shape2(capacity, observed_size));
+    bool is_binary(string fname) {
+        std::ifstream fp(fname, std::ios::in | std::ios::binary);
+        char magic[8];
+        return fp.read(magic, 8) && std::memcmp(magic, BINARY_MAGIC, 8) == 0;
+    }
+
+    int convert_to_binary(string text_fname, string binary_fname, int threshold) {
+        ASSERT2(utils::file_exists(text_fname), "Cannot open file with glove vectors.");
+        std::string line;
+        std::string word;
+        vector<float> embedding;
+
+        // first pass: the words and the size of the vectors.
+        vector<string> words;
+        int dims = 0;
+        {
+            std::fstream fp(text_fname);
+            while ((threshold == -1 || words.size() < threshold) && std::getline(fp, line)) {
+                auto numbers = collect_name(line.data(), line.data() + line.size(), &word);
+                if (words.empty()) {
+                    collect_numericals(numbers, line.data() + line.size(), &embedding);
+                    dims = embedding.size();
+                }
+                words.emplace_back(word);
             }
-            ASSERT2(embedding.size() == observed_size,
+        }
+
+        binary_header_t header;
+        std::memcpy(header.magic, BINARY_MAGIC, 8);
+        header.num_words = words.size();
+        header.dims      = dims;
+        size_t vocab_bytes = 0;
+        for (auto& w : words) {
+            vocab_bytes += w.size() + 1;
+        }
+        const size_t vectors_offset = BINARY_ALIGNMENT *
+                ((sizeof(header) + vocab_bytes + BINARY_ALIGNMENT - 1) / BINARY_ALIGNMENT);
+        header.vocab_bytes = vectors_offset - sizeof(header);
+
+        std::ofstream out(binary_fname, std::ios::out | std::ios::binary | std::ios::trunc);
+        ASSERT2(out.good(), utils::MS() << "Cannot write binary embedding file " << binary_fname);
+        out.write((const char*)&header, sizeof(header));
+        for (auto& w : words) {
+            out << w << '\n';
+        }
+        vector<char> padding(header.vocab_bytes - vocab_bytes, '\0');
+        out.write(padding.data(), padding.size());
+
+        // second pass: the vectors.
+        std::fstream fp(text_fname);
+        for (int word_idx = 0; word_idx < words.size(); ++word_idx) {
+            std::getline(fp, line);
+            convert_line_to_embedding(line.data(), line.data() + line.size(), &word, &embedding);
+            ASSERT2(embedding.size() == dims,
                 utils::MS() << "Vectors in Glove file are of different sizes. Expected "
-                            << observed_size << " but found " << embedding.size()
+                            << dims << " but found " << embedding.size()
             );
-            // got all the vocab needed.
-            if (vocab_size == threshold) {
-                break;
+            out.write((const char*)embedding.data(), dims * sizeof(float));
+        }
+        // the unknown word.
+        vector<float> zeros(dims, 0.0);
+        out.write((const char*)zeros.data(), dims * sizeof(float));
+        ASSERT2(out.good(), utils::MS() << "Cannot write binary embedding file " << binary_fname);
+        return words.size();
+    }
+
+    template<typename T>
+    void load(string fname, Mat<T>* underlying_mat, Vocab* vocab, int threshold) {
+        ASSERT2(utils::file_exists(fname), "Cannot open file with glove vectors.");
+        if (is_binary(fname)) {
+            load_binary(fname, underlying_mat, vocab, threshold);
+            return;
+        }
+
+        // lines are parsed in parallel.
+        typedef std::pair<string, vector<T>> entry_t;
+        auto entries = utils::parallel_parsing::parse_lines<entry_t>(fname,
+            [](const char* begin, const char* end, vector<entry_t>* parsed) {
+                parsed->emplace_back();
+                convert_line_to_embedding(begin, end, &parsed->back().first, &parsed->back().second);
+            }, max_lines(threshold));
+
+        int observed_size = underlying_mat->dims(1);
+        vector<string> vocabulary;
+        vocabulary.reserve(entries.size());
+        for (auto& entry : entries) {
+            if (observed_size == 0) {
+                observed_size = entry.second.size();
             }
+            ASSERT2(entry.second.size() == observed_size,
+                utils::MS() << "Vectors in Glove file are of different sizes. Expected "
+                            << observed_size << " but found " << entry.second.size()
+            );
+            vocabulary.emplace_back(entry.first);
         }
         (*vocab) = Vocab(vocabulary);
         if (observed_size > 0) {
-            // // now final update is made to matrix
-            underlying_mat->resize(vocab_size + 1, observed_size);
-            mat[vocab_size].clear();
+            // one more row (zeros) for the unknown word.
+            *underlying_mat = Mat<T>(entries.size() + 1, observed_size, weights<T>::empty());
+            auto mat = MAT(*underlying_mat).overwrite_cpu_data();
+            for (int row = 0; row < entries.size(); ++row) {
+                std::copy(entries[row].second.begin(), entries[row].second.end(), mat[row].dptr_);
+            }
+            std::fill(mat[entries.size()].dptr_, mat[entries.size()].dptr_ + observed_size, (T)0.0);
         } else {
             underlying_mat->forget_w();
             underlying_mat->forget_dw();
@@ -128,36 +312,45 @@ namespace glove {
                               const utils::Vocab& vocab,
                               int threshold) {
         ASSERT2(utils::file_exists(fname), "Cannot open file with glove vectors.");
+        if (is_binary(fname)) {
+            return load_relevant_binary_vectors(fname, target, vocab, threshold);
+        }
+
+        // lines are parsed in parallel, and only the vectors of
+        // the words of vocab are kept.
+        typedef std::pair<int, vector<T>> match_t;
+        auto matches = utils::parallel_parsing::parse_lines<match_t>(fname,
+            [&vocab](const char* begin, const char* end, vector<match_t>* parsed) {
+                std::string word;
+                vector<T> embedding;
+                convert_line_to_embedding_if<T>(begin, end, [&vocab](const string& word) {
+                    return vocab.word2index.find(word) != vocab.word2index.end();
+                }, &word, &embedding);
+                if (embedding.size() > 0) {
+                    parsed->emplace_back(vocab.word2index.at(word), std::move(embedding));
+                }
+            }, max_lines(threshold));
 
         int embedding_size = 0;
-        int words_read_so_far = 0;
         int words_matched_so_far = 0;
-        vector<T> embedding;
-        std::string word;
-        std::string line;
-
-        std::fstream fp(fname);
-        while (std::getline(fp, line)) {
-            convert_line_to_embedding_if<T>(line, [&vocab](const string& word) {
-                return vocab.word2index.find(word) != vocab.word2index.end();
-            }, &word, &embedding);
-            if (embedding.size() > 0) {
-                int word_index = vocab.word2index.at(word);
-                // ensure matrix is the right size
-                if (embedding_size == 0) {
-                    embedding_size = embedding.size();
-                    if (target->dims(0) != vocab.word2index.size() ||
-                            target->dims(1) !=  embedding_size) {
-                        *target = Mat<T>(vocab.size(), embedding_size,
-                                        weights<T>::uniform(1.0/embedding_size));
-                    }
+        for (auto& match : matches) {
+            // ensure matrix is the right size
+            if (embedding_size == 0) {
+                embedding_size = match.second.size();
+                if (target->dims(0) != vocab.word2index.size() ||
+                        target->dims(1) !=  embedding_size) {
+                    *target = Mat<T>(vocab.size(), embedding_size,
+                                    weights<T>::uniform(1.0/embedding_size));
                 }
-                // store the embedding
-                for (int eidx = 0; eidx < embedding_size; ++ eidx)
-                    target->w(word_index, eidx) = embedding[eidx];
-                ++words_matched_so_far;
             }
-            if (threshold != -1 && ++words_read_so_far >= threshold) break;
+            ASSERT2(match.second.size() == embedding_size,
+                utils::MS() << "Vectors in Glove file are of different sizes. Expected "
+                            << embedding_size << " but found " << match.second.size()
+            );
+            // store the embedding
+            for (int eidx = 0; eidx < embedding_size; ++ eidx)
+                target->w(match.first, eidx) = match.second[eidx];
+            ++words_matched_so_far;
         }
         return words_matched_so_far;
     }
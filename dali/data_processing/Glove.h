@@ -13,6 +13,10 @@ namespace glove {
     with a Matrix containing the embeddings (one row per word)
     and a Vocab object containing a mapping from index to word
     and from word to index. Matrix is dynamically resized.
+
+    Binary files (see `convert_to_binary`) are recognized and
+    memory mapped instead of parsed: the Matrix of a float load
+    of the whole file is the mapped memory, nothing is copied.
     **/
 
     template<typename T>
@@ -30,6 +34,44 @@ namespace glove {
                               Mat<T>* target,
                               const utils::Vocab& vocab,
                               int threshold=-1);
+
+    /**
+    Convert To Binary
+    -----------------
+
+    Writes the word vectors of a Glove text file in a binary
+    format that loads without parsing:
+
+        "DALIEMB1"            8 byte magic
+        num_words, dims       uint64 each
+        vocab_bytes           uint64
+        words                 '\n' terminated, padded with '\0'
+                              up to a multiple of 64 bytes
+        vectors               (num_words + 1) x dims float32, row
+                              major, the last row zeros (the
+                              unknown word's row in `load`)
+
+    Integers and floats are stored in the machine's byte order.
+
+    Inputs
+    ------
+
+    std::string text_fname : Glove text file
+    std::string binary_fname : where to write the binary file
+    int threshold : convert at most this many words (if not -1)
+
+    Outputs
+    -------
+
+    int num_words : number of words converted
+
+    **/
+    int convert_to_binary(std::string text_fname,
+                          std::string binary_fname,
+                          int threshold=-1);
+
+    // whether fname is a binary file written by convert_to_binary.
+    bool is_binary(std::string fname);
 }
 
 #endif
@@ -130,6 +130,32 @@ namespace SST {
         return trees;
     }
 
+    namespace {
+        // adds the subtree children first, returns the id of its root.
+        int add_to_tree_batch(const Vocab& word_vocab,
+                              const AnnotatedParseTree& node,
+                              TreeBatch& batch) {
+            if (node.children.empty()) {
+                return batch.add_leaf(word_vocab[node.sentence], node.label);
+            }
+            vector<int> children;
+            for (auto& child : node.children) {
+                children.emplace_back(add_to_tree_batch(word_vocab, *child, batch));
+            }
+            return batch.add_node(children, node.label);
+        }
+    }
+
+    TreeBatch trees_to_tree_batch(
+            const Vocab& word_vocab,
+            const std::vector<AnnotatedParseTree::shared_tree>& trees) {
+        TreeBatch batch;
+        for (auto& tree : trees) {
+            batch.roots.emplace_back(add_to_tree_batch(word_vocab, *tree, batch));
+        }
+        return batch;
+    }
+
     treebank_minibatch_dataset convert_trees_to_indexed_minibatches(
         const Vocab& word_vocab,
         const std::vector<AnnotatedParseTree::shared_tree>& trees,
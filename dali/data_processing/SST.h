@@ -107,6 +107,30 @@ namespace SST {
         const std::vector<AnnotatedParseTree::shared_tree>& trees,
         int minibatch_size);
 
+    /**
+    Trees To Tree Batch
+    -------------------
+
+    Schedule the nodes of some parse trees by height (see
+    `TreeBatch` and `tree_batching::activate`), so that a tree model
+    computes every node of a level of the minibatch at once.
+
+    Inputs
+    ------
+
+    const Vocab& word_vocab : vocabulary used to index the leaves
+    const std::vector<AnnotatedParseTree::shared_tree>& trees : the minibatch
+
+    Outputs
+    -------
+
+    TreeBatch batch : every node of the trees with its label, the
+                      roots in the order of `trees`.
+    **/
+    TreeBatch trees_to_tree_batch(
+        const utils::Vocab& word_vocab,
+        const std::vector<AnnotatedParseTree::shared_tree>& trees);
+
     template<typename R>
     struct SentimentBatch : public Batch<R> {
         SentimentBatch(int max_example_length, int num_examples);
@@ -1,4 +1,5 @@
 
+#include <cstdio>
 #include <vector>
 #include <gtest/gtest.h>
 
@@ -31,6 +32,35 @@ TEST(Glove, load) {
     ASSERT_TRUE(MatOps<double>::equals(relevant_mat,  std::get<0>(embedding)));
 }
 
+TEST(Glove, load_binary) {
+    std::string text_fname   = STR(DALI_DATA_DIR) "/glove/test_data.txt";
+    std::string binary_fname = "/tmp/dali_glove_test_data.bin";
+    ASSERT_EQ(glove::convert_to_binary(text_fname, binary_fname), 20);
+    ASSERT_TRUE(glove::is_binary(binary_fname));
+    ASSERT_FALSE(glove::is_binary(text_fname));
+
+    auto text   = glove::load<float>(text_fname);
+    auto binary = glove::load<float>(binary_fname);
+    ASSERT_EQ(std::get<1>(binary).index2word, std::get<1>(text).index2word);
+    ASSERT_TRUE(MatOps<float>::equals(std::get<0>(binary), std::get<0>(text)));
+
+    // the mapped memory is copy on write.
+    std::get<0>(binary).w(0, 0) += 1.0;
+    auto reloaded = glove::load<double>(binary_fname, 5);
+    ASSERT_EQ(std::get<0>(reloaded).dims(0), 6);
+    ASSERT_NEAR(std::get<0>(reloaded).w(0, 0), std::get<0>(text).w(0, 0), 1e-6);
+
+    Mat<double> relevant_mat;
+    auto matched = glove::load_relevant_vectors(binary_fname, &relevant_mat, std::get<1>(text), -1);
+    ASSERT_EQ(matched, 20);
+    for (int row = 0; row < 20; ++row) {
+        for (int col = 0; col < relevant_mat.dims(1); ++col) {
+            ASSERT_NEAR(relevant_mat.w(row, col), std::get<0>(text).w(row, col), 1e-6);
+        }
+    }
+    std::remove(binary_fname.c_str());
+}
+
 // exposing internal functions from arithmetic for testing.
 namespace arithmetic {
     std::tuple<std::vector<int>, std::vector<std::string>> remove_multiplies(const std::vector<int>& numbers, const std::vector<std::string>& ops);
@@ -154,7 +184,7 @@ TEST(paraphrase, convert_to_indexed_minibatches) {
     auto gen_data = paraphrase::STS_2015::generate_train(STR(DALI_DATA_DIR) "/paraphrase_STS_2015/paraphrase_dummy_data.tsv");
     auto vocab_gen = utils::Vocab(paraphrase::get_vocabulary(gen_data, 1));
 
-    // deadlock when generator inside generator is run.
+    // generator consuming another generator.
     auto gen_minibatches = paraphrase::convert_to_indexed_minibatches(vocab_gen, gen_data, 3);
 
     vector<vector<paraphrase::numeric_example_t>> minibatches;
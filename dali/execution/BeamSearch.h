@@ -26,101 +26,208 @@ namespace beam_search {
         }
     };
 
-    template<typename REAL_t, typename state_t>
-    struct BeamSearchProposal {
-        typedef BeamSearchResult<REAL_t,state_t> result_t;
+    namespace internal {
+        // last symbol of a hypothesis and the history entry of
+        // the hypothesis it extends (-1 for the empty prefix).
+        struct BackPointer {
+            int parent;
+            uint symbol;
+        };
 
-        result_t prev_result;
-        REAL_t score;
-        uint candidate_idx;
-        bool finalized;
-
-        BeamSearchProposal() {}
-
-        BeamSearchProposal(result_t _prev_result,
-                         REAL_t _score,
-                         uint _candidate_idx,
-                         bool _finalized) :
-                prev_result(_prev_result),
-                score(_score),
-                candidate_idx(_candidate_idx),
-                finalized(_finalized) {
-        }
+        template<typename REAL_t, typename state_t>
+        struct Hypothesis {
+            state_t state;
+            REAL_t score;
+            int last;
+            bool finalized;
+        };
 
-        static BeamSearchProposal finalized_solution(result_t _result) {
-            return BeamSearchProposal<REAL_t,state_t>(
-                    _result, _result.score, 0, true);
-        }
+        // extend `hypothesis` with `symbol`, or keep it as is
+        // (finalized hypotheses) when `symbol` is negative.
+        template<typename REAL_t>
+        struct Candidate {
+            REAL_t score;
+            int hypothesis;
+            int symbol;
+        };
 
-        static BeamSearchProposal solution_candidate(result_t _prev_result,
-                                                     REAL_t _updated_score,
-                                                     uint _candidate_idx) {
-            return BeamSearchProposal<REAL_t,state_t>(
-                    _prev_result, _updated_score, _candidate_idx, false);
+        // higher score first, ties broken by position so that
+        // results do not depend on the order of selection.
+        template<typename REAL_t>
+        bool better(const Candidate<REAL_t>& a, const Candidate<REAL_t>& b) {
+            if (a.score != b.score)
+                return a.score > b.score;
+            if (a.hypothesis != b.hypothesis)
+                return a.hypothesis < b.hypothesis;
+            return a.symbol < b.symbol;
         }
 
+        // Keeps the k best candidates pushed so far in a heap whose
+        // front is the worst of them: O(log k) per accepted
+        // candidate, a single comparison per rejected one.
+        template<typename REAL_t>
+        class TopK {
+            std::vector<Candidate<REAL_t>> heap;
+            size_t k;
+            public:
+                explicit TopK(size_t _k) : k(_k) {
+                    heap.reserve(k);
+                }
+
+                bool accepts(REAL_t score) const {
+                    return heap.size() < k || score >= heap.front().score;
+                }
 
-    };
+                void push(const Candidate<REAL_t>& candidate) {
+                    if (heap.size() < k) {
+                        heap.emplace_back(candidate);
+                        std::push_heap(heap.begin(), heap.end(), better<REAL_t>);
+                    } else if (better(candidate, heap.front())) {
+                        std::pop_heap(heap.begin(), heap.end(), better<REAL_t>);
+                        heap.back() = candidate;
+                        std::push_heap(heap.begin(), heap.end(), better<REAL_t>);
+                    }
+                }
+
+                // best candidate first (empties the selection).
+                std::vector<Candidate<REAL_t>> sorted() {
+                    std::sort_heap(heap.begin(), heap.end(), better<REAL_t>);
+                    std::vector<Candidate<REAL_t>> result;
+                    result.swap(heap);
+                    return result;
+                }
+        };
+    }
 
-    // attempts to find maximum sum of scores candidate.
+    // Attempts to find maximum sum of scores candidate.
+    //
+    // All the live hypotheses are scored at once: `candidate_scores`
+    // receives their states and returns a matrix with one row of
+    // candidate scores per state. The best `beam_width` extensions
+    // across all rows are selected without sorting the rows, and
+    // solutions are only materialized (from back-pointers) once the
+    // search is over.
     template<typename REAL_t, typename state_t>
     std::vector<BeamSearchResult<REAL_t,state_t>>
-    beam_search(state_t initial_state,
-                uint beam_width,
-                std::function<Mat<REAL_t>(state_t)> candidate_scores,
-                std::function<state_t(state_t, uint)> make_choice,
-                uint end_symbol,
-                int max_solution_length,
-                std::vector<uint> forbidden_symbols=std::vector<uint>()) {
+    batched_beam_search(state_t initial_state,
+                        uint beam_width,
+                        std::function<Mat<REAL_t>(const std::vector<state_t>&)> candidate_scores,
+                        std::function<state_t(state_t, uint)> make_choice,
+                        uint end_symbol,
+                        int max_solution_length,
+                        std::vector<uint> forbidden_symbols=std::vector<uint>()) {
         utils::assert2(beam_width > 0, "Beam width must be strictly positive.");
         typedef BeamSearchResult<REAL_t, state_t> result_t;
-        typedef BeamSearchProposal<REAL_t, state_t> proposal_t;
+        typedef internal::Hypothesis<REAL_t, state_t> hypothesis_t;
+        typedef internal::Candidate<REAL_t> candidate_t;
 
-        std::vector<result_t> results = {
-            result_t(initial_state, std::vector<uint>(), (REAL_t)0.0)
+        std::vector<internal::BackPointer> history;
+        std::vector<hypothesis_t> beams = {
+            hypothesis_t{initial_state, (REAL_t)0.0, -1, false}
         };
+        std::vector<bool> forbidden;
 
         while (max_solution_length--) {
-            std::vector<proposal_t> proposals;
-            for (auto& result: results) {
-                if (result.solution.size() > 0 && result.solution.back() == end_symbol) {
-                    proposals.push_back(proposal_t::finalized_solution(result));
+            internal::TopK<REAL_t> selection(beam_width);
+            std::vector<int> live;
+            std::vector<state_t> live_states;
+            for (int idx = 0; idx < beams.size(); ++idx) {
+                if (beams[idx].finalized) {
+                    selection.push(candidate_t{beams[idx].score, idx, -1});
                 } else {
-                    auto scores = candidate_scores(result.state);
-                    auto sorted_candidates = scores.argsort();
-                    std::reverse(sorted_candidates.begin(), sorted_candidates.end());
-                    auto candidates_remaining = beam_width;
-                    for(auto& candidate_idx: sorted_candidates) {
-                        if (utils::in_vector(forbidden_symbols, (uint)candidate_idx))
-                            continue;
-                        if (candidates_remaining-- <= 0)
-                            break;
-                        auto candidate_score = scores.w(candidate_idx);
-                        proposals.push_back(proposal_t::solution_candidate(
-                                result, result.score + candidate_score, candidate_idx));
+                    live.emplace_back(idx);
+                    live_states.emplace_back(beams[idx].state);
+                }
+            }
+            if (!live.empty()) {
+                auto scores = candidate_scores(live_states);
+                ASSERT2(scores.dims(0) == live.size(),
+                    utils::MS() << "Beam search expected one row of scores per hypothesis ("
+                                << live.size() << ") but got " << scores.dims(0) << " rows.");
+                const int vocab_size = scores.dims(1);
+                if (forbidden.size() != vocab_size) {
+                    forbidden.assign(vocab_size, false);
+                    for (auto symbol : forbidden_symbols) {
+                        if (symbol < vocab_size)
+                            forbidden[symbol] = true;
+                    }
+                }
+                const REAL_t* row_scores = scores.w().data();
+                for (int row = 0; row < live.size(); ++row, row_scores += vocab_size) {
+                    const REAL_t prefix_score = beams[live[row]].score;
+                    for (int symbol = 0; symbol < vocab_size; ++symbol) {
+                        REAL_t score = prefix_score + row_scores[symbol];
+                        if (selection.accepts(score) && !forbidden[symbol])
+                            selection.push(candidate_t{score, live[row], symbol});
                     }
                 }
             }
-            // proposals due
-            sort(proposals.begin(), proposals.end(), [](proposal_t a, proposal_t b) {
-                return a.score > b.score;
-            });
-            proposals.resize(std::min((size_t)beam_width, proposals.size()));
 
-            results = std::vector<result_t>();
-            for(auto& proposal : proposals) {
-                if (proposal.finalized) {
-                    results.push_back(proposal.prev_result);
+            std::vector<hypothesis_t> next_beams;
+            for (auto& candidate : selection.sorted()) {
+                auto& prev = beams[candidate.hypothesis];
+                if (candidate.symbol < 0) {
+                    next_beams.emplace_back(prev);
                 } else {
-                    auto new_state = make_choice(proposal.prev_result.state, proposal.candidate_idx);
-                    auto new_solution = proposal.prev_result.solution;
-                    new_solution.emplace_back(proposal.candidate_idx);
-                    results.emplace_back(new_state, new_solution, proposal.score);
+                    history.push_back(internal::BackPointer{prev.last, (uint)candidate.symbol});
+                    next_beams.push_back(hypothesis_t{
+                        make_choice(prev.state, candidate.symbol),
+                        candidate.score,
+                        (int)history.size() - 1,
+                        (uint)candidate.symbol == end_symbol
+                    });
                 }
             }
+            beams.swap(next_beams);
+        }
+
+        std::vector<result_t> results;
+        for (auto& beam : beams) {
+            std::vector<uint> solution;
+            for (int entry = beam.last; entry >= 0; entry = history[entry].parent) {
+                solution.emplace_back(history[entry].symbol);
+            }
+            std::reverse(solution.begin(), solution.end());
+            results.emplace_back(beam.state, solution, beam.score);
         }
         return results;
     }
+
+    // Same as `batched_beam_search`, with `candidate_scores` called
+    // once per hypothesis (returning one score per candidate).
+    template<typename REAL_t, typename state_t>
+    std::vector<BeamSearchResult<REAL_t,state_t>>
+    beam_search(state_t initial_state,
+                uint beam_width,
+                std::function<Mat<REAL_t>(state_t)> candidate_scores,
+                std::function<state_t(state_t, uint)> make_choice,
+                uint end_symbol,
+                int max_solution_length,
+                std::vector<uint> forbidden_symbols=std::vector<uint>()) {
+        auto scores_rowwise = [&candidate_scores](const std::vector<state_t>& states) {
+            std::vector<Mat<REAL_t>> rows;
+            for (auto& state : states) {
+                rows.emplace_back(candidate_scores(state));
+            }
+            Mat<REAL_t> scores(rows.size(), rows[0].number_of_elements(), weights<REAL_t>::empty());
+            for (int row = 0; row < rows.size(); ++row) {
+                ASSERT2(rows[row].number_of_elements() == scores.dims(1),
+                    "Beam search candidates must have the same number of scores.");
+                std::copy(rows[row].w().data(),
+                          rows[row].w().data() + scores.dims(1),
+                          scores.w().data() + row * scores.dims(1));
+            }
+            return scores;
+        };
+        return batched_beam_search<REAL_t, state_t>(
+            initial_state,
+            beam_width,
+            scores_rowwise,
+            make_choice,
+            end_symbol,
+            max_solution_length,
+            forbidden_symbols);
+    }
 }
 
 #endif
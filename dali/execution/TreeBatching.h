@@ -0,0 +1,146 @@
+#ifndef DALI_EXECUTION_TREE_BATCHING_H
+#define DALI_EXECUTION_TREE_BATCHING_H
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "dali/data_processing/Batch.h"
+#include "dali/layers/LSTM.h"
+#include "dali/tensor/Mat.h"
+#include "dali/tensor/MatOps.h"
+
+namespace tree_batching {
+    /**
+    Activate
+    --------
+
+    Runs a tree LSTM over every node of a minibatch of trees, one
+    batched `LSTM::activate` per level of the TreeBatch instead of one
+    per node: the children's states are gathered (rows_pluck) from
+    the levels that computed them, leaves read their word embedding and
+    the other nodes a zero input. Missing children (a node with fewer
+    children than the LSTM) get a zero state.
+
+    Inputs
+    ------
+
+    const LSTM<R>& lstm : LSTM with one input (the size of an
+                          embedding) and at least `batch.max_children()`
+                          children
+    Mat<R> embedding : word embeddings
+    const TreeBatch& batch : the nodes of the trees
+
+    Outputs
+    -------
+
+    LSTM<R>::activation_t states : memory and hidden state of every
+                                   node, one row per node in the order
+                                   of `batch.row` / `batch.labels()`.
+
+    **/
+    template<typename R>
+    typename LSTM<R>::activation_t activate(
+            const LSTM<R>& lstm,
+            Mat<R> embedding,
+            const TreeBatch& batch) {
+        typedef typename LSTM<R>::activation_t state_t;
+        ASSERT2(lstm.input_sizes.size() == 1 && lstm.input_sizes[0] == embedding.dims(1),
+            utils::MS() << "tree_batching: expected an LSTM with a single input of size "
+                        << embedding.dims(1));
+        ASSERT2(batch.max_children() <= lstm.num_children,
+            utils::MS() << "tree_batching: nodes have up to " << batch.max_children()
+                        << " children but the LSTM takes " << lstm.num_children);
+
+        // states computed so far, one matrix per level: a node's state
+        // is the row of its level's given by batch.nodes[node].second.
+        std::vector<Mat<R>> memories;
+        std::vector<Mat<R>> hiddens;
+        // stands for missing children.
+        Mat<R> zeros(1, lstm.hidden_size);
+
+        // rows `rows` of `states` (a row -1 is a zero row), plucked from
+        // the levels they were computed at instead of from all the
+        // states so far, which would copy them again at every level.
+        auto gather = [&zeros](const std::vector<Mat<R>>& states,
+                               const std::vector<std::pair<int,int>>& rows) -> Mat<R> {
+            const int num_nodes = rows.size();
+            std::map<int, std::vector<int>> level_nodes;
+            bool missing = false;
+            for (int node = 0; node < num_nodes; ++node) {
+                if (rows[node].second == -1) {
+                    missing = true;
+                } else {
+                    level_nodes[rows[node].first].emplace_back(node);
+                }
+            }
+            std::vector<Mat<R>> pieces;
+            Mat<int> order(1, num_nodes);
+            int num_rows = 0;
+            if (missing) {
+                pieces.emplace_back(zeros);
+                num_rows = 1;
+                for (int node = 0; node < num_nodes; ++node) {
+                    order.w(node) = 0;
+                }
+            }
+            for (auto& level : level_nodes) {
+                Mat<int> level_rows(1, level.second.size());
+                for (int i = 0; i < level.second.size(); ++i) {
+                    level_rows.w(i) = rows[level.second[i]].second;
+                    order.w(level.second[i]) = num_rows + i;
+                }
+                pieces.emplace_back(MatOps<R>::rows_pluck(states[level.first], level_rows));
+                num_rows += level.second.size();
+            }
+            // every child comes from the same level, already in order.
+            if (!missing && pieces.size() == 1) {
+                return pieces[0];
+            }
+            return MatOps<R>::rows_pluck(MatOps<R>::vstack(pieces), order);
+        };
+
+        for (int level = 0; level < batch.levels.size(); ++level) {
+            auto& nodes = batch.levels[level];
+            const int num_nodes = nodes.labels.size();
+
+            Mat<R> input;
+            std::vector<state_t> children;
+            if (level == 0) {
+                Mat<int> words(1, num_nodes);
+                for (int node = 0; node < num_nodes; ++node) {
+                    words.w(node) = nodes.words[node];
+                }
+                input = embedding[words];
+                for (int child = 0; child < lstm.num_children; ++child) {
+                    children.emplace_back(
+                        Mat<R>(num_nodes, lstm.hidden_size),
+                        Mat<R>(num_nodes, lstm.hidden_size)
+                    );
+                }
+            } else {
+                input = Mat<R>(num_nodes, embedding.dims(1));
+                for (int child = 0; child < lstm.num_children; ++child) {
+                    // (level, row) of each node's child, row -1 if missing.
+                    std::vector<std::pair<int,int>> rows(num_nodes, std::make_pair(0, -1));
+                    for (int node = 0; node < num_nodes; ++node) {
+                        auto& node_children = nodes.children[node];
+                        if (child < node_children.size()) {
+                            rows[node] = batch.nodes[node_children[child]];
+                        }
+                    }
+                    children.emplace_back(gather(memories, rows), gather(hiddens, rows));
+                }
+            }
+            auto state = lstm.activate(input, children);
+            memories.emplace_back(state.memory);
+            hiddens.emplace_back(state.hidden);
+        }
+        if (memories.empty()) {
+            return state_t(Mat<R>(0, lstm.hidden_size), Mat<R>(0, lstm.hidden_size));
+        }
+        return state_t(MatOps<R>::vstack(memories), MatOps<R>::vstack(hiddens));
+    }
+}
+
+#endif
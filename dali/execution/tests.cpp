@@ -6,6 +6,8 @@
 #include "dali/tensor/MatOps.h"
 #include "dali/execution/BeamSearch.h"
 #include "dali/execution/SequenceProbability.h"
+#include "dali/execution/TreeBatching.h"
+#include "dali/test_gradients.h"
 
 using std::make_tuple;
 using std::map;
@@ -215,6 +217,79 @@ TEST(beam_search, beam_search_score_test) {
 }
 
 
+TEST(beam_search, batched_beam_search_exhaustive) {
+    typedef double REAL_t;
+    typedef vector<uint> state_t;
+    const int vocab_size = 6;
+    const int length = 3;
+    const uint forbidden = 0;
+
+    // deterministic score of appending `symbol` to `prefix`
+    auto step_score = [](const state_t& prefix, uint symbol) -> REAL_t {
+        REAL_t code = symbol + 1;
+        for (auto s : prefix) code = code * 7.0 + s;
+        return -std::abs(std::sin(code));
+    };
+    auto candidate_scores = [&](const vector<state_t>& states) -> Mat<REAL_t> {
+        Mat<REAL_t> scores(states.size(), vocab_size);
+        for (int row = 0; row < states.size(); ++row) {
+            for (int symbol = 0; symbol < vocab_size; ++symbol) {
+                scores.w(row, symbol) = step_score(states[row], symbol);
+            }
+        }
+        return scores;
+    };
+    auto make_choice = [](state_t prefix, uint symbol) -> state_t {
+        prefix.emplace_back(symbol);
+        return prefix;
+    };
+
+    // a beam as wide as the search space keeps every sequence
+    int num_sequences = 125;
+    auto results = beam_search::batched_beam_search<REAL_t, state_t>(
+            state_t(),
+            num_sequences,
+            candidate_scores,
+            make_choice,
+            999,
+            length,
+            {forbidden});
+    ASSERT_EQ(num_sequences, results.size());
+    for (int ridx = 0; ridx < results.size(); ++ridx) {
+        auto& result = results[ridx];
+        // back-pointers rebuild the same prefix the state followed
+        ASSERT_EQ(result.state, result.solution);
+        ASSERT_EQ(length, result.solution.size());
+        REAL_t expected_score = 0.0;
+        for (int t = 0; t < length; ++t) {
+            ASSERT_NE(forbidden, result.solution[t]);
+            expected_score += step_score(state_t(result.solution.begin(), result.solution.begin() + t),
+                                         result.solution[t]);
+        }
+        ASSERT_NEAR(expected_score, result.score, 1e-9);
+        if (ridx > 0) {
+            ASSERT_GE(results[ridx - 1].score, result.score);
+        }
+    }
+
+    // narrower beams agree with the per-hypothesis interface
+    auto single_scores = [&](state_t state) -> Mat<REAL_t> {
+        return candidate_scores({state});
+    };
+    for (uint beam_width : {1, 3, 10}) {
+        auto batched = beam_search::batched_beam_search<REAL_t, state_t>(
+                state_t(), beam_width, candidate_scores, make_choice, 999, length, {forbidden});
+        auto single = beam_search::beam_search<REAL_t, state_t>(
+                state_t(), beam_width, single_scores, make_choice, 999, length, {forbidden});
+        ASSERT_EQ(beam_width, batched.size());
+        ASSERT_EQ(batched.size(), single.size());
+        for (int ridx = 0; ridx < batched.size(); ++ridx) {
+            ASSERT_EQ(batched[ridx].solution, single[ridx].solution);
+            ASSERT_NEAR(batched[ridx].score, single[ridx].score, 1e-9);
+        }
+    }
+}
+
 TEST(sequence_probability, score) {
     Batch<R> batch;
     int seq_length = 5;
@@ -266,3 +341,62 @@ TEST(sequence_probability, score) {
 
     ASSERT_EQ(scores.w(0), expected_prob);
 }
+
+TEST(tree_batching, matches_node_by_node) {
+    int vocab_size = 8, input_size = 3, hidden_size = 4;
+    Mat<R> embedding(vocab_size, input_size, weights<R>::uniform(1.0));
+    LSTM<R> lstm(input_size, hidden_size, 2);
+
+    // ((1 2) 3), (4 5) and a lone leaf 6, children added first.
+    TreeBatch batch;
+    vector<vector<int>> children;
+    vector<int> words;
+    auto leaf = [&](int word) {
+        children.emplace_back();
+        words.emplace_back(word);
+        return batch.add_leaf(word, 0);
+    };
+    auto node = [&](vector<int> node_children) {
+        children.emplace_back(node_children);
+        words.emplace_back(-1);
+        return batch.add_node(node_children, 1);
+    };
+    int left = node({leaf(1), leaf(2)});
+    batch.roots.emplace_back(node({left, leaf(3)}));
+    batch.roots.emplace_back(node({leaf(4), leaf(5)}));
+    batch.roots.emplace_back(leaf(6));
+    ASSERT_EQ(3, batch.levels.size());
+    ASSERT_EQ(2, batch.max_children());
+
+    auto params = lstm.parameters();
+    params.emplace_back(embedding);
+
+    // reference: one LSTM step per node.
+    vector<LSTM<R>::activation_t> states;
+    for (int i = 0; i < batch.size(); ++i) {
+        vector<LSTM<R>::activation_t> child_states;
+        for (int child = 0; child < 2; ++child) {
+            if (child < children[i].size()) {
+                child_states.emplace_back(states[children[i][child]]);
+            } else {
+                child_states.emplace_back(Mat<R>(1, hidden_size), Mat<R>(1, hidden_size));
+            }
+        }
+        auto input = words[i] >= 0 ? embedding[words[i]] : Mat<R>(1, input_size);
+        states.emplace_back(lstm.activate(input, child_states));
+    }
+    vector<Mat<R>> hiddens(batch.size());
+    for (int i = 0; i < batch.size(); ++i) {
+        hiddens[batch.row(i)] = states[i].hidden;
+    }
+    auto expected = MatOps<R>::vstack(hiddens);
+    expected.sum().grad();
+    graph::backward();
+    auto expected_grads = take_gradients(params);
+
+    auto batched = tree_batching::activate(lstm, embedding, batch);
+    ASSERT_TRUE(MatOps<R>::allclose(expected, batched.hidden, 1e-5));
+    batched.hidden.sum().grad();
+    graph::backward();
+    ASSERT_TRUE(gradients_near(expected_grads, params, (R)1e-5));
+}
@@ -1,5 +1,7 @@
 #include "dali/layers/LSTM.h"
 
+#include <numeric>
+
 using std::vector;
 using utils::assert2;
 using std::string;
@@ -63,10 +65,7 @@ LSTM<R>::LSTM (vector<int> _input_sizes, int _hidden_size, int _num_children, bo
         hidden_size(_hidden_size),
         num_children(_num_children) {
 
-    auto gate_input_sizes = utils::concatenate({
-        input_sizes,
-        vector<int>(num_children, hidden_size) // num_children * [hidden_size]
-    });
+    auto gate_input_sizes = this->gate_input_sizes();
 
     input_layer = StackedInputLayer<R>(gate_input_sizes, hidden_size);
     for (int cidx=0; cidx < num_children; ++cidx) {
@@ -94,14 +93,20 @@ LSTM<R>::LSTM (const LSTM<R>& other, bool copy_w, bool copy_dw) :
         memory_feeds_gates(other.memory_feeds_gates),
         input_sizes(other.input_sizes),
         hidden_size(other.hidden_size),
-        num_children(other.num_children) {
+        num_children(other.num_children),
+        fused(other.fused) {
 
-    input_layer = StackedInputLayer<R>(other.input_layer, copy_w, copy_dw);
-    for (int cidx=0; cidx < num_children; ++cidx) {
-        forget_layers.emplace_back(other.forget_layers[cidx], copy_w, copy_dw);
+    if (fused) {
+        fused_weights = Mat<R>(other.fused_weights, copy_w, copy_dw);
+        fused_bias = Mat<R>(other.fused_bias, copy_w, copy_dw);
+    } else {
+        input_layer = StackedInputLayer<R>(other.input_layer, copy_w, copy_dw);
+        for (int cidx=0; cidx < num_children; ++cidx) {
+            forget_layers.emplace_back(other.forget_layers[cidx], copy_w, copy_dw);
+        }
+        output_layer = StackedInputLayer<R>(other.output_layer, copy_w, copy_dw);
+        cell_layer = StackedInputLayer<R>(other.cell_layer, copy_w, copy_dw);
     }
-    output_layer = StackedInputLayer<R>(other.output_layer, copy_w, copy_dw);
-    cell_layer = StackedInputLayer<R>(other.cell_layer, copy_w, copy_dw);
 
     if (memory_feeds_gates) {
         Wco = Mat<R>(other.Wco, copy_w, copy_dw);
@@ -117,8 +122,160 @@ LSTM<R> LSTM<R>::shallow_copy() const {
     return LSTM<R>(*this, false, true);
 }
 
+template<typename R>
+vector<int> LSTM<R>::gate_input_sizes() const {
+    return utils::concatenate({
+        input_sizes,
+        vector<int>(num_children, hidden_size) // num_children * [hidden_size]
+    });
+}
+
+namespace {
+    // copy the `rows` x `cols` block of `source` at (`source_row`, `source_col`)
+    // into `dest` at (`dest_row`, `dest_col`).
+    template<typename R>
+    void copy_block(const Mat<R>& source, int source_row, int source_col,
+                    Mat<R>& dest, int dest_row, int dest_col,
+                    int rows, int cols) {
+        auto source_data = source.w().cpu_data();
+        auto dest_data   = dest.w().mutable_cpu_data();
+        for (int row = 0; row < rows; ++row) {
+            for (int col = 0; col < cols; ++col) {
+                dest_data.dptr_[dest_data.stride_ * (dest_row + row) + dest_col + col] =
+                        source_data.dptr_[source_data.stride_ * (source_row + row) + source_col + col];
+            }
+        }
+    }
+}
+
+template<typename R>
+vector<typename LSTM<R>::layer_type*> LSTM<R>::gate_layers() {
+    // gate order matches `parameters`: input, forgets, output, cell.
+    vector<layer_type*> layers({&input_layer});
+    for (auto& forget_layer : forget_layers) {
+        layers.emplace_back(&forget_layer);
+    }
+    layers.emplace_back(&output_layer);
+    layers.emplace_back(&cell_layer);
+    return layers;
+}
+
+template<typename R>
+vector<Mat<R>> LSTM<R>::fused_matrices() const {
+    vector<Mat<R>> matrices;
+    int start = 0;
+    for (int size : gate_input_sizes()) {
+        matrices.emplace_back(MatOps<R>::slice(fused_weights, start, start + size));
+        start += size;
+    }
+    return matrices;
+}
+
+template<typename R>
+void LSTM<R>::stack_gates(vector<Mat<R>>& matrices, Mat<R>& bias) const {
+    if (fused) {
+        matrices = fused_matrices();
+        bias = fused_bias;
+        return;
+    }
+    vector<const layer_type*> layers({&input_layer});
+    for (auto& forget_layer : forget_layers) {
+        layers.emplace_back(&forget_layer);
+    }
+    layers.emplace_back(&output_layer);
+    layers.emplace_back(&cell_layer);
+
+    matrices.clear();
+    for (int iidx = 0; iidx < gate_input_sizes().size(); ++iidx) {
+        vector<Mat<R>> blocks;
+        for (auto layer : layers) {
+            blocks.emplace_back(layer->matrices[iidx]);
+        }
+        matrices.emplace_back(MatOps<R>::hstack(blocks));
+    }
+    vector<Mat<R>> biases;
+    for (auto layer : layers) {
+        biases.emplace_back(layer->b);
+    }
+    bias = MatOps<R>::hstack(biases);
+}
+
+template<typename R>
+void LSTM<R>::fuse() {
+    ASSERT2(!memory_feeds_gates,
+            "LSTM: fused gates are not available when memory feeds gates.");
+    if (fused) {
+        return;
+    }
+    auto gate_input_sizes = this->gate_input_sizes();
+    auto layers = gate_layers();
+    const int num_columns = layers.size() * hidden_size;
+    fused_weights = Mat<R>(std::accumulate(gate_input_sizes.begin(), gate_input_sizes.end(), 0), num_columns, weights<R>::empty());
+    fused_bias    = Mat<R>(1, num_columns, weights<R>::empty());
+
+    for (int gidx = 0; gidx < layers.size(); ++gidx) {
+        int start = 0;
+        for (int iidx = 0; iidx < gate_input_sizes.size(); ++iidx) {
+            copy_block(layers[gidx]->matrices[iidx], 0, 0,
+                       fused_weights, start, gidx * hidden_size,
+                       gate_input_sizes[iidx], hidden_size);
+            start += gate_input_sizes[iidx];
+        }
+        copy_block(layers[gidx]->b, 0, 0, fused_bias, 0, gidx * hidden_size, 1, hidden_size);
+    }
+
+    input_layer = layer_type();
+    forget_layers.clear();
+    output_layer = layer_type();
+    cell_layer = layer_type();
+    fused = true;
+}
+
+template<typename R>
+void LSTM<R>::unfuse() {
+    if (!fused) {
+        return;
+    }
+    auto gate_input_sizes = this->gate_input_sizes();
+
+    input_layer = layer_type(gate_input_sizes, hidden_size);
+    for (int cidx=0; cidx < num_children; ++cidx) {
+        forget_layers.emplace_back(gate_input_sizes, hidden_size);
+    }
+    output_layer = layer_type(gate_input_sizes, hidden_size);
+    cell_layer   = layer_type(gate_input_sizes, hidden_size);
+
+    auto layers = gate_layers();
+    for (int gidx = 0; gidx < layers.size(); ++gidx) {
+        int start = 0;
+        for (int iidx = 0; iidx < gate_input_sizes.size(); ++iidx) {
+            copy_block(fused_weights, start, gidx * hidden_size,
+                       layers[gidx]->matrices[iidx], 0, 0,
+                       gate_input_sizes[iidx], hidden_size);
+            start += gate_input_sizes[iidx];
+        }
+        copy_block(fused_bias, 0, gidx * hidden_size, layers[gidx]->b, 0, 0, 1, hidden_size);
+    }
+
+    fused_weights = Mat<R>();
+    fused_bias = Mat<R>();
+    fused = false;
+}
+
+template<typename R>
+vector<Mat<R>> LSTM<R>::gate_parameters() const {
+    if (!fused) {
+        return parameters();
+    }
+    auto unfused = LSTM<R>(*this, true, false);
+    unfused.unfuse();
+    return unfused.parameters();
+}
+
 template<typename R>
 void LSTM<R>::name_internal_layers() {
+    fused_weights.name = make_shared<string>("fused_weights");
+    fused_bias.name = make_shared<string>("fused_bias");
     int i = 0;
     for (auto& cell_to_input : Wcells_to_inputs) {
         cell_to_input.name = make_shared<string>("Wcells_to_inputs[" + std::to_string(i++) + "]");
@@ -182,6 +339,17 @@ typename LSTM<R>::activation_t LSTM<R>::activate(
     }
     auto gate_input = utils::concatenate({inputs, activation_t::hiddens(states)});
 
+    if (fused) {
+        Mat<R> cell_d, hidden_d;
+        std::tie(cell_d, hidden_d) = MatOps<R>::fused_lstm_cell(
+            fused_matrices(),
+            gate_input,
+            fused_bias,
+            activation_t::memories(states)
+        );
+        return activation_t(cell_d, hidden_d);
+    }
+
     if (memory_feeds_gates) {
         input_gate  = input_layer.activate(gate_input);
         // if the memory feeds the gates (Alex Graves 2013) then
@@ -272,18 +440,82 @@ template<typename R>
 typename LSTM<R>::activation_t LSTM<R>::activate_sequence(
         activation_t state,
         const vector<Mat<R>>& sequence) const {
-    for (auto& input_vector : sequence)
-        state = activate(
-            input_vector,
-            vector<activation_t>({state})
-        );
-    return state;
+    auto states = activate_sequence_states(state, vector<vector<Mat<R>>>({sequence}));
+    return states.empty() ? state : states.back();
 };
 
+template<typename R>
+vector<typename LSTM<R>::activation_t> LSTM<R>::activate_sequence_states(
+        activation_t state,
+        const vector<vector<Mat<R>>>& inputs) const {
+    assert2(input_sizes.size() == inputs.size(),
+        utils::MS() << "LSTM: Got " << inputs.size() << " inputs but expected " << input_sizes.size() << " instead."
+    );
+    const int timesteps = inputs[0].size();
+    for (auto& input : inputs) {
+        assert2(input.size() == timesteps,
+            "LSTM: all inputs to activate_sequence_states should have the same number of timesteps.");
+    }
+    vector<activation_t> states;
+    if (timesteps == 0) {
+        return states;
+    }
+
+    const int num_examples = inputs[0][0].dims(0);
+    bool hoist_projections = !memory_feeds_gates && num_children == 1 &&
+            (state.memory.dims(0) == 1 || state.memory.dims(0) == num_examples) &&
+            (state.hidden.dims(0) == 1 || state.hidden.dims(0) == num_examples);
+    for (int iidx = 0; iidx < inputs.size(); ++iidx) {
+        for (auto& input_vector : inputs[iidx]) {
+            assert2(input_vector.dims(1) == input_sizes[iidx],
+                utils::MS() << "LSTM: " << iidx << "-th input to LSTM should have size "
+                            << input_sizes[iidx] << " not " << input_vector.dims(1));
+            hoist_projections = hoist_projections && input_vector.dims(0) == num_examples;
+        }
+    }
+
+    if (!hoist_projections) {
+        vector<Mat<R>> step_inputs(inputs.size());
+        for (int t = 0; t < timesteps; ++t) {
+            for (int iidx = 0; iidx < inputs.size(); ++iidx) {
+                step_inputs[iidx] = inputs[iidx][t];
+            }
+            state = activate(step_inputs, vector<activation_t>({state}));
+            states.emplace_back(state);
+        }
+        return states;
+    }
+
+    vector<Mat<R>> gate_matrices;
+    Mat<R> gate_bias;
+    stack_gates(gate_matrices, gate_bias);
+    // the last gate input is the hidden state of the single child:
+    auto recurrent_matrix = gate_matrices.back();
+    gate_matrices.pop_back();
+
+    vector<Mat<R>> memories, hiddens;
+    std::tie(memories, hiddens) = MatOps<R>::fused_lstm_sequence(
+        gate_matrices,
+        inputs,
+        recurrent_matrix,
+        gate_bias,
+        state.memory,
+        state.hidden
+    );
+    for (int t = 0; t < timesteps; ++t) {
+        states.emplace_back(memories[t], hiddens[t]);
+    }
+    return states;
+}
+
 template<typename R>
 std::vector<Mat<R>> LSTM<R>::parameters() const {
     std::vector<Mat<R>> parameters;
 
+    if (fused) {
+        return std::vector<Mat<R>>({fused_weights, fused_bias});
+    }
+
     if (memory_feeds_gates) {
         for (int cidx = 0; cidx < num_children; ++cidx) {
             parameters.emplace_back(Wcells_to_forgets[cidx]);
@@ -24,6 +24,8 @@ class LSTM : public AbstractLayer<R> {
     See `Layers.h`
     */
     typedef StackedInputLayer<R> layer_type;
+    // the gate layers, in the order of `parameters`.
+    std::vector<layer_type*> gate_layers();
 
     public:
         void name_internal_layers();
@@ -59,6 +61,18 @@ class LSTM : public AbstractLayer<R> {
         // gradient by setting this to true:
         bool backprop_through_gates = false;
 
+        // When fused, the gate layers above are replaced by one
+        // matrix holding the weights of every gate input stacked by
+        // rows (gate_input_sizes() summed) and the columns of every
+        // gate side by side ([input, forget_1..forget_n, output, cell]),
+        // and by one bias, so that each timestep performs one product
+        // per input (MatOps::fused_lstm_cell). Use `fuse` / `unfuse`
+        // to convert between the two layouts, and `gate_parameters`
+        // for checkpoints in the per-gate layout.
+        bool fused = false;
+        Mat<R> fused_weights;
+        Mat<R> fused_bias;
+
         LSTM() = default;
 
         // This is a regular vanilla, but awesome LSTM constructor.
@@ -75,6 +89,27 @@ class LSTM : public AbstractLayer<R> {
 
         virtual std::vector<Mat<R>> parameters() const;
 
+        // sizes of the inputs seen by every gate: the inputs
+        // followed by each child's hidden state.
+        std::vector<int> gate_input_sizes() const;
+
+        void fuse();
+        void unfuse();
+
+        // parameters in the unfused layout and order (copies of the
+        // stacked weights when fused), to save checkpoints in that
+        // layout: load them into an unfused LSTM, then fuse it.
+        std::vector<Mat<R>> gate_parameters() const;
+
+        // gate parameters in the fused layout: one matrix per gate
+        // input and one bias. When fused, the matrices are the rows of
+        // `fused_weights` (sharing its weights and gradients); otherwise
+        // they are joined on the fly (gradients flow back to each gate).
+        void stack_gates(std::vector<Mat<R>>& matrices, Mat<R>& bias) const;
+
+        // rows of `fused_weights` multiplied with each gate input.
+        std::vector<Mat<R>> fused_matrices() const;
+
         activation_t activate(
             Mat<R> input_vector,
             activation_t previous_state) const;
@@ -97,6 +132,16 @@ class LSTM : public AbstractLayer<R> {
         virtual activation_t activate_sequence(
             activation_t initial_state,
             const std::vector<Mat<R>>& sequence) const;
+
+        // Activate over a whole sequence and return the state at every
+        // timestep; inputs[i][t] is the i-th input at timestep t.
+        // The input projections of every timestep are computed up front
+        // with one product per input, leaving only the recurrent product
+        // inside the loop (falls back to stepwise activation when memory
+        // feeds gates, for multiple children, or for ragged batches).
+        std::vector<activation_t> activate_sequence_states(
+            activation_t initial_state,
+            const std::vector<std::vector<Mat<R>>>& inputs) const;
 };
 
 template<typename R>
@@ -136,6 +181,8 @@ class StackedLSTM : public AbstractStackedLSTM<R> {
             const std::vector<Mat<R>>& inputs,
             R drop_prob = 0.0) const;
         virtual std::vector<Mat<R>> parameters() const;
+        // parameters of every cell in the unfused layout (see `LSTM::gate_parameters`)
+        std::vector<Mat<R>> gate_parameters() const;
         StackedLSTM();
         StackedLSTM(
             const int& input_size,
@@ -149,6 +196,15 @@ class StackedLSTM : public AbstractStackedLSTM<R> {
             bool _memory_feeds_gates);
         StackedLSTM(const StackedLSTM<R>& model, bool copy_w, bool copy_dw);
         StackedLSTM<R> shallow_copy() const;
+        // runs each layer over the whole sequence before moving up
+        // the stack (see `LSTM::activate_sequence_states`).
+        virtual state_t activate_sequence(
+            state_t initial_state,
+            const std::vector<Mat<R>>& sequence,
+            R drop_prob = 0.0) const;
+        // fuse / unfuse the gates of every cell (see `LSTM::fuse`)
+        void fuse();
+        void unfuse();
 };
 
 /**
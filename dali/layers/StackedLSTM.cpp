@@ -61,6 +61,62 @@ StackedLSTM<R> StackedLSTM<R>::shallow_copy() const {
     return StackedLSTM<R>(*this, false, true);
 }
 
+template<typename R>
+typename StackedLSTM<R>::state_t StackedLSTM<R>::activate_sequence(
+        state_t initial_state,
+        const vector<Mat<R>>& sequence,
+        R drop_prob) const {
+    ASSERT2(cells.size() == initial_state.size(),
+        utils::MS() << "Activating LSTM stack of size " << cells.size()
+        << " with different number of states " << initial_state.size());
+    if (sequence.empty()) {
+        return initial_state;
+    }
+    state_t out_state;
+    out_state.reserve(cells.size());
+
+    vector<Mat<R>> layer_sequence = sequence;
+    int level = 0;
+    for (auto& layer : cells) {
+        vector<vector<Mat<R>>> layer_inputs({
+            MatOps<R>::dropout_normalized(layer_sequence, drop_prob)
+        });
+        if (shortcut && level > 0) {
+            // layers above the first also see the base inputs:
+            layer_inputs.emplace_back(MatOps<R>::dropout_normalized(sequence, drop_prob));
+        }
+        auto states = layer.activate_sequence_states(initial_state[level], layer_inputs);
+        out_state.emplace_back(states.back());
+        layer_sequence = LSTMState<R>::hiddens(states);
+        ++level;
+    }
+    return out_state;
+}
+
+template<typename R>
+void StackedLSTM<R>::fuse() {
+    for (auto& cell : cells) {
+        cell.fuse();
+    }
+}
+
+template<typename R>
+void StackedLSTM<R>::unfuse() {
+    for (auto& cell : cells) {
+        cell.unfuse();
+    }
+}
+
+template<typename R>
+std::vector<Mat<R>> StackedLSTM<R>::gate_parameters() const {
+    vector<Mat<R>> parameters;
+    for (auto& cell : cells) {
+        auto cell_params = cell.gate_parameters();
+        parameters.insert(parameters.end(), cell_params.begin(), cell_params.end());
+    }
+    return parameters;
+}
+
 template<typename R>
 std::vector<Mat<R>> StackedLSTM<R>::parameters() const {
     vector<Mat<R>> parameters;
@@ -237,6 +237,147 @@ TEST_F(LayerTests, LSTM_Zaremba_shortcut_gradient) {
     }
 }
 
+TEST_F(LayerTests, LSTM_fused_matches_unfused) {
+    int num_examples           = 4;
+    int hidden_size            = 5;
+    int input_size             = 3;
+    int shortcut_size          = 2;
+    int num_children           = 2;
+
+    EXPERIMENT_REPEAT {
+        auto X   = Mat<R>(num_examples, input_size,    weights<R>::uniform(2.0));
+        auto X_s = Mat<R>(1,            shortcut_size, weights<R>::uniform(2.0));
+        vector<LSTM<R>::activation_t> states;
+        for (int cidx = 0 ; cidx < num_children; ++cidx) {
+            states.emplace_back(
+                Mat<R>(cidx == 0 ? 1 : num_examples, hidden_size, weights<R>::uniform(2.0)),
+                Mat<R>(num_examples, hidden_size, weights<R>::uniform(2.0))
+            );
+        }
+        auto unfused = LSTM<R>({input_size, shortcut_size}, hidden_size, num_children, false);
+        auto fused   = LSTM<R>(unfused, true, false);
+        fused.fuse();
+        ASSERT_TRUE(fused.fused);
+
+        auto expected = unfused.activate(vector<Mat<R>>({X, X_s}), states);
+        auto state    = fused.activate(vector<Mat<R>>({X, X_s}), states);
+        ASSERT_MATRIX_CLOSE(expected.memory, state.memory, 1e-6);
+        ASSERT_MATRIX_CLOSE(expected.hidden, state.hidden, 1e-6);
+
+        // the gates are stacked into one matrix and one bias:
+        ASSERT_EQ(2, fused.parameters().size());
+        // which map back to the per-gate parameters (and checkpoint layout):
+        auto params          = fused.gate_parameters();
+        auto original_params = unfused.parameters();
+        ASSERT_EQ(original_params.size(), params.size());
+        for (int i = 0; i < params.size(); ++i) {
+            ASSERT_MATRIX_EQ(original_params[i], params[i]);
+        }
+        // shallow copies share the stacked weights:
+        auto copy = fused.shallow_copy();
+        ASSERT_EQ(&fused.fused_weights.w().memory(), &copy.fused_weights.w().memory());
+        // and unfusing restores the per-gate layout.
+        fused.unfuse();
+        params = fused.parameters();
+        ASSERT_EQ(original_params.size(), params.size());
+        for (int i = 0; i < params.size(); ++i) {
+            ASSERT_MATRIX_EQ(original_params[i], params[i]);
+        }
+    }
+}
+
+TEST_F(LayerTests, LSTM_fused_gradient) {
+    int num_examples           = 10;
+    int hidden_size            = 5;
+    int input_size             = 3;
+    int num_children           = 2;
+
+    EXPERIMENT_REPEAT {
+        auto X  = Mat<R>(num_examples, input_size, weights<R>::uniform(20.0));
+        vector<LSTM<R>::activation_t> states;
+        for (int cidx = 0 ; cidx < num_children; ++cidx) {
+            states.emplace_back(
+                Mat<R>(cidx == 0 ? 1 : num_examples, hidden_size, weights<R>::uniform(0.1)),
+                Mat<R>(num_examples, hidden_size, weights<R>::uniform(0.1))
+            );
+        }
+        auto mylayer = LSTM<R>(input_size, hidden_size, num_children);
+        mylayer.fuse();
+        auto params = mylayer.parameters();
+        params.emplace_back(X);
+        for (auto& state : states) {
+            params.emplace_back(state.memory);
+            params.emplace_back(state.hidden);
+        }
+        auto functor = [&mylayer, &X, &states](vector<Mat<R>> Xs)-> Mat<R> {
+            auto myout_state = mylayer.activate(X, states);
+            return myout_state.hidden;
+        };
+        ASSERT_TRUE(gradient_same(functor, params, 1e-3));
+    }
+}
+
+TEST_F(LayerTests, LSTM_sequence_matches_stepwise) {
+    int num_examples           = 3;
+    int hidden_size            = 5;
+    int input_size             = 4;
+    int timesteps              = 6;
+
+    EXPERIMENT_REPEAT {
+        vector<Mat<R>> sequence;
+        for (int t = 0; t < timesteps; ++t) {
+            sequence.emplace_back(num_examples, input_size, weights<R>::uniform(2.0));
+        }
+        auto unfused = LSTM<R>(input_size, hidden_size, false);
+        auto fused   = LSTM<R>(unfused, true, false);
+        fused.fuse();
+
+        auto state = unfused.initial_states();
+        vector<LSTM<R>::activation_t> expected;
+        for (auto& input : sequence) {
+            state = unfused.activate(input, state);
+            expected.emplace_back(state);
+        }
+        for (auto& layer : {unfused, fused}) {
+            auto states = layer.activate_sequence_states(layer.initial_states(), {sequence});
+            ASSERT_EQ(timesteps, states.size());
+            for (int t = 0; t < timesteps; ++t) {
+                ASSERT_MATRIX_CLOSE(expected[t].memory, states[t].memory, 1e-6);
+                ASSERT_MATRIX_CLOSE(expected[t].hidden, states[t].hidden, 1e-6);
+            }
+        }
+    }
+}
+
+TEST_F(LayerTests, LSTM_sequence_gradient) {
+    int num_examples           = 3;
+    int hidden_size            = 5;
+    int input_size             = 3;
+    int timesteps              = 4;
+
+    EXPERIMENT_REPEAT {
+        vector<Mat<R>> sequence;
+        for (int t = 0; t < timesteps; ++t) {
+            sequence.emplace_back(num_examples, input_size, weights<R>::uniform(2.0));
+        }
+        auto initial_state = LSTM<R>::activation_t(
+                Mat<R>(1, hidden_size, weights<R>::uniform(0.1)),
+                Mat<R>(1, hidden_size, weights<R>::uniform(0.1)));
+        for (bool fuse : {false, true}) {
+            auto mylayer = LSTM<R>(input_size, hidden_size, false);
+            if (fuse) mylayer.fuse();
+            auto params = mylayer.parameters();
+            params.insert(params.end(), sequence.begin(), sequence.end());
+            params.emplace_back(initial_state.memory);
+            params.emplace_back(initial_state.hidden);
+            auto functor = [&mylayer, &sequence, &initial_state](vector<Mat<R>> Xs)-> Mat<R> {
+                return mylayer.activate_sequence(initial_state, sequence).hidden;
+            };
+            ASSERT_TRUE(gradient_same(functor, params, 1e-3));
+        }
+    }
+}
+
 TEST_F(LayerTests, RNN_gradient_vs_Stacked_gradient) {
     int num_examples           = 10;
     int hidden_size            = 5;
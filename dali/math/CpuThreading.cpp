@@ -0,0 +1,66 @@
+#include "dali/math/CpuThreading.h"
+
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "dali/utils/ThreadPool.h"
+
+namespace cpu_threading {
+    namespace {
+        int threads = 0;
+        int min_size = 1 << 15;
+
+        std::mutex pool_mutex;
+        std::unique_ptr<ThreadPool> shared_pool;
+
+        ThreadPool& pool() {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            if (shared_pool == nullptr) {
+                shared_pool.reset(new ThreadPool(num_threads() - 1));
+            }
+            return *shared_pool;
+        }
+    }
+
+    void set_num_threads(int num_threads) {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        threads = num_threads;
+        // started again with the new size when needed.
+        shared_pool.reset();
+    }
+
+    int num_threads() {
+        if (threads > 0) {
+            return threads;
+        }
+        return std::max(1, (int)std::thread::hardware_concurrency());
+    }
+
+    void set_min_parallel_size(int size) {
+        min_size = size;
+    }
+
+    int min_parallel_size() {
+        return min_size;
+    }
+
+    bool should_parallelize(int size) {
+        return size >= min_size &&
+               num_threads() > 1 &&
+               ThreadPool::get_thread_number() == -1;
+    }
+
+    int grain_size(int size) {
+        // a few chunks per thread, to even out the load.
+        return std::max(min_size / 4, size / (4 * num_threads()) + 1);
+    }
+
+    void parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& f) {
+        pool().parallel_for(begin, end, grain, f);
+    }
+
+    ThreadPool& thread_pool() {
+        return pool();
+    }
+}
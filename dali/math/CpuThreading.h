@@ -0,0 +1,126 @@
+#ifndef DALI_MATH_CPU_THREADING_H
+#define DALI_MATH_CPU_THREADING_H
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "mshadow/tensor.h"
+
+class ThreadPool;
+
+/*
+CPU threading
+-------------
+
+Large elementwise expressions assigned to a TensorInternal on the
+CPU, and large reductions (TensorOps::reduction), are split across
+a thread pool shared by all ops (the calling thread takes part).
+
+Small tensors stay on the calling thread (see `min_parallel_size`),
+and so does everything called from a ThreadPool's worker (e.g.
+Hogwild-style training threads), so that callers who already
+parallelize are not oversubscribed.
+
+Reductions are cut in chunks of REDUCTION_CHUNK elements whatever
+the number of threads, and the partial results are combined in
+order: the result only depends on the data.
+*/
+namespace cpu_threading {
+    // Threads used by CPU ops, calling thread included (1 disables
+    // threading, 0 means one per core which is the default). Call
+    // before running ops in parallel.
+    void set_num_threads(int num_threads);
+    int num_threads();
+
+    // Expressions with fewer elements stay on the calling thread.
+    void set_min_parallel_size(int size);
+    int min_parallel_size();
+
+    // whether work on `size` elements should be split across threads.
+    bool should_parallelize(int size);
+
+    // elements per chunk when splitting `size` elements.
+    int grain_size(int size);
+
+    // ThreadPool::parallel_for on the shared pool.
+    void parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& f);
+
+    // The shared pool itself, for work that is not a loop (e.g. a
+    // pipeline feeding a TaskGroup). It has num_threads() - 1 workers:
+    // the calling thread is expected to do its share.
+    ThreadPool& thread_pool();
+
+    const int REDUCTION_CHUNK = 1 << 14;
+
+    // Reduces `size` elements: `reduce_chunk(begin, end)` reduces a
+    // chunk, and the partials are folded left to right into `init`
+    // with `combine`.
+    template<typename T, typename ReduceChunk, typename Combine>
+    T reduce(int size, T init, ReduceChunk reduce_chunk, Combine combine) {
+        const int num_chunks = (size + REDUCTION_CHUNK - 1) / REDUCTION_CHUNK;
+        std::vector<T> partials(num_chunks);
+        auto reduce_chunks = [&partials, &reduce_chunk, size](int first, int last) {
+            for (int chunk = first; chunk < last; ++chunk) {
+                partials[chunk] = reduce_chunk(
+                    chunk * REDUCTION_CHUNK,
+                    std::min(size, (chunk + 1) * REDUCTION_CHUNK)
+                );
+            }
+        };
+        if (should_parallelize(size)) {
+            parallel_for(0, num_chunks, 1, reduce_chunks);
+        } else {
+            reduce_chunks(0, num_chunks);
+        }
+        T result = init;
+        for (auto& partial : partials) {
+            result = combine(result, partial);
+        }
+        return result;
+    }
+
+    // Evaluates `dst <Saver> exp` (e.g. sv::plusto for +=) across
+    // threads and returns true, or returns false without doing
+    // anything when the expression is too small to be worth it.
+    template<int etype>
+    struct Map {
+        template<typename Saver, int dim, typename DType, typename E>
+        static bool run(mshadow::Tensor<mshadow::cpu, dim, DType> dst, const E& exp) {
+            const mshadow::Shape<2> shape = dst.shape_.FlatTo2D();
+            const int size = shape[0] * shape[1];
+            if (!should_parallelize(size)) {
+                return false;
+            }
+            const mshadow::Shape<dim> eshape = mshadow::expr::ShapeCheck<dim, E>::Check(exp);
+            mshadow::utils::Check(eshape[0] == 0 || eshape == dst.shape_,
+                    "Assignment: Shape of Tensors are not consistent with target");
+            auto dst_plan = mshadow::expr::MakePlan(dst);
+            const auto exp_plan = mshadow::expr::MakePlan(exp);
+            const mshadow::index_t cols = shape[1];
+            parallel_for(0, size, grain_size(size), [&dst_plan, &exp_plan, cols](int begin, int end) {
+                mshadow::index_t y = begin / cols;
+                mshadow::index_t x = begin % cols;
+                for (int i = begin; i < end; ++i) {
+                    Saver::template Save<DType>(dst_plan.REval(y, x), exp_plan.Eval(y, x));
+                    if (++x == cols) {
+                        x = 0;
+                        ++y;
+                    }
+                }
+            });
+            return true;
+        }
+    };
+
+    // complex expressions (dot, softmax, ...) have no elementwise plan.
+    template<>
+    struct Map<mshadow::expr::type::kComplex> {
+        template<typename Saver, int dim, typename DType, typename E>
+        static bool run(mshadow::Tensor<mshadow::cpu, dim, DType> dst, const E& exp) {
+            return false;
+        }
+    };
+}
+
+#endif
@@ -108,12 +108,44 @@ SynchronizedMemory<R>::SynchronizedMemory(const SynchronizedMemory& other) :
 template<typename R>
 void SynchronizedMemory<R>::free_cpu() const {
     if (allocated_cpu) {
-        memory_bank<R>::deposit_cpu(total_memory, inner_dimension, cpu_ptr);
+        if (cpu_owner != nullptr) {
+            cpu_owner.reset();
+        } else {
+            memory_bank<R>::deposit_cpu(total_memory, inner_dimension, cpu_ptr);
+        }
         cpu_ptr = NULL;
     }
     allocated_cpu = false;
 }
 
+template<typename R>
+void SynchronizedMemory<R>::adopt_cpu(R* ptr, std::shared_ptr<void> owner) {
+    free_cpu();
+    cpu_ptr = ptr;
+    cpu_owner = owner;
+    allocated_cpu = true;
+    cpu_fresh = true;
+#ifdef DALI_USE_CUDA
+    gpu_fresh = false;
+#endif
+}
+
+template<typename R>
+void SynchronizedMemory<R>::own_cpu() {
+    if (cpu_owner == nullptr) {
+        return;
+    }
+    R* adopted = cpu_ptr;
+    auto owner = cpu_owner;
+    bool was_fresh = cpu_fresh;
+    cpu_owner.reset();
+    allocated_cpu = false;
+    allocate_cpu();
+    if (was_fresh) {
+        memory_operations<R>::copy_memory_cpu_to_cpu(cpu_ptr, adopted, total_memory, inner_dimension);
+    }
+}
+
 #ifdef DALI_USE_CUDA
 template<typename R>
 void SynchronizedMemory<R>::free_gpu() const {
@@ -5,6 +5,7 @@
 #include <functional>
 #include <initializer_list>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <ostream>
 
@@ -67,8 +68,18 @@ class SynchronizedMemory {
         mutable bool allocated_cpu;
         mutable bool cpu_fresh;
         mutable R* cpu_ptr;
+        // set when cpu_ptr is memory owned by someone else (e.g. a
+        // memory mapped file): kept alive while in use, and released
+        // instead of going back to the memory bank.
+        mutable std::shared_ptr<void> cpu_owner;
 
         void free_cpu() const;
+        // Use `ptr` (total_memory elements owned by `owner`) as the
+        // fresh cpu copy of the memory, without copying it.
+        void adopt_cpu(R* ptr, std::shared_ptr<void> owner);
+        // replaces adopted cpu memory by a copy from the memory bank
+        // (e.g. before reallocating it).
+        void own_cpu();
         // Ensure a fresh copy of the memory is on the cpu
         void to_cpu() const;
         bool prefers_cpu() const;
@@ -447,6 +447,8 @@ template<typename R, int dimension>
 void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R filler) {
     if (newshape == shape)
         return;
+    // memory mapped from a file cannot be reallocated.
+    memory_->own_cpu();
     // if same columns
     if (newshape[1] == shape[1]) {
         if (newshape[0] != shape[0]) {
@@ -454,7 +456,7 @@ void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R
             // then we can simply chop off or add memory
             // at the tail end of this tensor's memory buffer.
             R* data_ptr = memory_->mutable_cpu_data();
-            R* new_ptr  = (R*)realloc(data_ptr, newshape.Size() * sizeof(R));
+            R* new_ptr  = memory_bank<R>::reallocate_cpu(data_ptr, memory_->total_memory, newshape.Size());
             ASSERT2(new_ptr != NULL, "Error: Could not allocated memory for TensorInternal.");
             if (new_ptr != NULL) {
                 memory_->cpu_ptr = new_ptr;
@@ -478,7 +480,7 @@ void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R
                 // we move the farthest rows & columns out to
                 // make room for closer columns
                 R* data_ptr = memory_->mutable_cpu_data();
-                R* new_ptr  = (R*)realloc(data_ptr, newshape.Size() * sizeof(R));
+                R* new_ptr  = memory_bank<R>::reallocate_cpu(data_ptr, memory_->total_memory, newshape.Size());
                 ASSERT2(new_ptr != NULL, "Error: Could not allocated memory for TensorInternal.");
                 if (new_ptr != NULL) {
                     memory_->cpu_ptr = new_ptr;
@@ -523,7 +525,7 @@ void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R
                         *(data_ptr + new_offset) = *(data_ptr + old_offset);
                     }
                 }
-                R* new_ptr = (R*)realloc(data_ptr, newshape.Size() * sizeof(R));
+                R* new_ptr = memory_bank<R>::reallocate_cpu(data_ptr, memory_->total_memory, newshape.Size());
                 ASSERT2(new_ptr != NULL, "Error: Could not allocated memory for TensorInternal.");
                 if (new_ptr != NULL) {
                     memory_->cpu_ptr = new_ptr;
@@ -554,8 +556,9 @@ void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R
         void TensorInternal<dtype, 1>::resize(mshadow::Shape<1> newshape, dtype filler) {\
             if (newshape == shape)\
                 return;\
+            memory_->own_cpu();\
             dtype* data_ptr = memory_->mutable_cpu_data();\
-            dtype* new_ptr  = (dtype*)realloc(data_ptr, newshape.Size() * sizeof(dtype));\
+            dtype* new_ptr  = memory_bank<dtype>::reallocate_cpu(data_ptr, memory_->total_memory, newshape.Size());\
             ASSERT2(new_ptr != NULL, "Error: Could not allocated memory for TensorInternal.");\
             memory_->cpu_ptr = new_ptr;\
             memory_->total_memory = newshape.Size();\
@@ -573,8 +576,9 @@ void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R
         void TensorInternal<dtype, 1>::resize(mshadow::Shape<1> newshape, dtype filler) {\
             if (newshape == shape)\
                 return;\
+            memory_->own_cpu();\
             dtype* data_ptr = memory_->mutable_cpu_data();\
-            dtype* new_ptr  = (dtype*)realloc(data_ptr, newshape.Size() * sizeof(dtype));\
+            dtype* new_ptr  = memory_bank<dtype>::reallocate_cpu(data_ptr, memory_->total_memory, newshape.Size());\
             ASSERT2(new_ptr != NULL, "Error: Could not allocated memory for TensorInternal.");\
             memory_->cpu_ptr = new_ptr;\
             memory_->total_memory = newshape.Size();\
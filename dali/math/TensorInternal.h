@@ -1,6 +1,7 @@
 #ifndef DALI_MAT_MATH_TENSOR_INTERNAL_H
 #define DALI_MAT_MATH_TENSOR_INTERNAL_H
 
+#include "dali/math/CpuThreading.h"
 #include "dali/math/SynchronizedMemory.h"
 #include "dali/utils/core_utils.h"
 #include "mshadow/tensor.h"
@@ -47,7 +48,7 @@ class TensorInternal;
 
 
 #ifdef DALI_USE_CUDA
-    #define DALI_SYNC_TENSOR_ASSIGN_OP(op_symbol) \
+    #define DALI_SYNC_TENSOR_ASSIGN_OP(op_symbol, saver) \
         template <typename TA, typename TB, int ta> \
         TensorInternal& operator op_symbol (const LazyTensor<TA, TB, R, dimension, ta>& expr) { \
             if (should_compute_on_gpu(extract_memory(expr.dependent_tensors))) { \
@@ -60,7 +61,10 @@ class TensorInternal;
                 for (auto participant : expr.dependent_tensors) { \
                     participant->update_tensor(DEVICE_CPU); \
                 } \
-                this->mutable_cpu_data() op_symbol expr.left;\
+                auto dst = this->mutable_cpu_data(); \
+                if (!cpu_threading::Map<ta>::template run<saver>(dst, expr.left)) { \
+                    dst op_symbol expr.left; \
+                } \
             };\
             return *this;\
         }
@@ -74,7 +78,7 @@ class TensorInternal;
             return *this;\
         }
 
-    #define DALI_SYNC_TENSOR_OVERWRITE_OP(op_symbol) \
+    #define DALI_SYNC_TENSOR_OVERWRITE_OP(op_symbol, saver) \
         template <typename TA, typename TB, int ta> \
         TensorInternal& operator op_symbol (const LazyTensor<TA, TB, R, dimension, ta>& expr) { \
             if (should_compute_on_gpu(extract_memory(expr.dependent_tensors))) { \
@@ -87,7 +91,10 @@ class TensorInternal;
                 for (auto participant : expr.dependent_tensors) { \
                     participant->update_tensor(DEVICE_CPU); \
                 } \
-                this->overwrite_cpu_data() op_symbol expr.left;\
+                auto dst = this->overwrite_cpu_data(); \
+                if (!cpu_threading::Map<ta>::template run<saver>(dst, expr.left)) { \
+                    dst op_symbol expr.left; \
+                } \
             };\
             return *this;\
         }
@@ -101,22 +108,28 @@ class TensorInternal;
             return *this;\
         }
 #else
-    #define DALI_SYNC_TENSOR_ASSIGN_OP(op_symbol) \
+    #define DALI_SYNC_TENSOR_ASSIGN_OP(op_symbol, saver) \
         template <typename TA, int ta> \
         TensorInternal& operator op_symbol (const LazyTensor<TA, R, dimension,ta>& expr) { \
             for (auto participant : expr.dependent_tensors) { \
                 participant->update_tensor(DEVICE_CPU); \
             } \
-            this->mutable_cpu_data() op_symbol expr.left;\
+            auto dst = this->mutable_cpu_data(); \
+            if (!cpu_threading::Map<ta>::template run<saver>(dst, expr.left)) { \
+                dst op_symbol expr.left; \
+            } \
             return *this;\
         }
-    #define DALI_SYNC_TENSOR_OVERWRITE_OP(op_symbol) \
+    #define DALI_SYNC_TENSOR_OVERWRITE_OP(op_symbol, saver) \
         template <typename TA, int ta> \
         TensorInternal& operator op_symbol (const LazyTensor<TA, R, dimension,ta>& expr) { \
             for (auto participant : expr.dependent_tensors) { \
                 participant->update_tensor(DEVICE_CPU); \
             } \
-            this->overwrite_cpu_data() op_symbol expr.left;\
+            auto dst = this->overwrite_cpu_data(); \
+            if (!cpu_threading::Map<ta>::template run<saver>(dst, expr.left)) { \
+                dst op_symbol expr.left; \
+            } \
             return *this;\
         }
 
@@ -181,11 +194,13 @@ class TensorInternal {
             gpu_tensor_t       overwrite_gpu_data();
         #endif
 
-        DALI_SYNC_TENSOR_OVERWRITE_OP(=)
-        DALI_SYNC_TENSOR_ASSIGN_OP(+=)
-        DALI_SYNC_TENSOR_ASSIGN_OP(-=)
-        DALI_SYNC_TENSOR_ASSIGN_OP(/=)
-        DALI_SYNC_TENSOR_ASSIGN_OP(*=)
+        // large expressions are evaluated across threads on the cpu
+        // (see CpuThreading.h).
+        DALI_SYNC_TENSOR_OVERWRITE_OP(=,  mshadow::sv::saveto)
+        DALI_SYNC_TENSOR_ASSIGN_OP(+=,    mshadow::sv::plusto)
+        DALI_SYNC_TENSOR_ASSIGN_OP(-=,    mshadow::sv::minusto)
+        DALI_SYNC_TENSOR_ASSIGN_OP(/=,    mshadow::sv::divto)
+        DALI_SYNC_TENSOR_ASSIGN_OP(*=,    mshadow::sv::multo)
         DALI_SYNC_TENSOR_OVERWRITE_SCALAR_OP(=)
         DALI_SYNC_TENSOR_ASSIGN_SCALAR_OP(+=)
         DALI_SYNC_TENSOR_ASSIGN_SCALAR_OP(-=)
@@ -121,8 +121,21 @@ namespace TensorOps {
             }
         #endif
 
+        // Large cpu reductions run in chunks across threads (see
+        // CpuThreading.h), which gives the same result whatever the
+        // number of threads.
+        template<typename R, typename Kernel>
+        double chunked_accumulate(const R* data, int num_elts, Kernel kernel) {
+            return cpu_threading::reduce(num_elts, 0.0, [data, &kernel](int begin, int end) {
+                return std::accumulate(data + begin, data + end, 0.0, kernel);
+            }, std::plus<double>());
+        }
+
         template <typename R, int dimension>
         bool is_nan(const mshadow::Tensor<cpu, dimension, R> a, int num_elts) {
+            if (num_elts >= cpu_threading::min_parallel_size()) {
+                return std::isnan(chunked_accumulate(a.dptr_, num_elts, std::plus<double>()));
+            }
             return std::isnan(std::accumulate(a.dptr_, a.dptr_ + num_elts, 0.0));
         }
 
@@ -139,6 +152,9 @@ namespace TensorOps {
 
         template<int ndims, typename R>
         R sum(const mshadow::Tensor<cpu, ndims, R> a, int num_elts) {
+            if (num_elts >= cpu_threading::min_parallel_size()) {
+                return chunked_accumulate(a.dptr_, num_elts, std::plus<double>());
+            }
             return std::accumulate(a.dptr_, a.dptr_ + num_elts, 0.0);
         }
 
@@ -178,6 +194,9 @@ namespace TensorOps {
 
         template<int ndims, typename R>
         R L2_norm(const mshadow::Tensor<cpu, ndims, R> a, int num_elts) {
+            if (num_elts >= cpu_threading::min_parallel_size()) {
+                return std::sqrt(chunked_accumulate(a.dptr_, num_elts, thrust_square_reduce<R>()));
+            }
             return std::sqrt(std::accumulate(a.dptr_, a.dptr_ + num_elts, 0.0, thrust_square_reduce<R>()));
         }
 
@@ -197,12 +216,18 @@ namespace TensorOps {
 
         template<int ndims, typename R>
         R min(const mshadow::Tensor<cpu, ndims, R> a, int num_elts) {
-            return std::accumulate(a.dptr_, a.dptr_ + num_elts, std::numeric_limits<R>::infinity(), min_kernel<R>());
+            const R* data = a.dptr_;
+            return cpu_threading::reduce(num_elts, std::numeric_limits<R>::infinity(), [data](int begin, int end) {
+                return std::accumulate(data + begin, data + end, std::numeric_limits<R>::infinity(), min_kernel<R>());
+            }, min_kernel<R>());
         }
 
         template<int ndims, typename R>
         R max(const mshadow::Tensor<cpu, ndims, R> a, int num_elts) {
-            return std::accumulate(a.dptr_, a.dptr_ + num_elts, -std::numeric_limits<R>::infinity(), max_kernel<R>());
+            const R* data = a.dptr_;
+            return cpu_threading::reduce(num_elts, -std::numeric_limits<R>::infinity(), [data](int begin, int end) {
+                return std::accumulate(data + begin, data + end, -std::numeric_limits<R>::infinity(), max_kernel<R>());
+            }, max_kernel<R>());
         }
 
     }
@@ -3,6 +3,7 @@
 
 #include <mshadow/tensor.h>
 #include <math.h>
+#include <algorithm>
 #include <random>
 
 #include "dali/utils/random.h"
@@ -13,6 +14,154 @@
 
 namespace TensorOps {
     namespace random {
+        /////////////////////// philox ////////////////////////////////////////////////
+
+        // Counter based generator (Philox 4x32-10 from Salmon et al.,
+        // "Parallel Random Numbers: As Easy as 1, 2, 3", SC 2011): the
+        // four numbers of a block only depend on the key and on the
+        // block's counter, so any part of a stream can be generated
+        // again, in any order and on any device.
+        struct philox4x32 {
+            // the key is (seed, stream): stream 0 is shared by everyone
+            // reserving counters from utils::random::reserve_counters,
+            // thread t has stream t + 1 (reserve_thread_counters).
+            unsigned int seed;
+            unsigned int stream;
+            // counter of the stream's first block.
+            unsigned long long offset;
+
+            philox4x32(unsigned int _seed, unsigned long long _offset, unsigned int _stream = 0) :
+                    seed(_seed), stream(_stream), offset(_offset) {}
+
+            MSHADOW_XINLINE void operator()(unsigned long long block, unsigned int out[4]) const {
+                const unsigned long long counter = offset + block;
+                unsigned int c0 = (unsigned int)counter;
+                unsigned int c1 = (unsigned int)(counter >> 32);
+                unsigned int c2 = 0;
+                unsigned int c3 = 0;
+                unsigned int k0 = seed;
+                unsigned int k1 = stream;
+                for (int round = 0; round < 10; ++round) {
+                    const unsigned long long p0 = 0xD2511F53ULL * c0;
+                    const unsigned long long p1 = 0xCD9E8D57ULL * c2;
+                    c0 = (unsigned int)(p1 >> 32) ^ c1 ^ k0;
+                    c2 = (unsigned int)(p0 >> 32) ^ c3 ^ k1;
+                    c1 = (unsigned int)p1;
+                    c3 = (unsigned int)p0;
+                    k0 += 0x9E3779B9;
+                    k1 += 0xBB67AE85;
+                }
+                out[0] = c0;
+                out[1] = c1;
+                out[2] = c2;
+                out[3] = c3;
+            }
+
+            // PHILOX_BATCH consecutive blocks from `first_block` on, the
+            // same numbers as operator() but computed side by side so
+            // that the rounds vectorize.
+            void batch(unsigned long long first_block, unsigned int* out) const;
+
+            // uniform in [0, 1) from the top 24 bits.
+            MSHADOW_XINLINE static float to_uniform(unsigned int x) {
+                return (x >> 8) * (1.0f / 16777216.0f);
+            }
+
+            // uniform in [0, 1) with a full double mantissa: 27 bits
+            // of `high` and 26 bits of `low`.
+            MSHADOW_XINLINE static double to_uniform_double(unsigned int high, unsigned int low) {
+                return ((high >> 5) * 67108864.0 + (low >> 6)) * (1.0 / 9007199254740992.0);
+            }
+        };
+
+        const int PHILOX_BATCH = 16;
+        // numbers per batch.
+        const int PHILOX_BATCH_SIZE = 4 * PHILOX_BATCH;
+
+        inline void philox4x32::batch(unsigned long long first_block, unsigned int* out) const {
+            unsigned int c0[PHILOX_BATCH], c1[PHILOX_BATCH], c2[PHILOX_BATCH], c3[PHILOX_BATCH];
+            for (int lane = 0; lane < PHILOX_BATCH; ++lane) {
+                const unsigned long long counter = offset + first_block + lane;
+                c0[lane] = (unsigned int)counter;
+                c1[lane] = (unsigned int)(counter >> 32);
+                c2[lane] = 0;
+                c3[lane] = 0;
+            }
+            unsigned int k0 = seed;
+            unsigned int k1 = stream;
+            for (int round = 0; round < 10; ++round) {
+                for (int lane = 0; lane < PHILOX_BATCH; ++lane) {
+                    const unsigned long long p0 = 0xD2511F53ULL * c0[lane];
+                    const unsigned long long p1 = 0xCD9E8D57ULL * c2[lane];
+                    c0[lane] = (unsigned int)(p1 >> 32) ^ c1[lane] ^ k0;
+                    c2[lane] = (unsigned int)(p0 >> 32) ^ c3[lane] ^ k1;
+                    c1[lane] = (unsigned int)p1;
+                    c3[lane] = (unsigned int)p0;
+                }
+                k0 += 0x9E3779B9;
+                k1 += 0xBB67AE85;
+            }
+            for (int lane = 0; lane < PHILOX_BATCH; ++lane) {
+                out[4 * lane]     = c0[lane];
+                out[4 * lane + 1] = c1[lane];
+                out[4 * lane + 2] = c2[lane];
+                out[4 * lane + 3] = c3[lane];
+            }
+        }
+
+        // Fills `size` values from the calling thread's philox stream
+        // (see utils::random::reserve_thread_counters), which persists
+        // across calls: nothing is constructed or seeded per call.
+        // `transform(bits, values)` turns a batch of PHILOX_BATCH_SIZE
+        // random words into `batch_values` values (as many by default,
+        // fewer when each value takes several words). Large fills are
+        // split across threads (see CpuThreading.h), with the same result.
+        template<typename R, typename Transform>
+        void philox_sample(R* data, int size, const Transform& transform,
+                           const int batch_values = PHILOX_BATCH_SIZE) {
+            const int num_batches = (size + batch_values - 1) / batch_values;
+            const auto reserved = utils::random::reserve_thread_counters(
+                    (unsigned long long)num_batches * PHILOX_BATCH);
+            const philox4x32 generator(utils::random::seed(), reserved.offset, reserved.stream + 1);
+            auto sample_batches = [&generator, &transform, data, size, batch_values](int begin, int end) {
+                unsigned int bits[PHILOX_BATCH_SIZE];
+                R values[PHILOX_BATCH_SIZE];
+                for (int batch = begin; batch < end; ++batch) {
+                    generator.batch((unsigned long long)batch * PHILOX_BATCH, bits);
+                    const int first = batch * batch_values;
+                    if (size - first >= batch_values) {
+                        transform(bits, data + first);
+                    } else {
+                        transform(bits, values);
+                        std::copy(values, values + (size - first), data + first);
+                    }
+                }
+            };
+            if (cpu_threading::should_parallelize(size)) {
+                cpu_threading::parallel_for(0, num_batches,
+                        cpu_threading::grain_size(size) / batch_values + 1, sample_batches);
+            } else {
+                sample_batches(0, num_batches);
+            }
+        }
+
+        // Box-Muller on pairs of words, two passes so that the first
+        // (no trigonometry) vectorizes.
+        template<typename R>
+        void philox_to_gaussian(const unsigned int* bits, R* out, float mean, float std) {
+            float radius[PHILOX_BATCH_SIZE / 2];
+            float angle[PHILOX_BATCH_SIZE / 2];
+            for (int pair = 0; pair < PHILOX_BATCH_SIZE / 2; ++pair) {
+                // in (0, 1] so that the log is finite.
+                radius[pair] = std * sqrtf(-2.0f * logf(1.0f - philox4x32::to_uniform(bits[2 * pair])));
+                angle[pair]  = 6.283185307f * philox4x32::to_uniform(bits[2 * pair + 1]);
+            }
+            for (int pair = 0; pair < PHILOX_BATCH_SIZE / 2; ++pair) {
+                out[2 * pair]     = (R)(mean + radius[pair] * cosf(angle[pair]));
+                out[2 * pair + 1] = (R)(mean + radius[pair] * sinf(angle[pair]));
+            }
+        }
+
         #ifdef DALI_USE_CUDA
         // from thrust Monte Carlo experiment
         // here: https://github.com/thrust/thrust/blob/master/examples/monte_carlo.cu
@@ -99,32 +248,41 @@ namespace TensorOps {
 
         template<int ndims, typename R, template <typename,int,typename> class tensor_t>
         void uniform(tensor_t<mshadow::cpu, ndims, R> t, R lower, R upper) {
-            mshadow::Random<mshadow::cpu, R> generator(utils::randint(0,999999));
-            generator.SampleUniform(&t, lower, upper);
+            const R range = upper - lower;
+            philox_sample(t.dptr_, t.shape_.Size(), [lower, range](const unsigned int* bits, R* out) {
+                for (int i = 0; i < PHILOX_BATCH_SIZE; ++i) {
+                    out[i] = lower + range * philox4x32::to_uniform(bits[i]);
+                }
+            });
+        }
+
+        template<int ndims, template <typename,int,typename> class tensor_t>
+        void uniform(tensor_t<mshadow::cpu, ndims, double> t, double lower, double upper) {
+            // two words per value, for all 53 bits of the mantissa.
+            const double range = upper - lower;
+            philox_sample(t.dptr_, t.shape_.Size(), [lower, range](const unsigned int* bits, double* out) {
+                for (int i = 0; i < PHILOX_BATCH_SIZE / 2; ++i) {
+                    out[i] = lower + range * philox4x32::to_uniform_double(bits[2 * i], bits[2 * i + 1]);
+                }
+            }, PHILOX_BATCH_SIZE / 2);
         }
 
         template<int ndims, template <typename,int,typename> class tensor_t>
         void uniform(tensor_t<mshadow::cpu, ndims, int> t, int lower, int upper) {
-            std::uniform_int_distribution<int> dist(lower, upper);
-            auto& gen = utils::random::generator();
-            for (int i = 0; i < t.shape_.Size(); ++i) {
-                *(t.dptr_ + i) = dist(gen);
-            }
+            // between lower and upper included.
+            const unsigned long long range = (long long)upper - lower + 1;
+            philox_sample(t.dptr_, t.shape_.Size(), [lower, range](const unsigned int* bits, int* out) {
+                for (int i = 0; i < PHILOX_BATCH_SIZE; ++i) {
+                    out[i] = lower + (int)((bits[i] * range) >> 32);
+                }
+            });
         }
 
         template<int ndims, typename R, template <typename,int,typename> class tensor_t>
         void gaussian(tensor_t<mshadow::cpu, ndims, R> t, R mean, R std) {
-            mshadow::Random<mshadow::cpu, R> generator(utils::randint(0,999999));
-            generator.SampleGaussian(&t, mean, std);
-        }
-
-        template<int ndims, template <typename,int,typename> class tensor_t>
-        void gaussian(tensor_t<mshadow::cpu, ndims, int> t, int mean, int std) {
-            std::normal_distribution<float> dist((float)mean, (float)std);
-            auto& gen = utils::random::generator();
-            for (int i = 0; i < t.shape_.Size(); ++i) {
-                *(t.dptr_ + i) = (int)dist(gen);
-            }
+            philox_sample(t.dptr_, t.shape_.Size(), [mean, std](const unsigned int* bits, R* out) {
+                philox_to_gaussian(bits, out, mean, std);
+            });
         }
 
         template<typename Device, int ndims, typename R, template <typename,int,typename> class tensor_t>
@@ -138,6 +296,111 @@ namespace TensorOps {
             random::uniform(t, (R)0.0, (R)1.0);
             t = mshadow::expr::F<op::threshold<R>>(t, prob) * (1.0 / prob);
         }
+
+        // Mask values of a philox stream, four per block: `scale`
+        // with probability `prob`, 0 otherwise.
+        template<typename R>
+        struct philox_bernoulli {
+            philox4x32 generator;
+            float prob;
+            R scale;
+
+            philox_bernoulli(philox4x32 _generator, float _prob, R _scale) :
+                    generator(_generator), prob(_prob), scale(_scale) {}
+
+            MSHADOW_XINLINE void operator()(unsigned long long block, R out[4]) const {
+                unsigned int bits[4];
+                generator(block, bits);
+                for (int lane = 0; lane < 4; ++lane) {
+                    out[lane] = philox4x32::to_uniform(bits[lane]) < prob ? scale : (R)0;
+                }
+            }
+        };
+
+        // Gaussian mask values of a philox stream (Box-Muller on pairs
+        // of uniforms), four per block.
+        template<typename R>
+        struct philox_gaussian {
+            philox4x32 generator;
+            float mean;
+            float std;
+
+            philox_gaussian(philox4x32 _generator, R _mean, R _std) :
+                    generator(_generator), mean(_mean), std(_std) {}
+
+            MSHADOW_XINLINE void operator()(unsigned long long block, R out[4]) const {
+                unsigned int bits[4];
+                generator(block, bits);
+                for (int lane = 0; lane < 4; lane += 2) {
+                    // in (0, 1] so that the log is finite.
+                    const float u1 = 1.0f - philox4x32::to_uniform(bits[lane]);
+                    const float angle = 6.283185307f * philox4x32::to_uniform(bits[lane + 1]);
+                    const float radius = sqrtf(-2.0f * logf(u1));
+                    out[lane]     = (R)(mean + std * radius * cosf(angle));
+                    out[lane + 1] = (R)(mean + std * radius * sinf(angle));
+                }
+            }
+        };
+
+        // dst[i] <Saver> src[i] * mask[i] for the elements of one block.
+        template<typename Saver, typename R, typename Mask>
+        struct apply_mask_kernel {
+            R* dst;
+            const R* src;
+            unsigned long long size;
+            Mask mask;
+
+            apply_mask_kernel(R* _dst, const R* _src, unsigned long long _size, Mask _mask) :
+                    dst(_dst), src(_src), size(_size), mask(_mask) {}
+
+            MSHADOW_XINLINE void operator()(unsigned long long block) const {
+                R values[4];
+                mask(block, values);
+                for (int lane = 0; lane < 4; ++lane) {
+                    const unsigned long long i = 4 * block + lane;
+                    if (i < size) {
+                        Saver::template Save<R>(dst[i], src[i] * values[lane]);
+                    }
+                }
+            }
+        };
+
+        // blocks of four values needed to cover `size` elements.
+        inline unsigned long long philox_blocks(unsigned long long size) {
+            return (size + 3) / 4;
+        }
+
+        #ifdef DALI_USE_CUDA
+        template<typename Saver, typename R, typename Mask>
+        void apply_mask(mshadow::Tensor<mshadow::gpu, 2, R> dst,
+                        const mshadow::Tensor<mshadow::gpu, 2, R>& src,
+                        const Mask& mask) {
+            const unsigned long long size = src.shape_.Size();
+            thrust::for_each(
+                    thrust::counting_iterator<unsigned long long>(0),
+                    thrust::counting_iterator<unsigned long long>(philox_blocks(size)),
+                    apply_mask_kernel<Saver, R, Mask>(dst.dptr_, src.dptr_, size, mask));
+        }
+        #endif
+
+        template<typename Saver, typename R, typename Mask>
+        void apply_mask(mshadow::Tensor<mshadow::cpu, 2, R> dst,
+                        const mshadow::Tensor<mshadow::cpu, 2, R>& src,
+                        const Mask& mask) {
+            const int size = src.shape_.Size();
+            apply_mask_kernel<Saver, R, Mask> kernel(dst.dptr_, src.dptr_, size, mask);
+            auto apply_blocks = [&kernel](int begin, int end) {
+                for (int block = begin; block < end; ++block) {
+                    kernel(block);
+                }
+            };
+            const int num_blocks = philox_blocks(size);
+            if (cpu_threading::should_parallelize(size)) {
+                cpu_threading::parallel_for(0, num_blocks, philox_blocks(cpu_threading::grain_size(size)), apply_blocks);
+            } else {
+                apply_blocks(0, num_blocks);
+            }
+        }
     }
 }
 
@@ -14,6 +14,8 @@
     #include <thrust/transform_reduce.h>
     // contains thrust::max_element & thrust::min_element
     #include <thrust/extrema.h>
+    #include <thrust/for_each.h>
+    #include <thrust/iterator/counting_iterator.h>
 
     #define STR(x) __THIS_IS_VERY_ABNOXIOUS(x)
     #define __THIS_IS_VERY_ABNOXIOUS(tok) #tok
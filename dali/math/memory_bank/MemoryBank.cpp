@@ -1,4 +1,8 @@
 #include "dali/math/memory_bank/MemoryBank.h"
+
+#include <algorithm>
+#include <cstring>
+
 using std::vector;
 
 static std::mutex memory_mutex;
@@ -6,37 +10,187 @@ static std::mutex memory_mutex;
 template<typename R>
 cuckoohash_map<unsigned long long,std::vector<R*>> memory_bank<R>::cpu_memory_bank(100000);
 
+namespace {
+    // smallest size class, in elements.
+    const unsigned long long MIN_CPU_SIZE_CLASS = 16;
+    // 4 size classes per power of two, for every power of two
+    // an int can describe.
+    const int NUM_CPU_SIZE_CLASSES = 4 * 32 + 1;
+
+    inline int floor_log2(unsigned long long x) {
+        return 63 - __builtin_clzll(x);
+    }
+
+    // Class 0 holds MIN_CPU_SIZE_CLASS elements, then each interval
+    // (2^s, 2^(s+1)] is split into 4 equally spaced classes.
+    inline int cpu_size_class_index(unsigned long long amount) {
+        if (amount <= MIN_CPU_SIZE_CLASS) {
+            return 0;
+        }
+        int shift = floor_log2(amount - 1);
+        unsigned long long step = 1ULL << (shift - 2);
+        unsigned long long steps = (amount + step - 1) / step;
+        return 1 + (shift - 4) * 4 + (int)(steps - 5);
+    }
+
+    inline unsigned long long cpu_size_class_capacity(int index) {
+        if (index == 0) {
+            return MIN_CPU_SIZE_CLASS;
+        }
+        int shift = (index - 1) / 4 + 4;
+        unsigned long long steps = (index - 1) % 4 + 5;
+        return steps << (shift - 2);
+    }
+
+    // Trivially destructible flag that stays readable after the
+    // thread's cache is gone (thread exit, or static destruction of
+    // Mats on the main thread).
+    template<typename R>
+    bool& cpu_thread_cache_alive() {
+        static thread_local bool alive = true;
+        return alive;
+    }
+
+    template<typename R>
+    void move_to_bank(unsigned long long capacity, R** begin, R** end) {
+        if (begin == end) {
+            return;
+        }
+        vector<R*> moved(begin, end);
+        memory_bank<R>::cpu_memory_bank.upsert(capacity, [&moved](vector<R*>& deposit_box) {
+            deposit_box.insert(deposit_box.end(), moved.begin(), moved.end());
+        }, moved);
+    }
+
+    template<typename R>
+    int take_from_bank(unsigned long long capacity, vector<R*>& dest, int max_taken) {
+        int taken = 0;
+        memory_bank<R>::cpu_memory_bank.update_fn(capacity, [&dest, &taken, max_taken](vector<R*>& deposit_box) {
+            while (!deposit_box.empty() && taken < max_taken) {
+                dest.emplace_back(deposit_box.back());
+                deposit_box.pop_back();
+                taken++;
+            }
+        });
+        return taken;
+    }
+
+    // Free buffers owned by a single thread. Allocations and deposits
+    // are served from here without synchronization; the shared memory
+    // bank is only touched to refill an empty size class or to absorb
+    // the overflow of a full one.
+    template<typename R>
+    struct cpu_thread_cache {
+        vector<vector<R*>> buffers;
+
+        cpu_thread_cache() : buffers(NUM_CPU_SIZE_CLASSES) {}
+
+        void flush() {
+            for (int index = 0; index < buffers.size(); ++index) {
+                auto& box = buffers[index];
+                move_to_bank<R>(cpu_size_class_capacity(index), box.data(), box.data() + box.size());
+                box.clear();
+            }
+        }
+
+        ~cpu_thread_cache() {
+            flush();
+            cpu_thread_cache_alive<R>() = false;
+        }
+    };
+
+    template<typename R>
+    cpu_thread_cache<R>& local_cpu_cache() {
+        static thread_local cpu_thread_cache<R> cache;
+        return cache;
+    }
+
+    void update_high_water_mark(std::atomic<long long>& mark, long long value) {
+        long long current = mark.load(std::memory_order_relaxed);
+        while (value > current &&
+               !mark.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+template<typename R>
+std::atomic<int> memory_bank<R>::cpu_thread_cache_size(32);
+
+template<typename R>
+unsigned long long memory_bank<R>::cpu_size_class(int amount) {
+    return cpu_size_class_capacity(cpu_size_class_index(amount));
+}
 
 template<typename R>
 void memory_bank<R>::deposit_cpu(int amount, int inner_dimension, R* ptr) {
-    // make sure there is only one person
-    // at a time in the vault to prevent
-    // robberies
-    /*cpu_memory_bank.upsert(amount, [ptr](std::vector<R*>& deposit_box) {
-        deposit_box.emplace_back(ptr);
-    }, {ptr});*/
-    memory_operations<R>::free_cpu_memory(ptr, amount, inner_dimension);
+    int index = cpu_size_class_index(amount);
+    auto capacity = cpu_size_class_capacity(index);
+    cpu_memory_in_use.fetch_sub(capacity, std::memory_order_relaxed);
+
+    if (!cpu_thread_cache_alive<R>()) {
+        memory_operations<R>::free_cpu_memory(ptr, capacity, 1);
+        total_cpu_memory -= capacity;
+        return;
+    }
+    auto& deposit_box = local_cpu_cache<R>().buffers[index];
+    int cache_size = cpu_thread_cache_size.load(std::memory_order_relaxed);
+    if (deposit_box.size() >= cache_size) {
+        // spill the older half of this class to the shared bank
+        // so that other threads can pick it up.
+        auto half = deposit_box.size() / 2;
+        move_to_bank<R>(capacity, deposit_box.data(), deposit_box.data() + half);
+        deposit_box.erase(deposit_box.begin(), deposit_box.begin() + half);
+    }
+    deposit_box.emplace_back(ptr);
 }
 
 template<typename R>
 R* memory_bank<R>::allocate_cpu(int amount, int inner_dimension) {
-    /*R* memory = NULL;
-    bool success = cpu_memory_bank.update_fn(amount, [&memory](std::vector<R*>& deposit_box) {
+    num_cpu_requests.fetch_add(1, std::memory_order_relaxed);
+    int index = cpu_size_class_index(amount);
+    auto capacity = cpu_size_class_capacity(index);
+
+    R* memory = NULL;
+    if (cpu_thread_cache_alive<R>()) {
+        auto& deposit_box = local_cpu_cache<R>().buffers[index];
+        if (deposit_box.empty()) {
+            // refill half of the thread cache at once to amortize
+            // the cost of locking the shared bank.
+            take_from_bank<R>(capacity, deposit_box,
+                std::max(1, cpu_thread_cache_size.load(std::memory_order_relaxed) / 2));
+        }
         if (!deposit_box.empty()) {
             memory = deposit_box.back();
             deposit_box.pop_back();
         }
-    });
-    if (memory != NULL) {
-        return memory;
-    }*/
-    num_cpu_allocations++;
-    total_cpu_memory += amount;
-    return memory_operations<R>::allocate_cpu_memory(amount, inner_dimension);
+    }
+    if (memory == NULL) {
+        num_cpu_allocations++;
+        total_cpu_memory += capacity;
+        memory = memory_operations<R>::allocate_cpu_memory(capacity, 1);
+    }
+    auto in_use = cpu_memory_in_use.fetch_add(capacity, std::memory_order_relaxed) + capacity;
+    update_high_water_mark(cpu_memory_high_water_mark, in_use);
+    return memory;
+}
+
+template<typename R>
+R* memory_bank<R>::reallocate_cpu(R* ptr, int old_amount, int new_amount) {
+    if (cpu_size_class_index(old_amount) == cpu_size_class_index(new_amount)) {
+        // buffer is already large enough
+        return ptr;
+    }
+    R* memory = allocate_cpu(new_amount, 1);
+    std::memcpy(memory, ptr, std::min(old_amount, new_amount) * sizeof(R));
+    deposit_cpu(old_amount, 1, ptr);
+    return memory;
 }
 
 template<typename R>
 void memory_bank<R>::clear_cpu() {
+    if (cpu_thread_cache_alive<R>()) {
+        local_cpu_cache<R>().flush();
+    }
     for (auto it = cpu_memory_bank.cbegin(); !it.is_end(); it++) {
         auto& ptrs = it->second;
         for (auto ptr : ptrs) {
@@ -47,12 +201,54 @@ void memory_bank<R>::clear_cpu() {
     cpu_memory_bank.clear();
 }
 
+template<typename R>
+void memory_bank<R>::trim_cpu(long long max_pooled) {
+    if (cpu_thread_cache_alive<R>()) {
+        local_cpu_cache<R>().flush();
+    }
+    vector<unsigned long long> capacities;
+    for (auto it = cpu_memory_bank.cbegin(); !it.is_end(); it++) {
+        capacities.emplace_back(it->first);
+    }
+    // release the largest buffers first: most memory for fewest calls.
+    std::sort(capacities.rbegin(), capacities.rend());
+    vector<R*> released;
+    for (auto capacity : capacities) {
+        while (total_cpu_memory - cpu_memory_in_use > max_pooled) {
+            released.clear();
+            if (take_from_bank<R>(capacity, released, 1) == 0) {
+                break;
+            }
+            memory_operations<R>::free_cpu_memory(released.front(), capacity, 1);
+            total_cpu_memory -= capacity;
+        }
+    }
+}
+
+template<typename R>
+double memory_bank<R>::cpu_pool_hit_rate() {
+    long long requests = num_cpu_requests;
+    if (requests == 0) {
+        return 0.0;
+    }
+    return 1.0 - (double) num_cpu_allocations / (double) requests;
+}
+
 template<typename R>
 std::atomic<long long> memory_bank<R>::num_cpu_allocations(0);
 
+template<typename R>
+std::atomic<long long> memory_bank<R>::num_cpu_requests(0);
+
 template<typename R>
 std::atomic<long long> memory_bank<R>::total_cpu_memory(0);
 
+template<typename R>
+std::atomic<long long> memory_bank<R>::cpu_memory_in_use(0);
+
+template<typename R>
+std::atomic<long long> memory_bank<R>::cpu_memory_high_water_mark(0);
+
 #ifdef DALI_USE_CUDA
     template<typename R>
     void memory_bank<R>::clear_gpu() {
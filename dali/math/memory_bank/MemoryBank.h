@@ -9,15 +9,60 @@
 
 #include "dali/math/memory_bank/MemoryBankInternal.h"
 
+/*
+Memory Bank
+-----------
+
+Recycles the buffers behind SynchronizedMemory instead of
+returning them to the system. CPU requests are rounded up
+to a size class (4 classes per power of two, so at most 25%
+of a buffer is slack), and freed buffers are first kept in a
+small per-thread cache, so that the common allocate/free
+pattern of a training step never touches a lock. Buffers
+that overflow the thread cache are deposited in the shared
+`cpu_memory_bank`, keyed by size class.
+
+Accounting (all sizes are expressed in number of elements):
+
+* num_cpu_requests           - allocations asked of the bank
+* num_cpu_allocations        - allocations that missed the pool
+                               and went to the system
+* total_cpu_memory           - memory currently obtained from the
+                               system (in use + pooled)
+* cpu_memory_in_use          - memory currently handed out
+* cpu_memory_high_water_mark - peak of cpu_memory_in_use
+
+Pooled memory can be handed back with `trim_cpu` or `clear_cpu`.
+*/
+
 template<typename R>
 struct memory_bank {
     static cuckoohash_map<unsigned long long,std::vector<R*>> cpu_memory_bank;
     static std::atomic<long long> num_cpu_allocations;
+    static std::atomic<long long> num_cpu_requests;
     static std::atomic<long long> total_cpu_memory;
+    static std::atomic<long long> cpu_memory_in_use;
+    static std::atomic<long long> cpu_memory_high_water_mark;
+    // maximum number of free buffers kept per size class
+    // in each thread's cache before spilling to the bank.
+    static std::atomic<int> cpu_thread_cache_size;
+
+    // size class (capacity in elements) used to serve a request
+    static unsigned long long cpu_size_class(int amount);
 
     static void deposit_cpu(int amount, int inner_dimension, R* ptr);
     static R* allocate_cpu(int amount, int inner_dimension);
+    // pool-aware replacement for realloc: contents up to
+    // min(old_amount, new_amount) are preserved.
+    static R* reallocate_cpu(R* ptr, int old_amount, int new_amount);
+    // return all the pooled memory (bank + this thread's cache)
+    // to the system.
     static void clear_cpu();
+    // return pooled memory to the system until at most `max_pooled`
+    // elements remain pooled. Caches of other threads are untouched.
+    static void trim_cpu(long long max_pooled = 0);
+    // fraction of requests served without going to the system.
+    static double cpu_pool_hit_rate();
 
     #ifdef DALI_USE_CUDA
         // find out how many bytes of memory are still available
@@ -10,9 +10,10 @@ using std::to_string;
 template<typename R>
 void RecurrentEmbeddingModel<R>::save(std::string dirname) const {
     utils::ensure_directory(dirname);
-    // Save the matrices:
-    auto params = parameters();
-    utils::save_matrices(params, dirname);
+    utils::makedirs(dirname.c_str());
+    // Save the matrices (in a single checkpoint):
+    auto params = checkpoint_parameters();
+    utils::save_checkpoint(params, dirname + utils::CHECKPOINT_FNAME);
     dirname += "config.md";
     save_configuration(dirname);
 }
@@ -24,6 +25,11 @@ vector<typename RecurrentEmbeddingModel<R>::mat> RecurrentEmbeddingModel<R>::par
     return parameters;
 }
 
+template<typename R>
+vector<typename RecurrentEmbeddingModel<R>::mat> RecurrentEmbeddingModel<R>::checkpoint_parameters() const {
+    return parameters();
+}
+
 template<typename R>
 void RecurrentEmbeddingModel<R>::save_configuration(std::string fname) const {
     auto config = configuration();
@@ -81,6 +87,14 @@ typename RecurrentEmbeddingModel<R>::config_t RecurrentEmbeddingModel<R>::config
     return config;
 }
 
+namespace {
+    // writes the checkpoints of maybe_save_model.
+    utils::CheckpointSaver& background_saver() {
+        static utils::CheckpointSaver saver;
+        return saver;
+    }
+}
+
 template<typename R>
 void maybe_save_model(RecurrentEmbeddingModel<R>* model,
                       const string& base_path,
@@ -104,7 +118,16 @@ void maybe_save_model(RecurrentEmbeddingModel<R>* model,
             std::cout << "Saving model to \""
                       << filename.str() << "/\"" << std::endl;
 
-            model->save(filename.str());
+            auto dirname = filename.str();
+            utils::ensure_directory(dirname);
+            utils::makedirs(dirname.c_str());
+            // the weights (and the configuration, written just before
+            // them) are saved in the background while training goes on.
+            background_saver().save(
+                model->checkpoint_parameters(),
+                dirname + utils::CHECKPOINT_FNAME,
+                {{dirname + "config.md", utils::map_to_string(model->configuration())}}
+            );
         });
     }
 }
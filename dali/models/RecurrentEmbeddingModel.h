@@ -56,6 +56,24 @@ class RecurrentEmbeddingModel {
         **/
         virtual std::vector<mat> parameters() const;
 
+        /**
+        Checkpoint Parameters
+        ---------------------
+
+        Parameters in the order and layout written to checkpoints
+        (by `save` and `maybe_save_model`). Same as `parameters`
+        unless a model stores some of them differently while training
+        (e.g. fused LSTM gates), in which case they are mapped back
+        to the layout the model's `load` expects.
+
+        Outputs
+        -------
+
+        std::vector<Mat<T>> parameters : vector of model parameters
+
+        **/
+        virtual std::vector<mat> checkpoint_parameters() const;
+
         void save(std::string) const;
 
         typedef std::vector<typename LSTM<R>::activation_t> state_type;
@@ -17,6 +17,14 @@ vector<Mat<Z>> StackedGatedModel<Z>::parameters() const {
     return parameters;
 }
 
+template<typename Z>
+vector<Mat<Z>> StackedGatedModel<Z>::checkpoint_parameters() const {
+    auto parameters = StackedModel<Z>::checkpoint_parameters();
+    auto gate_params = gate.parameters();
+    parameters.insert(parameters.end(), gate_params.begin(), gate_params.end());
+    return parameters;
+}
+
 template<typename Z>
 typename StackedGatedModel<Z>::config_t StackedGatedModel<Z>::configuration() const  {
     auto config = StackedModel<Z>::configuration();
@@ -88,7 +96,7 @@ typename StackedGatedModel<Z>::MaskedActivation StackedGatedModel<Z>::masked_pre
         int temporal_offset,
         uint softmax_offset) const {
 
-    utils::Timer mpc("masked_predict_cost");
+    DALI_PROFILE_SPAN(mpc, "masked_predict_cost");
     auto state = this->initial_states();
     mat total_error(1,1);
     mat memory;
@@ -100,7 +108,7 @@ typename StackedGatedModel<Z>::MaskedActivation StackedGatedModel<Z>::masked_pre
 
     for (uint timestep = 0; timestep < n - temporal_offset; ++timestep) {
         // pick this letter from the embedding
-        utils::Timer gte("get the embeddings");
+        DALI_PROFILE_SPAN(gte, "get the embeddings");
         auto input_vector = this->embedding[data[timestep]];
         memory = gate.activate(
             {
@@ -110,7 +118,7 @@ typename StackedGatedModel<Z>::MaskedActivation StackedGatedModel<Z>::masked_pre
         input_vector = input_vector.eltmul_broadcast_colwise(memory);
         gte.stop();
 
-        utils::Timer flstm("forward lstm");
+        DALI_PROFILE_SPAN(flstm, "forward lstm");
         state = this->stacked_lstm.activate(
             state,
             input_vector,
@@ -119,7 +127,7 @@ typename StackedGatedModel<Z>::MaskedActivation StackedGatedModel<Z>::masked_pre
         flstm.stop();
 
         // classifier takes as input the final hidden layer's activation:
-        utils::Timer decode_tm("decode");
+        DALI_PROFILE_SPAN(decode_tm, "decode");
         auto logprobs = this->decode(input_vector, state);
         decode_tm.stop();
 
@@ -128,11 +136,11 @@ typename StackedGatedModel<Z>::MaskedActivation StackedGatedModel<Z>::masked_pre
             target -= softmax_offset;
         }
 
-        utils::Timer softmax_tm("softmax cross entropy");
+        DALI_PROFILE_SPAN(softmax_tm, "softmax cross entropy");
         auto errors = MatOps<Z>::softmax_cross_entropy_rowwise(logprobs, target);
         softmax_tm.stop();
 
-        utils::Timer masking_tm("masking");
+        DALI_PROFILE_SPAN(masking_tm, "masking");
         errors *= mask[timestep + temporal_offset].T();
         memory *= mask[timestep + temporal_offset].T();
         masking_tm.stop();
@@ -52,6 +52,7 @@ class StackedGatedModel : public StackedModel<Z> {
 
         Z memory_penalty;
         virtual std::vector<mat> parameters() const;
+        virtual std::vector<mat> checkpoint_parameters() const;
         /**
         Configuration
         -------------
@@ -22,6 +22,16 @@ vector<Mat<Z>> StackedModel<Z>::parameters() const {
     return parameters;
 }
 
+template<typename Z>
+vector<Mat<Z>> StackedModel<Z>::checkpoint_parameters() const {
+    auto parameters = RecurrentEmbeddingModel<Z>::parameters();
+    auto decoder_params = decoder.parameters();
+    parameters.insert(parameters.end(), decoder_params.begin(), decoder_params.end());
+    auto stacked_lstm_params = stacked_lstm.gate_parameters();
+    parameters.insert(parameters.end(), stacked_lstm_params.begin(), stacked_lstm_params.end());
+    return parameters;
+}
+
 template<typename R>
 typename StackedModel<R>::state_t StackedModel<R>::initial_states() const {
     return stacked_lstm.initial_states();
@@ -152,6 +162,45 @@ Mat<Z> StackedModel<Z>::decode(
     }
 }
 
+template<typename Z>
+vector<Mat<Z>> StackedModel<Z>::decoder_inputs(
+    Mat<Z> input_vector,
+    state_t& states
+    ) const {
+    if (!use_shortcut) {
+        return {states.back().hidden};
+    }
+    auto inputs = LSTM<Z>::activation_t::hiddens(states);
+    if (_input_vector_to_decoder) {
+        inputs.insert(inputs.begin(), input_vector);
+    }
+    return inputs;
+}
+
+template<typename Z>
+Mat<Z> StackedModel<Z>::decode_cost(
+    Mat<Z> input_vector,
+    state_t& states,
+    Mat<int> target,
+    Mat<Z> mask
+    ) const {
+    if (!decoder.matrices[0].w().compute_me_on_gpu()) {
+        return MatOps<Z>::fused_softmax_cross_entropy_rowwise(
+            decoder.matrices,
+            decoder_inputs(input_vector, states),
+            decoder.b,
+            target,
+            mask
+        );
+    }
+    auto logprobs = decode(input_vector, states);
+    auto errors = MatOps<Z>::softmax_cross_entropy_rowwise(logprobs, target);
+    if (mask.dims(1) != 1) {
+        mask = mask.T();
+    }
+    return errors * mask;
+}
+
 template<typename Z>
 Mat<Z> StackedModel<Z>::masked_predict_cost(
         Mat<int> data,
@@ -161,7 +210,7 @@ Mat<Z> StackedModel<Z>::masked_predict_cost(
         int temporal_offset,
         uint softmax_offset) const {
 
-    utils::Timer mpc("masked_predict_cost");
+    DALI_PROFILE_SPAN(mpc, "masked_predict_cost");
     auto state = this->initial_states();
 
     auto n = data.dims(0);
@@ -172,12 +221,12 @@ Mat<Z> StackedModel<Z>::masked_predict_cost(
 
     for (uint timestep = 0; timestep < n - temporal_offset; ++timestep) {
         // pick this letter from the embedding
-        utils::Timer gte("get the embeddings");
+        DALI_PROFILE_SPAN(gte, "get the embeddings");
         auto input_vector = this->embedding[data[timestep]];
         gte.stop();
         // pass this letter to the LSTM for processing
 
-        utils::Timer flstm("forward lstm");
+        DALI_PROFILE_SPAN(flstm, "forward lstm");
         state = stacked_lstm.activate(
             state,
             input_vector,
@@ -185,23 +234,15 @@ Mat<Z> StackedModel<Z>::masked_predict_cost(
         );
         flstm.stop();
 
-        // classifier takes as input the final hidden layer's activation:
-        utils::Timer decode_tm("decode");
-        auto logprobs = decode(input_vector, state);
-        decode_tm.stop();
-
         auto target = target_data[timestep + temporal_offset];
         if (softmax_offset > 0) {
             target -= softmax_offset;
         }
 
-        utils::Timer softmax_tm("softmax cross entropy");
-        auto errors = MatOps<Z>::softmax_cross_entropy_rowwise(logprobs, target);
-        softmax_tm.stop();
-
-        utils::Timer masking_tm("masking");
-        errors *= mask[timestep + temporal_offset].T();
-        masking_tm.stop();
+        // classifier takes as input the final hidden layer's activation:
+        DALI_PROFILE_SPAN(decode_tm, "decode and softmax cross entropy");
+        auto errors = decode_cost(input_vector, state, target, mask[timestep + temporal_offset]);
+        decode_tm.stop();
 
         total_error += errors;
     }
@@ -219,6 +260,121 @@ Mat<Z> StackedModel<Z>::masked_predict_cost(const Batch<Z>& batch,
                                drop_prob, temporal_offset, softmax_offset);
 }
 
+template<typename Z>
+Mat<Z> StackedModel<Z>::masked_sampled_predict_cost(const Batch<Z>& batch,
+                                                    const utils::UnigramSampler& sampler,
+                                                    int num_samples,
+                                                    bool use_nce,
+                                                    Z drop_prob,
+                                                    int temporal_offset,
+                                                    uint softmax_offset) const {
+    DALI_PROFILE_SPAN(mpc, "masked_sampled_predict_cost");
+    auto state = this->initial_states();
+
+    auto n = batch.data.dims(0);
+    mat total_error(batch.data.dims(1),1);
+
+    assert (temporal_offset < n);
+    assert (batch.target.dims(0) >= batch.data.dims(0));
+
+    // one set of negatives for the whole minibatch:
+    auto negatives = sampler.sample_unique(num_samples);
+
+    for (uint timestep = 0; timestep < n - temporal_offset; ++timestep) {
+        DALI_PROFILE_SPAN(gte, "get the embeddings");
+        auto input_vector = this->embedding[batch.data[timestep]];
+        gte.stop();
+
+        DALI_PROFILE_SPAN(flstm, "forward lstm");
+        state = stacked_lstm.activate(
+            state,
+            input_vector,
+            drop_prob
+        );
+        flstm.stop();
+
+        auto target = batch.target[timestep + temporal_offset];
+        if (softmax_offset > 0) {
+            target -= softmax_offset;
+        }
+
+        DALI_PROFILE_SPAN(decode_tm, "decode and sampled objective");
+        auto inputs = decoder_inputs(input_vector, state);
+        auto errors = use_nce ?
+            MatOps<Z>::nce_rowwise(
+                decoder.matrices, inputs, decoder.b, target,
+                batch.mask[timestep + temporal_offset], sampler, negatives
+            ) :
+            MatOps<Z>::sampled_softmax_cross_entropy_rowwise(
+                decoder.matrices, inputs, decoder.b, target,
+                batch.mask[timestep + temporal_offset], sampler, negatives
+            );
+        decode_tm.stop();
+
+        total_error += errors;
+    }
+    mpc.stop();
+
+    return total_error;
+}
+
+template<typename Z>
+Mat<Z> StackedModel<Z>::masked_predict_cost(const PackedBatch<Z>& batch,
+                                            Z drop_prob,
+                                            int temporal_offset,
+                                            uint softmax_offset) const {
+    DALI_PROFILE_SPAN(mpc, "masked_predict_cost");
+    auto state = this->initial_states();
+
+    int n = batch.max_length();
+    assert (temporal_offset < n || n == 0);
+
+    // error of the running examples; examples that finish leave it
+    // as a block of its last rows.
+    mat running_error(batch.size(), 1);
+    vector<mat> finished_errors;
+
+    for (int timestep = 0; timestep < n - temporal_offset; ++timestep) {
+        int running = batch.running(timestep + temporal_offset);
+        if (running < running_error.dims(0)) {
+            finished_errors.emplace_back(running_error.slice(running, running_error.dims(0)));
+            running_error = running_error.slice(0, running);
+        }
+        // the first step broadcasts the initial state.
+        for (auto& layer_state : state) {
+            if (layer_state.hidden.dims(0) > running) {
+                layer_state.memory = layer_state.memory.slice(0, running);
+                layer_state.hidden = layer_state.hidden.slice(0, running);
+            }
+        }
+
+        auto input_vector = this->embedding[batch.inputs(timestep, running)];
+
+        state = stacked_lstm.activate(
+            state,
+            input_vector,
+            drop_prob
+        );
+
+        auto target = batch.targets(timestep + temporal_offset, running);
+        if (softmax_offset > 0) {
+            target -= softmax_offset;
+        }
+
+        auto errors = decode_cost(input_vector, state, target,
+                                  batch.masks(timestep + temporal_offset, running));
+
+        running_error += errors;
+    }
+    mpc.stop();
+
+    // sorted order: the examples still running, then those that
+    // finished last.
+    finished_errors.emplace_back(running_error);
+    std::reverse(finished_errors.begin(), finished_errors.end());
+    return batch.unsort(MatOps<Z>::vstack(finished_errors));
+}
+
 // Private method that names the parameters
 // For better debugging and reference
 template<typename Z>
@@ -468,5 +624,13 @@ void StackedModel<Z>::input_vector_to_decoder(bool should_input_feed_to_decoder)
     }
 }
 
+template<typename Z>
+void StackedModel<Z>::sparse_decoder_gradient(bool sparse) {
+    for (auto& matrix : decoder.matrices) {
+        matrix.set_sparse_gradient_columns(sparse);
+    }
+    decoder.b.set_sparse_gradient_columns(sparse);
+}
+
 template class StackedModel<float>;
 template class StackedModel<double>;
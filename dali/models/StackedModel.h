@@ -49,13 +49,16 @@ class StackedModel : public RecurrentEmbeddingModel<Z>, public ReconstructModel
         StackedLSTM<Z> stacked_lstm;
         StackedInputLayer<Z> decoder;
         virtual std::vector<mat> parameters() const;
+        // LSTM parameters are saved in the unfused layout.
+        virtual std::vector<mat> checkpoint_parameters() const;
         /**
         Load
         ----
 
         Load a saved copy of this model from a directory containing the
-        configuration file named "config.md", and from ".npy" saves of
-        the model parameters in the same directory.
+        configuration file named "config.md", and from the checkpoint
+        (see Checkpoint.h) or ".npy" saves of the model parameters in
+        the same directory.
 
         Inputs
         ------
@@ -159,6 +162,60 @@ class StackedModel : public RecurrentEmbeddingModel<Z>, public ReconstructModel
                                    Z drop_prob = 0.0,
                                    int temporal_offset = 0,
                                    uint softmax_offset = 0) const;
+        /**
+        Masked Predict Cost (packed)
+        ----------------------------
+
+        Same cost as for the padded Batch, but each timestep only runs
+        the LSTM, decoder and softmax on the examples whose labels are
+        still to come (see `PackedBatch`), and finished examples drop
+        out of the state.
+
+        Outputs
+        -------
+
+        Mat<Z> total_error : error of each example (one row per
+                             example, in the order of the original batch)
+
+        **/
+        Mat<Z> masked_predict_cost(const PackedBatch<Z>& data,
+                                   Z drop_prob = 0.0,
+                                   int temporal_offset = 0,
+                                   uint softmax_offset = 0) const;
+        /**
+        Masked Sampled Predict Cost
+        ---------------------------
+
+        Training cost for large vocabularies: same as `masked_predict_cost`
+        on a padded Batch, but each prediction is only scored against its
+        target and `num_samples` negatives drawn once per minibatch from
+        `sampler` (shared by every example and timestep), with either a
+        sampled softmax or noise contrastive estimation (`use_nce`).
+        Only the sampled columns of the decoder get gradient (and only
+        they are cleared and updated with `sparse_decoder_gradient`).
+        `masked_predict_cost` remains the exact cost for evaluation.
+
+        Inputs
+        ------
+
+        const UnigramSampler& sampler : distribution over the words of
+                                        the softmax (after softmax_offset)
+                      int num_samples : number of distinct negatives
+                         bool use_nce : NCE instead of sampled softmax
+
+        Outputs
+        -------
+
+        Mat<Z> total_error : error of each example (one row per example)
+
+        **/
+        Mat<Z> masked_sampled_predict_cost(const Batch<Z>& data,
+                                           const utils::UnigramSampler& sampler,
+                                           int num_samples,
+                                           bool use_nce = false,
+                                           Z drop_prob = 0.0,
+                                           int temporal_offset = 0,
+                                           uint softmax_offset = 0) const;
 
 
         virtual std::vector<int> reconstruct(
@@ -203,6 +260,13 @@ class StackedModel : public RecurrentEmbeddingModel<Z>, public ReconstructModel
         const bool& input_vector_to_decoder() const;
         void input_vector_to_decoder(bool should_input_feed_to_decoder);
 
+        // Puts the decoder's weights and bias in sparse gradient mode
+        // over columns (see Mat::set_sparse_gradient_columns), so that
+        // after a `masked_sampled_predict_cost` clearing gradients and
+        // solver steps only touch the sampled words. Gradient from the
+        // full softmax (`masked_predict_cost`) would then be ignored.
+        void sparse_decoder_gradient(bool sparse);
+
         /**
         Shallow Copy
         ------------
@@ -231,6 +295,14 @@ class StackedModel : public RecurrentEmbeddingModel<Z>, public ReconstructModel
         to decoder, and extracting hidden states from LSTM States.
         **/
         mat decode(mat input_vector, state_t& states, Z drop_prob = 0.0) const;
+        // the inputs `decode` gives to the decoder (without dropout).
+        std::vector<mat> decoder_inputs(mat input_vector, state_t& states) const;
+        // masked softmax cross entropy of the decoder's prediction for
+        // `target` (one value per example, like `mask`). Fused with the
+        // decoder (see MatOps::fused_softmax_cross_entropy_rowwise) unless
+        // the decoder is on the GPU, where that op would copy its weights
+        // and gradients to the host and back.
+        mat decode_cost(mat input_vector, state_t& states, Mat<int> target, mat mask) const;
 
         /**
         Decoder initialization
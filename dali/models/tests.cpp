@@ -1,9 +1,12 @@
 #include <vector>
 #include <gtest/gtest.h>
 #include "dali/test_utils.h"
+#include "dali/test_gradients.h"
 #include "dali/models/StackedGatedModel.h"
 #include "dali/core.h"
 
+using std::vector;
+
 typedef double R;
 
 TEST(utils, shallow_copy) {
@@ -59,3 +62,44 @@ TEST(utils, shallow_copy_multi_params) {
     ASSERT_EQ(std::get<1>(copies)[0].size(), 1);
     ASSERT_EQ(std::get<2>(copies)[0].size(), params.size() - 1);
 }
+
+TEST(StackedModel, packed_batch_matches_padded) {
+    int vocab_size = 7,
+        input_size = 3,
+        hidden_size = 4,
+        stack_size = 2,
+        output_size = 7;
+    auto model = StackedModel<R>(vocab_size, input_size, hidden_size, stack_size, output_size, true);
+
+    // language model style batch: predict the next word (temporal
+    // offset 1), examples of very different lengths.
+    vector<int> lengths({3, 8, 1, 5, 8, 2});
+    Batch<R> batch;
+    batch.data = Mat<int>(8, lengths.size());
+    batch.target = batch.data;
+    batch.mask = Mat<R>(8, lengths.size());
+    batch.code_lengths = lengths;
+    batch.total_codes = 0;
+    for (int example = 0; example < lengths.size(); ++example) {
+        for (int timestep = 0; timestep < lengths[example]; ++timestep) {
+            batch.data.w(timestep, example) = utils::randint(0, vocab_size - 1);
+            batch.mask.w(timestep, example) = timestep > 0 ? 1.0 : 0.0;
+            batch.total_codes += timestep > 0;
+        }
+    }
+    PackedBatch<R> packed(batch);
+    ASSERT_EQ(vector<int>({6, 5, 4, 3, 3, 2, 2, 2}), packed.batch_sizes);
+    ASSERT_EQ(vector<int>({1, 4, 3, 0, 5, 2}), packed.order);
+
+    auto params = model.parameters();
+    auto padded_error = model.masked_predict_cost(batch, 0.0, 1);
+    padded_error.grad();
+    graph::backward();
+    auto padded_grads = take_gradients(params);
+
+    auto packed_error = model.masked_predict_cost(packed, 0.0, 1);
+    ASSERT_MATRIX_CLOSE(padded_error, packed_error, 1e-6);
+    packed_error.grad();
+    graph::backward();
+    ASSERT_TRUE(gradients_near(padded_grads, params, (R)1e-6));
+}
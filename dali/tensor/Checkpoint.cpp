@@ -0,0 +1,237 @@
+#include "dali/tensor/Checkpoint.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+#include "dali/tensor/__MatMacros__.h"
+#include "dali/utils/core_utils.h"
+
+using std::string;
+using std::vector;
+
+namespace utils {
+    namespace {
+        const char CHECKPOINT_MAGIC[] = "DALICKPT";
+        // matrices start at a multiple of this many bytes.
+        const size_t CHECKPOINT_ALIGNMENT = 64;
+
+        struct checkpoint_header_t {
+            char magic[8];
+            uint64_t num_matrices;
+            uint64_t word_size;
+        };
+
+        struct checkpoint_entry_t {
+            uint64_t rows;
+            uint64_t cols;
+            uint64_t offset;
+        };
+
+        size_t aligned(size_t offset) {
+            return CHECKPOINT_ALIGNMENT * ((offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT);
+        }
+
+        // the whole checkpoint file for parameters, in memory.
+        template<typename R>
+        vector<char> serialize(const vector<Mat<R>>& parameters) {
+            checkpoint_header_t header;
+            std::memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+            header.num_matrices = parameters.size();
+            header.word_size    = sizeof(R);
+
+            vector<checkpoint_entry_t> index(parameters.size());
+            size_t size = sizeof(header) + index.size() * sizeof(checkpoint_entry_t);
+            for (int i = 0; i < parameters.size(); ++i) {
+                index[i].rows   = parameters[i].dims(0);
+                index[i].cols   = parameters[i].dims(1);
+                index[i].offset = aligned(size);
+                size = index[i].offset + index[i].rows * index[i].cols * sizeof(R);
+            }
+
+            vector<char> data(size, 0);
+            std::memcpy(data.data(), &header, sizeof(header));
+            std::memcpy(data.data() + sizeof(header), index.data(), index.size() * sizeof(checkpoint_entry_t));
+            for (int i = 0; i < parameters.size(); ++i) {
+                if (parameters[i].number_of_elements() == 0) {
+                    continue;
+                }
+                // rows one by one: the parameter may be a slice.
+                auto weights = MAT(parameters[i]).cpu_data();
+                for (int row = 0; row < index[i].rows; ++row) {
+                    std::memcpy(data.data() + index[i].offset + row * index[i].cols * sizeof(R),
+                                weights[row].dptr_,
+                                index[i].cols * sizeof(R));
+                }
+            }
+            return data;
+        }
+
+        // writes size bytes of data to fname + ".tmp" and renames it to fname.
+        void write_atomically(const string& fname, const char* data, size_t size) {
+            const string temporary_fname = fname + ".tmp";
+            FILE* fp = fopen(temporary_fname.c_str(), "wb");
+            ASSERT2(fp != NULL, MS() << "Cannot write checkpoint " << temporary_fname);
+            bool written = fwrite(data, 1, size, fp) == size;
+            written = fflush(fp) == 0 && written;
+            // on disk before the rename makes it visible.
+            written = fsync(fileno(fp)) == 0 && written;
+            written = fclose(fp) == 0 && written;
+            ASSERT2(written, MS() << "Could not write checkpoint " << temporary_fname);
+            ASSERT2(std::rename(temporary_fname.c_str(), fname.c_str()) == 0,
+                MS() << "Could not move checkpoint " << temporary_fname << " to " << fname);
+        }
+
+        void write_atomically(const string& fname, const vector<char>& data) {
+            write_atomically(fname, data.data(), data.size());
+        }
+
+        template<typename R, typename Stored>
+        void copy_matrix(const char* stored, Mat<R>& parameter) {
+            auto weights = MAT(parameter).mutable_cpu_data();
+            const int rows = parameter.dims(0);
+            const int cols = parameter.dims(1);
+            for (int row = 0; row < rows; ++row) {
+                const Stored* source = reinterpret_cast<const Stored*>(stored) + (size_t)row * cols;
+                std::copy(source, source + cols, weights[row].dptr_);
+            }
+        }
+    }
+
+    template<typename R>
+    void save_checkpoint(const vector<Mat<R>>& parameters, const string& fname) {
+        write_atomically(fname, serialize(parameters));
+    }
+
+    template<typename R>
+    void load_checkpoint(vector<Mat<R>> parameters, const string& fname) {
+        ASSERT2(file_exists(fname), MS() << "Cannot open checkpoint " << fname);
+        MappedFile file(fname);
+        checkpoint_header_t header;
+        ASSERT2(file.size >= sizeof(header) && std::memcmp(file.data, CHECKPOINT_MAGIC, 8) == 0,
+            MS() << fname << " is not a checkpoint.");
+        std::memcpy(&header, file.data, sizeof(header));
+        ASSERT2(header.num_matrices == parameters.size(),
+            MS() << "Checkpoint " << fname << " has " << header.num_matrices
+                 << " matrices but " << parameters.size() << " were expected.");
+        ASSERT2(header.word_size == sizeof(float) || header.word_size == sizeof(double),
+            MS() << "Checkpoint " << fname << " holds numbers of unknown size " << header.word_size);
+        ASSERT2(file.size >= sizeof(header) + header.num_matrices * sizeof(checkpoint_entry_t),
+            MS() << "Checkpoint " << fname << " is truncated.");
+
+        auto index = reinterpret_cast<const checkpoint_entry_t*>(file.data + sizeof(header));
+        for (int i = 0; i < parameters.size(); ++i) {
+            ASSERT2(index[i].rows == parameters[i].dims(0) && index[i].cols == parameters[i].dims(1),
+                MS() << "Matrix " << i << " of checkpoint " << fname << " is "
+                     << index[i].rows << "x" << index[i].cols << " but parameter is "
+                     << parameters[i].dims(0) << "x" << parameters[i].dims(1));
+            ASSERT2(index[i].offset + index[i].rows * index[i].cols * header.word_size <= file.size,
+                MS() << "Checkpoint " << fname << " is truncated.");
+            if (parameters[i].number_of_elements() == 0) {
+                continue;
+            }
+            if (header.word_size == sizeof(float)) {
+                copy_matrix<R, float>(file.data + index[i].offset, parameters[i]);
+            } else {
+                copy_matrix<R, double>(file.data + index[i].offset, parameters[i]);
+            }
+        }
+    }
+
+    CheckpointSaver::CheckpointSaver() :
+            writing(false),
+            should_terminate(false),
+            writer(&CheckpointSaver::writer_body, this) {
+    }
+
+    CheckpointSaver::~CheckpointSaver() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            should_terminate = true;
+        }
+        changed.notify_all();
+        writer.join();
+        // nobody is left to rethrow it to.
+        if (error != nullptr) {
+            try {
+                std::rethrow_exception(error);
+            } catch (const std::exception& e) {
+                std::cerr << "CheckpointSaver: a checkpoint could not be written: "
+                          << e.what() << std::endl;
+            } catch (...) {
+                std::cerr << "CheckpointSaver: a checkpoint could not be written." << std::endl;
+            }
+        }
+    }
+
+    void CheckpointSaver::writer_body() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [this]() {
+                return should_terminate || !pending.empty();
+            });
+            if (pending.empty()) {
+                // should_terminate, and everything is written.
+                return;
+            }
+            Snapshot snapshot = std::move(pending.front());
+            pending.pop_front();
+            writing = true;
+            lock.unlock();
+            try {
+                for (auto& file : snapshot.files) {
+                    write_atomically(file.first, file.second.data(), file.second.size());
+                }
+                write_atomically(snapshot.fname, snapshot.data);
+            } catch (...) {
+                lock.lock();
+                error = std::current_exception();
+                lock.unlock();
+            }
+            lock.lock();
+            writing = false;
+            changed.notify_all();
+        }
+    }
+
+    void CheckpointSaver::rethrow_error() {
+        if (error != nullptr) {
+            auto rethrown = error;
+            error = nullptr;
+            std::rethrow_exception(rethrown);
+        }
+    }
+
+    template<typename R>
+    void CheckpointSaver::save(const vector<Mat<R>>& parameters, const string& fname,
+                               const vector<std::pair<string, string>>& files) {
+        // the copy is made on the calling thread, so that training
+        // can change the weights as soon as this returns.
+        Snapshot snapshot;
+        snapshot.fname = fname;
+        snapshot.data  = serialize(parameters);
+        snapshot.files = files;
+        std::lock_guard<std::mutex> lock(mutex);
+        rethrow_error();
+        pending.emplace_back(std::move(snapshot));
+        changed.notify_all();
+    }
+
+    void CheckpointSaver::wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() {
+            return pending.empty() && !writing;
+        });
+        rethrow_error();
+    }
+
+    template void save_checkpoint(const vector<Mat<float>>&, const string&);
+    template void save_checkpoint(const vector<Mat<double>>&, const string&);
+    template void load_checkpoint(vector<Mat<float>>, const string&);
+    template void load_checkpoint(vector<Mat<double>>, const string&);
+    template void CheckpointSaver::save(const vector<Mat<float>>&, const string&, const vector<std::pair<string, string>>&);
+    template void CheckpointSaver::save(const vector<Mat<double>>&, const string&, const vector<std::pair<string, string>>&);
+}
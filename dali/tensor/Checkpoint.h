@@ -0,0 +1,102 @@
+#ifndef DALI_TENSOR_CHECKPOINT_H
+#define DALI_TENSOR_CHECKPOINT_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dali/tensor/Mat.h"
+
+/*
+Checkpoints
+-----------
+
+All the parameters of a model in a single file:
+
+    "DALICKPT"                     8 byte magic
+    num_matrices, word_size        uint64 each (word_size is the size
+                                   of a float or double)
+    rows, cols, offset             uint64 each, for every matrix
+    data                           each matrix row major at its
+                                   offset (a multiple of 64 bytes)
+
+Integers and numbers are stored in the machine's byte order. Files
+are always written next to their destination and renamed into place,
+so a checkpoint is either the previous one or the new one, never half
+written. Loading maps the file and copies every matrix straight into
+the memory of the parameters.
+*/
+namespace utils {
+    // name of the checkpoint in a model's directory.
+    const std::string CHECKPOINT_FNAME = "parameters.ckpt";
+
+    // Writes the weights of parameters to fname.
+    template<typename R>
+    void save_checkpoint(const std::vector<Mat<R>>& parameters, const std::string& fname);
+
+    // Reads the weights of parameters (which must have the shapes
+    // they were saved with) from fname, in place: every copy of the
+    // parameters sees the loaded weights.
+    template<typename R>
+    void load_checkpoint(std::vector<Mat<R>> parameters, const std::string& fname);
+
+    /*
+    Checkpoint Saver
+    ----------------
+
+    Saves checkpoints without pausing training: `save` copies the
+    weights to a staging buffer and returns, and the file is written
+    by a background thread. Errors of the background thread are
+    rethrown by the next call to `save` or `wait` (or reported on
+    std::cerr if the saver is destroyed first).
+
+        static utils::CheckpointSaver saver;
+        ...
+        saver.save(model.parameters(), "model/parameters.ckpt");
+    */
+    class CheckpointSaver {
+        private:
+            struct Snapshot {
+                std::string fname;
+                std::vector<char> data;
+                // (fname, contents) of the files saved with it.
+                std::vector<std::pair<std::string, std::string>> files;
+            };
+
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::deque<Snapshot> pending;
+            bool writing;
+            bool should_terminate;
+            std::exception_ptr error;
+            std::thread writer;
+
+            void writer_body();
+            void rethrow_error();
+
+            CheckpointSaver(const CheckpointSaver&) = delete;
+            CheckpointSaver& operator=(const CheckpointSaver&) = delete;
+        public:
+            CheckpointSaver();
+            // writes the pending checkpoints before returning.
+            ~CheckpointSaver();
+
+            // `files` are (fname, contents) pairs that belong with the
+            // checkpoint (e.g. the model's configuration): each one is
+            // written atomically before the checkpoint itself, so a
+            // checkpoint on disk always comes with its files.
+            template<typename R>
+            void save(const std::vector<Mat<R>>& parameters, const std::string& fname,
+                      const std::vector<std::pair<std::string, std::string>>& files =
+                            std::vector<std::pair<std::string, std::string>>());
+            // Returns once every checkpoint saved so far is written.
+            void wait();
+    };
+}
+
+#endif
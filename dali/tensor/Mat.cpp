@@ -1,5 +1,12 @@
 #include "dali/tensor/Mat.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "dali/math/CpuThreading.h"
+#include "dali/tensor/Checkpoint.h"
 #include "dali/tensor/Index.h"
+#include "dali/tensor/__MatMacros__.h"
 
 using std::vector;
 using std::string;
@@ -9,6 +16,35 @@ using std::make_shared;
 
 const vector<dim_t> mat_missing_dimensions({0,0});
 
+/* TouchedRows */
+TouchedRows::TouchedRows(bool _columns) : is_unique(true), columns(_columns) {
+}
+
+void TouchedRows::touch(int row) {
+    if (!rows.empty() && rows.back() >= row) {
+        is_unique = false;
+    }
+    rows.emplace_back(row);
+}
+
+void TouchedRows::clear() {
+    rows.clear();
+    is_unique = true;
+}
+
+bool TouchedRows::empty() const {
+    return rows.empty();
+}
+
+const vector<int>& TouchedRows::unique() {
+    if (!is_unique) {
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+        is_unique = true;
+    }
+    return rows;
+}
+
 /* Mat */
 // this does not need to initialize anything once we get rid of w and dw.
 template<typename R>
@@ -188,8 +224,12 @@ Mat<R>::Mat(const Mat<R>& other, bool copy_w, bool copy_dw) :
     if (copy_dw && other.g != nullptr) {
         // see comment for copy_w.
         g = make_shared<TensorInternal<R,2>>(*other.g, true);
+        if (other.touched != nullptr) {
+            touched = make_shared<TouchedRows>(*other.touched);
+        }
     } else {
         g = other.g;
+        touched = other.touched;
     }
 }
 
@@ -243,7 +283,82 @@ void Mat<R>::grad() {
 
 template<typename R>
 void Mat<R>::clear_grad() {
-    dw().clear();
+    if (touched != nullptr) {
+        // not GPU friendly.
+        auto grad = dw().mutable_cpu_data();
+        if (touched->columns) {
+            for (int row = 0; row < dims(0); ++row) {
+                for (auto col : touched->unique()) {
+                    grad.dptr_[row * grad.stride_ + col] = 0.0;
+                }
+            }
+        } else {
+            for (auto row : touched->unique()) {
+                std::fill(grad.dptr_ + row * grad.stride_,
+                          grad.dptr_ + row * grad.stride_ + dims(1),
+                          (R)0.0);
+            }
+        }
+        touched->clear();
+    } else {
+        dw().clear();
+    }
+}
+
+template<typename R>
+void Mat<R>::set_sparse_gradient(bool sparse) {
+    if (sparse && (touched == nullptr || touched->columns)) {
+        // rows written before now are unknown: start from zero.
+        dw().clear();
+        touched = make_shared<TouchedRows>();
+    } else if (!sparse) {
+        touched = nullptr;
+    }
+}
+
+template<typename R>
+void Mat<R>::set_sparse_gradient_columns(bool sparse) {
+    if (sparse && (touched == nullptr || !touched->columns)) {
+        // columns written before now are unknown: start from zero.
+        dw().clear();
+        touched = make_shared<TouchedRows>(true);
+    } else if (!sparse) {
+        touched = nullptr;
+    }
+}
+
+template<typename R>
+bool Mat<R>::sparse_gradient() const {
+    return touched != nullptr;
+}
+
+template<typename R>
+bool Mat<R>::sparse_gradient_columns() const {
+    return touched != nullptr && touched->columns;
+}
+
+template<typename R>
+void Mat<R>::touch_row(int row) const {
+    if (touched != nullptr) {
+        ASSERT2(!touched->columns,
+            "Rows of a matrix in sparse gradient mode over columns cannot be plucked.");
+        touched->touch(row);
+    }
+}
+
+template<typename R>
+void Mat<R>::touch_column(int col) const {
+    if (touched != nullptr) {
+        ASSERT2(touched->columns,
+            "Columns of a matrix in sparse gradient mode over rows cannot be looked up.");
+        touched->touch(col);
+    }
+}
+
+template<typename R>
+const vector<int>& Mat<R>::touched_rows() const {
+    ASSERT2(touched != nullptr, "touched_rows is only available in sparse gradient mode.");
+    return touched->unique();
 }
 
 template<typename R>
@@ -423,51 +538,91 @@ void Mat<R>::npy_save (FILE * fp) {
     fwrite(w().data(),sizeof(R), number_of_elements(), fp);
 }
 
+namespace {
+    // fortran ordered arrays are transposed one tile at a time, so
+    // that both the rows read and the rows written stay in cache.
+    const int NPY_TRANSPOSE_TILE = 32;
+
+    // copies the n x d array at `stored` into the row major `dst`,
+    // converting each number from Stored to R.
+    template<typename R, typename Stored>
+    void copy_npy_data(const char* stored, R* dst, int n, int d, bool fortran_order) {
+        const size_t size = (size_t)n * d;
+        // arrays inside of npz files need not be aligned.
+        vector<Stored> aligned_copy;
+        if (reinterpret_cast<uintptr_t>(stored) % alignof(Stored) != 0) {
+            aligned_copy.resize(size);
+            std::memcpy(aligned_copy.data(), stored, size * sizeof(Stored));
+            stored = reinterpret_cast<const char*>(aligned_copy.data());
+        }
+        const Stored* source = reinterpret_cast<const Stored*>(stored);
+        auto copy_rows = [source, dst, n, d, fortran_order](int first, int last) {
+            if (!fortran_order) {
+                // a memcpy, or a vectorized conversion.
+                std::copy(source + (size_t)first * d, source + (size_t)last * d, dst + (size_t)first * d);
+                return;
+            }
+            for (int row_tile = first; row_tile < last; row_tile += NPY_TRANSPOSE_TILE) {
+                const int row_end = std::min(last, row_tile + NPY_TRANSPOSE_TILE);
+                for (int col_tile = 0; col_tile < d; col_tile += NPY_TRANSPOSE_TILE) {
+                    const int col_end = std::min(d, col_tile + NPY_TRANSPOSE_TILE);
+                    for (int row = row_tile; row < row_end; ++row) {
+                        for (int col = col_tile; col < col_end; ++col) {
+                            dst[(size_t)row * d + col] = source[(size_t)col * n + row];
+                        }
+                    }
+                }
+            }
+        };
+        if (cpu_threading::should_parallelize(size)) {
+            cpu_threading::parallel_for(0, n, NPY_TRANSPOSE_TILE, copy_rows);
+        } else {
+            copy_rows(0, n);
+        }
+    }
+}
+
 template<typename R>
 void Mat<R>::npy_load(cnpy::NpyArray& arr) {
     int n = arr.shape[0];
     int d = arr.shape.size() > 1 ? arr.shape[1] : 1;
+    const bool is_float   = arr.type == 'f' && (arr.word_size == sizeof(double) || arr.word_size == sizeof(float));
+    const bool is_integer = (arr.type == 'i' || arr.type == 'u') &&
+                            (arr.word_size == sizeof(int64_t) || arr.word_size == sizeof(int32_t));
+    ASSERT2(is_float || is_integer,
+        MS() << "Could not load numpy matrix : dtype '" << arr.type << arr.word_size
+             << "' not recognized as float, double or integer.");
 
     g = make_shared<storage_t>(mshadow::Shape2(n,d));
     g->clear();
 
     m = make_shared<storage_t>(mshadow::Shape2(n,d));
-    auto mut_data = w().mutable_cpu_data();
-    R* data_ptr = mut_data.dptr_;
-
-    if (arr.word_size == sizeof(double)) {
-        double* loaded_data = reinterpret_cast<double*>(arr.data);
-        if (arr.fortran_order) {
-            for (int i = 0; i < dims(0); i++) {
-                for (int j = 0; j < dims(1); j++) {
-                    mut_data[i][j] = loaded_data[j * dims(0) + i];
-                }
-            }
-        } else {
-            for (int i = 0; i < dims(0); i++) {
-                for (int j = 0; j < dims(1); j++) {
-                    mut_data[i][j] = loaded_data[i * dims(1) + j];
-                }
-            }
-        }
-    } else if (arr.word_size == sizeof(float)) {
-        float* loaded_data = reinterpret_cast<float*>(arr.data);
-        if (arr.fortran_order) {
-            for (int i = 0; i < dims(0); i++) {
-                for (int j = 0; j < dims(1); j++) {
-                    mut_data[i][j] = loaded_data[j * dims(0) + i];
-                }
-            }
-        } else {
-            for (int i = 0; i < dims(0); i++) {
-                for (int j = 0; j < dims(1); j++) {
-                    mut_data[i][j] = loaded_data[i * dims(1) + j];
-                }
-            }
-        }
+    // vectors are the same in both orders.
+    bool fortran_order = arr.fortran_order && n > 1 && d > 1;
+
+    // mapped arrays (see cnpy::npy_load) that already hold numbers of
+    // type R laid out like the weights become their memory, without
+    // a copy.
+    if (arr.mapping != nullptr && !fortran_order &&
+            arr.type == cnpy::map_type(typeid(R)) && arr.word_size == sizeof(R) &&
+            reinterpret_cast<uintptr_t>(arr.data) % alignof(R) == 0) {
+        w().memory().adopt_cpu(reinterpret_cast<R*>(arr.data), arr.mapping);
+        return;
+    }
+
+    R* data_ptr = w().overwrite_cpu_data().dptr_;
+    if (is_float && arr.word_size == sizeof(double)) {
+        copy_npy_data<R, double>(arr.data, data_ptr, n, d, fortran_order);
+    } else if (is_float) {
+        copy_npy_data<R, float>(arr.data, data_ptr, n, d, fortran_order);
+    } else if (arr.type == 'i' && arr.word_size == sizeof(int64_t)) {
+        copy_npy_data<R, int64_t>(arr.data, data_ptr, n, d, fortran_order);
+    } else if (arr.type == 'i') {
+        copy_npy_data<R, int32_t>(arr.data, data_ptr, n, d, fortran_order);
+    } else if (arr.word_size == sizeof(uint64_t)) {
+        copy_npy_data<R, uint64_t>(arr.data, data_ptr, n, d, fortran_order);
     } else {
-        ASSERT2(arr.word_size == sizeof(double) || arr.word_size == sizeof(float),
-            "Could not load numpy matrix : not recognized as float or double.");
+        copy_npy_data<R, uint32_t>(arr.data, data_ptr, n, d, fortran_order);
     }
 }
 
@@ -796,6 +951,11 @@ namespace utils {
     template<typename R>
     void load_matrices(vector<Mat<R>> parameters, string dirname) {
         utils::ensure_directory(dirname);
+        // models saved as a single checkpoint (see Checkpoint.h).
+        if (utils::file_exists(dirname + CHECKPOINT_FNAME)) {
+            load_checkpoint(parameters, dirname + CHECKPOINT_FNAME);
+            return;
+        }
         int i = 0;
         for (auto& param : parameters) {
             stringstream param_location;
@@ -839,6 +999,36 @@ namespace utils {
 
 }
 
+namespace graph {
+    template<typename R>
+    Dependencies gradient_dependencies(const vector<Mat<R>>& reads,
+                                       const vector<Mat<R>>& writes) {
+        Dependencies deps;
+        for (auto& mat : reads) {
+            deps.reads.emplace_back(GRAD_HANDLE(mat));
+        }
+        for (auto& mat : writes) {
+            if (!mat.constant) {
+                deps.writes.emplace_back(GRAD_HANDLE(mat));
+            }
+        }
+        return deps;
+    }
+
+    template Dependencies gradient_dependencies(const vector<Mat<float>>&, const vector<Mat<float>>&);
+    template Dependencies gradient_dependencies(const vector<Mat<double>>&, const vector<Mat<double>>&);
+    template Dependencies gradient_dependencies(const vector<Mat<int>>&, const vector<Mat<int>>&);
+
+    template<typename R>
+    void backward(const Mat<R>& loss) {
+        backward(vector<const void*>({GRAD_HANDLE(loss)}));
+    }
+
+    template void backward(const Mat<float>&);
+    template void backward(const Mat<double>&);
+    template void backward(const Mat<int>&);
+}
+
 template class weights<float>;
 template class weights<double>;
 template class Mat<float>;
@@ -28,6 +28,31 @@ namespace Indexing {
 
 template<typename R>
 struct weights;
+
+/*
+TouchedRows
+-----------
+
+Rows of a gradient that may be non-zero, for matrices in
+sparse gradient mode (see `Mat::set_sparse_gradient`), or
+columns for matrices in sparse gradient mode over columns
+(see `Mat::set_sparse_gradient_columns`).
+*/
+class TouchedRows {
+    private:
+        std::vector<int> rows;
+        bool is_unique;
+    public:
+        // whether the rows recorded are columns of the gradient.
+        const bool columns;
+        explicit TouchedRows(bool columns = false);
+        void touch(int row);
+        void clear();
+        bool empty() const;
+        // sorted touched rows, without duplicates.
+        const std::vector<int>& unique();
+};
+
 /**
 Mat
 ---
@@ -63,6 +88,9 @@ class Mat {
     private:
         storage_ref_t m;
         mutable storage_ref_t g;
+        // rows (or columns) of `g` written since it was last
+        // cleared (NULL unless in sparse gradient mode).
+        std::shared_ptr<TouchedRows> touched;
     public:
 
         std::shared_ptr<std::string> name = nullptr;
@@ -111,6 +139,31 @@ class Mat {
         void clear_grad();
         void clear();
 
+        /*
+        Sparse gradient mode, for matrices that only receive
+        gradient through `rows_pluck` and `row_pluck` (e.g.
+        embeddings): the plucked rows are recorded, solvers only
+        update those rows and `clear_grad` only zeros them.
+        Gradient written to other rows is never seen nor cleared.
+        */
+        void set_sparse_gradient(bool sparse);
+        // Same over columns, for matrices whose columns are looked up
+        // (e.g. the weights and bias of a decoder, whose columns are
+        // words, under a sampled softmax): the columns recorded with
+        // `touch_column` take the place of the touched rows.
+        void set_sparse_gradient_columns(bool sparse);
+        // whether in sparse gradient mode (over rows or columns).
+        bool sparse_gradient() const;
+        bool sparse_gradient_columns() const;
+        // records that gradient may be written to `row` (no-op
+        // outside of sparse gradient mode).
+        void touch_row(int row) const;
+        // same for `col` in sparse gradient mode over columns.
+        void touch_column(int col) const;
+        // rows (columns in sparse gradient mode over columns) that
+        // may have non-zero gradient.
+        const std::vector<int>& touched_rows() const;
+
         const storage_t& w() const;
         storage_t& w();
 
@@ -142,6 +195,9 @@ class Mat {
 
         void npy_save(std::string fname, std::string mode = "w");
         void npy_save(FILE*);
+        // Files are memory mapped: a C ordered array with the same
+        // number type as the matrix becomes its memory (copy on write),
+        // anything else is converted.
         void npy_load(std::string fname);
         void npy_load(FILE*);
         void npy_load(cnpy::NpyArray&);
@@ -278,6 +334,23 @@ Mat<R> operator*(double other, Mat<R> mat);
 template<typename R>
 std::ostream& operator<<(std::ostream&, const Mat<R>&);
 
+namespace graph {
+    // Dependencies of a closure reading the gradients of `reads` and
+    // accumulating into the gradients of `writes` (constant
+    // matrices are skipped):
+    //
+    //     graph::emplace_back([matrix, out]() mutable {...},
+    //         graph::gradient_dependencies<R>({out}, {matrix}));
+    template<typename R>
+    Dependencies gradient_dependencies(const std::vector<Mat<R>>& reads,
+                                       const std::vector<Mat<R>>& writes);
+
+    // Backpropagate only the nodes that `loss` depends on (the
+    // gradient of `loss` must already be set, e.g. with `grad()`).
+    template<typename R>
+    void backward(const Mat<R>& loss);
+}
+
 // define hash code for matrices:
 namespace std {
     template <typename R> struct hash<Mat<R>> {
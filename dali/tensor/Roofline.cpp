@@ -0,0 +1,174 @@
+#include "dali/tensor/Roofline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "dali/math/CpuThreading.h"
+#include "dali/tensor/Mat.h"
+#include "dali/tensor/MatOps.h"
+#include "dali/tensor/Tape.h"
+#include "dali/utils/assert2.h"
+#include "dali/utils/core_utils.h"
+
+using std::string;
+using std::vector;
+
+namespace utils {
+    namespace {
+        typedef std::chrono::steady_clock clock_t;
+
+        double seconds_since(const clock_t::time_point& start) {
+            return std::chrono::duration<double>(clock_t::now() - start).count();
+        }
+
+        // dimensions up to the last one that is set, e.g. "128x512".
+        string format_shape(const profiler::op_shape_t& shape) {
+            int last = shape.size() - 1;
+            while (last > 0 && shape[last] == 0) {
+                --last;
+            }
+            std::stringstream ss;
+            for (int i = 0; i <= last; ++i) {
+                ss << (i > 0 ? "x" : "") << shape[i];
+            }
+            return ss.str();
+        }
+    }
+
+    double MachinePeak::ridge() const {
+        return gflops_per_second / gbytes_per_second;
+    }
+
+    double MachinePeak::attainable_gflops_per_second(double intensity) const {
+        return std::min(gflops_per_second, intensity * gbytes_per_second);
+    }
+
+    template<typename R>
+    MachinePeak measure_machine_peak(int size, int repeats) {
+        ASSERT2(size > 0 && repeats > 0,
+            MS() << "Machine peak needs a positive size and number of repeats (got "
+                 << size << " and " << repeats << ")");
+        // the measurement itself is not part of any model.
+        const bool was_counting = profiler::counting_ops();
+        profiler::count_ops(false);
+        graph::NoBackprop nb;
+
+        MachinePeak peak{0.0, 0.0};
+        Mat<R> a(size, size, weights<R>::uniform(1.0));
+        Mat<R> b(size, size, weights<R>::uniform(1.0));
+        // warms up the BLAS and its threads.
+        MatOps<R>::mul(a, b);
+        for (int repeat = 0; repeat < repeats; ++repeat) {
+            auto start = clock_t::now();
+            auto c = MatOps<R>::mul(a, b);
+            const double elapsed = seconds_since(start);
+            peak.gflops_per_second = std::max(peak.gflops_per_second,
+                2.0 * size * size * size / elapsed / 1e9);
+        }
+
+        // 3 x 32MB of floats: well past the last level cache.
+        const int stream_size = 1 << 23;
+        vector<R> x(stream_size, (R)1), y(stream_size, (R)2), z(stream_size, (R)0);
+        for (int repeat = 0; repeat <= repeats; ++repeat) {
+            auto start = clock_t::now();
+            cpu_threading::parallel_for(0, stream_size, cpu_threading::grain_size(stream_size),
+                [&x, &y, &z](int begin, int end) {
+                    for (int i = begin; i < end; ++i) {
+                        z[i] = x[i] + (R)3 * y[i];
+                    }
+                });
+            const double elapsed = seconds_since(start);
+            // the first run pages the buffers in.
+            if (repeat > 0) {
+                peak.gbytes_per_second = std::max(peak.gbytes_per_second,
+                    3.0 * stream_size * sizeof(R) / elapsed / 1e9);
+            }
+        }
+        profiler::count_ops(was_counting);
+        return peak;
+    }
+
+    vector<OpRoofline> roofline(const MachinePeak& peak) {
+        vector<OpRoofline> ops;
+        for (auto& op : profiler::op_summary()) {
+            const double seconds = std::max(op.total_ns, (int64_t)1) / 1e9;
+            const double bytes   = op.work.bytes_read + op.work.bytes_written;
+            OpRoofline entry;
+            entry.op                = op;
+            entry.gflops_per_second = op.work.flops / seconds / 1e9;
+            entry.gbytes_per_second = bytes / seconds / 1e9;
+            entry.intensity         = bytes > 0 ? op.work.flops / bytes : 0.0;
+            entry.memory_bound      = entry.intensity < peak.ridge();
+            if (op.work.flops > 0) {
+                entry.efficiency = entry.gflops_per_second /
+                    peak.attainable_gflops_per_second(entry.intensity);
+            } else {
+                entry.efficiency = entry.gbytes_per_second / peak.gbytes_per_second;
+            }
+            ops.emplace_back(entry);
+        }
+        return ops;
+    }
+
+    void roofline_report(const MachinePeak& peak, std::ostream& stream) {
+        auto ops = roofline(peak);
+        stream << std::fixed << std::setprecision(2) << std::setfill(' ')
+               << "machine peak: " << peak.gflops_per_second << " GFLOP/s, "
+               << peak.gbytes_per_second << " GB/s (ridge at "
+               << peak.ridge() << " FLOP/byte)" << std::endl;
+        stream << std::left  << std::setw(32) << "op"
+               << std::right << std::setw(6)  << "pass"
+               << std::setw(10) << "calls"
+               << std::setw(10) << "time s"
+               << std::setw(11) << "GFLOP/s"
+               << std::setw(9)  << "GB/s"
+               << std::setw(10) << "FLOP/B"
+               << std::setw(9)  << "bound"
+               << std::setw(10) << "% roof"
+               << "  shape" << std::endl;
+        for (auto& entry : ops) {
+            stream << std::left  << std::setw(32) << entry.op.name
+                   << std::right << std::setw(6)
+                   << (entry.op.direction == profiler::FORWARD ? "fwd" : "bwd")
+                   << std::setw(10) << entry.op.calls
+                   << std::setw(10) << std::setprecision(4) << entry.op.total_ns / 1e9
+                   << std::setprecision(2)
+                   << std::setw(11) << entry.gflops_per_second
+                   << std::setw(9)  << entry.gbytes_per_second
+                   << std::setw(10) << entry.intensity
+                   << std::setw(9)  << (entry.memory_bound ? "memory" : "compute")
+                   << std::setw(10) << 100.0 * entry.efficiency
+                   << "  " << format_shape(entry.op.shape)
+                   << " (" << entry.op.shape_calls << " calls)" << std::endl;
+        }
+        // totals of the forward, backward and both.
+        for (int direction = profiler::FORWARD; direction <= profiler::BACKWARD + 1; ++direction) {
+            double flops = 0.0, bytes = 0.0, seconds = 0.0;
+            for (auto& entry : ops) {
+                if (direction <= profiler::BACKWARD && entry.op.direction != direction) {
+                    continue;
+                }
+                flops   += entry.op.work.flops;
+                bytes   += entry.op.work.bytes_read + entry.op.work.bytes_written;
+                seconds += entry.op.total_ns / 1e9;
+            }
+            if (seconds == 0.0) {
+                continue;
+            }
+            stream << (direction == profiler::FORWARD ? "forward" :
+                       direction == profiler::BACKWARD ? "backward" : "total")
+                   << ": " << std::setprecision(4) << seconds << "s, " << std::setprecision(2)
+                   << flops / seconds / 1e9 << " GFLOP/s ("
+                   << 100.0 * flops / seconds / 1e9 / peak.gflops_per_second << "% of peak), "
+                   << bytes / seconds / 1e9 << " GB/s ("
+                   << 100.0 * bytes / seconds / 1e9 / peak.gbytes_per_second << "% of peak)"
+                   << std::endl;
+        }
+    }
+
+    template MachinePeak measure_machine_peak<float>(int, int);
+    template MachinePeak measure_machine_peak<double>(int, int);
+}
@@ -0,0 +1,66 @@
+#ifndef DALI_TENSOR_ROOFLINE_H
+#define DALI_TENSOR_ROOFLINE_H
+
+#include <iostream>
+#include <vector>
+
+#include "dali/utils/Profiler.h"
+
+/*
+Roofline
+--------
+
+Compares the work counted for each op (see `utils::profiler::
+count_ops`) with what the machine can do: an op doing F FLOPs on
+B bytes (an arithmetic intensity of F / B) cannot run faster than
+
+    min(peak GFLOP/s, F / B * peak GB/s)
+
+so ops below the ridge (peak GFLOP/s / peak GB/s) are bound by
+memory, and ops above it by compute. FLOPs and bytes are analytic
+estimates for each op (operands read once, results written once),
+not hardware counters.
+
+    auto peak = utils::measure_machine_peak<REAL_t>();
+    utils::profiler::count_ops();
+    ... train an epoch ...
+    utils::roofline_report(peak);
+    utils::profiler::clear();
+*/
+namespace utils {
+    struct MachinePeak {
+        double gflops_per_second;
+        double gbytes_per_second;
+        // arithmetic intensity (FLOP/byte) where ops become compute bound.
+        double ridge() const;
+        // best GFLOP/s reachable at `intensity`.
+        double attainable_gflops_per_second(double intensity) const;
+    };
+
+    // best of `repeats` runs of a `size` x `size` matrix product (the
+    // same one MatOps::mul uses) for FLOP/s, and of a threaded stream
+    // triad over buffers much larger than caches for bytes/s.
+    template<typename R>
+    MachinePeak measure_machine_peak(int size = 1024, int repeats = 3);
+
+    struct OpRoofline {
+        profiler::OpSummary op;
+        double gflops_per_second;
+        double gbytes_per_second;
+        // FLOP per byte moved.
+        double intensity;
+        bool memory_bound;
+        // achieved fraction of the roofline at the op's intensity (of
+        // the peak bandwidth for ops that do no FLOPs).
+        double efficiency;
+    };
+
+    // the counted ops against `peak`, by decreasing total time.
+    std::vector<OpRoofline> roofline(const MachinePeak& peak);
+    // per op and direction: calls, time, achieved GFLOP/s and GB/s,
+    // intensity, bound and efficiency, then totals for forward,
+    // backward and both.
+    void roofline_report(const MachinePeak& peak, std::ostream& stream = std::cout);
+}
+
+#endif
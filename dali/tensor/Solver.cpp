@@ -1,4 +1,6 @@
 #include "dali/tensor/Solver.h"
+
+#include "dali/math/CpuThreading.h"
 #include "dali/tensor/__MatMacros__.h"
 
 
@@ -48,12 +50,191 @@ namespace Solver {
     }
 
 
+    /* Sparse gradients */
+
+    template<typename R>
+    void gather_rows(const TensorInternal<R,2>& full,
+                     const vector<int>& rows,
+                     TensorInternal<R,2>& compact) {
+        // not GPU friendly.
+        auto source = full.cpu_data();
+        auto dest   = compact.overwrite_cpu_data();
+        for (int i = 0; i < rows.size(); ++i) {
+            std::copy(source.dptr_ + rows[i] * source.stride_,
+                      source.dptr_ + rows[i] * source.stride_ + full.shape[1],
+                      dest.dptr_ + i * dest.stride_);
+        }
+    }
+
+    template<typename R>
+    void scatter_rows(const TensorInternal<R,2>& compact,
+                      const vector<int>& rows,
+                      TensorInternal<R,2>& full) {
+        // not GPU friendly.
+        auto source = compact.cpu_data();
+        auto dest   = full.mutable_cpu_data();
+        for (int i = 0; i < rows.size(); ++i) {
+            std::copy(source.dptr_ + i * source.stride_,
+                      source.dptr_ + i * source.stride_ + full.shape[1],
+                      dest.dptr_ + rows[i] * dest.stride_);
+        }
+    }
+
+    template<typename R>
+    void gather_columns(const TensorInternal<R,2>& full,
+                        const vector<int>& columns,
+                        TensorInternal<R,2>& compact) {
+        // not GPU friendly.
+        auto source = full.cpu_data();
+        auto dest   = compact.overwrite_cpu_data();
+        for (int row = 0; row < full.shape[0]; ++row) {
+            for (int i = 0; i < columns.size(); ++i) {
+                dest[row][i] = source[row][columns[i]];
+            }
+        }
+    }
+
+    template<typename R>
+    void scatter_columns(const TensorInternal<R,2>& compact,
+                         const vector<int>& columns,
+                         TensorInternal<R,2>& full) {
+        // not GPU friendly.
+        auto source = compact.cpu_data();
+        auto dest   = full.mutable_cpu_data();
+        for (int row = 0; row < full.shape[0]; ++row) {
+            for (int i = 0; i < columns.size(); ++i) {
+                dest[row][columns[i]] = source[row][i];
+            }
+        }
+    }
+
+    // Applies the update rule `update` to `param` and its `caches`,
+    // then clears the gradient. For sparse gradient parameters the
+    // rule runs on compact copies of the touched rows (or columns)
+    // only. Rows of cache i skipped since their last update
+    // (`last_step`) are first decayed by `decays[i]` once per
+    // skipped step, as the dense rule would have done with a zero
+    // gradient.
+    template<typename R>
+    void apply_update(Mat<R>& param,
+                      vector<Mat<R>> caches,
+                      const vector<R>& decays,
+                      vector<unsigned long long>* last_step,
+                      unsigned long long step,
+                      std::function<void(Mat<R>&, vector<Mat<R>>&)> update) {
+        if (!param.sparse_gradient()) {
+            if (nan_protection && param.is_grad_nan()) {
+                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
+            } else {
+                update(param, caches);
+            }
+            // reset gradient
+            param.clear_grad();
+            return;
+        }
+        // copied: clearing the gradient forgets the touched rows.
+        auto rows = param.touched_rows();
+        if (rows.empty()) {
+            return;
+        }
+        const bool columns = param.sparse_gradient_columns();
+        auto gather  = columns ? &gather_columns<R>  : &gather_rows<R>;
+        auto scatter = columns ? &scatter_columns<R> : &scatter_rows<R>;
+        const int compact_rows = columns ? param.dims(0) : rows.size();
+        const int compact_cols = columns ? rows.size()   : param.dims(1);
+
+        Mat<R> compact_param(compact_rows, compact_cols, weights<R>::empty());
+        gather(MAT(param), rows, MAT(compact_param));
+        gather(GRAD(param), rows, GRAD(compact_param));
+        // reset gradient
+        param.clear_grad();
+        if (nan_protection && compact_param.is_grad_nan()) {
+            std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
+            return;
+        }
+
+        vector<Mat<R>> compact_caches;
+        for (auto& cache : caches) {
+            compact_caches.emplace_back(compact_rows, compact_cols, weights<R>::empty());
+            gather(MAT(cache), rows, MAT(compact_caches.back()));
+        }
+        if (!decays.empty()) {
+            last_step->resize(columns ? param.dims(1) : param.dims(0), 0);
+            for (int i = 0; i < rows.size(); ++i) {
+                auto skipped = step - (*last_step)[rows[i]] - 1;
+                (*last_step)[rows[i]] = step;
+                if (skipped == 0) {
+                    continue;
+                }
+                for (int c = 0; c < compact_caches.size(); ++c) {
+                    const R decay = std::pow(decays[c], (double)skipped);
+                    if (columns) {
+                        for (int row = 0; row < compact_rows; ++row) {
+                            compact_caches[c].w(row, i) *= decay;
+                        }
+                    } else {
+                        MAT(compact_caches[c])[i] *= decay;
+                    }
+                }
+            }
+        }
+
+        update(compact_param, compact_caches);
+
+        scatter(MAT(compact_param), rows, MAT(param));
+        for (int c = 0; c < caches.size(); ++c) {
+            scatter(MAT(compact_caches[c]), rows, MAT(caches[c]));
+        }
+    }
+
+    /* Fused parameters */
+
+    // flat buffers are laid out (and cut into chunks) at multiples
+    // of this many elements, to keep every view aligned.
+    const int FUSED_ALIGNMENT = 16;
+    // smallest chunk worth its own thread.
+    const size_t FUSED_MIN_CHUNK_SIZE = 1 << 16;
+
+    // copies `tensor` into `flat` at `offset`, then makes `tensor` a
+    // view of it. On the cpu the memory `tensor` shares with its
+    // copies (e.g. the shallow copies of Hogwild threads) adopts its
+    // part of `flat`, so that all of them follow; memory kept on the
+    // gpu cannot, so it must not be shared.
+    template<typename R>
+    void move_into_flat(TensorInternal<R,2>& tensor, TensorInternal<R,2>& flat, size_t offset) {
+        ASSERT2(tensor.offset == 0 && tensor.memory().total_memory == tensor.number_of_elements(),
+            "Fused solver cannot pack parameters that are views of larger tensors.");
+        TensorInternal<R,2> view(tensor.shape, flat.memory_, offset);
+        view = tensor.wrapper();
+        if (flat.memory().prefers_cpu() && tensor.memory().prefers_cpu()) {
+            tensor.memory().adopt_cpu(flat.memory().mutable_cpu_data() + offset, flat.memory_);
+            return;
+        }
+        ASSERT2(tensor.memory_.use_count() == 1,
+            "Fused solver cannot pack parameters on the gpu whose memory is shared with other tensors.");
+        tensor.memory_ = flat.memory_;
+        tensor.offset  = offset;
+    }
+
+    // `size` elements of `flat` (weights and gradients) from `offset`.
+    template<typename R>
+    Mat<R> flat_slice(Mat<R>& flat, size_t offset, size_t size) {
+        Mat<R> slice(1, size, false);
+        MAT(slice).memory_  = MAT(flat).memory_;
+        MAT(slice).offset   = offset;
+        GRAD(slice).memory_ = GRAD(flat).memory_;
+        GRAD(slice).offset  = offset;
+        return slice;
+    }
+
     /* Abstract Solver */
     template<typename R>
     AbstractSolver<R>::AbstractSolver() :
             clipval(std::numeric_limits<R>::infinity),
             smooth_eps(SMOOTH_DEFAULT),
             regc(0.0),
+            sparse_step(0),
+            fused(false),
             method(METHOD_UNINITIALIZED) {
     }
 
@@ -65,13 +246,119 @@ namespace Solver {
             clipval(_clipval),
             smooth_eps(_smooth_eps),
             regc(_regc),
+            sparse_step(0),
+            fused(false),
             method(_method) {
     }
 
     template<typename R>
     void AbstractSolver<R>::reset_caches(vector<Mat<R>>& parameters) {}
     template<typename R>
-    void AbstractSolver<R>::create_gradient_caches(vector<Mat<R>>& parameters) {}
+    void AbstractSolver<R>::create_gradient_caches(vector<Mat<R>>& parameters) {
+        pack(parameters, {});
+    }
+
+    template<typename R>
+    void AbstractSolver<R>::fuse(vector<Mat<R>>& parameters) {
+        fused = true;
+        create_gradient_caches(parameters);
+    }
+
+    template<typename R>
+    void AbstractSolver<R>::pack(vector<Mat<R>>& parameters,
+                                 const vector<cache_table_t<R>*>& tables) {
+        if (!fused) {
+            return;
+        }
+        auto layout = std::make_shared<FusedParameters<R>>();
+        vector<Mat<R>> dense;
+        vector<size_t> offsets;
+        size_t total = 0;
+        for (auto& param : parameters) {
+            layout->keys.emplace_back(PARAM_KEY_FOR_LOOKUP_TABLE);
+            if (param.sparse_gradient()) {
+                layout->unfused.emplace_back(param);
+                continue;
+            }
+            dense.emplace_back(param);
+            offsets.emplace_back(total);
+            total += (param.number_of_elements() + FUSED_ALIGNMENT - 1) / FUSED_ALIGNMENT * FUSED_ALIGNMENT;
+        }
+        total = std::max(total, (size_t)FUSED_ALIGNMENT);
+
+        // zeros: padding between parameters stays at zero (it has
+        // no gradient, so no update moves it).
+        layout->flat = Mat<R>(1, total);
+        for (int i = 0; i < dense.size(); ++i) {
+            move_into_flat(MAT(dense[i]),  MAT(layout->flat),  offsets[i]);
+            move_into_flat(GRAD(dense[i]), GRAD(layout->flat), offsets[i]);
+        }
+        for (auto table : tables) {
+            layout->flat_caches.emplace_back(1, total);
+            for (int i = 0; i < dense.size(); ++i) {
+                move_into_flat(MAT(table->at(&MAT(dense[i]))), MAT(layout->flat_caches.back()), offsets[i]);
+            }
+        }
+
+        size_t num_chunks = std::max((size_t)1, std::min(
+                (size_t)cpu_threading::num_threads(), total / FUSED_MIN_CHUNK_SIZE));
+        if (MAT(layout->flat).compute_me_on_gpu()) {
+            num_chunks = 1;
+        }
+        size_t chunk_size = ((total + num_chunks - 1) / num_chunks + FUSED_ALIGNMENT - 1) / FUSED_ALIGNMENT * FUSED_ALIGNMENT;
+        for (size_t begin = 0; begin < total; begin += chunk_size) {
+            auto size = std::min(chunk_size, total - begin);
+            layout->chunks.emplace_back(flat_slice(layout->flat, begin, size));
+            layout->chunk_caches.emplace_back();
+            for (auto& flat_cache : layout->flat_caches) {
+                layout->chunk_caches.back().emplace_back(flat_slice(flat_cache, begin, size));
+            }
+        }
+        packed = layout;
+    }
+
+    template<typename R>
+    vector<Mat<R>>& AbstractSolver<R>::fused_update(vector<Mat<R>>& parameters,
+                                                    update_t update) {
+        if (!fused) {
+            return parameters;
+        }
+        ASSERT2(packed->keys.size() == parameters.size(),
+            "Fused solver must be stepped with the parameters it was fused with.");
+        for (int i = 0; i < parameters.size(); ++i) {
+            auto& param = parameters[i];
+            ASSERT2(packed->keys[i] == PARAM_KEY_FOR_LOOKUP_TABLE,
+                "Fused solver must be stepped with the parameters it was fused with.");
+        }
+        if (nan_protection && packed->flat.is_grad_nan()) {
+            std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
+        } else if (packed->chunks.size() == 1 ||
+                   !cpu_threading::should_parallelize(MAT(packed->flat).number_of_elements())) {
+            // e.g. called from a Hogwild thread of a pool.
+            for (int chunk = 0; chunk < packed->chunks.size(); ++chunk) {
+                update(packed->chunks[chunk], packed->chunk_caches[chunk]);
+            }
+        } else {
+            // bring the buffers to the cpu before the threads share them.
+            MAT(packed->flat).mutable_cpu_data();
+            GRAD(packed->flat).mutable_cpu_data();
+            for (auto& flat_cache : packed->flat_caches) {
+                MAT(flat_cache).mutable_cpu_data();
+            }
+            // the pool rethrows the first error once every chunk is done.
+            cpu_threading::parallel_for(0, packed->chunks.size(), 1, [this, &update](int begin, int end) {
+                for (int chunk = begin; chunk < end; ++chunk) {
+                    update(packed->chunks[chunk], packed->chunk_caches[chunk]);
+                }
+            });
+        }
+        // reset gradient
+        GRAD(packed->flat).clear();
+        return packed->unfused;
+    }
+
+    template class AbstractSolver<float>;
+    template class AbstractSolver<double>;
 
     /* SGD */
     template<typename R>
@@ -87,15 +374,12 @@ namespace Solver {
 
     template<typename R>
     void SGD<R>::step (vector<Mat<R>>& parameters, R step_size) {
-        for (auto& param : parameters) {
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
-                MatOps<R>::sgd_update(param, step_size);
-            }
-            // reset gradient
-            GRAD(param).clear();
+        auto update = [this, step_size](Mat<R>& param, vector<Mat<R>>& caches) {
+            MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
+            MatOps<R>::sgd_update(param, step_size);
+        };
+        for (auto& param : this->fused_update(parameters, update)) {
+            apply_update<R>(param, {}, {}, NULL, 0, update);
         }
     }
 
@@ -128,6 +412,7 @@ namespace Solver {
     void AdaGrad<R>::create_gradient_caches(
             vector<Mat<R>>& parameters) {
         create_cache(parameters, gsums);
+        this->pack(parameters, {&gsums});
     }
 
     template<typename R>
@@ -139,19 +424,13 @@ namespace Solver {
     template<typename R>
     void AdaGrad<R>::step(
             vector<Mat<R>>& parameters, R step_size) {
-        for (auto& param : parameters) {
-
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                auto& s = gsums.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-
-                MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
-                MatOps<R>::adagrad_update(param, s, step_size, this->smooth_eps);
-            }
-
-            // reset gradient
-            GRAD(param).clear();
+        auto update = [this, step_size](Mat<R>& param, vector<Mat<R>>& caches) {
+            MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
+            MatOps<R>::adagrad_update(param, caches[0], step_size, this->smooth_eps);
+        };
+        for (auto& param : this->fused_update(parameters, update)) {
+            auto& s = gsums.at(PARAM_KEY_FOR_LOOKUP_TABLE);
+            apply_update<R>(param, {s}, {}, NULL, 0, update);
         }
     }
 
@@ -191,19 +470,16 @@ namespace Solver {
             vector<Mat<R>>& parameters,
             R step_size
             ) {
-        for (auto& param : parameters) {
-
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                auto& s = this->gsums[PARAM_KEY_FOR_LOOKUP_TABLE];
-
-                MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
-                MatOps<R>::rmsprop_update(param, s, decay_rate, step_size, this->smooth_eps);
-            }
-
-            // reset gradient
-            GRAD(param).clear();
+        this->sparse_step++;
+        auto update = [this, step_size](Mat<R>& param, vector<Mat<R>>& caches) {
+            MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
+            MatOps<R>::rmsprop_update(param, caches[0], decay_rate, step_size, this->smooth_eps);
+        };
+        for (auto& param : this->fused_update(parameters, update)) {
+            auto& s = this->gsums[PARAM_KEY_FOR_LOOKUP_TABLE];
+            apply_update<R>(param, {s}, {decay_rate},
+                    &this->row_last_step[PARAM_KEY_FOR_LOOKUP_TABLE], this->sparse_step,
+                    update);
             DEBUG_ASSERT_NOT_NAN(MAT(param));
         }
     }
@@ -253,6 +529,7 @@ namespace Solver {
         create_cache(parameters, n_cache);
         create_cache(parameters, g_cache);
         create_cache(parameters, momentum_cache);
+        this->pack(parameters, {&n_cache, &g_cache, &momentum_cache});
     }
 
     template<typename R>
@@ -267,23 +544,28 @@ namespace Solver {
     template<typename R>
     void RMSPropMomentum<R>::step(
             vector<Mat<R>>& parameters, R step_size_override) {
-        for (auto& param : parameters) {
+        auto update = [this, step_size_override](Mat<R>& param, vector<Mat<R>>& caches) {
+            MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
+            MatOps<R>::rmsprop_momentum_update(
+                    param, caches[0], caches[1], caches[2], decay_rate, momentum,
+                    step_size_override, this->smooth_eps);
+        };
+        for (auto& param : this->fused_update(parameters, update)) {
 
             if (nan_protection && param.is_grad_nan()) {
                 std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
             } else {
-                auto& n = n_cache.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-                auto& g = g_cache.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-                auto& m = momentum_cache.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-
-                MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
-                MatOps<R>::rmsprop_momentum_update(
-                        param, n, g, m, decay_rate, momentum,
-                        step_size_override, this->smooth_eps);
+                vector<Mat<R>> caches({
+                    n_cache.at(PARAM_KEY_FOR_LOOKUP_TABLE),
+                    g_cache.at(PARAM_KEY_FOR_LOOKUP_TABLE),
+                    momentum_cache.at(PARAM_KEY_FOR_LOOKUP_TABLE)
+                });
+                update(param, caches);
             }
 
-            // reset gradient
-            GRAD(param).clear();
+            // reset gradient (momentum moves every row, so sparse
+            // gradient parameters get the dense update here).
+            param.clear_grad();
         }
     }
 
@@ -322,6 +604,7 @@ namespace Solver {
             vector<Mat<R>>& parameters) {
         create_cache(parameters, gsums);
         create_cache(parameters, xsums);
+        this->pack(parameters, {&gsums, &xsums});
     }
 
     template<typename R>
@@ -334,19 +617,17 @@ namespace Solver {
 
     template<typename R>
     void AdaDelta<R>::step (vector<Mat<R>>& parameters) {
-        for (auto& param : parameters) {
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                auto& gsum = gsums[PARAM_KEY_FOR_LOOKUP_TABLE];
-                auto& xsum = xsums[PARAM_KEY_FOR_LOOKUP_TABLE];
-
-                MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
-                MatOps<R>::adadelta_update(param, gsum, xsum, rho, this->smooth_eps);
-            }
-
-            // reset gradient
-            GRAD(param).clear();
+        this->sparse_step++;
+        auto update = [this](Mat<R>& param, vector<Mat<R>>& caches) {
+            MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
+            MatOps<R>::adadelta_update(param, caches[0], caches[1], rho, this->smooth_eps);
+        };
+        for (auto& param : this->fused_update(parameters, update)) {
+            auto& gsum = gsums[PARAM_KEY_FOR_LOOKUP_TABLE];
+            auto& xsum = xsums[PARAM_KEY_FOR_LOOKUP_TABLE];
+            apply_update<R>(param, {gsum, xsum}, {rho, rho},
+                    &this->row_last_step[PARAM_KEY_FOR_LOOKUP_TABLE], this->sparse_step,
+                    update);
 
             DEBUG_ASSERT_NOT_NAN(GET_MAT(param));
         }
@@ -383,6 +664,7 @@ namespace Solver {
             vector<Mat<R>>& parameters) {
         create_cache(parameters, gsums);
         create_cache(parameters, xsums);
+        this->pack(parameters, {&gsums, &xsums});
     }
 
     template<typename R>
@@ -398,20 +680,20 @@ namespace Solver {
         // increase timesteps:
         epoch += 1;
 
-        for (auto& param : parameters) {
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                auto& m = gsums[PARAM_KEY_FOR_LOOKUP_TABLE];
-                auto& v = xsums[PARAM_KEY_FOR_LOOKUP_TABLE];
-
-                MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
-
-                MatOps<R>::adam_update(param, m, v, b1, b2, this->smooth_eps, step_size, epoch);
-            }
-
-            // reset gradient
-            GRAD(param).clear();
+        this->sparse_step++;
+        auto update = [this, step_size](Mat<R>& param, vector<Mat<R>>& caches) {
+            MatOps<R>::clip_and_regularize(param, this->clipval, this->regc);
+
+            MatOps<R>::adam_update(param, caches[0], caches[1], b1, b2, this->smooth_eps, step_size, epoch);
+        };
+        for (auto& param : this->fused_update(parameters, update)) {
+            auto& m = gsums[PARAM_KEY_FOR_LOOKUP_TABLE];
+            auto& v = xsums[PARAM_KEY_FOR_LOOKUP_TABLE];
+            // sparse rows are updated lazily: skipped rows only have
+            // their moments decayed, their parameters do not move.
+            apply_update<R>(param, {m, v}, {(R)1.0 - b1, (R)1.0 - b2},
+                    &this->row_last_step[PARAM_KEY_FOR_LOOKUP_TABLE], this->sparse_step,
+                    update);
         }
     }
 
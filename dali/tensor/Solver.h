@@ -14,6 +14,8 @@ namespace Solver {
     using cache_key_t = void*;
     template<typename R>
     using cache_t = Mat<R>;
+    template<typename R>
+    using cache_table_t = std::unordered_map<cache_key_t<R>, cache_t<R>>;
 
     enum Method {
         METHOD_UNINITIALIZED,
@@ -29,6 +31,37 @@ namespace Solver {
 
     const double SMOOTH_DEFAULT = 1e-4;
 
+    /*
+    FusedParameters
+    ---------------
+
+    Flat layout of a solver in fused mode (see `AbstractSolver::fuse`).
+    The weights, gradients and caches of every dense parameter are
+    moved into one flat buffer each, and the memory of the
+    parameters and their caches adopts its part of those buffers
+    (so views and shallow copies of a parameter follow it). A step
+    then evaluates each update expression once over the whole
+    buffer (cut into a few chunks updated on the shared cpu thread
+    pool) instead of once per parameter after a few hash lookups.
+
+    Fused parameters cannot be resized, nor be views of larger
+    tensors. On the gpu the parameters become views of the buffers
+    instead, so their memory must not be shared with other tensors.
+    */
+    template<typename R>
+    struct FusedParameters {
+        // all the weights and gradients, and one buffer per cache.
+        Mat<R> flat;
+        std::vector<Mat<R>> flat_caches;
+        // the same buffers, cut into chunks.
+        std::vector<Mat<R>> chunks;
+        std::vector<std::vector<Mat<R>>> chunk_caches;
+        // every parameter given to `fuse`, in order.
+        std::vector<cache_key_t<R>> keys;
+        // parameters left out of the buffers (sparse gradients).
+        std::vector<Mat<R>> unfused;
+    };
+
     template<typename R> class AbstractSolver {
         public:
             Method method;
@@ -36,11 +69,41 @@ namespace Solver {
             R clipval;
             R smooth_eps;
             R regc;
+
+            // Sparse gradient parameters (see Mat::set_sparse_gradient)
+            // only have their touched rows (or columns) updated. Solvers
+            // whose caches decay count their steps and remember when each
+            // row was last updated, to decay skipped rows lazily.
+            unsigned long long sparse_step;
+            std::unordered_map<cache_key_t<R>, std::vector<unsigned long long>> row_last_step;
+
+            // set by `fuse`.
+            bool fused;
+            std::shared_ptr<FusedParameters<R>> packed;
+
             AbstractSolver();
             AbstractSolver(R clipval, R smooth_eps, R regc, Method method);
             virtual void step( std::vector<Mat<R>>& ) = 0;
             virtual void reset_caches( std::vector<Mat<R>>&);
             virtual void create_gradient_caches(std::vector<Mat<R>>&);
+
+            // Switch to fused mode (see FusedParameters): from now on
+            // `create_gradient_caches` packs `parameters` into flat
+            // buffers, and `step` must be called with the same
+            // parameters, in the same order.
+            void fuse(std::vector<Mat<R>>& parameters);
+        protected:
+            typedef std::function<void(Mat<R>&, std::vector<Mat<R>>&)> update_t;
+
+            // Packs `parameters` and their caches from `tables` (in
+            // the order `update` expects them) when in fused mode.
+            void pack(std::vector<Mat<R>>& parameters,
+                      const std::vector<cache_table_t<R>*>& tables);
+            // In fused mode, runs `update` over the flat buffers, clears
+            // the gradients and returns the parameters left to update one
+            // by one. Otherwise returns `parameters`.
+            std::vector<Mat<R>>& fused_update(std::vector<Mat<R>>& parameters,
+                                              update_t update);
     };
 
     template<typename R> class SGD : public AbstractSolver<R> {
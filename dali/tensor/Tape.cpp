@@ -1,20 +1,173 @@
 #include "Tape.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "dali/utils/ThreadPool.h"
+
+using std::vector;
 
 namespace graph {
     thread_local bool _backprop_enabled = true;
     thread_local Tape tape;
+    // innermost live SubTape's tape (NULL when recording on `tape`).
+    thread_local Tape* active_tape = NULL;
+
+    namespace {
+        // Closures recorded with `emplace_back` live on the tape
+        // like any other node.
+        struct closure_node {
+            std::function<void()> f;
+            void backward() {
+                f();
+            }
+        };
+
+        struct dependent_closure_node {
+            std::function<void()> f;
+            Dependencies deps;
+            void dependencies(Dependencies& out) {
+                out.reads.insert(out.reads.end(), deps.reads.begin(), deps.reads.end());
+                out.writes.insert(out.writes.end(), deps.writes.begin(), deps.writes.end());
+            }
+            void backward() {
+                f();
+            }
+        };
+
+        // closures are named by the type of the function they hold
+        // (the op's lambda) rather than by that of the closure node.
+        void name_closure(Tape& tape, const std::type_info& type) {
+            if (tape.nodes.back().span != -1) {
+                tape.nodes.back().span = utils::profiler::intern(type);
+            }
+        }
+
+        void run_node(const Node& node) {
+            if (node.span == -1) {
+                node.backward(node.record);
+            } else {
+                utils::profiler::Span span(node.span);
+                node.backward(node.record);
+            }
+        }
+
+        // Nodes writing to the same gradient may run in any order, but
+        // not concurrently: they lock the stripes of every gradient
+        // they touch (in increasing order, so they cannot deadlock).
+        const int NUM_GRADIENT_LOCKS = 64;
+        std::mutex gradient_locks[NUM_GRADIENT_LOCKS];
+
+        int gradient_lock_index(const void* handle) {
+            return (reinterpret_cast<std::uintptr_t>(handle) >> 4) % NUM_GRADIENT_LOCKS;
+        }
+
+        // State shared by the threads running a parallel backward.
+        // Kept alive by every worker, so that a worker started after
+        // all the work is done exits without touching the tape.
+        struct ParallelBackward {
+            const vector<Node>* nodes;
+            vector<vector<int>> successors;
+            vector<vector<int>> locks;
+            std::unique_ptr<std::atomic<int>[]> pending;
+
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::deque<int> ready;
+            int remaining;
+            std::exception_ptr error;
+
+            // `step` is the position in backward order: it runs
+            // nodes[nodes.size() - 1 - step].
+            void run(int step) {
+                vector<std::unique_lock<std::mutex>> held;
+                for (auto lock_index : locks[step]) {
+                    held.emplace_back(gradient_locks[lock_index]);
+                }
+                run_node((*nodes)[nodes->size() - 1 - step]);
+            }
+
+            void work() {
+                while (true) {
+                    int step;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        changed.wait(lock, [this]() {
+                            return !ready.empty() || remaining == 0;
+                        });
+                        if (remaining == 0) {
+                            return;
+                        }
+                        step = ready.front();
+                        ready.pop_front();
+                    }
+                    try {
+                        run(step);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                    }
+                    vector<int> newly_ready;
+                    for (auto successor : successors[step]) {
+                        if (--pending[successor] == 0) {
+                            newly_ready.emplace_back(successor);
+                        }
+                    }
+                    bool done;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        ready.insert(ready.end(), newly_ready.begin(), newly_ready.end());
+                        done = --remaining == 0;
+                    }
+                    if (done || newly_ready.size() > 1) {
+                        changed.notify_all();
+                    } else if (newly_ready.size() == 1) {
+                        changed.notify_one();
+                    }
+                }
+            }
+        };
+    }
+
+    Tape& current_tape() {
+        return active_tape == NULL ? tape : *active_tape;
+    }
 
     void emplace_back(std::function<void()>&& f) {
-        tape.backprop.emplace_back(f);
+        current_tape().emplace_back(std::move(f));
+    }
+
+    void emplace_back(std::function<void()>&& f, Dependencies&& deps) {
+        const std::type_info& type = f.target_type();
+        current_tape().emplace_node<dependent_closure_node>(std::move(f), std::move(deps));
+        name_closure(current_tape(), type);
     }
 
     void backward() {
-        tape.backward();
+        current_tape().backward();
+    }
+
+    void backward(const vector<const void*>& roots) {
+        current_tape().backward(roots);
+    }
+
+    void backward_parallel(ThreadPool& pool) {
+        current_tape().backward_parallel(pool);
     }
 
     void clear() {
-        tape.backprop.clear();
+        current_tape().clear();
     }
 
     bool backprop_enabled() {
@@ -26,16 +179,275 @@ namespace graph {
     }
 
     size_t size() {
-        return tape.backprop.size();
+        return current_tape().size();
+    }
+
+    /* Arena */
+
+    Arena::Arena(size_t _block_size) : block_size(_block_size), current_block(0), offset(0) {
+    }
+
+    Arena::~Arena() {
+        for (auto& block : blocks) {
+            delete[] block.data;
+        }
     }
 
+    void* Arena::allocate(size_t bytes, size_t alignment) {
+        while (true) {
+            if (current_block < blocks.size()) {
+                auto& block   = blocks[current_block];
+                auto base     = reinterpret_cast<std::uintptr_t>(block.data);
+                auto aligned  = ((base + offset + alignment - 1) & ~(std::uintptr_t)(alignment - 1)) - base;
+                if (aligned + bytes <= block.size) {
+                    offset = aligned + bytes;
+                    return block.data + aligned;
+                }
+                // move on to the next block (an unusually large
+                // record gets a block of its own).
+                current_block++;
+                offset = 0;
+                continue;
+            }
+            size_t size = std::max(block_size, bytes + alignment);
+            blocks.push_back(Block{new char[size], size});
+        }
+    }
+
+    void Arena::reset() {
+        current_block = 0;
+        offset = 0;
+    }
+
+    void Arena::absorb(Arena& other) {
+        // blocks `other` allocated from so far (including the
+        // partially filled current one).
+        size_t used = std::min(other.current_block + 1, other.blocks.size());
+        if (used == 0) {
+            return;
+        }
+        // placed before our current block: they count as
+        // allocated until the next reset.
+        blocks.insert(blocks.begin() + std::min(current_block, blocks.size()),
+                      other.blocks.begin(),
+                      other.blocks.begin() + used);
+        current_block += used;
+        other.blocks.erase(other.blocks.begin(), other.blocks.begin() + used);
+        other.reset();
+    }
+
+    size_t Arena::capacity() const {
+        size_t total = 0;
+        for (auto& block : blocks) {
+            total += block.size;
+        }
+        return total;
+    }
 
     /* Tape */
 
+    void Tape::emplace_back(std::function<void()>&& f) {
+        const std::type_info& type = f.target_type();
+        emplace_node<closure_node>(std::move(f));
+        name_closure(*this, type);
+    }
+
+    size_t Tape::size() const {
+        return nodes.size();
+    }
+
     void Tape::backward () {
-        for (auto it = backprop.rbegin(); it != backprop.rend(); ++it)
-            (*it)();
-        backprop.clear();
+        for (auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+            run_node(*it);
+        clear();
+    }
+
+    void Tape::backward(const vector<const void*>& roots) {
+        // gradients that (may) have received something from `roots`.
+        std::unordered_set<const void*> live(roots.begin(), roots.end());
+        bool reaches_everything = false;
+        Dependencies deps;
+        for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+            if (!reaches_everything) {
+                if (it->dependencies == NULL) {
+                    // unknown writes: anything before might be reached.
+                    reaches_everything = true;
+                } else {
+                    deps.reads.clear();
+                    deps.writes.clear();
+                    it->dependencies(it->record, deps);
+                    bool reached = false;
+                    for (auto handle : deps.reads) {
+                        if (live.count(handle) > 0) {
+                            reached = true;
+                            break;
+                        }
+                    }
+                    if (!reached) {
+                        continue;
+                    }
+                    live.insert(deps.writes.begin(), deps.writes.end());
+                }
+            }
+            run_node(*it);
+        }
+        clear();
+    }
+
+    void Tape::backward_parallel(ThreadPool& pool) {
+        const int num_nodes = nodes.size();
+        if (num_nodes == 0) {
+            return;
+        }
+        auto state = std::make_shared<ParallelBackward>();
+        state->nodes = &nodes;
+        state->successors.resize(num_nodes);
+        state->locks.resize(num_nodes);
+        state->pending.reset(new std::atomic<int>[num_nodes]);
+        vector<int> num_dependencies(num_nodes, 0);
+
+        auto add_edge = [&state, &num_dependencies](int from, int to) {
+            if (from != to) {
+                state->successors[from].emplace_back(to);
+                num_dependencies[to]++;
+            }
+        };
+
+        // Accesses to one gradient since the last barrier. Readers
+        // wait for the writers before them; writers wait for the
+        // readers before them (readers see the gradient before the
+        // write). Consecutive writers are left unordered.
+        struct access_t {
+            vector<int> writers;
+            vector<int> readers;
+            vector<int> prior_readers;
+        };
+        std::unordered_map<const void*, access_t> accesses;
+        vector<int> since_barrier;
+        int last_barrier = -1;
+        Dependencies deps;
+
+        for (int step = 0; step < num_nodes; ++step) {
+            auto& node = nodes[num_nodes - 1 - step];
+            if (node.dependencies == NULL) {
+                // barrier: waits for everything before it, and
+                // everything after it waits for the barrier.
+                for (auto other : since_barrier) {
+                    add_edge(other, step);
+                }
+                if (since_barrier.empty() && last_barrier >= 0) {
+                    add_edge(last_barrier, step);
+                }
+                since_barrier.clear();
+                accesses.clear();
+                last_barrier = step;
+                continue;
+            }
+            if (last_barrier >= 0) {
+                add_edge(last_barrier, step);
+            }
+            deps.reads.clear();
+            deps.writes.clear();
+            node.dependencies(node.record, deps);
+
+            for (auto handle : deps.reads) {
+                auto& access = accesses[handle];
+                for (auto writer : access.writers) {
+                    add_edge(writer, step);
+                }
+                access.readers.emplace_back(step);
+            }
+            for (auto handle : deps.writes) {
+                auto& access = accesses[handle];
+                if (!access.readers.empty()) {
+                    access.prior_readers.swap(access.readers);
+                    access.readers.clear();
+                    access.writers.clear();
+                }
+                for (auto reader : access.prior_readers) {
+                    add_edge(reader, step);
+                }
+                access.writers.emplace_back(step);
+            }
+
+            auto& locks = state->locks[step];
+            for (auto handle : deps.reads) {
+                locks.emplace_back(gradient_lock_index(handle));
+            }
+            for (auto handle : deps.writes) {
+                locks.emplace_back(gradient_lock_index(handle));
+            }
+            std::sort(locks.begin(), locks.end());
+            locks.erase(std::unique(locks.begin(), locks.end()), locks.end());
+            since_barrier.emplace_back(step);
+        }
+
+        for (int step = 0; step < num_nodes; ++step) {
+            state->pending[step] = num_dependencies[step];
+            if (num_dependencies[step] == 0) {
+                state->ready.emplace_back(step);
+            }
+        }
+        state->remaining = num_nodes;
+
+        for (int helper = 0; helper < pool.size(); ++helper) {
+            pool.run([state]() {
+                state->work();
+            });
+        }
+        state->work();
+
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+        clear();
+    }
+
+    void Tape::clear() {
+        for (auto& node : nodes)
+            node.destroy(node.record);
+        nodes.clear();
+        arena.reset();
+    }
+
+    void Tape::splice(Tape& other) {
+        nodes.insert(nodes.end(), other.nodes.begin(), other.nodes.end());
+        other.nodes.clear();
+        arena.absorb(other.arena);
+    }
+
+    Tape::~Tape() {
+        clear();
+    }
+
+    /* SubTape */
+    SubTape::SubTape() : parent(&current_tape()), previous(active_tape) {
+        active_tape = &tape;
+    }
+
+    SubTape::~SubTape() {
+        tape.clear();
+        active_tape = previous;
+    }
+
+    size_t SubTape::size() const {
+        return tape.size();
+    }
+
+    void SubTape::backward() {
+        tape.backward();
+    }
+
+    void SubTape::backward(const vector<const void*>& roots) {
+        tape.backward(roots);
+    }
+
+    void SubTape::discard() {
+        tape.clear();
+    }
+
+    void SubTape::merge() {
+        parent->splice(tape);
     }
 
     /* NoBackprop */
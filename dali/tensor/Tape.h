@@ -1,14 +1,52 @@
 #ifndef CORE_NEW_GRAPH_H
 #define CORE_NEW_GRAPH_H
 
+#include <cstddef>
 #include <functional>
+#include <new>
+#include <utility>
 #include <vector>
 
+#include "dali/utils/Profiler.h"
+
+class ThreadPool;
+
 namespace graph {
+    struct Dependencies;
+
     void emplace_back(std::function<void()>&& f);
 
+    // Record a closure together with the gradients it reads and
+    // writes, so that it does not act as a barrier for
+    // `backward_parallel` or for a backward from given roots.
+    void emplace_back(std::function<void()>&& f, Dependencies&& deps);
+
+    // Record an operation of type `Op` constructed from `args`.
+    // `Op` is a plain struct holding the op's inputs and outputs
+    // and a `void backward()` method. Its record is placed in the
+    // tape's arena, so unlike `emplace_back` no std::function is
+    // created and nothing is heap allocated per node.
+    template<typename Op, typename... Args>
+    void emplace_node(Args&&... args);
+
     void backward();
 
+    // Run only the nodes through which gradient can flow from
+    // the gradient buffers `roots` (e.g. the gradient of a loss,
+    // see `graph::backward(const Mat<R>&)`), then clear the tape.
+    // Nodes that do not declare their dependencies are assumed
+    // to reach everything recorded before them.
+    void backward(const std::vector<const void*>& roots);
+
+    // Opt-in parallel backward: nodes that touch disjoint gradients
+    // run concurrently on `pool` (and the calling thread). Nodes
+    // declare the gradients they read and write via `dependencies`;
+    // nodes that do not (e.g. closures recorded without them) act as
+    // barriers and run alone. `pool` may be the one the nodes use
+    // themselves (e.g. cpu_threading::thread_pool()): their task
+    // groups only wait on their own tasks.
+    void backward_parallel(ThreadPool& pool);
+
     void clear();
 
     bool backprop_enabled();
@@ -18,13 +56,184 @@ namespace graph {
 
     size_t size();
 
+    /*
+    Arena
+    -----
+
+    Bump allocator for tape records. Memory is handed out
+    from large blocks and is only given back all at once
+    with `reset`, which keeps the blocks around for the
+    next pass of the tape.
+    */
+    class Arena {
+        struct Block {
+            char*  data;
+            size_t size;
+        };
+        std::vector<Block> blocks;
+        size_t block_size;
+        size_t current_block;
+        size_t offset;
+
+        Arena(const Arena&) = delete;
+        Arena& operator =(Arena const &) = delete;
+        public:
+            explicit Arena(size_t block_size = 1 << 16);
+            ~Arena();
+            void* allocate(size_t bytes, size_t alignment);
+            // invalidates all allocations (blocks are kept).
+            void reset();
+            // take over the blocks `other` allocated from, keeping
+            // the allocations alive until this arena is reset.
+            void absorb(Arena& other);
+            // total memory reserved by the arena in bytes.
+            size_t capacity() const;
+    };
+
+    // Gradient buffers a node reads and writes during backward.
+    // Writes are accumulations, so two nodes writing the same
+    // buffer may run in any order (but not at the same time).
+    struct Dependencies {
+        std::vector<const void*> reads;
+        std::vector<const void*> writes;
+    };
+
+    typedef void (*dependencies_t)(void* record, Dependencies& deps);
+
+    // A tape entry: the op type (what to run during backward,
+    // which gradients it touches, how to destroy the record) and
+    // its arena-allocated record holding the op's inputs and outputs.
+    struct Node {
+        void (*backward)(void* record);
+        void (*destroy)(void* record);
+        // NULL when the node does not declare its dependencies.
+        dependencies_t dependencies;
+        void* record;
+        // profiler span of the op's backward (-1 when the profiler was
+        // disabled as the node was recorded).
+        int span;
+    };
+
+    template<typename Op>
+    void node_backward(void* record) {
+        static_cast<Op*>(record)->backward();
+    }
+
+    template<typename Op>
+    void node_destroy(void* record) {
+        static_cast<Op*>(record)->~Op();
+    }
+
+    template<typename Op>
+    void node_dependencies(void* record, Dependencies& deps) {
+        static_cast<Op*>(record)->dependencies(deps);
+    }
+
+    // `Op` may declare its dependencies with a method
+    // `void dependencies(graph::Dependencies&)`.
+    template<typename Op>
+    auto node_dependencies_function(int) -> decltype(
+            std::declval<Op&>().dependencies(std::declval<Dependencies&>()),
+            dependencies_t()) {
+        return &node_dependencies<Op>;
+    }
+
+    template<typename Op>
+    dependencies_t node_dependencies_function(long) {
+        return NULL;
+    }
+
     class Tape {
         public:
-            std::vector<std::function<void()>>  backprop;
+            Arena arena;
+            std::vector<Node> nodes;
+
+            template<typename Op, typename... Args>
+            void emplace_node(Args&&... args) {
+                void* record = arena.allocate(sizeof(Op), alignof(Op));
+                new (record) Op{std::forward<Args>(args)...};
+                nodes.push_back(Node{
+                    &node_backward<Op>,
+                    &node_destroy<Op>,
+                    node_dependencies_function<Op>(0),
+                    record,
+                    utils::profiler::enabled() ? utils::profiler::type_id<Op>() : -1
+                });
+            }
+
+            void emplace_back(std::function<void()>&& f);
 
+            size_t size() const;
+
+            // run every node in reverse order, then clear the tape.
             void backward ();
+            // run the nodes reachable from the gradients `roots`,
+            // then clear the tape.
+            void backward(const std::vector<const void*>& roots);
+            // same result as `backward`, running independent nodes
+            // concurrently.
+            void backward_parallel(ThreadPool& pool);
+            // destroy every node without running it.
+            void clear();
+            // move the nodes of `other` to the end of this tape.
+            void splice(Tape& other);
+
+            Tape() = default;
+            ~Tape();
+        private:
+            Tape(const Tape&) = delete;
+            Tape& operator =(Tape const &) = delete;
+    };
+
+    // tape recording operations on this thread: the innermost
+    // live SubTape, or the thread's main tape.
+    Tape& current_tape();
+
+    /*
+    SubTape
+    -------
+
+    Scoped tape: while alive, operations on this thread are
+    recorded on the sub-tape instead of the enclosing tape.
+    Its nodes can be backpropagated or discarded on their own
+    (e.g. scoring beams without touching the main tape), or
+    merged into the enclosing tape. Whatever is left on the
+    sub-tape when it goes out of scope is discarded.
+
+    Sub-tapes nest, and must be destroyed in the reverse order
+    of their creation (which scoping guarantees).
+
+        {
+            graph::SubTape scoring;
+            auto score = model.score(beam);
+            if (keep) scoring.merge();
+        }
+    */
+    class SubTape {
+        private:
+            Tape tape;
+            Tape* parent;
+            Tape* previous;
+            SubTape(const SubTape&) = delete;
+            SubTape& operator =(SubTape const &) = delete;
+
+        public:
+            SubTape();
+            ~SubTape();
+            size_t size() const;
+            void backward();
+            void backward(const std::vector<const void*>& roots);
+            // destroy the nodes recorded so far without running them.
+            void discard();
+            // move the nodes recorded so far to the enclosing tape.
+            void merge();
     };
 
+    template<typename Op, typename... Args>
+    void emplace_node(Args&&... args) {
+        current_tape().emplace_node<Op>(std::forward<Args>(args)...);
+    }
+
     class NoBackprop {
         private:
             // value of backprop before object go activated.
@@ -1,9 +1,64 @@
 #ifndef DALI_MAT_MATH___MAT_MACROS___H
 #define DALI_MAT_MATH___MAT_MACROS___H
 
+#include "dali/utils/Profiler.h"
+
 #define MAT(matrix) ((matrix).w())
 #define GRAD(X) ((X).dw())
 
 #define SAFE_GRAD(X) if (!(X).constant) GRAD(X)
 
+// identifies the gradient of X in tape node dependencies
+#define GRAD_HANDLE(X) ((const void*)&GRAD(X).memory())
+
+// counts an elementwise op over the elements of X (see DALI_COUNT_OP),
+// doing `flops` per element, reading `reads` arrays the size of X and
+// writing one. A gradient accumulated with += is read and written.
+#define DALI_COUNT_ELEMENTWISE(name, direction, X, flops, reads) \
+    DALI_COUNT_OP(name, direction, \
+        (double)(X).number_of_elements() * (flops), \
+        (double)(X).number_of_elements() * (reads) * sizeof(R), \
+        (double)(X).number_of_elements() * sizeof(R), \
+        (X).dims(0), (X).dims(1))
+
+// counts the backward of a binary elementwise op with output OUT,
+// accumulating into the gradients of both of its inputs.
+#define DALI_COUNT_BINARY_BACKWARD(name, OUT, flops, reads) \
+    DALI_COUNT_OP(name, BACKWARD, \
+        (double)(OUT).number_of_elements() * (flops), \
+        (double)(OUT).number_of_elements() * (reads) * sizeof(R), \
+        (double)(OUT).number_of_elements() * 2 * sizeof(R), \
+        (OUT).dims(0), (OUT).dims(1))
+
+// counts the product of A (n x k) with B (k x m): 2nkm FLOPs, reading
+// both operands and writing the output.
+#define DALI_COUNT_MUL_FORWARD(name, A, B) \
+    DALI_COUNT_OP(name, FORWARD, \
+        2.0 * (A).dims(0) * (A).dims(1) * (B).dims(1), \
+        ((double)(A).number_of_elements() + (B).number_of_elements()) * sizeof(R), \
+        (double)(A).dims(0) * (B).dims(1) * sizeof(R), \
+        (A).dims(0), (A).dims(1), (B).dims(1))
+
+// counts the backward of that product: one product per gradient,
+// each reading the output gradient, the other operand and the
+// gradient it accumulates into.
+#define DALI_COUNT_MUL_BACKWARD(name, A, B) \
+    DALI_COUNT_OP(name, BACKWARD, \
+        4.0 * (A).dims(0) * (A).dims(1) * (B).dims(1), \
+        2.0 * ((double)(A).number_of_elements() + (B).number_of_elements() + \
+               (double)(A).dims(0) * (B).dims(1)) * sizeof(R), \
+        ((double)(A).number_of_elements() + (B).number_of_elements()) * sizeof(R), \
+        (A).dims(0), (A).dims(1), (B).dims(1))
+
+// counts a reduction of X into OUT: forward reads X and writes OUT,
+// backward accumulates the gradient of OUT into that of X.
+#define DALI_COUNT_REDUCTION(name, direction, X, OUT) \
+    DALI_COUNT_OP(name, direction, \
+        (double)(X).number_of_elements(), \
+        ((double)(X).number_of_elements() + \
+            (utils::profiler::direction == utils::profiler::BACKWARD ? (OUT).number_of_elements() : 0)) * sizeof(R), \
+        (double)(utils::profiler::direction == utils::profiler::BACKWARD ? \
+            (X).number_of_elements() : (OUT).number_of_elements()) * sizeof(R), \
+        (X).dims(0), (X).dims(1))
+
 #endif
@@ -11,6 +11,77 @@ using std::vector;
 using namespace TensorOps;
 
 namespace matops {
+    // tape nodes for the most common binary ops (and the matrix product):
+    template<typename R>
+    void binary_dependencies(const Mat<R>& matrix1,
+                             const Mat<R>& matrix2,
+                             const Mat<R>& out,
+                             graph::Dependencies& deps) {
+        deps.reads.emplace_back(GRAD_HANDLE(out));
+        if (!matrix1.constant) deps.writes.emplace_back(GRAD_HANDLE(matrix1));
+        if (!matrix2.constant) deps.writes.emplace_back(GRAD_HANDLE(matrix2));
+    }
+
+    template<typename R>
+    struct add_node {
+        Mat<R> matrix1;
+        Mat<R> matrix2;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            binary_dependencies(matrix1, matrix2, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_BINARY_BACKWARD("add", out, 2, 3);
+            SAFE_GRAD(matrix1) += GRAD(out).wrapper();
+            SAFE_GRAD(matrix2) += GRAD(out).wrapper();
+        }
+    };
+
+    template<typename R>
+    struct sub_node {
+        Mat<R> matrix1;
+        Mat<R> matrix2;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            binary_dependencies(matrix1, matrix2, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_BINARY_BACKWARD("sub", out, 2, 3);
+            SAFE_GRAD(matrix1) += GRAD(out).wrapper();
+            SAFE_GRAD(matrix2) -= GRAD(out).wrapper();
+        }
+    };
+
+    template<typename R>
+    struct eltmul_node {
+        Mat<R> matrix1;
+        Mat<R> matrix2;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            binary_dependencies(matrix1, matrix2, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_BINARY_BACKWARD("eltmul", out, 4, 5);
+            SAFE_GRAD(matrix1) += MAT(matrix2).wrapper() * GRAD(out).wrapper();
+            SAFE_GRAD(matrix2) += MAT(matrix1).wrapper() * GRAD(out).wrapper();
+        }
+    };
+
+    template<typename R>
+    struct mul_node {
+        Mat<R> matrix1;
+        Mat<R> matrix2;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            binary_dependencies(matrix1, matrix2, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_MUL_BACKWARD("mul", matrix1, matrix2);
+            SAFE_GRAD(matrix1) += dot( GRAD(out).wrapper(),        MAT(matrix2).wrapper().T() );
+            SAFE_GRAD(matrix2) += dot( MAT(matrix1).wrapper().T(), GRAD(out).wrapper() );
+        }
+    };
+
     template<typename R>
     Mat<R> Binary<R>::eltmul_broadcast_colwise(
             Mat<R> matrix1,
@@ -73,13 +144,11 @@ namespace matops {
 
         ASSERT2(matrix1.dims(0) == matrix2.dims(0) && matrix1.dims(1) == matrix2.dims(1),
                 "Matrices cannot be element-wise multiplied, they do not have the same dimensions.");
+        DALI_COUNT_ELEMENTWISE("eltmul", FORWARD, matrix1, 1, 2);
         auto out = Mat<R>::empty_like(matrix1);
         MAT(out) = MAT(matrix1).wrapper() * MAT(matrix2).wrapper();
         if (graph::backprop_enabled())
-            graph::emplace_back([matrix1, matrix2, out]() mutable {
-                SAFE_GRAD(matrix1) += MAT(matrix2).wrapper() * GRAD(out).wrapper();
-                SAFE_GRAD(matrix2) += MAT(matrix1).wrapper() * GRAD(out).wrapper();
-            });
+            graph::emplace_node<eltmul_node<R>>(matrix1, matrix2, out);
         return out;
     }
 
@@ -107,10 +176,12 @@ namespace matops {
         }
         ASSERT2(matrix1.dims(0) == matrix2.dims(0) && matrix1.dims(1) == matrix2.dims(1),
                 "Matrices cannot be element-wise divided, they do not have the same dimensions.");
+        DALI_COUNT_ELEMENTWISE("eltdivide", FORWARD, matrix1, 1, 2);
         auto out = Mat<R>::empty_like(matrix1);
         MAT(out) = MAT(matrix1).wrapper() / MAT(matrix2).wrapper();
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
+                DALI_COUNT_BINARY_BACKWARD("eltdivide", out, 7, 5);
                 SAFE_GRAD(matrix1) += (
                     F<op::inv<R>>(MAT(matrix2).wrapper()) *
                     GRAD(out).wrapper()
@@ -137,14 +208,12 @@ namespace matops {
         }
         ASSERT2(matrix1.dims() == matrix2.dims(), "Matrices cannot be added, they do not have the same dimensions.");
 
+        DALI_COUNT_ELEMENTWISE("add", FORWARD, matrix1, 1, 2);
         auto out = Mat<R>::empty_like(matrix1);
         MAT(out) = MAT(matrix1).wrapper() + MAT(matrix2).wrapper();
 
         if (graph::backprop_enabled())
-            graph::emplace_back([matrix1, matrix2, out]() mutable {
-                SAFE_GRAD(matrix1) += GRAD(out).wrapper();
-                SAFE_GRAD(matrix2) += GRAD(out).wrapper();
-            });
+            graph::emplace_node<add_node<R>>(matrix1, matrix2, out);
         return out;
     }
 
@@ -164,14 +233,12 @@ namespace matops {
 
         ASSERT2(matrix1.dims() == matrix2.dims(), "Matrices cannot be subtracted, they do not have the same dimensions.");
 
+        DALI_COUNT_ELEMENTWISE("sub", FORWARD, matrix1, 1, 2);
         auto out = Mat<R>::empty_like(matrix1);
         MAT(out) = MAT(matrix1).wrapper() - MAT(matrix2).wrapper();
 
         if (graph::backprop_enabled())
-            graph::emplace_back([matrix1, matrix2, out]() mutable {
-                SAFE_GRAD(matrix1) += GRAD(out).wrapper();
-                SAFE_GRAD(matrix2) -= GRAD(out).wrapper();
-            });
+            graph::emplace_node<sub_node<R>>(matrix1, matrix2, out);
 
         return out;
     }
@@ -350,16 +417,13 @@ namespace matops {
             Mat<R> matrix1,
             Mat<R> matrix2) {
         ASSERT2(matrix1.dims(1) == matrix2.dims(0), "matrix product dimensions misaligned.");
+        DALI_COUNT_MUL_FORWARD("mul", matrix1, matrix2);
         Mat<R> out (matrix1.dims(0), matrix2.dims(1), weights<R>::empty());
 
         MAT(out) = dot( MAT(matrix1).wrapper(), MAT(matrix2).wrapper() );
 
         if (graph::backprop_enabled())
-            graph::emplace_back([matrix1, matrix2, out]() mutable {
-
-                SAFE_GRAD(matrix1) += dot( GRAD(out).wrapper(),        MAT(matrix2).wrapper().T() );
-                SAFE_GRAD(matrix2) += dot( MAT(matrix1).wrapper().T(), GRAD(out).wrapper() );
-            });
+            graph::emplace_node<mul_node<R>>(matrix1, matrix2, out);
         return out;
     }
 
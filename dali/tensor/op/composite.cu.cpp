@@ -1,5 +1,10 @@
 #include "dali/tensor/op/composite.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
 #include "dali/tensor/__MatMacros__.h"
 #include "dali/math/TensorOps.h"
 #include "dali/math/LazyTensor.h"
@@ -9,6 +14,711 @@ using std::vector;
 using utils::MS;
 
 namespace matops {
+    template<typename R>
+    void add_gradient_writes(const vector<Mat<R>>& mats, graph::Dependencies& deps) {
+        for (auto& mat : mats) {
+            if (!mat.constant) {
+                deps.writes.emplace_back(GRAD_HANDLE(mat));
+            }
+        }
+    }
+
+    // records that `columns` of `matrices` get gradient, for those in
+    // sparse gradient mode (see Mat::set_sparse_gradient_columns).
+    template<typename R>
+    void touch_columns(const vector<Mat<R>>& matrices, const vector<int>& columns) {
+        for (auto& matrix : matrices) {
+            if (!matrix.constant && matrix.sparse_gradient()) {
+                for (int col : columns) {
+                    matrix.touch_column(col);
+                }
+            }
+        }
+    }
+
+    // work of mul_add_mul_with_bias: forward, one product per input
+    // accumulated into the output, which starts as the bias; backward,
+    // two products per input (one per gradient) and the bias gradient.
+    template<typename R>
+    utils::profiler::OpWork mul_add_mul_with_bias_work(const vector<Mat<R>>& weight_mats,
+                                                       const vector<Mat<R>>& inputs,
+                                                       dim_t max_num_examples,
+                                                       bool backward) {
+        const double out_size = (double)max_num_examples * weight_mats[0].dims(1);
+        utils::profiler::OpWork work{out_size, 0.0, 0.0};
+        if (backward) {
+            work.bytes_read    = out_size + weight_mats[0].dims(1);
+            work.bytes_written = weight_mats[0].dims(1);
+        } else {
+            work.bytes_read    = weight_mats[0].dims(1);
+            work.bytes_written = out_size;
+        }
+        for (int i = 0; i < weight_mats.size(); ++i) {
+            const double flops    = 2.0 * inputs[i].number_of_elements() * weight_mats[i].dims(1);
+            const double operands = (double)inputs[i].number_of_elements() + weight_mats[i].number_of_elements();
+            if (backward) {
+                work.flops         += 2.0 * flops;
+                work.bytes_read    += 2.0 * (operands + out_size);
+                work.bytes_written += operands;
+            } else {
+                work.flops         += flops;
+                work.bytes_read    += operands + out_size;
+            }
+        }
+        work.bytes_read    *= sizeof(R);
+        work.bytes_written *= sizeof(R);
+        return work;
+    }
+
+    template<typename R>
+    struct mul_add_mul_with_bias_node {
+        vector<Mat<R>> weight_mats;
+        vector<Mat<R>> inputs;
+        Mat<R> bias;
+        Mat<R> out;
+        dim_t max_num_examples;
+
+        void dependencies(graph::Dependencies& deps) {
+            deps.reads.emplace_back(GRAD_HANDLE(out));
+            add_gradient_writes(weight_mats, deps);
+            add_gradient_writes(inputs, deps);
+            add_gradient_writes<R>({bias}, deps);
+        }
+
+        void backward() {
+            DALI_COUNT_OP_WORK("mul_add_mul_with_bias", BACKWARD,
+                mul_add_mul_with_bias_work(weight_mats, inputs, max_num_examples, true),
+                max_num_examples, inputs[0].dims(1), out.dims(1), (int64_t)inputs.size());
+            for (int i = 0; i < weight_mats.size(); ++i) {
+
+                if (inputs[i].dims(0) == max_num_examples) {
+                    SAFE_GRAD(inputs[i]) += dot(GRAD(out).wrapper(),
+                                                MAT(weight_mats[i]).wrapper().T());
+
+                    SAFE_GRAD(weight_mats[i]) += dot(MAT(inputs[i]).wrapper().T(),
+                                                     GRAD(out).wrapper());
+                } else {
+                    TensorInternal<R, 2> temp(mshadow::Shape2(1, out.dims(1)));
+                    temp[0] = sum_rows(GRAD(out).wrapper());
+
+
+                    SAFE_GRAD(inputs[i]) += dot(
+                        temp.wrapper(), MAT(weight_mats[i]).wrapper().T()
+                    );
+
+                    SAFE_GRAD(weight_mats[i]) += dot(MAT(inputs[i]).wrapper().T(), temp.wrapper());
+                }
+            }
+            SAFE_GRAD(bias).ravel() += sum_rows(GRAD(out).wrapper());
+        }
+    };
+
+    // `state` (one row, or one row per example) transposed to one
+    // column per example, like the gates of fused_lstm_cell.
+    template<typename R>
+    TensorInternal<R, 2> transposed_state(const Mat<R>& state, dim_t num_examples) {
+        TensorInternal<R, 2> transposed(mshadow::Shape2(state.dims(1), num_examples));
+        if (state.dims(0) == num_examples) {
+            transposed = MAT(state).wrapper().T();
+        } else {
+            transposed = MAT(state).ravel().wrapper().template broadcast<0>(transposed.shape);
+        }
+        return transposed;
+    }
+
+    template<typename R>
+    struct fused_lstm_cell_node {
+        vector<Mat<R>> weight_mats;
+        vector<Mat<R>> inputs;
+        Mat<R> bias;
+        vector<Mat<R>> prev_memories;
+        // activated gates and new memory, one column per example
+        // (see fused_lstm_cell).
+        TensorInternal<R, 2> gates;
+        TensorInternal<R, 2> memory_t;
+        Mat<R> memory;
+        Mat<R> hidden;
+        dim_t num_examples;
+        int num_children;
+        int hidden_size;
+
+        void dependencies(graph::Dependencies& deps) {
+            deps.reads.emplace_back(GRAD_HANDLE(memory));
+            deps.reads.emplace_back(GRAD_HANDLE(hidden));
+            add_gradient_writes(weight_mats, deps);
+            add_gradient_writes(inputs, deps);
+            add_gradient_writes(prev_memories, deps);
+            add_gradient_writes<R>({bias}, deps);
+        }
+
+        TensorInternal<R, 2> gate(const TensorInternal<R, 2>& tensor, int gidx) const {
+            return tensor.Slice(gidx * hidden_size, (gidx + 1) * hidden_size);
+        }
+
+        void backward() {
+            auto input_gate  = gate(gates, 0);
+            auto output_gate = gate(gates, num_children + 1);
+            auto cell_write  = gate(gates, num_children + 2);
+
+            TensorInternal<R, 2> tanh_memory(memory_t.shape);
+            tanh_memory = F<TensorOps::op::tanh<R>>(memory_t.wrapper());
+            TensorInternal<R, 2> dhidden(memory_t.shape);
+            dhidden = GRAD(hidden).wrapper().T();
+            TensorInternal<R, 2> dmemory(memory_t.shape);
+            dmemory = GRAD(memory).wrapper().T();
+            dmemory += dhidden.wrapper() * output_gate.wrapper() *
+                       F<TensorOps::op::dtanh<R>>(tanh_memory.wrapper());
+
+            // gradient with respect to the gate preactivations:
+            TensorInternal<R, 2> gates_grad(gates.shape);
+            gate(gates_grad, 0) = dmemory.wrapper() * cell_write.wrapper() *
+                                  F<TensorOps::op::dsigmoid<R>>(input_gate.wrapper());
+            gate(gates_grad, num_children + 1) = dhidden.wrapper() * tanh_memory.wrapper() *
+                                                 F<TensorOps::op::dsigmoid<R>>(output_gate.wrapper());
+            gate(gates_grad, num_children + 2) = dmemory.wrapper() * input_gate.wrapper() *
+                                                 F<TensorOps::op::dtanh<R>>(cell_write.wrapper());
+            for (int cidx = 0; cidx < num_children; ++cidx) {
+                auto forget_gate = gate(gates, cidx + 1);
+                auto prev_t = transposed_state(prev_memories[cidx], num_examples);
+                gate(gates_grad, cidx + 1) = dmemory.wrapper() * prev_t.wrapper() *
+                                             F<TensorOps::op::dsigmoid<R>>(forget_gate.wrapper());
+                if (prev_memories[cidx].constant) {
+                    continue;
+                }
+                if (prev_memories[cidx].dims(0) == num_examples) {
+                    TensorInternal<R, 2> prev_grad(memory_t.shape);
+                    prev_grad = dmemory.wrapper() * forget_gate.wrapper();
+                    GRAD(prev_memories[cidx]) += prev_grad.wrapper().T();
+                } else {
+                    GRAD(prev_memories[cidx]).ravel() += sum_cols(dmemory.wrapper() * forget_gate.wrapper());
+                }
+            }
+
+            for (int i = 0; i < weight_mats.size(); ++i) {
+                if (inputs[i].dims(0) == num_examples) {
+                    SAFE_GRAD(inputs[i]) += dot(gates_grad.wrapper().T(),
+                                                MAT(weight_mats[i]).wrapper().T());
+                    SAFE_GRAD(weight_mats[i]) += dot(MAT(inputs[i]).wrapper().T(),
+                                                     gates_grad.wrapper().T());
+                } else {
+                    TensorInternal<R, 2> temp(mshadow::Shape2(1, gates.shape[0]));
+                    temp[0] = sum_cols(gates_grad.wrapper());
+
+                    SAFE_GRAD(inputs[i]) += dot(temp.wrapper(), MAT(weight_mats[i]).wrapper().T());
+                    SAFE_GRAD(weight_mats[i]) += dot(MAT(inputs[i]).wrapper().T(), temp.wrapper());
+                }
+            }
+            if (bias.dims(0) == num_examples) {
+                SAFE_GRAD(bias) += gates_grad.wrapper().T();
+            } else {
+                SAFE_GRAD(bias).ravel() += sum_cols(gates_grad.wrapper());
+            }
+        }
+    };
+
+    // gradient of the recurrent weights of fused_lstm_sequence, once
+    // every timestep has added its gate gradients to `projections`.
+    template<typename R>
+    struct fused_lstm_recurrent_node {
+        Mat<R> recurrent_weights;
+        Mat<R> previous_hiddens;
+        Mat<R> projections;
+
+        void dependencies(graph::Dependencies& deps) {
+            deps.reads.emplace_back(GRAD_HANDLE(projections));
+            add_gradient_writes<R>({recurrent_weights}, deps);
+        }
+
+        void backward() {
+            GRAD(recurrent_weights) += dot(MAT(previous_hiddens).wrapper().T(),
+                                           GRAD(projections).wrapper());
+        }
+    };
+
+    // columns of the vocabulary scored at once by
+    // fused_softmax_cross_entropy_rowwise.
+    const int FUSED_SOFTMAX_BLOCK = 1024;
+
+    // columns [start, start + size) of tensor (sharing its memory).
+    template<typename R>
+    mshadow::Tensor<mshadow::cpu, 2, R> column_block(mshadow::Tensor<mshadow::cpu, 2, R> tensor, int start, int size) {
+        return mshadow::Tensor<mshadow::cpu, 2, R>(
+            tensor.dptr_ + start, mshadow::Shape2(tensor.size(0), size), tensor.stride_, tensor.stream_
+        );
+    }
+
+    // scores += inputs[i] * weights[i] for every input (inputs with
+    // one row are broadcast to every example).
+    template<typename R>
+    void add_input_scores(const vector<Mat<R>>& inputs,
+                          const vector<mshadow::Tensor<mshadow::cpu, 2, R>>& weights,
+                          mshadow::Tensor<mshadow::cpu, 2, R> scores) {
+        const int num_examples = scores.size(0);
+        const int size         = scores.size(1);
+        for (int i = 0; i < inputs.size(); ++i) {
+            if (inputs[i].dims(0) == num_examples) {
+                scores += mshadow::expr::dot(MAT(inputs[i]).cpu_data(), weights[i]);
+            } else {
+                vector<R> broadcast(size);
+                mshadow::Tensor<mshadow::cpu, 2, R> broadcast_scores(broadcast.data(), mshadow::Shape2(1, size));
+                broadcast_scores = mshadow::expr::dot(MAT(inputs[i]).cpu_data(), weights[i]);
+                for (int row = 0; row < num_examples; ++row) {
+                    R* row_scores = scores[row].dptr_;
+                    for (int col = 0; col < size; ++col) {
+                        row_scores[col] += broadcast[col];
+                    }
+                }
+            }
+        }
+    }
+
+    // scores of the columns [start, start + scores.size(1)) of
+    // mul_add_mul_with_bias(weight_mats, inputs, bias).
+    template<typename R>
+    void score_block(const vector<Mat<R>>& weight_mats,
+                     const vector<Mat<R>>& inputs,
+                     Mat<R> bias,
+                     int start,
+                     mshadow::Tensor<mshadow::cpu, 2, R> scores) {
+        const int num_examples = scores.size(0);
+        const int size         = scores.size(1);
+        const R* bias_data = MAT(bias).ravel().cpu_data().dptr_ + start;
+        for (int row = 0; row < num_examples; ++row) {
+            std::copy(bias_data, bias_data + size, scores[row].dptr_);
+        }
+        vector<mshadow::Tensor<mshadow::cpu, 2, R>> weights_blocks;
+        for (auto& weights : weight_mats) {
+            weights_blocks.emplace_back(column_block(MAT(weights).cpu_data(), start, size));
+        }
+        add_input_scores(inputs, weights_blocks, scores);
+    }
+
+    template<typename R>
+    struct fused_softmax_cross_entropy_node {
+        vector<Mat<R>> weight_mats;
+        vector<Mat<R>> inputs;
+        Mat<R> bias;
+        Mat<int> targets;
+        Mat<R> mask;
+        Mat<R> out;
+        // logsumexp of the scores of each example.
+        TensorInternal<R, 1> logsumexp;
+        int num_examples;
+
+        void dependencies(graph::Dependencies& deps) {
+            deps.reads.emplace_back(GRAD_HANDLE(out));
+            add_gradient_writes(weight_mats, deps);
+            add_gradient_writes(inputs, deps);
+            add_gradient_writes<R>({bias}, deps);
+        }
+
+        void backward() {
+            const int vocab_size = bias.number_of_elements();
+            const int block      = std::min(FUSED_SOFTMAX_BLOCK, vocab_size);
+            auto targets_data   = targets.w().ravel().cpu_data();
+            auto logsumexp_data = logsumexp.cpu_data();
+            // gradient of the error of each example, through the mask.
+            vector<R> error_grad(num_examples);
+            {
+                auto out_grad  = GRAD(out).ravel().cpu_data();
+                auto mask_data = MAT(mask).ravel().cpu_data();
+                for (int row = 0; row < num_examples; ++row) {
+                    error_grad[row] = out_grad[row] * mask_data[row];
+                }
+            }
+            vector<R> buffer((size_t)num_examples * block);
+            vector<R> column_sums(block);
+            for (int start = 0; start < vocab_size; start += block) {
+                const int size = std::min(block, vocab_size - start);
+                // the scores of the block become their gradient:
+                // (softmax - one hot target) * error gradient.
+                mshadow::Tensor<mshadow::cpu, 2, R> scores(buffer.data(), mshadow::Shape2(num_examples, size));
+                score_block(weight_mats, inputs, bias, start, scores);
+                std::fill(column_sums.begin(), column_sums.begin() + size, (R)0.0);
+                for (int row = 0; row < num_examples; ++row) {
+                    R* row_grad = scores[row].dptr_;
+                    for (int col = 0; col < size; ++col) {
+                        row_grad[col] = std::exp(row_grad[col] - logsumexp_data[row]) * error_grad[row];
+                    }
+                    const int target = targets_data[row] - start;
+                    if (target >= 0 && target < size) {
+                        row_grad[target] -= error_grad[row];
+                    }
+                    for (int col = 0; col < size; ++col) {
+                        column_sums[col] += row_grad[col];
+                    }
+                }
+                mshadow::Tensor<mshadow::cpu, 2, R> summed(column_sums.data(), mshadow::Shape2(1, size));
+
+                if (!bias.constant) {
+                    R* bias_grad = GRAD(bias).ravel().mutable_cpu_data().dptr_ + start;
+                    for (int col = 0; col < size; ++col) {
+                        bias_grad[col] += column_sums[col];
+                    }
+                }
+                for (int i = 0; i < weight_mats.size(); ++i) {
+                    // broadcast inputs see the gradient summed over examples.
+                    auto block_grad = inputs[i].dims(0) == num_examples ? scores : summed;
+                    if (!inputs[i].constant) {
+                        auto input_grad = GRAD(inputs[i]).mutable_cpu_data();
+                        input_grad += mshadow::expr::dot(
+                            block_grad, column_block(MAT(weight_mats[i]).cpu_data(), start, size).T()
+                        );
+                    }
+                    if (!weight_mats[i].constant) {
+                        auto weights_grad = column_block(GRAD(weight_mats[i]).mutable_cpu_data(), start, size);
+                        weights_grad += mshadow::expr::dot(MAT(inputs[i]).cpu_data().T(), block_grad);
+                    }
+                }
+            }
+        }
+    };
+
+    inline double softplus(double x) {
+        return std::max(x, 0.0) + std::log1p(std::exp(-std::abs(x)));
+    }
+
+    inline double sigmoid(double x) {
+        return 1.0 / (1.0 + std::exp(-x));
+    }
+
+    // the given columns of each weight matrix, side by side.
+    template<typename R>
+    vector<TensorInternal<R, 2>> gather_columns(const vector<Mat<R>>& weight_mats,
+                                                const vector<int>& columns) {
+        vector<TensorInternal<R, 2>> gathered;
+        for (auto& weights : weight_mats) {
+            gathered.emplace_back(mshadow::Shape2(weights.dims(0), columns.size()));
+            auto source = MAT(weights).cpu_data();
+            auto dest   = gathered.back().overwrite_cpu_data();
+            for (int k = 0; k < weights.dims(0); ++k) {
+                for (int col = 0; col < columns.size(); ++col) {
+                    dest[k][col] = source[k][columns[col]];
+                }
+            }
+        }
+        return gathered;
+    }
+
+    // Backpropagates scores_grad, the gradient of the scores of the
+    // gathered columns (examples x columns), to the inputs and to those
+    // columns of the weights and bias. Broadcast inputs see the
+    // gradient summed over examples.
+    template<typename R>
+    void backward_gathered_columns(const vector<Mat<R>>& weight_mats,
+                                   const vector<Mat<R>>& inputs,
+                                   Mat<R> bias,
+                                   const vector<int>& columns,
+                                   const vector<TensorInternal<R, 2>>& gathered,
+                                   mshadow::Tensor<mshadow::cpu, 2, R> scores_grad) {
+        const int num_examples = scores_grad.size(0);
+        const int num_columns  = columns.size();
+        vector<R> column_sums(num_columns, 0);
+        for (int row = 0; row < num_examples; ++row) {
+            for (int col = 0; col < num_columns; ++col) {
+                column_sums[col] += scores_grad[row][col];
+            }
+        }
+        mshadow::Tensor<mshadow::cpu, 2, R> summed(column_sums.data(), mshadow::Shape2(1, num_columns));
+
+        if (!bias.constant) {
+            auto bias_grad = GRAD(bias).ravel().mutable_cpu_data();
+            for (int col = 0; col < num_columns; ++col) {
+                bias_grad[columns[col]] += column_sums[col];
+            }
+        }
+        for (int i = 0; i < weight_mats.size(); ++i) {
+            const int input_size = weight_mats[i].dims(0);
+            auto block_grad = inputs[i].dims(0) != num_examples ? summed : scores_grad;
+            if (!inputs[i].constant) {
+                GRAD(inputs[i]).mutable_cpu_data() += mshadow::expr::dot(block_grad, gathered[i].cpu_data().T());
+            }
+            if (!weight_mats[i].constant) {
+                vector<R> gathered_grad((size_t)input_size * num_columns);
+                mshadow::Tensor<mshadow::cpu, 2, R> gathered_grad_data(
+                    gathered_grad.data(), mshadow::Shape2(input_size, num_columns)
+                );
+                gathered_grad_data = mshadow::expr::dot(MAT(inputs[i]).cpu_data().T(), block_grad);
+                auto weights_grad = GRAD(weight_mats[i]).mutable_cpu_data();
+                for (int k = 0; k < input_size; ++k) {
+                    for (int col = 0; col < num_columns; ++col) {
+                        weights_grad[k][columns[col]] += gathered_grad_data[k][col];
+                    }
+                }
+            }
+        }
+    }
+
+    // see sampled_softmax_cross_entropy_rowwise and nce_rowwise.
+    template<typename R>
+    struct sampled_objective_node {
+        vector<Mat<R>> weight_mats;
+        vector<Mat<R>> inputs;
+        Mat<R> bias;
+        Mat<int> targets;
+        vector<int> negatives;
+        // the negatives' columns of each weight matrix.
+        vector<TensorInternal<R, 2>> gathered;
+        // gradients of each example's error (mask included) with
+        // respect to the scores of its target and of the negatives.
+        TensorInternal<R, 1> target_grad;
+        TensorInternal<R, 2> negatives_grad;
+        Mat<R> out;
+        int num_examples;
+
+        void dependencies(graph::Dependencies& deps) {
+            deps.reads.emplace_back(GRAD_HANDLE(out));
+            add_gradient_writes(weight_mats, deps);
+            add_gradient_writes(inputs, deps);
+            add_gradient_writes<R>({bias}, deps);
+        }
+
+        void backward() {
+            const int num_negatives = negatives.size();
+            auto targets_data = targets.w().ravel().cpu_data();
+            auto out_grad     = GRAD(out).ravel().cpu_data();
+            // scaled by the gradient of each error:
+            vector<R> target_scores_grad(num_examples);
+            vector<R> scores_grad((size_t)num_examples * num_negatives);
+            {
+                auto target_grad_data = target_grad.cpu_data();
+                auto unit_grad        = negatives_grad.cpu_data();
+                for (int row = 0; row < num_examples; ++row) {
+                    target_scores_grad[row] = target_grad_data[row] * out_grad[row];
+                    for (int col = 0; col < num_negatives; ++col) {
+                        scores_grad[(size_t)row * num_negatives + col] = unit_grad[row][col] * out_grad[row];
+                    }
+                }
+            }
+            backward_gathered_columns(
+                weight_mats, inputs, bias, negatives, gathered,
+                mshadow::Tensor<mshadow::cpu, 2, R>(scores_grad.data(), mshadow::Shape2(num_examples, num_negatives))
+            );
+
+            // the target of each example:
+            if (!bias.constant) {
+                auto bias_grad = GRAD(bias).ravel().mutable_cpu_data();
+                for (int row = 0; row < num_examples; ++row) {
+                    bias_grad[targets_data[row]] += target_scores_grad[row];
+                }
+            }
+            for (int i = 0; i < weight_mats.size(); ++i) {
+                const int input_size = weight_mats[i].dims(0);
+                const bool broadcast = inputs[i].dims(0) != num_examples;
+                if (!inputs[i].constant) {
+                    auto weights_data = MAT(weight_mats[i]).cpu_data();
+                    auto input_grad   = GRAD(inputs[i]).mutable_cpu_data();
+                    for (int row = 0; row < num_examples; ++row) {
+                        R* row_grad = input_grad[broadcast ? 0 : row].dptr_;
+                        const int target = targets_data[row];
+                        for (int k = 0; k < input_size; ++k) {
+                            row_grad[k] += target_scores_grad[row] * weights_data[k][target];
+                        }
+                    }
+                }
+                if (!weight_mats[i].constant) {
+                    auto input_data   = MAT(inputs[i]).cpu_data();
+                    auto weights_grad = GRAD(weight_mats[i]).mutable_cpu_data();
+                    for (int row = 0; row < num_examples; ++row) {
+                        const R* row_input = input_data[broadcast ? 0 : row].dptr_;
+                        const int target = targets_data[row];
+                        for (int k = 0; k < input_size; ++k) {
+                            weights_grad[k][target] += row_input[k] * target_scores_grad[row];
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    template<typename R>
+    Mat<R> sampled_objective(const vector<Mat<R>>& weight_mats,
+                             const vector<Mat<R>>& inputs,
+                             Mat<R> bias,
+                             Mat<int> targets,
+                             Mat<R> mask,
+                             const utils::UnigramSampler& sampler,
+                             const utils::NegativeSample& negatives,
+                             bool nce) {
+        ASSERT2(weight_mats.size() == inputs.size() && !inputs.empty(),
+                "Different number of weights and inputs passed to a sampled objective");
+        const int vocab_size = weight_mats[0].dims(1);
+        ASSERT2(bias.number_of_elements() == vocab_size,
+                MS() << "Sampled objective bias should have "
+                     << vocab_size << " elements (got " << bias.number_of_elements() << ")");
+        ASSERT2(sampler.size() == vocab_size,
+                MS() << "Sampled objective sampler draws from " << sampler.size()
+                     << " words but the vocabulary has " << vocab_size);
+        const int num_negatives = negatives.words.size();
+        ASSERT2(num_negatives > 0, "Sampled objective needs at least one negative.");
+        for (int word : negatives.words) {
+            ASSERT2(word >= 0 && word < vocab_size,
+                    MS() << "Sampled objective: negative " << word << " is not in [0, " << vocab_size << ")");
+        }
+        dim_t num_examples = 0;
+        for (auto& input : inputs) {
+            num_examples = std::max(num_examples, input.dims(0));
+        }
+        for (int i = 0; i < weight_mats.size(); ++i) {
+            ASSERT2((inputs[i].dims(0) == num_examples) || (inputs[i].dims(0) == 1),
+                    MS() << "incorrect outer dimension for input " << i);
+            ASSERT2(inputs[i].dims(1) == weight_mats[i].dims(0),
+                    MS() << "Disagreement on inner dimension on input pair " << i);
+            ASSERT2(weight_mats[i].dims(1) == vocab_size,
+                    MS() << "Sampled objective weight " << i << " should have "
+                         << vocab_size << " columns");
+        }
+        ASSERT2(targets.number_of_elements() == num_examples,
+                MS() << "Sampled objective: Number of targets ("
+                     << targets.number_of_elements() << ") should equal number of examples ("
+                     << num_examples << ")");
+        ASSERT2(mask.number_of_elements() == num_examples,
+                MS() << "Sampled objective: Number of mask values ("
+                     << mask.number_of_elements() << ") should equal number of examples ("
+                     << num_examples << ")");
+
+        Mat<R> out(num_examples, 1, weights<R>::empty());
+        TensorInternal<R, 1> target_grad(mshadow::Shape1(num_examples));
+        TensorInternal<R, 2> negatives_grad(mshadow::Shape2(num_examples, num_negatives));
+        auto gathered = gather_columns(weight_mats, negatives.words);
+
+        // not GPU friendly.
+        {
+            vector<mshadow::Tensor<mshadow::cpu, 2, R>> gathered_data;
+            for (auto& columns : gathered) {
+                gathered_data.emplace_back(columns.cpu_data());
+            }
+
+            // corrected scores of the negatives, which become their gradient.
+            auto bias_data = MAT(bias).ravel().cpu_data();
+            auto scores    = negatives_grad.overwrite_cpu_data();
+            for (int row = 0; row < num_examples; ++row) {
+                for (int col = 0; col < num_negatives; ++col) {
+                    scores[row][col] = bias_data[negatives.words[col]] - std::log(negatives.expected_counts[col]);
+                }
+            }
+            add_input_scores(inputs, gathered_data, scores);
+
+            auto targets_data     = targets.w().ravel().cpu_data();
+            auto mask_data        = MAT(mask).ravel().cpu_data();
+            auto out_data         = MAT(out).ravel().overwrite_cpu_data();
+            auto target_grad_data = target_grad.overwrite_cpu_data();
+            vector<mshadow::Tensor<mshadow::cpu, 2, R>> inputs_data, weights_data;
+            for (int i = 0; i < weight_mats.size(); ++i) {
+                inputs_data.emplace_back(MAT(inputs[i]).cpu_data());
+                weights_data.emplace_back(MAT(weight_mats[i]).cpu_data());
+            }
+            for (int row = 0; row < num_examples; ++row) {
+                const int target = targets_data[row];
+                ASSERT2(target >= 0 && target < vocab_size,
+                        MS() << "Sampled objective: target " << target
+                             << " is not in [0, " << vocab_size << ")");
+                // corrected score of the target.
+                R target_score = bias_data[target] - std::log(sampler.expected_count(target, negatives.num_tries));
+                for (int i = 0; i < weight_mats.size(); ++i) {
+                    const R* row_input = inputs_data[i][inputs[i].dims(0) == num_examples ? row : 0].dptr_;
+                    for (int k = 0; k < weight_mats[i].dims(0); ++k) {
+                        target_score += row_input[k] * weights_data[i][k][target];
+                    }
+                }
+
+                R* row_scores = scores[row].dptr_;
+                R error;
+                if (nce) {
+                    error = softplus(-target_score);
+                    target_grad_data[row] = sigmoid(target_score) - 1.0;
+                    for (int col = 0; col < num_negatives; ++col) {
+                        if (negatives.words[col] == target) {
+                            row_scores[col] = 0.0;
+                            continue;
+                        }
+                        error += softplus(row_scores[col]);
+                        row_scores[col] = sigmoid(row_scores[col]);
+                    }
+                } else {
+                    R max_score = target_score;
+                    for (int col = 0; col < num_negatives; ++col) {
+                        if (negatives.words[col] != target) {
+                            max_score = std::max(max_score, row_scores[col]);
+                        }
+                    }
+                    R sum = std::exp(target_score - max_score);
+                    for (int col = 0; col < num_negatives; ++col) {
+                        if (negatives.words[col] != target) {
+                            sum += std::exp(row_scores[col] - max_score);
+                        }
+                    }
+                    const R logsumexp = max_score + std::log(sum);
+                    error = logsumexp - target_score;
+                    target_grad_data[row] = std::exp(target_score - logsumexp) - 1.0;
+                    for (int col = 0; col < num_negatives; ++col) {
+                        row_scores[col] = negatives.words[col] == target ?
+                            0.0 : std::exp(row_scores[col] - logsumexp);
+                    }
+                }
+                out_data[row] = error * mask_data[row];
+                target_grad_data[row] *= mask_data[row];
+                for (int col = 0; col < num_negatives; ++col) {
+                    row_scores[col] *= mask_data[row];
+                }
+            }
+        }
+
+        if (graph::backprop_enabled()) {
+            // only the negatives and the targets get gradient.
+            vector<int> touched(negatives.words);
+            auto targets_data = targets.w().ravel().cpu_data();
+            touched.insert(touched.end(), targets_data.dptr_, targets_data.dptr_ + num_examples);
+            touch_columns(weight_mats, touched);
+            touch_columns<R>({bias}, touched);
+            graph::emplace_node<sampled_objective_node<R>>(
+                weight_mats, inputs, bias, targets, negatives.words, gathered,
+                target_grad, negatives_grad, out, (int)num_examples
+            );
+        }
+
+        return out;
+    }
+
+    // see hierarchical_softmax_rowwise.
+    template<typename R>
+    struct hierarchical_softmax_node {
+        vector<Mat<R>> weight_mats;
+        vector<Mat<R>> inputs;
+        Mat<R> bias;
+        // the edges of every node on the paths of the examples.
+        vector<int> columns;
+        vector<TensorInternal<R, 2>> gathered;
+        // gradient of each example's error (mask included) with respect
+        // to the scores of the gathered columns.
+        TensorInternal<R, 2> scores_grad;
+        Mat<R> out;
+
+        void dependencies(graph::Dependencies& deps) {
+            deps.reads.emplace_back(GRAD_HANDLE(out));
+            add_gradient_writes(weight_mats, deps);
+            add_gradient_writes(inputs, deps);
+            add_gradient_writes<R>({bias}, deps);
+        }
+
+        void backward() {
+            const int num_examples = scores_grad.shape[0];
+            const int num_columns  = columns.size();
+            auto out_grad  = GRAD(out).ravel().cpu_data();
+            auto unit_grad = scores_grad.cpu_data();
+            vector<R> grad((size_t)num_examples * num_columns);
+            for (int row = 0; row < num_examples; ++row) {
+                for (int col = 0; col < num_columns; ++col) {
+                    grad[(size_t)row * num_columns + col] = unit_grad[row][col] * out_grad[row];
+                }
+            }
+            backward_gathered_columns(
+                weight_mats, inputs, bias, columns, gathered,
+                mshadow::Tensor<mshadow::cpu, 2, R>(grad.data(), mshadow::Shape2(num_examples, num_columns))
+            );
+        }
+    };
+
     template<typename R>
     Mat<R> Composite<R>::quadratic_form(
             Mat<R> left,
@@ -142,6 +852,9 @@ namespace matops {
             max_num_examples = std::max(max_num_examples, input.dims(0));
         }
 
+        DALI_COUNT_OP_WORK("mul_add_mul_with_bias", FORWARD,
+            mul_add_mul_with_bias_work(weight_mats, inputs, max_num_examples, false),
+            max_num_examples, inputs[0].dims(1), weight_mats[0].dims(1), (int64_t)inputs.size());
         Mat<R> out(max_num_examples, weight_mats[0].dims(1), weights<R>::empty());
         MAT(out) = MAT(bias).ravel().wrapper().template broadcast<1>(MAT(out).shape);
 
@@ -168,34 +881,411 @@ namespace matops {
         }
 
         if (graph::backprop_enabled())
-            graph::emplace_back([weight_mats, inputs, bias, out, max_num_examples]() mutable {
+            graph::emplace_node<mul_add_mul_with_bias_node<R>>(weight_mats, inputs, bias, out, max_num_examples);
 
-                for (int i = 0; i < weight_mats.size(); ++i) {
+        return out;
+    }
+
+    template<typename R>
+    Mat<R> Composite<R>::fused_softmax_cross_entropy_rowwise(const vector<Mat<R>>& weight_mats,
+                                                             const vector<Mat<R>>& inputs,
+                                                             Mat<R> bias,
+                                                             Mat<int> targets,
+                                                             Mat<R> mask) {
+        ASSERT2(weight_mats.size() == inputs.size() && !inputs.empty(),
+                "Different number of weights and inputs passed to fused_softmax_cross_entropy_rowwise");
+        const int vocab_size = weight_mats[0].dims(1);
+        ASSERT2(bias.number_of_elements() == vocab_size,
+                MS() << "fused_softmax_cross_entropy_rowwise bias should have "
+                     << vocab_size << " elements (got " << bias.number_of_elements() << ")");
+        // broacast to largest number of examples
+        dim_t num_examples = 0;
+        for (auto& input : inputs) {
+            num_examples = std::max(num_examples, input.dims(0));
+        }
+        for (int i = 0; i < weight_mats.size(); ++i) {
+            ASSERT2((inputs[i].dims(0) == num_examples) || (inputs[i].dims(0) == 1),
+                    MS() << "incorrect outer dimension for input " << i);
+            ASSERT2(inputs[i].dims(1) == weight_mats[i].dims(0),
+                    MS() << "Disagreement on inner dimension on input pair " << i);
+            ASSERT2(weight_mats[i].dims(1) == vocab_size,
+                    MS() << "fused_softmax_cross_entropy_rowwise weight " << i << " should have "
+                         << vocab_size << " columns");
+        }
+        ASSERT2(targets.number_of_elements() == num_examples,
+                MS() << "Softmax cross entropy: Number of targets ("
+                     << targets.number_of_elements() << ") should equal number of examples ("
+                     << num_examples << ")");
+        ASSERT2(mask.number_of_elements() == num_examples,
+                MS() << "Softmax cross entropy: Number of mask values ("
+                     << mask.number_of_elements() << ") should equal number of examples ("
+                     << num_examples << ")");
 
-                    if (inputs[i].dims(0) == max_num_examples) {
-                        SAFE_GRAD(inputs[i]) += dot(GRAD(out).wrapper(),
-                                                    MAT(weight_mats[i]).wrapper().T());
+        Mat<R> out(num_examples, 1, weights<R>::empty());
+        TensorInternal<R, 1> logsumexp(mshadow::Shape1(num_examples));
 
-                        SAFE_GRAD(weight_mats[i]) += dot(MAT(inputs[i]).wrapper().T(),
-                                                         GRAD(out).wrapper());
-                    } else {
-                        TensorInternal<R, 2> temp(mshadow::Shape2(1, out.dims(1)));
-                        temp[0] = sum_rows(GRAD(out).wrapper());
+        // not GPU friendly.
+        {
+            auto targets_data   = targets.w().ravel().cpu_data();
+            auto mask_data      = MAT(mask).ravel().cpu_data();
+            auto out_data       = MAT(out).ravel().overwrite_cpu_data();
+            auto logsumexp_data = logsumexp.overwrite_cpu_data();
+            for (int row = 0; row < num_examples; ++row) {
+                ASSERT2(targets_data[row] >= 0 && targets_data[row] < vocab_size,
+                        MS() << "Softmax cross entropy: target " << targets_data[row]
+                             << " is not in [0, " << vocab_size << ")");
+            }
+            // online logsumexp: sums of exp(score - running_max), rescaled
+            // whenever a block raises the maximum.
+            vector<R> running_max(num_examples, std::numeric_limits<R>::lowest());
+            vector<R> running_sum(num_examples, 0);
+            vector<R> target_score(num_examples, 0);
+            const int block = std::min(FUSED_SOFTMAX_BLOCK, vocab_size);
+            vector<R> buffer((size_t)num_examples * block);
+            for (int start = 0; start < vocab_size; start += block) {
+                const int size = std::min(block, vocab_size - start);
+                mshadow::Tensor<mshadow::cpu, 2, R> scores(buffer.data(), mshadow::Shape2(num_examples, size));
+                score_block(weight_mats, inputs, bias, start, scores);
+                for (int row = 0; row < num_examples; ++row) {
+                    const R* row_scores = scores[row].dptr_;
+                    const R block_max = *std::max_element(row_scores, row_scores + size);
+                    if (block_max > running_max[row]) {
+                        running_sum[row] *= std::exp(running_max[row] - block_max);
+                        running_max[row] = block_max;
+                    }
+                    R block_sum = 0;
+                    for (int col = 0; col < size; ++col) {
+                        block_sum += std::exp(row_scores[col] - running_max[row]);
+                    }
+                    running_sum[row] += block_sum;
+                    const int target = targets_data[row] - start;
+                    if (target >= 0 && target < size) {
+                        target_score[row] = row_scores[target];
+                    }
+                }
+            }
+            for (int row = 0; row < num_examples; ++row) {
+                logsumexp_data[row] = running_max[row] + std::log(running_sum[row]);
+                out_data[row] = (logsumexp_data[row] - target_score[row]) * mask_data[row];
+            }
+        }
 
+        if (graph::backprop_enabled())
+            graph::emplace_node<fused_softmax_cross_entropy_node<R>>(
+                weight_mats, inputs, bias, targets, mask, out, logsumexp, (int)num_examples
+            );
 
-                        SAFE_GRAD(inputs[i]) += dot(
-                            temp.wrapper(), MAT(weight_mats[i]).wrapper().T()
-                        );
+        return out;
+    }
 
-                        SAFE_GRAD(weight_mats[i]) += dot(MAT(inputs[i]).wrapper().T(), temp.wrapper());
+
+    template<typename R>
+    Mat<R> Composite<R>::sampled_softmax_cross_entropy_rowwise(const vector<Mat<R>>& weight_mats,
+                                                               const vector<Mat<R>>& inputs,
+                                                               Mat<R> bias,
+                                                               Mat<int> targets,
+                                                               Mat<R> mask,
+                                                               const utils::UnigramSampler& sampler,
+                                                               const utils::NegativeSample& negatives) {
+        return sampled_objective(weight_mats, inputs, bias, targets, mask, sampler, negatives, false);
+    }
+
+    template<typename R>
+    Mat<R> Composite<R>::nce_rowwise(const vector<Mat<R>>& weight_mats,
+                                     const vector<Mat<R>>& inputs,
+                                     Mat<R> bias,
+                                     Mat<int> targets,
+                                     Mat<R> mask,
+                                     const utils::UnigramSampler& sampler,
+                                     const utils::NegativeSample& negatives) {
+        return sampled_objective(weight_mats, inputs, bias, targets, mask, sampler, negatives, true);
+    }
+
+    template<typename R>
+    Mat<R> Composite<R>::hierarchical_softmax_rowwise(const vector<Mat<R>>& weight_mats,
+                                                      const vector<Mat<R>>& inputs,
+                                                      Mat<R> bias,
+                                                      Mat<int> targets,
+                                                      Mat<R> mask,
+                                                      const utils::SoftmaxTree& tree) {
+        ASSERT2(weight_mats.size() == inputs.size() && !inputs.empty(),
+                "Different number of weights and inputs passed to hierarchical_softmax_rowwise");
+        const int num_tree_columns = tree.num_columns();
+        ASSERT2(bias.number_of_elements() == num_tree_columns,
+                MS() << "hierarchical_softmax_rowwise bias should have one element per edge of the tree ("
+                     << num_tree_columns << ", got " << bias.number_of_elements() << ")");
+        dim_t num_examples = 0;
+        for (auto& input : inputs) {
+            num_examples = std::max(num_examples, input.dims(0));
+        }
+        for (int i = 0; i < weight_mats.size(); ++i) {
+            ASSERT2((inputs[i].dims(0) == num_examples) || (inputs[i].dims(0) == 1),
+                    MS() << "incorrect outer dimension for input " << i);
+            ASSERT2(inputs[i].dims(1) == weight_mats[i].dims(0),
+                    MS() << "Disagreement on inner dimension on input pair " << i);
+            ASSERT2(weight_mats[i].dims(1) == num_tree_columns,
+                    MS() << "hierarchical_softmax_rowwise weight " << i
+                         << " should have one column per edge of the tree (" << num_tree_columns << ")");
+        }
+        ASSERT2(targets.number_of_elements() == num_examples,
+                MS() << "hierarchical_softmax_rowwise: Number of targets ("
+                     << targets.number_of_elements() << ") should equal number of examples ("
+                     << num_examples << ")");
+        ASSERT2(mask.number_of_elements() == num_examples,
+                MS() << "hierarchical_softmax_rowwise: Number of mask values ("
+                     << mask.number_of_elements() << ") should equal number of examples ("
+                     << num_examples << ")");
+
+        // the nodes on the paths of all examples, and their edges side
+        // by side (starting at node_columns[node]).
+        auto targets_data = targets.w().ravel().cpu_data();
+        std::unordered_map<int, int> node_columns;
+        vector<int> columns;
+        for (int row = 0; row < num_examples; ++row) {
+            const int target = targets_data[row];
+            ASSERT2(target >= 0 && target < tree.num_labels() && tree.path_length(target) > 0,
+                    MS() << "hierarchical_softmax_rowwise: target " << target << " has no path in the tree");
+            for (int step = tree.path_offsets[target]; step < tree.path_offsets[target + 1]; ++step) {
+                const int node = tree.path_nodes[step];
+                if (node_columns.emplace(node, columns.size()).second) {
+                    for (int edge = tree.node_offsets[node]; edge < tree.node_offsets[node + 1]; ++edge) {
+                        columns.emplace_back(edge);
                     }
                 }
-                SAFE_GRAD(bias).ravel() += sum_rows(GRAD(out).wrapper());
-            });
+            }
+        }
+        const int num_columns = columns.size();
+
+        Mat<R> out(num_examples, 1, weights<R>::empty());
+        TensorInternal<R, 2> scores_grad(mshadow::Shape2(num_examples, num_columns));
+        auto gathered = gather_columns(weight_mats, columns);
+
+        // not GPU friendly.
+        {
+            // every example is scored on every gathered node with one
+            // product per input.
+            vector<R> scores_buffer((size_t)num_examples * num_columns);
+            mshadow::Tensor<mshadow::cpu, 2, R> scores(scores_buffer.data(), mshadow::Shape2(num_examples, num_columns));
+            auto bias_data = MAT(bias).ravel().cpu_data();
+            for (int row = 0; row < num_examples; ++row) {
+                for (int col = 0; col < num_columns; ++col) {
+                    scores[row][col] = bias_data[columns[col]];
+                }
+            }
+            vector<mshadow::Tensor<mshadow::cpu, 2, R>> gathered_data;
+            for (auto& node_weights : gathered) {
+                gathered_data.emplace_back(node_weights.cpu_data());
+            }
+            add_input_scores(inputs, gathered_data, scores);
+
+            auto mask_data = MAT(mask).ravel().cpu_data();
+            auto out_data  = MAT(out).ravel().overwrite_cpu_data();
+            auto grad      = scores_grad.overwrite_cpu_data();
+            grad = 0;
+            for (int row = 0; row < num_examples; ++row) {
+                const int target = targets_data[row];
+                const R* row_scores = scores[row].dptr_;
+                R* row_grad = grad[row].dptr_;
+                R error = 0;
+                for (int step = tree.path_offsets[target]; step < tree.path_offsets[target + 1]; ++step) {
+                    const int node  = tree.path_nodes[step];
+                    const int start = node_columns[node];
+                    const int end   = start + tree.node_offsets[node + 1] - tree.node_offsets[node];
+                    const int chosen = start + tree.path_edges[step] - tree.node_offsets[node];
+                    R max_score = row_scores[start];
+                    for (int col = start + 1; col < end; ++col) {
+                        max_score = std::max(max_score, row_scores[col]);
+                    }
+                    R sum = 0;
+                    for (int col = start; col < end; ++col) {
+                        sum += std::exp(row_scores[col] - max_score);
+                    }
+                    const R logsumexp = max_score + std::log(sum);
+                    error += logsumexp - row_scores[chosen];
+                    for (int col = start; col < end; ++col) {
+                        row_grad[col] = std::exp(row_scores[col] - logsumexp) * mask_data[row];
+                    }
+                    row_grad[chosen] -= mask_data[row];
+                }
+                out_data[row] = error * mask_data[row];
+            }
+        }
+
+        if (graph::backprop_enabled()) {
+            touch_columns(weight_mats, columns);
+            touch_columns<R>({bias}, columns);
+            graph::emplace_node<hierarchical_softmax_node<R>>(
+                weight_mats, inputs, bias, columns, gathered, scores_grad, out
+            );
+        }
 
         return out;
     }
 
+    template<typename R>
+    std::tuple<Mat<R>, Mat<R>> Composite<R>::fused_lstm_cell(
+            const vector<Mat<R>>& weight_mats,
+            const vector<Mat<R>>& inputs,
+            Mat<R> bias,
+            const vector<Mat<R>>& prev_memories) {
+        ASSERT2(weight_mats.size() == inputs.size(),
+                "Different number of weights and inputs passed to fused_lstm_cell");
+        ASSERT2(!prev_memories.empty(), "fused_lstm_cell needs at least one previous memory.");
+        const int num_children = prev_memories.size();
+        const int num_gates    = num_children + 3;
+        const int hidden_size  = prev_memories[0].dims(1);
+        ASSERT2(bias.dims(1) == num_gates * hidden_size,
+                MS() << "fused_lstm_cell bias should have " << num_gates * hidden_size
+                     << " columns (got " << bias.dims(1) << ")");
+        // broacast to largest number of examples
+        dim_t num_examples = bias.dims(0);
+        for (auto& input : inputs) {
+            num_examples = std::max(num_examples, input.dims(0));
+        }
+        for (auto& memory : prev_memories) {
+            num_examples = std::max(num_examples, memory.dims(0));
+        }
+        ASSERT2(bias.dims(0) == num_examples || bias.dims(0) == 1,
+                "incorrect outer dimension for bias");
+        for (auto& memory : prev_memories) {
+            ASSERT2(memory.dims(1) == hidden_size,
+                    "All previous memories passed to fused_lstm_cell should have the same size.");
+            ASSERT2(memory.dims(0) == num_examples || memory.dims(0) == 1,
+                    "incorrect outer dimension for previous memory");
+        }
+        for (int i = 0; i < weight_mats.size(); ++i) {
+            ASSERT2((inputs[i].dims(0) == num_examples) || (inputs[i].dims(0) == 1),
+                    MS() << "incorrect outer dimension for input " << i);
+            ASSERT2(inputs[i].dims(1) == weight_mats[i].dims(0),
+                    MS() << "Disagreement on inner dimension on input pair " << i);
+            ASSERT2(weight_mats[i].dims(1) == num_gates * hidden_size,
+                    MS() << "fused_lstm_cell weight " << i << " should have "
+                         << num_gates * hidden_size << " columns");
+        }
+
+        // gate preactivations with one product per input, transposed
+        // (one column per example) so that each gate is a block of
+        // rows that the nonlinearities can work on in place:
+        TensorInternal<R, 2> gates(mshadow::Shape2(num_gates * hidden_size, num_examples));
+        if (bias.dims(0) == num_examples) {
+            gates = MAT(bias).wrapper().T();
+        } else {
+            gates = MAT(bias).ravel().wrapper().template broadcast<0>(gates.shape);
+        }
+        for (int i = 0; i < weight_mats.size(); ++i) {
+            if (inputs[i].dims(0) == num_examples) {
+                gates += dot(MAT(weight_mats[i]).wrapper().T(), MAT(inputs[i]).wrapper().T());
+            } else {
+                TensorInternal<R, 2> temp(mshadow::Shape2(gates.shape[0], 1));
+                temp = dot(MAT(weight_mats[i]).wrapper().T(), MAT(inputs[i]).wrapper().T());
+                gates += temp.ravel().wrapper().template broadcast<0>(gates.shape);
+            }
+        }
+
+        // input, forget and output gates, then the cell write:
+        auto sigmoid_gates = gates.Slice(0, (num_children + 2) * hidden_size);
+        sigmoid_gates = F<TensorOps::op::sigmoid<R>>(sigmoid_gates.wrapper());
+        auto cell_write = gates.Slice((num_children + 2) * hidden_size, num_gates * hidden_size);
+        cell_write = F<TensorOps::op::tanh<R>>(cell_write.wrapper());
+        auto input_gate  = gates.Slice(0, hidden_size);
+        auto output_gate = gates.Slice((num_children + 1) * hidden_size, (num_children + 2) * hidden_size);
+
+        TensorInternal<R, 2> memory_t(mshadow::Shape2(hidden_size, num_examples));
+        memory_t = input_gate.wrapper() * cell_write.wrapper();
+        for (int cidx = 0; cidx < num_children; ++cidx) {
+            auto forget_gate = gates.Slice((cidx + 1) * hidden_size, (cidx + 2) * hidden_size);
+            auto prev_t = transposed_state(prev_memories[cidx], num_examples);
+            memory_t += forget_gate.wrapper() * prev_t.wrapper();
+        }
+        TensorInternal<R, 2> hidden_t(memory_t.shape);
+        hidden_t = output_gate.wrapper() * F<TensorOps::op::tanh<R>>(memory_t.wrapper());
+
+        Mat<R> memory(num_examples, hidden_size, weights<R>::empty());
+        Mat<R> hidden(num_examples, hidden_size, weights<R>::empty());
+        MAT(memory) = memory_t.wrapper().T();
+        MAT(hidden) = hidden_t.wrapper().T();
+
+        if (graph::backprop_enabled())
+            graph::emplace_node<fused_lstm_cell_node<R>>(
+                weight_mats, inputs, bias, prev_memories, gates, memory_t, memory, hidden,
+                num_examples, num_children, hidden_size
+            );
+
+        return std::make_tuple(memory, hidden);
+    }
+
+    template<typename R>
+    std::tuple<vector<Mat<R>>, vector<Mat<R>>> Composite<R>::fused_lstm_sequence(
+            const vector<Mat<R>>& input_weights,
+            const vector<vector<Mat<R>>>& inputs,
+            Mat<R> recurrent_weights,
+            Mat<R> bias,
+            Mat<R> initial_memory,
+            Mat<R> initial_hidden) {
+        ASSERT2(input_weights.size() == inputs.size() && !inputs.empty(),
+                "Different number of weights and inputs passed to fused_lstm_sequence");
+        vector<Mat<R>> memories, hiddens;
+        const int timesteps = inputs[0].size();
+        if (timesteps == 0) {
+            return std::make_tuple(memories, hiddens);
+        }
+        const int num_examples = inputs[0][0].dims(0);
+        const int hidden_size  = recurrent_weights.dims(0);
+        for (auto& input : inputs) {
+            ASSERT2(input.size() == timesteps,
+                    "All inputs passed to fused_lstm_sequence should have the same number of timesteps.");
+            for (auto& step : input) {
+                ASSERT2(step.dims(0) == num_examples,
+                        "All timesteps passed to fused_lstm_sequence should have the same number of examples.");
+            }
+        }
+        ASSERT2(initial_hidden.dims(0) == num_examples || initial_hidden.dims(0) == 1,
+                "incorrect outer dimension for initial hidden state");
+
+        // input projections for every timestep at once:
+        vector<Mat<R>> stacked_inputs;
+        for (auto& input : inputs) {
+            stacked_inputs.emplace_back(MatOps<R>::vstack(input));
+        }
+        auto projections = mul_add_mul_with_bias(input_weights, stacked_inputs, bias);
+
+        // Every timestep adds its gate gradients to the matching rows of
+        // `projections`, so once all timesteps have been backpropagated
+        // the recurrent weight gradient is a single product with the
+        // hidden states that fed each timestep.
+        Mat<R> previous_hiddens;
+        bool backprop_recurrent = graph::backprop_enabled() && !recurrent_weights.constant;
+        if (backprop_recurrent) {
+            previous_hiddens = Mat<R>(timesteps * num_examples, hidden_size, weights<R>::empty());
+            graph::emplace_node<fused_lstm_recurrent_node<R>>(
+                recurrent_weights, previous_hiddens, projections
+            );
+        }
+        auto recurrent = MatOps<R>::consider_constant(recurrent_weights);
+
+        auto memory = initial_memory;
+        auto hidden = initial_hidden;
+        for (int t = 0; t < timesteps; ++t) {
+            if (backprop_recurrent) {
+                auto dest = MAT(previous_hiddens).Slice(t * num_examples, (t + 1) * num_examples);
+                if (hidden.dims(0) == num_examples) {
+                    dest = MAT(hidden).wrapper() + (R)0.0;
+                } else {
+                    dest = MAT(hidden).ravel().wrapper().template broadcast<1>(dest.shape);
+                }
+            }
+            std::tie(memory, hidden) = fused_lstm_cell(
+                {recurrent},
+                {hidden},
+                MatOps<R>::slice(projections, t * num_examples, (t + 1) * num_examples),
+                {memory}
+            );
+            memories.emplace_back(memory);
+            hiddens.emplace_back(hidden);
+        }
+        return std::make_tuple(memories, hiddens);
+    }
+
 
     template class Composite<float>;
     template class Composite<double>;
@@ -1,6 +1,7 @@
 #ifndef DALI_TENSOR_OP_COMPOSITE_H
 #define DALI_TENSOR_OP_COMPOSITE_H
 
+#include <tuple>
 #include <vector>
 
 #include "dali/tensor/Mat.h"
@@ -26,7 +27,93 @@ namespace matops {
                                             const std::vector<Mat<R>>& inputs,
                                             Mat<R> bias);
 
+        // Masked softmax cross entropy of a decoder, row by row:
+        //
+        //     -log softmax(mul_add_mul_with_bias(weights, inputs, bias))[targets] * mask
+        //
+        // without ever holding the examples x vocabulary probabilities.
+        // The vocabulary is scored one block of columns at a time while
+        // an online logsumexp accumulates, and only the logsumexp of each
+        // example is kept for backward, which scores the blocks again.
+        // targets and mask hold one value per example; bias has one row.
+        static Mat<R> fused_softmax_cross_entropy_rowwise(const std::vector<Mat<R>>& weights,
+                                                          const std::vector<Mat<R>>& inputs,
+                                                          Mat<R> bias,
+                                                          Mat<int> targets,
+                                                          Mat<R> mask);
+
+        // Training objectives that only score each example's target and
+        // `negatives` (words shared by every example, drawn from
+        // `sampler`) instead of the whole vocabulary. The scores are those
+        // of mul_add_mul_with_bias(weights, inputs, bias), corrected by the
+        // log of each word's expected count, and negatives equal to the
+        // example's target are left out. Only the sampled columns of the
+        // weights and bias get gradient. targets and mask hold one value
+        // per example, and the error of each example is multiplied by its
+        // mask (which gets no gradient).
+        //
+        // Sampled softmax: softmax cross entropy over the target and the
+        // negatives (its gradient is an estimate of that of the full softmax).
+        static Mat<R> sampled_softmax_cross_entropy_rowwise(const std::vector<Mat<R>>& weights,
+                                                            const std::vector<Mat<R>>& inputs,
+                                                            Mat<R> bias,
+                                                            Mat<int> targets,
+                                                            Mat<R> mask,
+                                                            const utils::UnigramSampler& sampler,
+                                                            const utils::NegativeSample& negatives);
+        // Noise contrastive estimation: logistic loss telling the target
+        // (label 1) from the negatives (label 0).
+        static Mat<R> nce_rowwise(const std::vector<Mat<R>>& weights,
+                                  const std::vector<Mat<R>>& inputs,
+                                  Mat<R> bias,
+                                  Mat<int> targets,
+                                  Mat<R> mask,
+                                  const utils::UnigramSampler& sampler,
+                                  const utils::NegativeSample& negatives);
+
+        // Masked hierarchical softmax cross entropy, row by row: the
+        // error of an example is -log of the probability of its target
+        // along its path in `tree` (the sum of a softmax cross entropy
+        // per node on the path), times its mask. The scores of the edges
+        // are those of mul_add_mul_with_bias(weights, inputs, bias), whose
+        // columns are the edges of the tree (tree.num_columns()). Only the
+        // nodes on the paths of the examples are scored, with one product
+        // per input over the columns of all of them, so that the cost
+        // grows with depth * branching instead of the number of labels.
+        static Mat<R> hierarchical_softmax_rowwise(const std::vector<Mat<R>>& weights,
+                                                   const std::vector<Mat<R>>& inputs,
+                                                   Mat<R> bias,
+                                                   Mat<int> targets,
+                                                   Mat<R> mask,
+                                                   const utils::SoftmaxTree& tree);
+
         static Mat<R> quadratic_form(Mat<R> left, Mat<R> weigths, Mat<R> right);
+
+        // LSTM cell with all gates computed at once. Each weight matrix
+        // holds the column blocks [input, forget_1..forget_n, output, cell]
+        // side by side (n = prev_memories.size()), so a single product per
+        // input computes every gate. Gate nonlinearities and the memory update
+        // happen in one pass, and one backward step is recorded. The bias
+        // has either one row (broadcast) or one row per example.
+        // Returns (memory, hidden).
+        static std::tuple<Mat<R>, Mat<R>> fused_lstm_cell(const std::vector<Mat<R>>& weights,
+                                                          const std::vector<Mat<R>>& inputs,
+                                                          Mat<R> bias,
+                                                          const std::vector<Mat<R>>& prev_memories);
+
+        // Runs `fused_lstm_cell` over a whole sequence for a cell with one
+        // previous state (inputs[i][t] is the i-th input at timestep t).
+        // The input projections of all timesteps are computed with one
+        // product per input, and the recurrent weight gradient is
+        // accumulated with one product for the whole sequence.
+        // Returns (memories, hiddens) for every timestep.
+        static std::tuple<std::vector<Mat<R>>, std::vector<Mat<R>>> fused_lstm_sequence(
+                const std::vector<Mat<R>>& input_weights,
+                const std::vector<std::vector<Mat<R>>>& inputs,
+                Mat<R> recurrent_weights,
+                Mat<R> bias,
+                Mat<R> initial_memory,
+                Mat<R> initial_hidden);
     };
 }
 
@@ -9,6 +9,72 @@ using namespace TensorOps;
 using std::make_shared;
 
 namespace matops {
+    // tape nodes of the softmaxes:
+    template<typename R>
+    struct softmax_rowwise_node {
+        Mat<R> matrix;
+        R temperature;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            deps.reads.emplace_back(GRAD_HANDLE(out));
+            if (!matrix.constant) deps.writes.emplace_back(GRAD_HANDLE(matrix));
+        }
+        void backward() {
+            DALI_COUNT_ELEMENTWISE("softmax_rowwise", BACKWARD, matrix, 6, 3);
+            TensorInternal<R, 1> sm_times_dy_colsum( mshadow::Shape1(matrix.dims(0)));
+            sm_times_dy_colsum = sum_cols(MAT(out).wrapper() * GRAD(out).wrapper());
+
+            GRAD(matrix) += (
+                  MAT(out).wrapper() * GRAD(out).wrapper()
+                - MAT(out).wrapper() * sm_times_dy_colsum.wrapper().template broadcast<0>(GRAD(out).shape)
+            ) / temperature;
+        }
+    };
+
+    template<typename R>
+    struct softmax_colwise_node {
+        Mat<R> matrix;
+        R temperature;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            deps.reads.emplace_back(GRAD_HANDLE(out));
+            if (!matrix.constant) deps.writes.emplace_back(GRAD_HANDLE(matrix));
+        }
+        void backward() {
+            DALI_COUNT_ELEMENTWISE("softmax_colwise", BACKWARD, matrix, 6, 3);
+
+            TensorInternal<R, 1> sm_times_dy_rowsum( mshadow::Shape1(matrix.dims(1)));
+            sm_times_dy_rowsum = sum_rows(MAT(out).wrapper() * GRAD(out).wrapper());
+
+            GRAD(matrix) += (
+                  MAT(out).wrapper() * GRAD(out).wrapper()
+                - MAT(out).wrapper() * sm_times_dy_rowsum.wrapper().template broadcast<1>(GRAD(out).shape)
+            )       / temperature;
+        }
+    };
+
+    template<typename R>
+    struct softmax_cross_entropy_rowwise_node {
+        Mat<R> matrix;
+        Mat<R> probs;
+        Mat<R> out;
+        Mat<int> targets;
+        void dependencies(graph::Dependencies& deps) {
+            deps.reads.emplace_back(GRAD_HANDLE(out));
+            if (!matrix.constant) deps.writes.emplace_back(GRAD_HANDLE(matrix));
+        }
+        void backward() {
+            if (!matrix.constant) {
+                DALI_COUNT_ELEMENTWISE("softmax_cross_entropy_rowwise", BACKWARD, matrix, 2, 2);
+                GRAD(matrix) += (
+                    MAT(probs).wrapper() *
+                    GRAD(out).ravel().wrapper().template broadcast<0>(MAT(probs).shape)
+                );
+
+                softmax_cross_entropy_rowwise_backward(GRAD(matrix), GRAD(out), targets.w().ravel());
+            }
+        }
+    };
 
     // performs row wise normalization
     template<typename R>
@@ -20,17 +86,10 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::softmax_rowwise(Mat<R> matrix, R temperature) {
+        DALI_COUNT_ELEMENTWISE("softmax_rowwise", FORWARD, matrix, 5, 1);
         Mat<R> out = Cost<R>::softmax_no_grad_rowwise(matrix, temperature);
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, temperature, out]() mutable {
-                TensorInternal<R, 1> sm_times_dy_colsum( mshadow::Shape1(matrix.dims(0)));
-                sm_times_dy_colsum = sum_cols(MAT(out).wrapper() * GRAD(out).wrapper());
-
-                GRAD(matrix) += (
-                      MAT(out).wrapper() * GRAD(out).wrapper()
-                    - MAT(out).wrapper() * sm_times_dy_colsum.wrapper().template broadcast<0>(GRAD(out).shape)
-                ) / temperature;
-            });
+            graph::emplace_node<softmax_rowwise_node<R>>(matrix, temperature, out);
         return out;
     }
 
@@ -75,25 +134,17 @@ namespace matops {
                         ) / temperature;
                     }
                 }
-            });
+            }, graph::gradient_dependencies<R>(out, matrices));
         return out;
     }
 
     template<typename R>
     Mat<R> Cost<R>::softmax_colwise(Mat<R> matrix, R temperature) {
+        DALI_COUNT_ELEMENTWISE("softmax_colwise", FORWARD, matrix, 5, 1);
         Mat<R> out     = Cost<R>::softmax_no_grad_colwise(matrix, temperature);
 
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, temperature, out]() mutable {
-
-                TensorInternal<R, 1> sm_times_dy_rowsum( mshadow::Shape1(matrix.dims(1)));
-                sm_times_dy_rowsum = sum_rows(MAT(out).wrapper() * GRAD(out).wrapper());
-
-                GRAD(matrix) += (
-                      MAT(out).wrapper() * GRAD(out).wrapper()
-                    - MAT(out).wrapper() * sm_times_dy_rowsum.wrapper().template broadcast<1>(GRAD(out).shape)
-                )       / temperature;
-            });
+            graph::emplace_node<softmax_colwise_node<R>>(matrix, temperature, out);
         return out;
     }
 
@@ -121,7 +172,7 @@ namespace matops {
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, t, out, sigmoided_input]() mutable {
                 SAFE_GRAD(matrix) += (sigmoided_input.wrapper() - t) * GRAD(out).wrapper();
-            });
+            }, graph::gradient_dependencies<R>({out}, {matrix}));
         return out;
     }
 
@@ -144,7 +195,7 @@ namespace matops {
             graph::emplace_back([matrix, target, out, sigmoided_input]() mutable {
                 SAFE_GRAD(matrix) += (sigmoided_input.wrapper() - MAT(target).wrapper()) * GRAD(out).wrapper();
                 DEBUG_ASSERT_GRAD_NOT_NAN(matrix);
-            });
+            }, graph::gradient_dependencies<R>({out}, {matrix}));
         return out;
     }
 
@@ -169,7 +220,7 @@ namespace matops {
                     ) * GRAD(out).wrapper()
                 );
                 DEBUG_ASSERT_GRAD_NOT_NAN(matrix);
-            });
+            }, graph::gradient_dependencies<R>({out}, {matrix}));
         return out;
     }
 
@@ -191,7 +242,7 @@ namespace matops {
                     ) * GRAD(out).wrapper()
                 );
                 DEBUG_ASSERT_GRAD_NOT_NAN(matrix);
-            });
+            }, graph::gradient_dependencies<R>({out}, {matrix}));
         return out;
     }
 
@@ -211,7 +262,7 @@ namespace matops {
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, answer_idx, out]() mutable {
                 SAFE_GRAD(matrix)[answer_idx] -= F<op::inv<R>>(MAT(matrix)[answer_idx].wrapper()) * GRAD(out).ravel().wrapper();
-            });
+            }, graph::gradient_dependencies<R>({out}, {matrix}));
         return out;
     }
 
@@ -238,7 +289,7 @@ namespace matops {
                 temp = (R)-1.0 * F<op::inv<R>>(temp.wrapper()) * GRAD(out).ravel().wrapper();
 
                 TensorOps::col_pluck_backward(GRAD(matrix), temp, answer_idx);
-            });
+            }, graph::gradient_dependencies<R>({out}, {matrix}));
         return out;
     }
 
@@ -254,7 +305,7 @@ namespace matops {
         if (graph::backprop_enabled() && !matrix.constant) {
             graph::emplace_back([matrix, out, targets]() mutable {
                 cross_entropy_colwise_backward(MAT(matrix), GRAD(matrix), GRAD(out), targets.w().ravel());
-            });
+            }, graph::gradient_dependencies<R>({out}, {matrix}));
         }
         return out;
     }
@@ -271,7 +322,7 @@ namespace matops {
         if (graph::backprop_enabled() && !matrix.constant) {
             graph::emplace_back([matrix, out, targets]() mutable {
                 cross_entropy_rowwise_backward(MAT(matrix), GRAD(matrix), GRAD(out), targets.w().ravel());
-            });
+            }, graph::gradient_dependencies<R>({out}, {matrix}));
         }
         return out;
     }
@@ -290,7 +341,7 @@ namespace matops {
             graph::emplace_back([matrix, target, out]() mutable {
                 SAFE_GRAD(matrix) -= F<op::inv<R>>(MAT(matrix).wrapper()) * MAT(target).wrapper() * GRAD(out).wrapper();
                 SAFE_GRAD(target) -= F<op::log<R>>(MAT(matrix).wrapper()) * GRAD(out).wrapper();
-            });
+            }, graph::gradient_dependencies<R>({out}, {matrix, target}));
         return out;
     }
 
@@ -324,7 +375,7 @@ namespace matops {
 
                     softmax_cross_entropy_colwise_backward(GRAD(matrix), GRAD(out), targets.w().ravel());
                 }
-            });
+            }, graph::gradient_dependencies<R>({out}, {matrix}));
         }
         return out;
     }
@@ -356,6 +407,7 @@ namespace matops {
                             << targets.number_of_elements() << ") should equal number of input rows ("
                             << matrix.dims(0) << ")");
 
+        DALI_COUNT_ELEMENTWISE("softmax_cross_entropy_rowwise", FORWARD, matrix, 5, 1);
         Mat<R> out =  Mat<R>(targets.number_of_elements(), 1, weights<R>::empty());
 
         Mat<R> probs = softmax_no_grad_rowwise(matrix);
@@ -366,17 +418,7 @@ namespace matops {
         MAT(out) = (R)-1.0 * F<op::log<R>>(MAT(out).wrapper());
 
         if (graph::backprop_enabled()) {
-            graph::emplace_back([matrix, probs, out, targets]() mutable {
-
-                if (!matrix.constant) {
-                    GRAD(matrix) += (
-                        MAT(probs).wrapper() *
-                        GRAD(out).ravel().wrapper().template broadcast<0>(MAT(probs).shape)
-                    );
-
-                    softmax_cross_entropy_rowwise_backward(GRAD(matrix), GRAD(out), targets.w().ravel());
-                }
-            });
+            graph::emplace_node<softmax_cross_entropy_rowwise_node<R>>(matrix, probs, out, targets);
         }
         return out;
     }
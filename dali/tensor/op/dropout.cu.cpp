@@ -3,6 +3,7 @@
 #include "dali/tensor/__MatMacros__.h"
 #include "dali/math/TensorOps.h"
 #include "dali/math/LazyTensor.h"
+#include "dali/math/TensorRandom.h"
 
 #include "dali/utils/core_utils.h"
 
@@ -11,6 +12,62 @@ using std::make_shared;
 
 
 namespace matops {
+    namespace {
+        bool regenerate_masks = false;
+
+        // out <Saver> matrix * mask, on the device where matrix is.
+        template<typename Saver, typename R, typename Mask>
+        void apply_mask(TensorInternal<R, 2>& out, const TensorInternal<R, 2>& matrix, const Mask& mask, bool overwrite) {
+            #ifdef DALI_USE_CUDA
+            if (matrix.compute_me_on_gpu()) {
+                TensorOps::random::apply_mask<Saver>(
+                        overwrite ? out.overwrite_gpu_data() : out.mutable_gpu_data(),
+                        matrix.gpu_data(),
+                        mask);
+                return;
+            }
+            #endif
+            TensorOps::random::apply_mask<Saver>(
+                    overwrite ? out.overwrite_cpu_data() : out.mutable_cpu_data(),
+                    matrix.cpu_data(),
+                    mask);
+        }
+
+        // a new philox stream long enough for a mask the size of matrix.
+        template<typename R>
+        TensorOps::random::philox4x32 philox_stream(const Mat<R>& matrix) {
+            return TensorOps::random::philox4x32(
+                utils::random::seed(),
+                utils::random::reserve_counters(
+                    TensorOps::random::philox_blocks(matrix.number_of_elements())
+                )
+            );
+        }
+
+        // the backward closure keeps `mask` (a seed, an offset and a
+        // couple of parameters) rather than the mask's values.
+        template<typename R, typename Mask>
+        Mat<R> regenerated_dropout(Mat<R> matrix, Mask mask) {
+            auto out = Mat<R>::empty_like(matrix);
+            apply_mask<mshadow::sv::saveto>(MAT(out), MAT(matrix), mask, true);
+            if (graph::backprop_enabled()) {
+                graph::emplace_back([matrix, out, mask]() mutable {
+                    if (!matrix.constant) {
+                        apply_mask<mshadow::sv::plusto>(GRAD(matrix), GRAD(out), mask, false);
+                    }
+                });
+            }
+            return out;
+        }
+    }
+
+    void set_regenerate_dropout_masks(bool regenerate) {
+        regenerate_masks = regenerate;
+    }
+
+    bool regenerate_dropout_masks() {
+        return regenerate_masks;
+    }
 
     template<typename R>
     Mat<R> Dropout<R>::dropout(
@@ -23,11 +80,16 @@ namespace matops {
         if (drop_prob < 1e-6)
             return matrix;
 
+        if (regenerate_masks) {
+            return regenerated_dropout(matrix, TensorOps::random::philox_bernoulli<R>(
+                    philox_stream(matrix), 1.0 - drop_prob, 1.0));
+        }
+
         auto out = Mat<R>::empty_like(matrix);
 
         auto mask = make_shared<TensorInternal<R, 2>>(MAT(matrix).shape);
         {
-            utils::Timer tbernoulli("tbernoulli");
+            DALI_PROFILE_SPAN(tbernoulli, "tbernoulli");
             weights<R>::bernoulli(1.0 - drop_prob)(*mask);
         }
 
@@ -53,6 +115,11 @@ namespace matops {
         if (drop_prob < 1e-6)
             return matrix;
 
+        if (regenerate_masks) {
+            return regenerated_dropout(matrix, TensorOps::random::philox_bernoulli<R>(
+                    philox_stream(matrix), 1.0 - drop_prob, 1.0 / (1.0 - drop_prob)));
+        }
+
         auto out = Mat<R>::empty_like(matrix);
 
         auto mask = make_shared<TensorInternal<R, 2>>(MAT(matrix).shape);
@@ -96,6 +163,11 @@ namespace matops {
     Mat<R> Dropout<R>::fast_dropout(
             Mat<R> matrix) {
 
+        if (regenerate_masks) {
+            return regenerated_dropout(matrix, TensorOps::random::philox_gaussian<R>(
+                    philox_stream(matrix), 1.0, 1.0));
+        }
+
         auto out = Mat<R>::empty_like(matrix);
 
         auto mask = make_shared<TensorInternal<R, 2>>(MAT(matrix).shape);
@@ -10,6 +10,21 @@
 template<typename R> class Mat;
 
 namespace matops {
+    /**
+    Regenerated dropout masks
+    -------------------------
+
+    By default the masks of dropout, dropout_normalized and
+    fast_dropout are stored until backward. Once
+    `set_regenerate_dropout_masks(true)` is called they are drawn from
+    a counter based generator (Philox) instead: backward only keeps
+    its seed and offset and draws the same mask again, so that no
+    mask is held between the forward and backward passes. Masks stay
+    reproducible under utils::random::set_seed (they are different
+    from the stored ones though).
+    **/
+    void set_regenerate_dropout_masks(bool regenerate);
+    bool regenerate_dropout_masks();
 
     template<typename R>
     struct Dropout {
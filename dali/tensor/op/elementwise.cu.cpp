@@ -8,31 +8,60 @@ using namespace TensorOps;
 using std::vector;
 
 namespace matops {
-    #define DALI_UNARY_OP0(name, forward_op, backward) \
+    // Unary ops are recorded as tape nodes: `name##_node` holds
+    // the input and output of the op and computes its gradient.
+    #define DALI_UNARY_OP0(name, forward_op, backward_expr) \
+        template<typename R>                                                                                  \
+        struct name##_node {                                                                                  \
+            Mat<R> matrix;                                                                                    \
+            Mat<R> out;                                                                                       \
+            void backward() {                                                                                 \
+                DALI_COUNT_ELEMENTWISE(#name, BACKWARD, matrix, 3, 3);                                        \
+                GRAD(matrix) += (backward_expr) * GRAD(out).wrapper();                                        \
+            }                                                                                                 \
+            void dependencies(graph::Dependencies& deps) {                                                    \
+                deps.reads.emplace_back(GRAD_HANDLE(out));                                                    \
+                deps.writes.emplace_back(GRAD_HANDLE(matrix));                                                \
+            }                                                                                                 \
+        };                                                                                                    \
+                                                                                                              \
         template<typename R>                                                                                  \
         Mat<R> Elementwise<R>::name(Mat<R> matrix) {                                                          \
             auto out = Mat<R>::empty_like(matrix);                                                            \
                                                                                                               \
+            DALI_COUNT_ELEMENTWISE(#name, FORWARD, matrix, 1, 1);                                             \
             MAT(out) = F<forward_op<R>>(MAT(matrix).wrapper());                                               \
                                                                                                               \
             if (graph::backprop_enabled() && !matrix.constant)                                                  \
-                graph::emplace_back([matrix, out]() mutable {                                                 \
-                    GRAD(matrix) += (backward) * GRAD(out).wrapper();                                         \
-                });                                                                                           \
+                graph::emplace_node<name##_node<R>>(matrix, out);                                             \
             return out;                                                                                       \
         }
 
-    #define DALI_UNARY_OP1(name, arg1, forward_op, backward) \
+    #define DALI_UNARY_OP1(name, arg1, forward_op, backward_expr) \
+        template<typename R>                                                                                  \
+        struct name##_node {                                                                                  \
+            Mat<R> matrix;                                                                                    \
+            Mat<R> out;                                                                                       \
+            R arg1;                                                                                           \
+            void backward() {                                                                                 \
+                DALI_COUNT_ELEMENTWISE(#name, BACKWARD, matrix, 3, 3);                                        \
+                GRAD(matrix) += (backward_expr) * GRAD(out).wrapper();                                        \
+            }                                                                                                 \
+            void dependencies(graph::Dependencies& deps) {                                                    \
+                deps.reads.emplace_back(GRAD_HANDLE(out));                                                    \
+                deps.writes.emplace_back(GRAD_HANDLE(matrix));                                                \
+            }                                                                                                 \
+        };                                                                                                    \
+                                                                                                              \
         template<typename R>                                                                                  \
         Mat<R> Elementwise<R>::name(Mat<R> matrix, R arg1) {                                                  \
             auto out = Mat<R>::empty_like(matrix);                                                            \
                                                                                                               \
+            DALI_COUNT_ELEMENTWISE(#name, FORWARD, matrix, 1, 1);                                             \
             MAT(out) = F<forward_op<R>>(MAT(matrix).wrapper(), arg1);                                         \
                                                                                                               \
             if (graph::backprop_enabled() && !matrix.constant)                                                  \
-                graph::emplace_back([matrix, out, arg1]() mutable {                                           \
-                    GRAD(matrix) += (backward) * GRAD(out).wrapper();                                         \
-                });                                                                                           \
+                graph::emplace_node<name##_node<R>>(matrix, out, arg1);                                       \
             return out;                                                                                       \
         }
 
@@ -53,37 +82,19 @@ namespace matops {
             F<op::steep_sigmoid_backward<R>>(MAT(out).wrapper(), aggressiveness));
 
 
-    template<typename R>
-    Mat<R> Elementwise<R>::exp(Mat<R> matrix) {
-        auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = F<op::exp<R>>(MAT(matrix).wrapper());
-
-        if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out]() mutable {
-                GRAD(matrix) += (MAT(out).wrapper() * GRAD(out).wrapper());
-            });
-        return out;
-    }
-
-    template<typename R>
-    Mat<R> Elementwise<R>::sigmoid(Mat<R> matrix) {
-        auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = F<op::sigmoid<R>>(MAT(matrix).wrapper());
-        if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out]() mutable {
-                GRAD(matrix) += (
-                    F<op::dsigmoid<R>>(MAT(out).wrapper()) * GRAD(out).wrapper()
-                );
-            });
-        return out;
-    }
+    DALI_UNARY_OP0(exp, op::exp,
+            MAT(out).wrapper());
+    DALI_UNARY_OP0(sigmoid, op::sigmoid,
+            F<op::dsigmoid<R>>(MAT(out).wrapper()));
 
     template<typename R>
     Mat<R> Elementwise<R>::sqrt(Mat<R> matrix) {
+        DALI_COUNT_ELEMENTWISE("sqrt", FORWARD, matrix, 1, 1);
         auto out = Mat<R>::empty_like(matrix);
         MAT(out) = F<op::sqrt_f<R>>(MAT(matrix).wrapper());
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, out]() mutable {
+                DALI_COUNT_ELEMENTWISE("sqrt", BACKWARD, matrix, 3, 3);
                 SAFE_GRAD(matrix) += ((R)0.5 / MAT(out).wrapper()) * GRAD(out).wrapper();
             });
         return out;
@@ -91,10 +102,12 @@ namespace matops {
 
     template<typename R>
     Mat<R> Elementwise<R>::elt_inv(Mat<R> matrix) {
+        DALI_COUNT_ELEMENTWISE("elt_inv", FORWARD, matrix, 1, 1);
         auto out = Mat<R>::empty_like(matrix);
         MAT(out) = F<op::inv<R>>(MAT(matrix).wrapper());
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, out]() mutable {
+                DALI_COUNT_ELEMENTWISE("elt_inv", BACKWARD, matrix, 3, 3);
                 SAFE_GRAD(matrix) -= F<op::square<R>>(MAT(out).wrapper()) * GRAD(out).wrapper();
             });
         return out;
@@ -103,11 +116,13 @@ namespace matops {
 
     template<typename R>
     Mat<R> Elementwise<R>::square(Mat<R> matrix) {
+        DALI_COUNT_ELEMENTWISE("square", FORWARD, matrix, 1, 1);
         auto out = Mat<R>::empty_like(matrix);
         MAT(out) = F<op::square<R>>(MAT(matrix).wrapper());
 
         if (graph::backprop_enabled() && !matrix.constant)
             graph::emplace_back([matrix, out]() mutable {
+                DALI_COUNT_ELEMENTWISE("square", BACKWARD, matrix, 3, 3);
                 GRAD(matrix) += GRAD(out).wrapper() * MAT(matrix).wrapper() * (R) 2.0;
             });
         return out;
@@ -127,12 +142,14 @@ namespace matops {
             return Elementwise<R>::square(matrix);
         }
 
+        DALI_COUNT_ELEMENTWISE("pow", FORWARD, matrix, 1, 1);
         auto out = Mat<R>::empty_like(matrix);
 
         MAT(out) = F<op::power<R>>(MAT(matrix).wrapper(), other);
 
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, out, other]() mutable {
+                DALI_COUNT_ELEMENTWISE("pow", BACKWARD, matrix, 4, 3);
                 SAFE_GRAD(matrix) += other * F<op::power<R>>(MAT(matrix).wrapper(), other - (R)1.0) * GRAD(out).wrapper();
             });
         return out;
@@ -147,10 +164,12 @@ namespace matops {
     Mat<R> Elementwise<R>::add(
             Mat<R> matrix1,
             R alpha) {
+        DALI_COUNT_ELEMENTWISE("add scalar", FORWARD, matrix1, 1, 1);
         auto out = Mat<R>::empty_like(matrix1);
         MAT(out) = MAT(matrix1).wrapper() + alpha;
         if (graph::backprop_enabled() && !matrix1.constant)
             graph::emplace_back([matrix1, out]() mutable {
+                DALI_COUNT_ELEMENTWISE("add scalar", BACKWARD, matrix1, 1, 2);
                 GRAD(matrix1) += GRAD(out).wrapper();
             });
         return out;
@@ -158,10 +177,12 @@ namespace matops {
 
     template<typename R>
     Mat<R> Elementwise<R>::sub_broadcast_reversed(Mat<R> matrix, R other) {
+        DALI_COUNT_ELEMENTWISE("sub scalar", FORWARD, matrix, 1, 1);
         auto out = Mat<R>::empty_like(matrix);
         MAT(out) = (other - MAT(matrix).wrapper());
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, out] () mutable {
+                DALI_COUNT_ELEMENTWISE("sub scalar", BACKWARD, matrix, 1, 2);
                 SAFE_GRAD(matrix) -= GRAD(out).wrapper();
             });
         return out;
@@ -171,10 +192,12 @@ namespace matops {
     Mat<R> Elementwise<R>::eltdivide(
             Mat<R> matrix,
             R alpha) {
+        DALI_COUNT_ELEMENTWISE("eltdivide scalar", FORWARD, matrix, 1, 1);
         auto out = Mat<R>::empty_like(matrix);
         MAT(out) = MAT(matrix).wrapper() / alpha;
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, alpha, out]() mutable {
+                DALI_COUNT_ELEMENTWISE("eltdivide scalar", BACKWARD, matrix, 2, 2);
                 SAFE_GRAD(matrix) += ((R)1.0 / alpha) * GRAD(out).wrapper();
             });
         return out;
@@ -184,10 +207,12 @@ namespace matops {
     Mat<R> Elementwise<R>::eltmul(
             Mat<R> matrix,
             R alpha) {
+        DALI_COUNT_ELEMENTWISE("eltmul scalar", FORWARD, matrix, 1, 1);
         auto out = Mat<R>::empty_like(matrix);
         MAT(out) = MAT(matrix).wrapper() * alpha;
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, alpha, out]() mutable {
+                DALI_COUNT_ELEMENTWISE("eltmul scalar", BACKWARD, matrix, 2, 2);
                 SAFE_GRAD(matrix) += alpha * GRAD(out).wrapper();
             });
         return out;
@@ -5,6 +5,139 @@
 #include "dali/math/LazyTensor.h"
 
 namespace matops {
+    // tape nodes of the reducers (`matrix` reduced into `out`):
+    template<typename R>
+    void reducer_dependencies(const Mat<R>& matrix,
+                              const Mat<R>& out,
+                              graph::Dependencies& deps) {
+        deps.reads.emplace_back(GRAD_HANDLE(out));
+        deps.writes.emplace_back(GRAD_HANDLE(matrix));
+    }
+
+    template<typename R>
+    struct L2_norm_node {
+        Mat<R> matrix;
+        Mat<R> out;
+        R norm;
+        void dependencies(graph::Dependencies& deps) {
+            reducer_dependencies(matrix, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_REDUCTION("L2_norm", BACKWARD, matrix, out);
+            GRAD(matrix) += (MAT(matrix).wrapper() * (out.dw(0) / norm) );
+        }
+    };
+
+    template<typename R>
+    struct L2_norm_rowwise_node {
+        Mat<R> matrix;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            reducer_dependencies(matrix, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_REDUCTION("L2_norm_rowwise", BACKWARD, matrix, out);
+            TensorInternal<R,2> temp(MAT(out).shape);
+            temp = GRAD(out).wrapper() / MAT(out).wrapper();
+            GRAD(matrix) += MAT(matrix).wrapper() * (temp.ravel().wrapper().template broadcast<0>(GRAD(matrix).shape));
+        }
+    };
+
+    template<typename R>
+    struct L2_norm_colwise_node {
+        Mat<R> matrix;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            reducer_dependencies(matrix, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_REDUCTION("L2_norm_colwise", BACKWARD, matrix, out);
+            TensorInternal<R,2> temp(MAT(out).shape);
+            temp = GRAD(out).wrapper() / MAT(out).wrapper();
+            GRAD(matrix) += MAT(matrix).wrapper() * (temp).ravel().wrapper().template broadcast<1>(GRAD(matrix).shape);
+        }
+    };
+
+    template<typename R>
+    struct sum_node {
+        Mat<R> matrix;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            reducer_dependencies(matrix, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_REDUCTION("sum", BACKWARD, matrix, out);
+            GRAD(matrix) += out.dw(0);
+        }
+    };
+
+    template<typename R>
+    struct sum_rowwise_node {
+        Mat<R> matrix;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            reducer_dependencies(matrix, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_REDUCTION("sum_rowwise", BACKWARD, matrix, out);
+            GRAD(matrix) += GRAD(out).ravel().wrapper().template broadcast<0>(GRAD(matrix).shape);
+        }
+    };
+
+    template<typename R>
+    struct sum_colwise_node {
+        Mat<R> matrix;
+        Mat<R> out;
+        void dependencies(graph::Dependencies& deps) {
+            reducer_dependencies(matrix, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_REDUCTION("sum_colwise", BACKWARD, matrix, out);
+            GRAD(matrix) += GRAD(out).ravel().wrapper().template broadcast<1>(GRAD(matrix).shape);
+        }
+    };
+
+    template<typename R>
+    struct mean_node {
+        Mat<R> matrix;
+        Mat<R> out;
+        unsigned int ne;
+        void dependencies(graph::Dependencies& deps) {
+            reducer_dependencies(matrix, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_REDUCTION("mean", BACKWARD, matrix, out);
+            GRAD(matrix) += out.dw(0) / ne;
+        }
+    };
+
+    template<typename R>
+    struct mean_rowwise_node {
+        Mat<R> matrix;
+        Mat<R> out;
+        R ne;
+        void dependencies(graph::Dependencies& deps) {
+            reducer_dependencies(matrix, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_REDUCTION("mean_rowwise", BACKWARD, matrix, out);
+            GRAD(matrix) += GRAD(out).ravel().wrapper().template broadcast<0>(GRAD(matrix).shape) / (R)ne;
+        }
+    };
+
+    template<typename R>
+    struct mean_colwise_node {
+        Mat<R> matrix;
+        Mat<R> out;
+        R ne;
+        void dependencies(graph::Dependencies& deps) {
+            reducer_dependencies(matrix, out, deps);
+        }
+        void backward() {
+            DALI_COUNT_REDUCTION("mean_colwise", BACKWARD, matrix, out);
+            GRAD(matrix) += GRAD(out).ravel().wrapper().template broadcast<1>(GRAD(matrix).shape) / ne;
+        }
+    };
 
     template<typename R>
     Mat<R> Reducers<R>::grad_norm(Mat<R> matrix) {
@@ -40,13 +173,12 @@ namespace matops {
     template<typename R>
     Mat<R> Reducers<R>::L2_norm(Mat<R> matrix) {
         auto out = Mat<R>(1, 1, weights<R>::empty());
+        DALI_COUNT_REDUCTION("L2_norm", FORWARD, matrix, out);
         auto norm = MAT(matrix).L2_norm();
         out.w(0) = norm;
 
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out, norm]() mutable {
-                GRAD(matrix) += (MAT(matrix).wrapper() * (out.dw(0) / norm) );
-            });
+            graph::emplace_node<L2_norm_node<R>>(matrix, out, norm);
         return out;
     }
 
@@ -55,16 +187,13 @@ namespace matops {
         if (matrix.dims(1) == 1)
             return matrix;
         Mat<R> out(matrix.dims(0), 1);
+        DALI_COUNT_REDUCTION("L2_norm_rowwise", FORWARD, matrix, out);
         MAT(out).ravel() = reduce_to_1d<0, mshadow::red::sum>(F<TensorOps::op::square<R>>(MAT(matrix).wrapper()));
 
         MAT(out) = F<TensorOps::op::sqrt_f<R>>(MAT(out).wrapper());
 
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out]() mutable {
-                TensorInternal<R,2> temp(MAT(out).shape);
-                temp = GRAD(out).wrapper() / MAT(out).wrapper();
-                GRAD(matrix) += MAT(matrix).wrapper() * (temp.ravel().wrapper().template broadcast<0>(GRAD(matrix).shape));
-            });
+            graph::emplace_node<L2_norm_rowwise_node<R>>(matrix, out);
         return out;
     }
 
@@ -73,15 +202,12 @@ namespace matops {
         if (matrix.dims(0) == 1)
             return matrix;
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
+        DALI_COUNT_REDUCTION("L2_norm_colwise", FORWARD, matrix, out);
         MAT(out).ravel() = reduce_to_1d<1, mshadow::red::sum>(F<TensorOps::op::square<R>>(MAT(matrix).wrapper()));
         MAT(out)         = F<TensorOps::op::sqrt_f<R>>(MAT(out).wrapper());
 
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out]() mutable {
-                TensorInternal<R,2> temp(MAT(out).shape);
-                temp = GRAD(out).wrapper() / MAT(out).wrapper();
-                GRAD(matrix) += MAT(matrix).wrapper() * (temp).ravel().wrapper().template broadcast<1>(GRAD(matrix).shape);
-            });
+            graph::emplace_node<L2_norm_colwise_node<R>>(matrix, out);
         return out;
     }
 
@@ -92,12 +218,11 @@ namespace matops {
         if (matrix.dims(0) == 1 && matrix.dims(1) == 1)
             return matrix;
         Mat<R> out(1,1, weights<R>::empty());
+        DALI_COUNT_REDUCTION("sum", FORWARD, matrix, out);
         out.w(0) = MAT(matrix).sum();
 
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out]() mutable {
-                GRAD(matrix) += out.dw(0);
-            });
+            graph::emplace_node<sum_node<R>>(matrix, out);
         return out;
     }
 
@@ -106,12 +231,11 @@ namespace matops {
         if (matrix.dims(1) == 1)
             return matrix;
         Mat<R> out(matrix.dims(0), 1, weights<R>::empty());
+        DALI_COUNT_REDUCTION("sum_rowwise", FORWARD, matrix, out);
         MAT(out).ravel() = reduce_to_1d<0, mshadow::red::sum>(MAT(matrix).wrapper());
 
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out]() mutable {
-                GRAD(matrix) += GRAD(out).ravel().wrapper().template broadcast<0>(GRAD(matrix).shape);
-            });
+            graph::emplace_node<sum_rowwise_node<R>>(matrix, out);
         return out;
     }
 
@@ -120,24 +244,22 @@ namespace matops {
         if (matrix.dims(0) == 1)
             return matrix;
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
+        DALI_COUNT_REDUCTION("sum_colwise", FORWARD, matrix, out);
         MAT(out).ravel() = reduce_to_1d<1, mshadow::red::sum>(MAT(matrix).wrapper());
 
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out]() mutable {
-                GRAD(matrix) += GRAD(out).ravel().wrapper().template broadcast<1>(GRAD(matrix).shape);
-            });
+            graph::emplace_node<sum_colwise_node<R>>(matrix, out);
         return out;
     }
 
     template<typename R>
     Mat<R> Reducers<R>::mean(Mat<R> matrix) {
         Mat<R> out (1,1, weights<R>::empty());
+        DALI_COUNT_REDUCTION("mean", FORWARD, matrix, out);
         auto ne = matrix.number_of_elements();
         out.w(0) = MAT(matrix).sum() / ne;
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out, ne]() mutable {
-                GRAD(matrix) += out.dw(0) / ne;
-            });
+            graph::emplace_node<mean_node<R>>(matrix, out, ne);
 
         return out;
     }
@@ -148,15 +270,14 @@ namespace matops {
         if (matrix.dims(1) == 1)
             return matrix;
         Mat<R> out(matrix.dims(0), 1, weights<R>::empty());
+        DALI_COUNT_REDUCTION("mean_rowwise", FORWARD, matrix, out);
         R ne = matrix.number_of_elements();
 
         MAT(out).ravel() = reduce_to_1d<0, mshadow::red::sum>(MAT(matrix).wrapper());
         MAT(out).ravel() /= ne;
 
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out, ne]() mutable {
-                GRAD(matrix) += GRAD(out).ravel().wrapper().template broadcast<0>(GRAD(matrix).shape) / (R)ne;
-            });
+            graph::emplace_node<mean_rowwise_node<R>>(matrix, out, ne);
         return out;
     }
 
@@ -165,14 +286,13 @@ namespace matops {
         if (matrix.dims(0) == 1)
             return matrix;
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
+        DALI_COUNT_REDUCTION("mean_colwise", FORWARD, matrix, out);
         R ne = matrix.number_of_elements();
         MAT(out).ravel() = reduce_to_1d<1, mshadow::red::sum>(MAT(matrix).wrapper());
         MAT(out).ravel() /= ne;
 
         if (graph::backprop_enabled() && !matrix.constant)
-            graph::emplace_back([matrix, out, ne]() mutable {
-                GRAD(matrix) += GRAD(out).ravel().wrapper().template broadcast<1>(GRAD(matrix).shape) / ne;
-            });
+            graph::emplace_node<mean_colwise_node<R>>(matrix, out, ne);
         return out;
     }
 
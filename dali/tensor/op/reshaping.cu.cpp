@@ -11,6 +11,23 @@ using std::vector;
 using utils::assert2;
 
 namespace matops {
+    template<typename R>
+    struct rows_pluck_node {
+        Mat<R> matrix;
+        Mat<R> out;
+        Mat<int> indices;
+        void dependencies(graph::Dependencies& deps) {
+            deps.reads.emplace_back(GRAD_HANDLE(out));
+            deps.writes.emplace_back(GRAD_HANDLE(matrix));
+        }
+        void backward() {
+            DALI_COUNT_OP("rows_pluck", BACKWARD, out.number_of_elements(),
+                          2.0 * out.number_of_elements() * sizeof(R) + indices.number_of_elements() * sizeof(int),
+                          (double)out.number_of_elements() * sizeof(R),
+                          matrix.dims(0), matrix.dims(1), indices.number_of_elements());
+            TensorOps::rows_pluck_backprop(GRAD(matrix), GRAD(out), indices.w().ravel());
+        }
+    };
 
     template<typename R>
     Mat<R> Reshaping<R>::rows_pluck(
@@ -32,12 +49,20 @@ namespace matops {
             matrix.dims(1),
             weights<R>::empty());
 
+        // plucks copy rows: no FLOPs forward, one add per element backward.
+        DALI_COUNT_OP("rows_pluck", FORWARD, 0,
+                      (double)out.number_of_elements() * sizeof(R) + indices.number_of_elements() * sizeof(int),
+                      (double)out.number_of_elements() * sizeof(R),
+                      matrix.dims(0), matrix.dims(1), indices.number_of_elements());
         TensorOps::rows_pluck(MAT(out), MAT(matrix), indices.w().ravel());
 
         if (graph::backprop_enabled() && !matrix.constant) {
-            graph::emplace_back([matrix, out, indices]() mutable {
-                TensorOps::rows_pluck_backprop(GRAD(matrix), GRAD(out), indices.w().ravel());
-            });
+            if (matrix.sparse_gradient()) {
+                for (int i = 0; i < indices.number_of_elements(); ++i) {
+                    matrix.touch_row(indices.w(i));
+                }
+            }
+            graph::emplace_node<rows_pluck_node<R>>(matrix, out, indices);
         }
         return out;
     }
@@ -200,6 +225,8 @@ namespace matops {
             for (int offset = 0; offset < row_indices.size(); ++offset)
                 MAT(out)(offset) = MAT(matrix)(row_indices[offset], col_indices[offset]);
         if (graph::backprop_enabled() && !matrix.constant) {
+            for (int offset = 0; offset < row_indices.size(); ++offset)
+                matrix.touch_row(row_indices[offset]);
             graph::emplace_back([matrix, out, row_indices, col_indices]() mutable {
                 auto row_index_ptr = row_indices.data();
                 auto col_index_ptr = col_indices.data();
@@ -230,6 +257,8 @@ namespace matops {
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
         MAT(out)  = MAT(matrix)[row].reshape(MAT(out).shape);
         GRAD(out) = GRAD(matrix)[row].reshape(MAT(out).shape);
+        if (graph::backprop_enabled() && !matrix.constant)
+            matrix.touch_row(row);
 
         return out;
     }
@@ -241,10 +270,12 @@ namespace matops {
         ASSERT2 (0 <= col && col <= matrix.dims(1), "Wrong col index used in col_pluck");
         Mat<R> out (matrix.dims(0), 1, weights<R>::empty());
 
+        DALI_COUNT_ELEMENTWISE("col_pluck", FORWARD, out, 0, 1);
         TensorOps::col_pluck(MAT(out).ravel(), MAT(matrix), col);
 
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, out, col]() mutable {
+                DALI_COUNT_ELEMENTWISE("col_pluck", BACKWARD, out, 1, 2);
                 TensorOps::col_pluck_backward(GRAD(matrix), GRAD(out).ravel(), col);
             });
         return out;
@@ -1,4 +1,9 @@
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <set>
+#include <thread>
 #include <vector>
 #include <iomanip>
 #include <gtest/gtest.h>
@@ -10,6 +15,9 @@
 #include "dali/tensor/MatOps.h"
 #include "dali/tensor/Tape.h"
 #include "dali/tensor/Solver.h"
+#include "dali/tensor/Checkpoint.h"
+#include "dali/tensor/Roofline.h"
+#include "dali/utils/ThreadPool.h"
 
 using std::vector;
 using std::chrono::milliseconds;
@@ -167,6 +175,41 @@ TEST_F(MatrixTests, identity_init) {
     }
 }
 
+TEST_F(MatrixTests, random_init_streams) {
+    utils::random::set_seed(42);
+    auto A = Mat<R>(30, 30, weights<R>::uniform(-2.0, 3.0));
+    auto B = Mat<R>(30, 30, weights<R>::gaussian(1.0, 2.0));
+    utils::random::set_seed(42);
+    auto A_again = Mat<R>(30, 30, weights<R>::uniform(-2.0, 3.0));
+    auto B_again = Mat<R>(30, 30, weights<R>::gaussian(1.0, 2.0));
+    ASSERT_MATRIX_EQ(A, A_again);
+    ASSERT_MATRIX_EQ(B, B_again);
+    ASSERT_MATRIX_NEQ(A, Mat<R>(30, 30, weights<R>::uniform(-2.0, 3.0)));
+    EXPECT_GE(A.w().min(), -2.0);
+    EXPECT_LT(A.w().max(), 3.0);
+    EXPECT_NEAR(1.0, B.w().sum() / B.number_of_elements(), 0.3);
+
+    #ifndef DALI_USE_CUDA
+    // another thread draws from a stream of its own.
+    Mat<R> C;
+    utils::random::set_seed(42);
+    std::thread([&C]() {
+        C = Mat<R>(30, 30, weights<R>::uniform(-2.0, 3.0));
+    }).join();
+    ASSERT_MATRIX_NEQ(A, C);
+
+    // doubles get more than the 24 random bits of a float.
+    auto D = Mat<double>(30, 30, weights<double>::uniform(0.0, 1.0));
+    bool finer_than_float = false;
+    for (int i = 0; i < D.number_of_elements(); ++i) {
+        double scaled = D.w(i) * 16777216.0;
+        finer_than_float = finer_than_float || scaled != std::floor(scaled);
+    }
+    EXPECT_TRUE(finer_than_float);
+    #endif
+    utils::random::reseed();
+}
+
 TEST_F(MatrixTests, recursive_sum) {
     auto functor = [](vector<Mat<R>>& Xs)-> Mat<R> {
         auto doubled = Xs[0] + Xs[0];
@@ -303,6 +346,106 @@ TEST_F(MatrixTests, save_load_test) {
     }
 }
 
+TEST_F(MatrixTests, npy_load_mapped) {
+    auto fname         = utils::dir_join({STR(DALI_DATA_DIR), "tests", "arange12.npy"});
+    auto fortran_fname = utils::dir_join({STR(DALI_DATA_DIR), "tests", "arange12.fortran.npy"});
+
+    // float32 arrays in C order become the memory of float matrices...
+    Mat<float> mapped(fname);
+    ASSERT_TRUE(mapped.w().memory().cpu_owner != nullptr);
+    // ...copy on write.
+    mapped.w(0, 0) += 100.0;
+    Mat<float> reloaded(fname);
+    ASSERT_EQ(reloaded.w(0, 0), 0);
+
+    // anything else is converted (and transposed).
+    Mat<double> converted(fname);
+    Mat<float> transposed(fortran_fname);
+    ASSERT_TRUE(converted.w().memory().cpu_owner == nullptr);
+    ASSERT_TRUE(transposed.w().memory().cpu_owner == nullptr);
+    for (int i = 0; i < 12; i++) {
+        ASSERT_EQ(converted.w(i), i);
+        ASSERT_EQ(transposed.w(i), i);
+    }
+
+    // numbers of the same size but another kind are converted too.
+    auto int_fname = utils::dir_join({STR(DALI_DATA_DIR), "tests", "arange12.int.temp.npy"});
+    vector<int32_t> ints(12);
+    for (int i = 0; i < 12; i++) {
+        ints[i] = i;
+    }
+    unsigned int int_shape[] = {3, 4};
+    cnpy::npy_save(int_fname, ints.data(), int_shape, 2, "w");
+    Mat<float> from_ints(int_fname);
+    ASSERT_TRUE(from_ints.w().memory().cpu_owner == nullptr);
+    for (int i = 0; i < 12; i++) {
+        ASSERT_EQ(from_ints.w(i), i);
+    }
+    std::remove(int_fname.c_str());
+
+    // arrays of npz files too.
+    auto npz_fname = utils::dir_join({STR(DALI_DATA_DIR), "tests", "arrays.temp.npz"});
+    Mat<float> first(40, 50, weights<float>::uniform(20.0));
+    Mat<double> second(3, 2, weights<double>::uniform(20.0));
+    cnpy::npz_save(npz_fname, "first", first.w().data(), first.dims().data(), 2, "w");
+    cnpy::npz_save(npz_fname, "second", second.w().data(), second.dims().data(), 2, "a");
+    auto arrays = cnpy::npz_load(npz_fname);
+    ASSERT_EQ(arrays.size(), 2);
+    Mat<float> loaded_first;
+    loaded_first.npy_load(arrays["first"]);
+    ASSERT_TRUE(MatOps<float>::equals(first, loaded_first));
+    arrays.destruct();
+
+    auto second_array = cnpy::npz_load(npz_fname, "second");
+    Mat<double> loaded_second;
+    loaded_second.npy_load(second_array);
+    ASSERT_TRUE(MatOps<double>::equals(second, loaded_second));
+    second_array.destruct();
+    std::remove(npz_fname.c_str());
+}
+
+TEST_F(MatrixTests, checkpoint_save_load) {
+    auto fname = utils::dir_join({STR(DALI_DATA_DIR), "tests", "checkpoint.temp.ckpt"});
+    vector<Mat<R>> params({
+        Mat<R>(3, 5, weights<R>::uniform(20.0)),
+        Mat<R>(1, 7, weights<R>::uniform(20.0)),
+        Mat<R>(4, 2, weights<R>::uniform(20.0))
+    });
+    utils::save_checkpoint(params, fname);
+    ASSERT_FALSE(utils::file_exists(fname + ".tmp"));
+
+    // loading writes into the parameters' memory, seen by every copy.
+    vector<Mat<R>> loaded({Mat<R>(3, 5), Mat<R>(1, 7), Mat<R>(4, 2)});
+    auto copies = loaded;
+    utils::load_checkpoint(copies, fname);
+    for (int i = 0; i < params.size(); ++i) {
+        ASSERT_TRUE(MatOps<R>::equals(params[i], loaded[i]));
+    }
+    ASSERT_THROW(
+        utils::load_checkpoint(vector<Mat<R>>({Mat<R>(3, 5), Mat<R>(7, 1), Mat<R>(4, 2)}), fname),
+        std::runtime_error
+    );
+
+    // background saves snapshot the weights when called.
+    {
+        utils::CheckpointSaver saver;
+        Mat<R> saved(params[0], true, false);
+        saver.save(params, fname);
+        params[0].w() += 1.0;
+        saver.wait();
+        utils::load_checkpoint(loaded, fname);
+        ASSERT_TRUE(MatOps<R>::equals(saved, loaded[0]));
+        ASSERT_FALSE(MatOps<R>::equals(params[0], loaded[0]));
+
+        // files saved with the checkpoint are written along with it.
+        saver.save(params, fname, {{fname + ".config", "hidden_sizes 3 4\n"}});
+        saver.wait();
+        ASSERT_EQ(vector<std::string>({"3", "4"}), utils::text_to_map(fname + ".config").at("hidden_sizes"));
+    }
+    std::remove((fname + ".config").c_str());
+    std::remove(fname.c_str());
+}
+
 TEST_F(MatrixTests, lazy_allocation) {
     // if memory must be filled with zeros,
     // then allocation is lazy
@@ -334,6 +477,283 @@ TEST_F(MatrixTests, lazy_allocation) {
     #endif
 }
 
+TEST_F(MatrixTests, memory_bank_recycles_cpu_memory) {
+    memory_bank<R>::clear_cpu();
+    // size classes always fit the request and waste at most a quarter
+    for (int amount : {1, 16, 17, 100, 1000, 123457}) {
+        auto capacity = memory_bank<R>::cpu_size_class(amount);
+        ASSERT_GE(capacity, amount);
+        ASSERT_LE(capacity, std::max(16.0, amount * 1.25));
+    }
+
+    R* first = memory_bank<R>::allocate_cpu(100, 10);
+    memory_bank<R>::deposit_cpu(100, 10, first);
+    auto allocations = (long long) memory_bank<R>::num_cpu_allocations;
+    // same size class is served from the pool:
+    R* second = memory_bank<R>::allocate_cpu(98, 2);
+    ASSERT_EQ(first, second);
+    ASSERT_EQ(allocations, (long long) memory_bank<R>::num_cpu_allocations);
+    ASSERT_GE(memory_bank<R>::cpu_memory_high_water_mark, memory_bank<R>::cpu_size_class(100));
+    memory_bank<R>::deposit_cpu(98, 2, second);
+
+    // trimming hands pooled memory back to the system
+    memory_bank<R>::trim_cpu(0);
+    ASSERT_EQ(memory_bank<R>::total_cpu_memory, memory_bank<R>::cpu_memory_in_use);
+    R* third = memory_bank<R>::allocate_cpu(100, 10);
+    ASSERT_EQ(allocations + 1, (long long) memory_bank<R>::num_cpu_allocations);
+    memory_bank<R>::deposit_cpu(100, 10, third);
+}
+
+namespace {
+    struct record_order_node {
+        vector<int>* order;
+        int id;
+        std::shared_ptr<int> alive;
+        void backward() {
+            order->emplace_back(id);
+        }
+    };
+}
+
+TEST_F(MatrixTests, tape_nodes_and_closures) {
+    graph::clear();
+    vector<int> order;
+    auto alive = std::make_shared<int>(0);
+    // nodes and closures share a single ordering on the tape
+    graph::emplace_node<record_order_node>(&order, 0, alive);
+    graph::emplace_back([&order]() { order.emplace_back(1); });
+    graph::emplace_node<record_order_node>(&order, 2, alive);
+    ASSERT_EQ(3, graph::size());
+    ASSERT_EQ(3, alive.use_count());
+
+    graph::backward();
+    ASSERT_EQ(vector<int>({2, 1, 0}), order);
+    // records are destroyed once backpropagated
+    ASSERT_EQ(0, graph::size());
+    ASSERT_EQ(1, alive.use_count());
+
+    // the arena is reused by the next pass
+    auto capacity = graph::current_tape().arena.capacity();
+    for (int i = 0; i < 1000; ++i) {
+        graph::emplace_node<record_order_node>(&order, i, alive);
+    }
+    graph::clear();
+    ASSERT_EQ(1, alive.use_count());
+    for (int i = 0; i < 1000; ++i) {
+        graph::emplace_node<record_order_node>(&order, i, alive);
+    }
+    auto reused_capacity = graph::current_tape().arena.capacity();
+    graph::clear();
+    for (int i = 0; i < 1000; ++i) {
+        graph::emplace_node<record_order_node>(&order, i, alive);
+    }
+    ASSERT_EQ(reused_capacity, graph::current_tape().arena.capacity());
+    ASSERT_GE(reused_capacity, capacity);
+    graph::clear();
+}
+
+TEST_F(MatrixTests, tape_profiles_backward_per_op) {
+    graph::clear();
+    utils::profiler::clear();
+    vector<int> order;
+    auto alive = std::make_shared<int>(0);
+    // recorded while the profiler is disabled: not profiled.
+    graph::emplace_node<record_order_node>(&order, 0, alive);
+    utils::profiler::enable();
+    graph::emplace_node<record_order_node>(&order, 1, alive);
+    graph::emplace_back([&order]() { order.emplace_back(2); });
+    graph::backward();
+    utils::profiler::enable(false);
+
+    int node_calls = 0, closure_calls = 0;
+    for (auto& span : utils::profiler::summary()) {
+        // "(anonymous namespace)::record_order_node"
+        if (span.name.find("record_order_node") != std::string::npos) {
+            node_calls += span.count;
+        } else if (span.name.find("lambda") != std::string::npos) {
+            // closures are named after the op's lambda.
+            closure_calls += span.count;
+        }
+    }
+    ASSERT_EQ(1, node_calls);
+    ASSERT_EQ(1, closure_calls);
+    utils::profiler::clear();
+}
+
+TEST_F(MatrixTests, mul_counts_flops_and_bytes) {
+    graph::clear();
+    utils::profiler::clear();
+    auto A = Mat<R>(3, 5, weights<R>::uniform(1.0));
+    auto B = Mat<R>(5, 4, weights<R>::uniform(1.0));
+    utils::profiler::count_ops();
+    auto out = MatOps<R>::mul(A, B);
+    out.grad();
+    graph::backward();
+    utils::profiler::count_ops(false);
+
+    int found = 0;
+    for (auto& op : utils::profiler::op_summary()) {
+        if (op.name != "mul") {
+            continue;
+        }
+        found += 1;
+        EXPECT_EQ(op.calls, 1);
+        EXPECT_EQ(op.shape[0], 3);
+        EXPECT_EQ(op.shape[1], 5);
+        EXPECT_EQ(op.shape[2], 4);
+        if (op.direction == utils::profiler::FORWARD) {
+            EXPECT_EQ(op.work.flops, 2 * 3 * 5 * 4);
+            EXPECT_EQ(op.work.bytes_read, (3 * 5 + 5 * 4) * sizeof(R));
+            EXPECT_EQ(op.work.bytes_written, 3 * 4 * sizeof(R));
+        } else {
+            // one product per gradient.
+            EXPECT_EQ(op.work.flops, 4 * 3 * 5 * 4);
+            EXPECT_EQ(op.work.bytes_written, (3 * 5 + 5 * 4) * sizeof(R));
+        }
+    }
+    EXPECT_EQ(found, 2);
+
+    // against a machine whose ridge is at 1 FLOP/byte.
+    for (auto& entry : utils::roofline(utils::MachinePeak{1.0, 1.0})) {
+        EXPECT_EQ(entry.memory_bound, entry.intensity < 1.0);
+    }
+    utils::profiler::clear();
+}
+
+TEST_F(MatrixTests, backward_parallel_matches_backward) {
+    ThreadPool pool(4);
+    EXPERIMENT_REPEAT {
+        auto W  = Mat<R>(5, 4, weights<R>::uniform(1.0));
+        auto b  = Mat<R>(1, 4, weights<R>::uniform(1.0));
+        auto X1 = Mat<R>(3, 5, weights<R>::uniform(1.0));
+        auto X2 = Mat<R>(3, 5, weights<R>::uniform(1.0));
+        vector<Mat<R>> params({W, b, X1, X2});
+        vector<Mat<R>> params_copy;
+        for (auto& param : params) {
+            params_copy.emplace_back(param, true, true);
+        }
+
+        auto forward = [](const vector<Mat<R>>& p) {
+            // two independent branches sharing W and b, joined at the end
+            auto left  = MatOps<R>::mul_with_bias(p[0], p[2], p[1]).sigmoid();
+            auto right = MatOps<R>::mul_with_bias(p[0], p[3], p[1]).tanh();
+            left  = (left * left + left).exp();
+            right = (right - right * right).relu();
+            return (left + right).sum();
+        };
+        forward(params).grad();
+        graph::backward();
+        forward(params_copy).grad();
+        graph::backward_parallel(pool);
+        ASSERT_EQ(0, graph::size());
+
+        for (int i = 0; i < params.size(); ++i) {
+            ASSERT_MATRIX_GRAD_CLOSE(params[i], params_copy[i], 1e-6);
+        }
+    }
+}
+
+TEST_F(MatrixTests, cpu_threading_matches_single_thread) {
+    // small threshold so that these matrices get split across threads,
+    // and more than 3 reduction chunks (the last one shorter) so that
+    // reductions combine partial results from several threads.
+    cpu_threading::set_min_parallel_size(64);
+    const int rows = 50;
+    const int cols = (3 * cpu_threading::REDUCTION_CHUNK) / rows + 20;
+    ASSERT_GT(rows * cols, 3 * cpu_threading::REDUCTION_CHUNK);
+    ASSERT_NE(0, (rows * cols) % cpu_threading::REDUCTION_CHUNK);
+    EXPERIMENT_REPEAT {
+        auto A = Mat<R>(rows, cols, weights<R>::uniform(2.0));
+        auto B = Mat<R>(rows, cols, weights<R>::uniform(2.0));
+        auto compute = [&A, &B]() {
+            auto C = (A * B + A.sigmoid()).tanh();
+            C += B;
+            return vector<R>({C.w().sum(), C.w().L2_norm(), C.w().min(), C.w().max(), C.w(1234)});
+        };
+        cpu_threading::set_num_threads(1);
+        auto expected = compute();
+        for (int num_threads : {2, std::max(4, (int)std::thread::hardware_concurrency())}) {
+            cpu_threading::set_num_threads(num_threads);
+            auto result = compute();
+            // bit for bit:
+            for (int i = 0; i < expected.size(); ++i) {
+                ASSERT_EQ(expected[i], result[i]);
+            }
+        }
+        graph::clear();
+    }
+    cpu_threading::set_num_threads(0);
+    cpu_threading::set_min_parallel_size(1 << 15);
+}
+
+TEST_F(MatrixTests, subtape_backward_discard_merge) {
+    graph::clear();
+    auto A = Mat<R>(3, 4, weights<R>::uniform(1.0));
+    auto B = Mat<R>(3, 4, weights<R>::uniform(1.0));
+
+    auto main_out = A.sigmoid();
+    ASSERT_EQ(1, graph::size());
+    {
+        graph::SubTape scoring;
+        // recorded on the sub-tape only
+        auto score = (B * B).sum();
+        ASSERT_EQ(2, graph::size());
+        ASSERT_EQ(2, scoring.size());
+        score.grad();
+        scoring.backward();
+        ASSERT_EQ(0, scoring.size());
+    }
+    ASSERT_EQ(1, graph::size());
+    for (int i = 0; i < B.number_of_elements(); ++i) {
+        ASSERT_NEAR(2.0 * B.w(i), B.dw(i), 1e-6);
+    }
+    {
+        // dropped when going out of scope
+        graph::SubTape discarded;
+        auto unused = (B * B).sum();
+    }
+    ASSERT_EQ(1, graph::size());
+    {
+        graph::SubTape merged;
+        auto loss = main_out.sum();
+        merged.merge();
+        ASSERT_EQ(0, merged.size());
+        ASSERT_EQ(0, graph::size());
+        loss.grad();
+    }
+    ASSERT_EQ(2, graph::size());
+    B.clear_grad();
+    graph::backward();
+    ASSERT_EQ(0, graph::size());
+    for (int i = 0; i < A.number_of_elements(); ++i) {
+        ASSERT_NEAR(main_out.w(i) * (1.0 - main_out.w(i)), A.dw(i), 1e-6);
+        ASSERT_EQ(0.0, B.dw(i));
+    }
+}
+
+TEST_F(MatrixTests, backward_from_loss_skips_disconnected_nodes) {
+    EXPERIMENT_REPEAT {
+        auto A = Mat<R>(3, 4, weights<R>::uniform(1.0));
+        auto B = Mat<R>(3, 4, weights<R>::uniform(1.0));
+        auto A_copy = Mat<R>(A, true, true);
+
+        auto loss     = (A * A + A).tanh().sum();
+        auto aux_loss = (B * B).sigmoid().sum();
+        loss.grad();
+        aux_loss.grad();
+        graph::backward(loss);
+        ASSERT_EQ(0, graph::size());
+        for (int i = 0; i < B.number_of_elements(); ++i) {
+            ASSERT_EQ(0.0, B.dw(i));
+        }
+
+        auto reference = (A_copy * A_copy + A_copy).tanh().sum();
+        reference.grad();
+        graph::backward();
+        ASSERT_MATRIX_GRAD_CLOSE(A, A_copy, 1e-6);
+    }
+}
+
 TEST_F(MatrixTests, view_transpose) {
     // For 1xN or Nx1 matrices, a transpose is simply a
     // different view onto the memory
@@ -936,6 +1356,166 @@ TEST_F(MatOpsTests, matrix_mul_add_mul_with_bias_fancy_broadcast) {
     }
 }
 
+TEST_F(MatOpsTests, fused_softmax_cross_entropy_rowwise) {
+    int num_examples = 5;
+    int input_size = 4;
+    int other_input_size = 3;
+    auto random_targets = [num_examples](int vocab_size) {
+        Mat<int> targets(num_examples, 1);
+        for (int i = 0; i < num_examples; ++i) {
+            targets.w(i) = utils::randint(0, vocab_size - 1);
+        }
+        return targets;
+    };
+    EXPERIMENT_REPEAT {
+        int vocab_size = 10;
+        auto targets = random_targets(vocab_size);
+        auto mask    = Mat<R>(num_examples, 1, weights<R>::uniform(0.5, 1.5));
+        auto functor = [targets, mask](vector<Mat<R>> Xs)-> Mat<R> {
+            return MatOps<R>::fused_softmax_cross_entropy_rowwise(
+                {Xs[0], Xs[2]}, {Xs[1], Xs[3]}, Xs[4], targets, mask
+            );
+        };
+        auto X      = Mat<R>(num_examples, input_size,       weights<R>::uniform(2.0));
+        auto W      = Mat<R>(input_size,   vocab_size,       weights<R>::uniform(2.0));
+        auto Xfancy = Mat<R>(1,            other_input_size, weights<R>::uniform(2.0));
+        auto Wfancy = Mat<R>(other_input_size, vocab_size,   weights<R>::uniform(2.0));
+        auto bias   = Mat<R>(1,            vocab_size,       weights<R>::uniform(2.0));
+        ASSERT_TRUE(gradient_same(functor, {W, X, Wfancy, Xfancy, bias}, 1e-3));
+    }
+
+    // a vocabulary of several blocks gives the error and gradients of
+    // the unfused ops.
+    int vocab_size = 2500;
+    auto targets = random_targets(vocab_size);
+    auto mask    = Mat<R>(num_examples, 1, weights<R>::uniform(0.0, 1.0));
+    auto X       = Mat<R>(num_examples, input_size, weights<R>::uniform(2.0));
+    auto W       = Mat<R>(input_size,   vocab_size, weights<R>::uniform(2.0));
+    auto bias    = Mat<R>(1,            vocab_size, weights<R>::uniform(2.0));
+
+    auto fused = MatOps<R>::fused_softmax_cross_entropy_rowwise({W}, {X}, bias, targets, mask);
+    fused.grad();
+    graph::backward();
+    Mat<R> fused_W_grad(W, false, true);
+    Mat<R> fused_X_grad(X, false, true);
+    Mat<R> fused_bias_grad(bias, false, true);
+    W.clear_grad();
+    X.clear_grad();
+    bias.clear_grad();
+
+    auto unfused = MatOps<R>::softmax_cross_entropy_rowwise(
+        MatOps<R>::mul_with_bias(W, X, bias), targets
+    ) * mask;
+    unfused.grad();
+    graph::backward();
+    ASSERT_MATRIX_CLOSE(fused, unfused, 1e-5);
+    ASSERT_MATRIX_GRAD_CLOSE(fused_W_grad, W, 1e-5);
+    ASSERT_MATRIX_GRAD_CLOSE(fused_X_grad, X, 1e-5);
+    ASSERT_MATRIX_GRAD_CLOSE(fused_bias_grad, bias, 1e-5);
+}
+
+TEST_F(MatOpsTests, sampled_softmax_and_nce_rowwise) {
+    int num_examples = 5;
+    int input_size = 4;
+    int other_input_size = 3;
+    int vocab_size = 10;
+    auto sampler = utils::UnigramSampler::zipfian(vocab_size);
+    // a fixed set of negatives: every evaluation of the functor must
+    // see the same one.
+    auto negatives = sampler.sample_unique(4);
+    EXPERIMENT_REPEAT {
+        Mat<int> targets(num_examples, 1);
+        for (int i = 0; i < num_examples; ++i) {
+            targets.w(i) = utils::randint(0, vocab_size - 1);
+        }
+        // one target is also a negative.
+        targets.w(0) = negatives.words[0];
+        auto mask = Mat<R>(num_examples, 1, weights<R>::uniform(0.5, 1.5));
+        for (bool nce : {false, true}) {
+            auto functor = [&](vector<Mat<R>> Xs)-> Mat<R> {
+                if (nce) {
+                    return MatOps<R>::nce_rowwise(
+                        {Xs[0], Xs[2]}, {Xs[1], Xs[3]}, Xs[4], targets, mask, sampler, negatives
+                    );
+                }
+                return MatOps<R>::sampled_softmax_cross_entropy_rowwise(
+                    {Xs[0], Xs[2]}, {Xs[1], Xs[3]}, Xs[4], targets, mask, sampler, negatives
+                );
+            };
+            auto X      = Mat<R>(num_examples, input_size,       weights<R>::uniform(2.0));
+            auto W      = Mat<R>(input_size,   vocab_size,       weights<R>::uniform(2.0));
+            auto Xfancy = Mat<R>(1,            other_input_size, weights<R>::uniform(2.0));
+            auto Wfancy = Mat<R>(other_input_size, vocab_size,   weights<R>::uniform(2.0));
+            auto bias   = Mat<R>(1,            vocab_size,       weights<R>::uniform(2.0));
+            ASSERT_TRUE(gradient_same(functor, {W, X, Wfancy, Xfancy, bias}, 1e-3));
+        }
+    }
+
+    // words that are neither sampled nor targets get no gradient.
+    Mat<int> targets(num_examples, 1);
+    for (int i = 0; i < num_examples; ++i) {
+        targets.w(i) = negatives.words[i % negatives.words.size()];
+    }
+    auto mask  = Mat<R>(num_examples, 1, weights<R>::uniform(0.5, 1.5));
+    auto X     = Mat<R>(num_examples, input_size, weights<R>::uniform(2.0));
+    auto W     = Mat<R>(input_size,   vocab_size, weights<R>::uniform(2.0));
+    auto bias  = Mat<R>(1,            vocab_size, weights<R>::uniform(2.0));
+    auto error = MatOps<R>::sampled_softmax_cross_entropy_rowwise(
+        {W}, {X}, bias, targets, mask, sampler, negatives
+    );
+    error.grad();
+    graph::backward();
+    for (int word = 0; word < vocab_size; ++word) {
+        if (std::find(negatives.words.begin(), negatives.words.end(), word) != negatives.words.end()) {
+            continue;
+        }
+        ASSERT_EQ(bias.dw(word), 0);
+        for (int k = 0; k < input_size; ++k) {
+            ASSERT_EQ(W.dw(k, word), 0);
+        }
+    }
+}
+
+TEST_F(MatOpsTests, hierarchical_softmax_rowwise) {
+    int num_examples = 5;
+    int input_size = 4;
+    int other_input_size = 3;
+    auto tree = utils::SoftmaxTree::huffman({5.0, 1.0, 1.0, 2.0, 10.0, 3.0, 4.0}, 3);
+    EXPERIMENT_REPEAT {
+        Mat<int> targets(num_examples, 1);
+        for (int i = 0; i < num_examples; ++i) {
+            targets.w(i) = utils::randint(0, tree.num_labels() - 1);
+        }
+        auto mask    = Mat<R>(num_examples, 1, weights<R>::uniform(0.5, 1.5));
+        auto functor = [&](vector<Mat<R>> Xs)-> Mat<R> {
+            return MatOps<R>::hierarchical_softmax_rowwise(
+                {Xs[0], Xs[2]}, {Xs[1], Xs[3]}, Xs[4], targets, mask, tree
+            );
+        };
+        auto X      = Mat<R>(num_examples, input_size,       weights<R>::uniform(2.0));
+        auto W      = Mat<R>(input_size,   tree.num_columns(), weights<R>::uniform(2.0));
+        auto Xfancy = Mat<R>(1,            other_input_size, weights<R>::uniform(2.0));
+        auto Wfancy = Mat<R>(other_input_size, tree.num_columns(), weights<R>::uniform(2.0));
+        auto bias   = Mat<R>(1,            tree.num_columns(), weights<R>::uniform(2.0));
+        ASSERT_TRUE(gradient_same(functor, {W, X, Wfancy, Xfancy, bias}, 1e-3));
+    }
+
+    // the probabilities of all labels sum to one.
+    graph::NoBackprop nb;
+    auto X    = Mat<R>(1,          input_size,         weights<R>::uniform(2.0));
+    auto W    = Mat<R>(input_size, tree.num_columns(), weights<R>::uniform(2.0));
+    auto bias = Mat<R>(1,          tree.num_columns(), weights<R>::uniform(2.0));
+    Mat<R> mask(1, 1);
+    mask.w(0) = 1.0;
+    R total = 0.0;
+    for (int label = 0; label < tree.num_labels(); ++label) {
+        Mat<int> target(1, 1);
+        target.w(0) = label;
+        total += std::exp(-MatOps<R>::hierarchical_softmax_rowwise({W}, {X}, bias, target, mask, tree).w(0));
+    }
+    ASSERT_NEAR(total, 1.0, 1e-5);
+}
+
 TEST_F(MatOpsTests, matrix_mul_add_mul_with_bias_colwise) {
     auto functor = [](vector<Mat<R>> Xs)-> Mat<R> {
         return MatOps<R>::mul_add_mul_with_bias_colwise({Xs[0], Xs[2], Xs[4]}, {Xs[1], Xs[3], Xs[5]}, Xs[6]);
@@ -1147,6 +1727,49 @@ TEST_F(MatOpsTests, fast_dropout) {
     }
 }
 
+TEST_F(MatOpsTests, dropout_regenerated_masks) {
+    matops::set_regenerate_dropout_masks(true);
+    int seed = 1234;
+    vector<std::function<Mat<R>(Mat<R>)>> dropouts({
+        [](Mat<R> X) { return MatOps<R>::dropout(X, 0.5); },
+        [](Mat<R> X) { return MatOps<R>::dropout_normalized(X, 0.5); },
+        [](Mat<R> X) { return MatOps<R>::fast_dropout(X); },
+    });
+    for (auto& dropout : dropouts) {
+        auto functor = [&seed, &dropout](vector<Mat<R>> Xs)-> Mat<R> {
+            auto C = Xs[0] * Xs[1];
+            utils::random::set_seed(seed);
+            auto D = dropout(C);
+            utils::random::reseed();
+            return D + Xs[2];
+        };
+        EXPERIMENT_REPEAT {
+            seed = utils::randint(0, 2000);
+            auto A = Mat<R>(4, 5, weights<R>::uniform(2.0));
+            auto B = Mat<R>(4, 5, weights<R>::uniform(20.0));
+            auto C = Mat<R>(1, 5, weights<R>::uniform(20.0));
+            ASSERT_TRUE(gradient_same(functor, {A, B, C}, 0.0003));
+        }
+    }
+    // same seed, same mask; about drop_prob of the values are dropped.
+    auto X = Mat<R>(100, 100, weights<R>::uniform(1.0, 2.0));
+    utils::random::set_seed(seed);
+    auto first = MatOps<R>::dropout(X, 0.3);
+    auto second = MatOps<R>::dropout(X, 0.3);
+    utils::random::set_seed(seed);
+    auto again = MatOps<R>::dropout(X, 0.3);
+    utils::random::reseed();
+    ASSERT_MATRIX_EQ(first, again);
+    ASSERT_MATRIX_NEQ(first, second);
+    int dropped = 0;
+    for (int i = 0; i < first.number_of_elements(); ++i) {
+        dropped += first.w(i) == 0.0;
+    }
+    EXPECT_NEAR(0.3, (double)dropped / first.number_of_elements(), 0.03);
+    graph::clear();
+    matops::set_regenerate_dropout_masks(false);
+}
+
 TEST_F(MatOpsTests, softmax_colwise) {
     int row_size = 5;
     int col_size = 10;
@@ -1914,6 +2537,182 @@ TEST(Solver, adam) {
     });
 }
 
+TEST(Solver, sparse_gradient_matches_dense) {
+    // solvers whose sparse update is exactly the dense one
+    // (Adam is lazy: skipped rows do not move at all).
+    vector<create_solver_t> create_solvers = {
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::SGD<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::AdaGrad<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::RMSProp<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::AdaDelta<R>>(params); },
+    };
+    vector<vector<uint>> batches = {{1, 3, 3}, {0}, {3, 7}, {9, 1}, {7}};
+
+    for (auto& create_solver : create_solvers) {
+        Mat<R> dense(10, 4, weights<R>::uniform(2.0));
+        Mat<R> sparse(dense, true, true);
+        sparse.set_sparse_gradient(true);
+        Mat<R> initial(dense, true, true);
+
+        vector<Mat<R>> dense_params({dense});
+        vector<Mat<R>> sparse_params({sparse});
+        auto dense_solver  = create_solver(dense_params);
+        auto sparse_solver = create_solver(sparse_params);
+
+        for (auto& batch : batches) {
+            dense[&batch].tanh().sum().grad();
+            sparse[&batch].tanh().sum().grad();
+            graph::backward();
+            ASSERT_EQ(sparse.touched_rows().size(), std::set<uint>(batch.begin(), batch.end()).size());
+
+            dense_solver->step(dense_params);
+            sparse_solver->step(sparse_params);
+
+            ASSERT_MATRIX_CLOSE(dense, sparse, 1e-5);
+            ASSERT_TRUE(sparse.touched_rows().empty());
+            for (unsigned int i = 0; i < sparse.number_of_elements(); ++i) {
+                ASSERT_EQ(sparse.dw(i), 0.0);
+            }
+        }
+        // never touched: left alone.
+        for (int row : {2, 4, 5, 6, 8}) {
+            for (int col = 0; col < 4; ++col) {
+                ASSERT_EQ(sparse.w(row, col), initial.w(row, col));
+            }
+        }
+    }
+}
+
+TEST(Solver, sparse_gradient_columns_matches_dense) {
+    vector<create_solver_t> create_solvers = {
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::SGD<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::AdaGrad<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::RMSProp<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::AdaDelta<R>>(params); },
+    };
+    int num_examples = 3;
+    int vocab_size = 12;
+    auto sampler = utils::UnigramSampler::zipfian(vocab_size);
+    auto X = Mat<R>(num_examples, 4, weights<R>::uniform(2.0));
+    X.constant = true;
+    auto mask = Mat<R>(num_examples, 1, weights<R>::uniform(0.5, 1.5));
+    mask.constant = true;
+
+    for (auto& create_solver : create_solvers) {
+        // a decoder, whose columns are words.
+        Mat<R> dense(4, vocab_size, weights<R>::uniform(2.0));
+        Mat<R> dense_bias(1, vocab_size, weights<R>::uniform(2.0));
+        Mat<R> sparse(dense, true, true);
+        Mat<R> sparse_bias(dense_bias, true, true);
+        sparse.set_sparse_gradient_columns(true);
+        sparse_bias.set_sparse_gradient_columns(true);
+
+        vector<Mat<R>> dense_params({dense, dense_bias});
+        vector<Mat<R>> sparse_params({sparse, sparse_bias});
+        auto dense_solver  = create_solver(dense_params);
+        auto sparse_solver = create_solver(sparse_params);
+
+        for (int iter = 0; iter < 4; ++iter) {
+            auto negatives = sampler.sample_unique(3);
+            Mat<int> targets(num_examples, 1);
+            for (int i = 0; i < num_examples; ++i) {
+                targets.w(i) = utils::randint(0, vocab_size - 1);
+            }
+            std::set<int> touched(negatives.words.begin(), negatives.words.end());
+            for (int i = 0; i < num_examples; ++i) {
+                touched.insert(targets.w(i));
+            }
+            MatOps<R>::sampled_softmax_cross_entropy_rowwise(
+                {dense}, {X}, dense_bias, targets, mask, sampler, negatives
+            ).grad();
+            MatOps<R>::sampled_softmax_cross_entropy_rowwise(
+                {sparse}, {X}, sparse_bias, targets, mask, sampler, negatives
+            ).grad();
+            graph::backward();
+            ASSERT_EQ(sparse.touched_rows(), vector<int>(touched.begin(), touched.end()));
+            ASSERT_EQ(sparse_bias.touched_rows(), vector<int>(touched.begin(), touched.end()));
+
+            dense_solver->step(dense_params);
+            sparse_solver->step(sparse_params);
+            ASSERT_MATRIX_CLOSE(dense, sparse, 1e-5);
+            ASSERT_MATRIX_CLOSE(dense_bias, sparse_bias, 1e-5);
+            ASSERT_TRUE(sparse.touched_rows().empty());
+            for (unsigned int i = 0; i < sparse.number_of_elements(); ++i) {
+                ASSERT_EQ(sparse.dw(i), 0.0);
+            }
+        }
+    }
+}
+
+TEST(Solver, fused_matches_unfused) {
+    vector<create_solver_t> create_solvers = {
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::SGD<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::AdaGrad<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::RMSProp<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::RMSPropMomentum<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::AdaDelta<R>>(params); },
+        [](vector<Mat<R>> params) { return std::make_shared<Solver::Adam<R>>(params); },
+    };
+    vector<uint> rows = {1, 3};
+
+    for (auto& create_solver : create_solvers) {
+        vector<Mat<R>> params;
+        vector<Mat<R>> fused_params;
+        // odd sizes (padding), and a large one so that the flat
+        // buffers get cut into several chunks.
+        for (auto dims : vector<std::pair<int,int>>({{3, 5}, {1, 7}, {380, 380}, {4, 4}})) {
+            params.emplace_back(dims.first, dims.second, weights<R>::uniform(2.0));
+            fused_params.emplace_back(params.back(), true, true);
+        }
+        // sparse gradients stay out of the flat buffers.
+        params.emplace_back(10, 3, weights<R>::uniform(2.0));
+        fused_params.emplace_back(params.back(), true, true);
+        params.back().set_sparse_gradient(true);
+        fused_params.back().set_sparse_gradient(true);
+
+        auto solver       = create_solver(params);
+        auto fused_solver = create_solver(fused_params);
+        fused_solver->fuse(fused_params);
+
+        for (int iter = 0; iter < 3; ++iter) {
+            for (auto p : {&params, &fused_params}) {
+                auto error = p->back()[&rows].tanh().sum();
+                for (int i = 0; i + 1 < p->size(); ++i) {
+                    error = error + (*p)[i].tanh().sum();
+                }
+                error.grad();
+            }
+            graph::backward();
+            solver->step(params);
+            fused_solver->step(fused_params);
+
+            for (int i = 0; i < params.size(); ++i) {
+                ASSERT_MATRIX_CLOSE(params[i], fused_params[i], 1e-5);
+                ASSERT_EQ(fused_params[i].dw().sum(), 0.0);
+            }
+        }
+    }
+}
+
+TEST(Solver, fused_keeps_views_in_sync) {
+    Mat<R> param(380, 380, weights<R>::uniform(2.0));
+    // shares the memory of `param`, not its TensorInternal.
+    auto view = param.slice(0, 380);
+    vector<Mat<R>> params({param});
+    Solver::SGD<R> solver(params);
+    solver.fuse(params);
+
+    param.tanh().sum().grad();
+    graph::backward();
+    solver.step(params);
+
+    ASSERT_EQ(&view.w().memory(), &param.w().memory());
+    ASSERT_MATRIX_CLOSE(view, param, 1e-9);
+    // copies of a packed parameter only copy the parameter.
+    Mat<R> copy(param, true, true);
+    ASSERT_EQ(copy.w().memory().total_memory, (int)param.number_of_elements());
+}
+
 Mat<R> create_dataset() {
     int num_points     = 20;
     int num_dimensions = 5;
@@ -0,0 +1,74 @@
+#ifndef DALI_TEST_GRADIENTS_H
+#define DALI_TEST_GRADIENTS_H
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "dali/tensor/Mat.h"
+
+/**
+Gradient snapshots
+------------------
+
+Compare the gradients two computations of the same result leave in
+the same parameters:
+
+    expected.grad();
+    graph::backward();
+    auto expected_grads = take_gradients(params);
+
+    result.grad();
+    graph::backward();
+    ASSERT_TRUE(gradients_near(expected_grads, params, 1e-6));
+
+Templated on the number type, so that tests can use float or double.
+**/
+
+// restrict to this compilation unit - avoid linking errors.
+namespace {
+    // copies of the gradients of `params`, which are then cleared.
+    template<typename R>
+    std::vector<std::vector<R>> take_gradients(std::vector<Mat<R>>& params) {
+        std::vector<std::vector<R>> gradients;
+        for (auto& param : params) {
+            gradients.emplace_back();
+            for (int j = 0; j < param.number_of_elements(); ++j) {
+                gradients.back().push_back(param.dw(j));
+            }
+            param.clear_grad();
+        }
+        return gradients;
+    }
+
+    // whether the gradients of `params` are within `tolerance` of
+    // `expected` (from `take_gradients`). Clears them.
+    template<typename R>
+    ::testing::AssertionResult gradients_near(const std::vector<std::vector<R>>& expected,
+                                              std::vector<Mat<R>>& params,
+                                              R tolerance) {
+        if (expected.size() != params.size()) {
+            return ::testing::AssertionFailure()
+                    << "expected gradients for " << expected.size()
+                    << " parameters but got " << params.size();
+        }
+        auto gradients = take_gradients(params);
+        for (int i = 0; i < params.size(); ++i) {
+            if (expected[i].size() != gradients[i].size()) {
+                return ::testing::AssertionFailure()
+                        << "parameter " << i << " has " << gradients[i].size()
+                        << " elements, expected " << expected[i].size();
+            }
+            for (int j = 0; j < gradients[i].size(); ++j) {
+                if (std::abs(expected[i][j] - gradients[i][j]) > tolerance) {
+                    return ::testing::AssertionFailure()
+                            << "gradient " << j << " of parameter " << i << " is "
+                            << gradients[i][j] << ", expected " << expected[i][j];
+                }
+            }
+        }
+        return ::testing::AssertionSuccess();
+    }
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "dali/utils/cnpy.h"
 #include "dali/utils/core_utils.h"
+#include "dali/utils/Profiler.h"
 #include "dali/utils/vocab.h"
 #include "dali/utils/random.h"
 #include "dali/utils/grid_search.h"
@@ -13,4 +14,7 @@
 #include "dali/utils/ParseUtils.h"
 #include "dali/utils/scoring_utils.h"
 #include "dali/utils/tsv_utils.h"
+#include "dali/utils/parallel_parsing.h"
 #include "dali/utils/OntologyBranch.h"
+#include "dali/utils/SoftmaxTree.h"
+#include "dali/utils/UnigramSampler.h"
@@ -0,0 +1,371 @@
+#include "dali/utils/Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "dali/utils/assert2.h"
+#include "dali/utils/core_utils.h"
+
+using std::string;
+using std::vector;
+
+namespace utils {
+    namespace profiler {
+        std::atomic<bool> is_enabled(false);
+        std::atomic<bool> is_counting_ops(false);
+
+        struct Event {
+            int span;
+            // index of the enclosing event of the thread (-1 for none).
+            int parent;
+            int64_t start;
+            // -1 while the span runs.
+            int64_t end;
+        };
+
+        struct OpTotals {
+            int64_t calls;
+            OpWork work;
+            int64_t total_ns;
+            std::map<op_shape_t, int64_t> shapes;
+        };
+
+        struct SpanTotals {
+            int64_t count;
+            int64_t total_ns;
+            int64_t self_ns;
+        };
+
+        // written only by its thread.
+        struct ThreadBuffer {
+            int thread;
+            vector<Event> events;
+            // innermost running event.
+            int open;
+            // by op id, forward and backward.
+            std::unordered_map<int, OpTotals> ops[2];
+            // by span id, spans recorded while the profiler is disabled.
+            std::unordered_map<int, SpanTotals> spans;
+            // time spent in the children of each of these spans that
+            // is running, innermost last.
+            vector<int64_t> children_ns;
+        };
+
+        namespace {
+            typedef std::chrono::steady_clock clock_t;
+            const clock_t::time_point epoch = clock_t::now();
+
+            int64_t now() {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - epoch).count();
+            }
+
+            std::mutex names_mutex;
+            // a deque keeps references to names valid as it grows.
+            std::deque<string> names;
+            std::unordered_map<string, int> name_ids;
+
+            // buffers outlive their threads, so that their spans
+            // can still be reported.
+            std::mutex buffers_mutex;
+            vector<std::unique_ptr<ThreadBuffer>> buffers;
+            thread_local ThreadBuffer* local_buffer = NULL;
+
+            ThreadBuffer* thread_buffer() {
+                if (local_buffer == NULL) {
+                    std::lock_guard<std::mutex> guard(buffers_mutex);
+                    buffers.emplace_back(new ThreadBuffer{(int)buffers.size(), {}, -1, {}, {}, {}});
+                    buffers.back()->events.reserve(1 << 12);
+                    local_buffer = buffers.back().get();
+                }
+                return local_buffer;
+            }
+
+            string json_escape(const string& text) {
+                string escaped;
+                for (char c : text) {
+                    if (c == '"' || c == '\\') {
+                        escaped += '\\';
+                        escaped += c;
+                    } else if ((unsigned char)c < 0x20) {
+                        char code[8];
+                        std::snprintf(code, sizeof(code), "\\u%04x", c);
+                        escaped += code;
+                    } else {
+                        escaped += c;
+                    }
+                }
+                return escaped;
+            }
+        }
+
+        void enable(bool value) {
+            is_enabled.store(value);
+        }
+
+        void count_ops(bool value) {
+            is_counting_ops.store(value);
+        }
+
+        int intern(const string& name) {
+            std::lock_guard<std::mutex> guard(names_mutex);
+            auto found = name_ids.find(name);
+            if (found != name_ids.end()) {
+                return found->second;
+            }
+            names.emplace_back(name);
+            name_ids[name] = names.size() - 1;
+            return names.size() - 1;
+        }
+
+        int intern(const std::type_info& type) {
+            // type_info objects are unique, so their address is a key.
+            thread_local std::unordered_map<const std::type_info*, int> type_ids;
+            auto found = type_ids.find(&type);
+            if (found != type_ids.end()) {
+                return found->second;
+            }
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+            int id = intern(status == 0 ? string(demangled) : string(type.name()));
+            std::free(demangled);
+            type_ids[&type] = id;
+            return id;
+        }
+
+        const string& name(int id) {
+            std::lock_guard<std::mutex> guard(names_mutex);
+            return names.at(id);
+        }
+
+        Span::Span(int id, bool autostart, bool always) :
+                id(id), buffer(NULL), event(-1), always(always), totals_start(-1) {
+            if (autostart) {
+                start();
+            }
+        }
+
+        void Span::start() {
+            if (event != -1 || totals_start != -1 || !(always || enabled())) {
+                return;
+            }
+            buffer = thread_buffer();
+            if (!enabled()) {
+                buffer->children_ns.push_back(0);
+                totals_start = now();
+                return;
+            }
+            event  = buffer->events.size();
+            buffer->events.push_back(Event{id, buffer->open, now(), -1});
+            buffer->open = event;
+        }
+
+        Span::~Span() {
+            stop();
+        }
+
+        void Span::stop() {
+            if (totals_start != -1) {
+                const int64_t duration = now() - totals_start;
+                auto& children_ns = buffer->children_ns;
+                int64_t self_ns = duration;
+                // spans stop in reverse order, so ours is the innermost.
+                if (!children_ns.empty()) {
+                    self_ns -= children_ns.back();
+                    children_ns.pop_back();
+                }
+                if (!children_ns.empty()) {
+                    children_ns.back() += duration;
+                }
+                auto& totals = buffer->spans[id];
+                totals.count    += 1;
+                totals.total_ns += duration;
+                totals.self_ns  += self_ns;
+                totals_start = -1;
+                return;
+            }
+            if (event == -1) {
+                return;
+            }
+            // the buffer may have been cleared since.
+            if (event < buffer->events.size()) {
+                buffer->events[event].end = now();
+                buffer->open = buffer->events[event].parent;
+            }
+            event = -1;
+        }
+
+        OpCounter::OpCounter(int id, Direction direction) :
+                id(id),
+                direction(direction),
+                start(-1),
+                work{0.0, 0.0, 0.0},
+                shape{{0, 0, 0, 0}} {
+            if (counting_ops()) {
+                start = now();
+            }
+        }
+
+        bool OpCounter::running() const {
+            return start != -1;
+        }
+
+        void OpCounter::set_work(const OpWork& op_work, std::initializer_list<int64_t> dims) {
+            work = op_work;
+            std::copy(dims.begin(), dims.begin() + std::min(dims.size(), shape.size()), shape.begin());
+        }
+
+        OpCounter::~OpCounter() {
+            if (start == -1) {
+                return;
+            }
+            const int64_t elapsed = now() - start;
+            auto& totals = thread_buffer()->ops[direction][id];
+            totals.calls              += 1;
+            totals.work.flops         += work.flops;
+            totals.work.bytes_read    += work.bytes_read;
+            totals.work.bytes_written += work.bytes_written;
+            totals.total_ns           += elapsed;
+            totals.shapes[shape]      += 1;
+        }
+
+        vector<OpSummary> op_summary() {
+            std::lock_guard<std::mutex> guard(buffers_mutex);
+            std::map<std::pair<int, int>, OpTotals> merged;
+            for (auto& buffer : buffers) {
+                for (int direction = FORWARD; direction <= BACKWARD; ++direction) {
+                    for (auto& kv : buffer->ops[direction]) {
+                        auto& totals = merged[std::make_pair(kv.first, direction)];
+                        totals.calls              += kv.second.calls;
+                        totals.work.flops         += kv.second.work.flops;
+                        totals.work.bytes_read    += kv.second.work.bytes_read;
+                        totals.work.bytes_written += kv.second.work.bytes_written;
+                        totals.total_ns           += kv.second.total_ns;
+                        for (auto& shape : kv.second.shapes) {
+                            totals.shapes[shape.first] += shape.second;
+                        }
+                    }
+                }
+            }
+            vector<OpSummary> ops;
+            for (auto& kv : merged) {
+                auto& totals = kv.second;
+                auto common = std::max_element(totals.shapes.begin(), totals.shapes.end(),
+                    [](const std::pair<const op_shape_t, int64_t>& a, const std::pair<const op_shape_t, int64_t>& b) {
+                        return a.second < b.second;
+                    });
+                ops.emplace_back(OpSummary{
+                    name(kv.first.first),
+                    (Direction)kv.first.second,
+                    totals.calls,
+                    totals.work,
+                    totals.total_ns,
+                    common->first,
+                    common->second
+                });
+            }
+            std::sort(ops.begin(), ops.end(), [](const OpSummary& a, const OpSummary& b) {
+                return a.total_ns > b.total_ns;
+            });
+            return ops;
+        }
+
+        vector<SpanSummary> summary() {
+            std::lock_guard<std::mutex> guard(buffers_mutex);
+            std::unordered_map<int, SpanSummary> by_span;
+            for (auto& buffer : buffers) {
+                auto& events = buffer->events;
+                vector<int64_t> children_ns(events.size(), 0);
+                for (int i = 0; i < events.size(); ++i) {
+                    if (events[i].end != -1 && events[i].parent != -1) {
+                        children_ns[events[i].parent] += events[i].end - events[i].start;
+                    }
+                }
+                for (int i = 0; i < events.size(); ++i) {
+                    if (events[i].end == -1) {
+                        continue;
+                    }
+                    auto& span = by_span[events[i].span];
+                    const int64_t duration = events[i].end - events[i].start;
+                    span.count    += 1;
+                    span.total_ns += duration;
+                    span.self_ns  += duration - children_ns[i];
+                }
+                for (auto& kv : buffer->spans) {
+                    auto& span = by_span[kv.first];
+                    span.count    += kv.second.count;
+                    span.total_ns += kv.second.total_ns;
+                    span.self_ns  += kv.second.self_ns;
+                }
+            }
+            vector<SpanSummary> spans;
+            for (auto& kv : by_span) {
+                spans.emplace_back(kv.second);
+                spans.back().name = name(kv.first);
+            }
+            std::sort(spans.begin(), spans.end(), [](const SpanSummary& a, const SpanSummary& b) {
+                return a.total_ns > b.total_ns;
+            });
+            return spans;
+        }
+
+        void report(std::ostream& stream) {
+            for (auto& span : summary()) {
+                stream << "\"" << span.name << "\" => "
+                       << std::fixed << std::setw(5) << std::setprecision(4) << std::setfill(' ')
+                       << span.total_ns / 1e9 << "s (self "
+                       << span.self_ns / 1e9 << "s, "
+                       << span.count << " calls)" << std::endl;
+            }
+        }
+
+        void save_chrome_trace(const string& fname) {
+            std::ofstream out(fname);
+            ASSERT2(out.good(), MS() << "Cannot write trace " << fname);
+            std::lock_guard<std::mutex> guard(buffers_mutex);
+            out << "{\"traceEvents\":[";
+            bool first = true;
+            out << std::fixed << std::setprecision(3);
+            for (auto& buffer : buffers) {
+                for (auto& event : buffer->events) {
+                    if (event.end == -1) {
+                        continue;
+                    }
+                    if (!first) {
+                        out << ",";
+                    }
+                    first = false;
+                    // times are in microseconds.
+                    out << "\n{\"name\":\"" << json_escape(name(event.span)) << "\","
+                        << "\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->thread << ","
+                        << "\"ts\":" << event.start / 1e3 << ","
+                        << "\"dur\":" << (event.end - event.start) / 1e3 << "}";
+                }
+            }
+            out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+            ASSERT2(out.good(), MS() << "Could not write trace " << fname);
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> guard(buffers_mutex);
+            for (auto& buffer : buffers) {
+                buffer->events.clear();
+                buffer->open = -1;
+                buffer->spans.clear();
+                // running spans only lose what they have seen so far.
+                std::fill(buffer->children_ns.begin(), buffer->children_ns.end(), 0);
+                buffer->ops[FORWARD].clear();
+                buffer->ops[BACKWARD].clear();
+            }
+        }
+    }
+}
@@ -0,0 +1,208 @@
+#ifndef DALI_UTILS_PROFILER_H
+#define DALI_UTILS_PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+/**
+Profiler
+--------
+
+Scoped spans of time recorded per thread, with nanosecond
+resolution and nesting:
+
+    void train_step() {
+        DALI_PROFILE_SCOPE("train step");
+        ...
+        {
+            DALI_PROFILE_SCOPE("decode");   // child of "train step"
+            ...
+        }
+    }
+
+or, when a span ends before its scope does:
+
+    DALI_PROFILE_SPAN(load, "load batch");
+    ...
+    load.stop();
+
+The name of a call site is interned once (the first time it runs),
+so a span costs two clock reads and an append to the thread's own
+buffer, without locks. Nothing is recorded unless the profiler is
+enabled (`utils::profiler::enable()`), and disabled spans cost a
+single relaxed load. `utils::Timer`s are the exception: they are
+always recorded, so that `Timer::report()` works without enabling
+the profiler. While it is disabled they only add to per-name totals
+of their thread (no events, so memory stays bounded however long
+training runs): they show in `summary` and `report`, but not in the
+Chrome trace.
+
+Spans on one thread must end in the reverse order they started.
+`summary`, `report`, `save_chrome_trace` and `clear` read the
+buffers of every thread, and should be called while no other
+thread is recording (e.g. between epochs).
+
+While enabled, the backward of every tape node is also recorded,
+under the name of the op (see `graph::Tape`).
+
+**/
+
+#define DALI_PROFILE_CONCAT_(a, b) a##b
+#define DALI_PROFILE_CONCAT(a, b) DALI_PROFILE_CONCAT_(a, b)
+
+// span `variable` named `name` (a string literal), started now.
+#define DALI_PROFILE_SPAN(variable, name) \
+    static const int DALI_PROFILE_CONCAT(variable, _span_id) = utils::profiler::intern(name); \
+    utils::profiler::Span variable(DALI_PROFILE_CONCAT(variable, _span_id))
+
+// span named `name` until the end of the enclosing scope.
+#define DALI_PROFILE_SCOPE(name) \
+    DALI_PROFILE_SPAN(DALI_PROFILE_CONCAT(dali_profile_span_, __LINE__), name)
+
+// counts a call of the op `name` (a string literal) in `direction`
+// (FORWARD or BACKWARD) until the end of the enclosing scope, doing
+// the OpWork `work` on operands of the given dimensions (see
+// `OpCounter`). The work is only evaluated while op counting is on.
+#define DALI_COUNT_OP_WORK(name, direction, work, ...) \
+    static const int DALI_PROFILE_CONCAT(dali_op_id_, __LINE__) = utils::profiler::intern(name); \
+    utils::profiler::OpCounter DALI_PROFILE_CONCAT(dali_op_counter_, __LINE__)( \
+        DALI_PROFILE_CONCAT(dali_op_id_, __LINE__), utils::profiler::direction); \
+    if (DALI_PROFILE_CONCAT(dali_op_counter_, __LINE__).running()) \
+        DALI_PROFILE_CONCAT(dali_op_counter_, __LINE__).set_work((work), {__VA_ARGS__})
+
+#define DALI_COUNT_OP(name, direction, flops, bytes_read, bytes_written, ...) \
+    DALI_COUNT_OP_WORK(name, direction, \
+        (utils::profiler::OpWork{(double)(flops), (double)(bytes_read), (double)(bytes_written)}), \
+        __VA_ARGS__)
+
+namespace utils {
+    namespace profiler {
+        extern std::atomic<bool> is_enabled;
+
+        inline bool enabled() {
+            return is_enabled.load(std::memory_order_relaxed);
+        }
+        void enable(bool value = true);
+
+        // id of a span name (the same for equal names).
+        int intern(const std::string& name);
+        // id of the (demangled) name of a type.
+        int intern(const std::type_info& type);
+        template<typename T>
+        int type_id() {
+            static const int id = intern(typeid(T));
+            return id;
+        }
+        const std::string& name(int id);
+
+        struct ThreadBuffer;
+
+        class Span {
+            int id;
+            ThreadBuffer* buffer;
+            int event;
+            // recorded even while the profiler is disabled.
+            bool always;
+            // start of a span only added to its totals (the profiler
+            // was disabled when it started), -1 otherwise.
+            int64_t totals_start;
+            Span(const Span&) = delete;
+            Span& operator =(Span const &) = delete;
+            public:
+                explicit Span(int id, bool autostart = true, bool always = false);
+                // stops the span if it is running.
+                ~Span();
+                // starts the span (if the profiler is enabled, or the
+                // span is always recorded).
+                void start();
+                void stop();
+        };
+
+        struct SpanSummary {
+            std::string name;
+            int64_t count;
+            // total time spent in the spans, and the part of it not
+            // spent in their children.
+            int64_t total_ns;
+            int64_t self_ns;
+        };
+
+        // one entry per name over every thread, by decreasing total time.
+        std::vector<SpanSummary> summary();
+        void report(std::ostream& stream = std::cout);
+        // Chrome trace event format: open with chrome://tracing or Perfetto.
+        void save_chrome_trace(const std::string& fname);
+        // forget every recorded span and op count.
+        void clear();
+
+        /*
+        Op counting
+        -----------
+
+        While op counting is enabled (independently of spans), the ops
+        that declare their work with DALI_COUNT_OP record, separately
+        for their forward and backward, their number of calls, FLOPs,
+        bytes read and written, wall time and the shapes they ran on.
+        Totals are kept per thread, like spans.
+        */
+        extern std::atomic<bool> is_counting_ops;
+
+        inline bool counting_ops() {
+            return is_counting_ops.load(std::memory_order_relaxed);
+        }
+        void count_ops(bool value = true);
+
+        enum Direction {
+            FORWARD  = 0,
+            BACKWARD = 1
+        };
+
+        struct OpWork {
+            double flops;
+            double bytes_read;
+            double bytes_written;
+        };
+
+        // dimensions of an op's operands (unused ones are 0).
+        typedef std::array<int64_t, 4> op_shape_t;
+
+        class OpCounter {
+            int id;
+            Direction direction;
+            int64_t start;
+            OpWork work;
+            op_shape_t shape;
+            OpCounter(const OpCounter&) = delete;
+            OpCounter& operator =(OpCounter const &) = delete;
+            public:
+                // starts timing if op counting is enabled.
+                OpCounter(int id, Direction direction);
+                ~OpCounter();
+                bool running() const;
+                void set_work(const OpWork& work, std::initializer_list<int64_t> shape);
+        };
+
+        struct OpSummary {
+            std::string name;
+            Direction direction;
+            int64_t calls;
+            OpWork work;
+            int64_t total_ns;
+            // the shape the op ran on most often, and how many times.
+            op_shape_t shape;
+            int64_t shape_calls;
+        };
+
+        // one entry per op and direction over every thread, by
+        // decreasing total time.
+        std::vector<OpSummary> op_summary();
+    }
+}
+
+#endif
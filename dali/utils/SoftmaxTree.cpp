@@ -0,0 +1,163 @@
+#include "dali/utils/SoftmaxTree.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+#include "dali/utils/assert2.h"
+#include "dali/utils/core_utils.h"
+
+using std::vector;
+
+namespace utils {
+    int SoftmaxTree::num_labels() const {
+        return path_offsets.size() - 1;
+    }
+
+    int SoftmaxTree::num_nodes() const {
+        return node_offsets.size() - 1;
+    }
+
+    int SoftmaxTree::num_columns() const {
+        return node_offsets.back();
+    }
+
+    int SoftmaxTree::path_length(int label) const {
+        return path_offsets[label + 1] - path_offsets[label];
+    }
+
+    int SoftmaxTree::max_depth() const {
+        int depth = 0;
+        for (int label = 0; label < num_labels(); ++label) {
+            depth = std::max(depth, path_length(label));
+        }
+        return depth;
+    }
+
+    void SoftmaxTree::compute_paths(const vector<int>& label_edges,
+                                    const vector<int>& node_edges) {
+        vector<int> edge_nodes(num_columns());
+        for (int node = 0; node < num_nodes(); ++node) {
+            for (int edge = node_offsets[node]; edge < node_offsets[node + 1]; ++edge) {
+                edge_nodes[edge] = node;
+            }
+        }
+        path_offsets.assign(1, 0);
+        path_nodes.clear();
+        path_edges.clear();
+        for (int label = 0; label < label_edges.size(); ++label) {
+            // from the label up to the root, then reversed.
+            for (int edge = label_edges[label]; edge != -1; edge = node_edges[edge_nodes[edge]]) {
+                path_nodes.emplace_back(edge_nodes[edge]);
+                path_edges.emplace_back(edge);
+            }
+            std::reverse(path_nodes.begin() + path_offsets.back(), path_nodes.end());
+            std::reverse(path_edges.begin() + path_offsets.back(), path_edges.end());
+            path_offsets.emplace_back(path_nodes.size());
+        }
+    }
+
+    SoftmaxTree SoftmaxTree::from_lattice(OntologyBranch::shared_branch root,
+                                          const Vocab& label_vocab) {
+        auto label_of = [&label_vocab](const OntologyBranch::shared_branch& branch) {
+            auto found = label_vocab.word2index.find(branch->name);
+            ASSERT2(found != label_vocab.word2index.end(),
+                MS() << "Lattice node \"" << branch->name << "\" is not in the label vocabulary.");
+            return (int)found->second;
+        };
+        SoftmaxTree tree;
+        tree.node_offsets.assign(1, 0);
+        vector<int> label_edges(label_vocab.size(), -1);
+        vector<int> node_edges;
+
+        // breadth first, so that nodes are reached by a shortest path.
+        vector<OntologyBranch::shared_branch> nodes;
+        std::unordered_map<OntologyBranch*, int> node_ids;
+        if (!root->children.empty()) {
+            node_ids[root.get()] = 0;
+            nodes.emplace_back(root);
+            node_edges.emplace_back(-1);
+        }
+        for (int node = 0; node < nodes.size(); ++node) {
+            auto branch = nodes[node];
+            const int start = tree.node_offsets.back();
+            int& stop_edge = label_edges[label_of(branch)];
+            if (stop_edge == -1) {
+                stop_edge = start;
+            }
+            for (int child = 0; child < branch->children.size(); ++child) {
+                auto& child_branch = branch->children[child];
+                const int edge = start + 1 + child;
+                if (!child_branch->children.empty()) {
+                    if (node_ids.count(child_branch.get()) == 0) {
+                        node_ids[child_branch.get()] = nodes.size();
+                        nodes.emplace_back(child_branch);
+                        node_edges.emplace_back(edge);
+                    }
+                } else {
+                    int& label_edge = label_edges[label_of(child_branch)];
+                    if (label_edge == -1) {
+                        label_edge = edge;
+                    }
+                }
+            }
+            tree.node_offsets.emplace_back(start + 1 + branch->children.size());
+        }
+        tree.compute_paths(label_edges, node_edges);
+        return tree;
+    }
+
+    SoftmaxTree SoftmaxTree::huffman(const vector<double>& counts, int branching) {
+        const int num_words = counts.size();
+        ASSERT2(num_words > 0, "Huffman tree needs at least one word.");
+        ASSERT2(branching >= 2,
+            MS() << "Huffman tree nodes need at least 2 edges (got " << branching << ")");
+
+        // words are 0..num_words - 1, merges are num_words + merge.
+        typedef std::pair<double, int> weighted_t;
+        std::priority_queue<weighted_t, vector<weighted_t>, std::greater<weighted_t>> queue;
+        for (int word = 0; word < num_words; ++word) {
+            ASSERT2(counts[word] >= 0.0,
+                MS() << "Huffman tree count of word " << word << " is negative (" << counts[word] << ")");
+            queue.emplace(counts[word], word);
+        }
+        vector<vector<int>> merges;
+        // the first merge takes what is left over so that every other
+        // one (and the root) has exactly `branching` edges.
+        int merge_size = num_words == 1 ? 1 : (num_words - 2) % (branching - 1) + 2;
+        do {
+            merges.emplace_back();
+            double total = 0.0;
+            for (int i = 0; i < merge_size && !queue.empty(); ++i) {
+                total += queue.top().first;
+                merges.back().emplace_back(queue.top().second);
+                queue.pop();
+            }
+            queue.emplace(total, num_words + merges.size() - 1);
+            merge_size = branching;
+        } while (queue.size() > 1);
+
+        // the last merge is the root, node 0.
+        const int num_nodes = merges.size();
+        SoftmaxTree tree;
+        tree.node_offsets.assign(1, 0);
+        vector<int> label_edges(num_words, -1);
+        vector<int> node_edges(num_nodes, -1);
+        for (int node = 0; node < num_nodes; ++node) {
+            auto& children = merges[num_nodes - 1 - node];
+            const int start = tree.node_offsets.back();
+            for (int child = 0; child < children.size(); ++child) {
+                if (children[child] < num_words) {
+                    label_edges[children[child]] = start + child;
+                } else {
+                    node_edges[num_nodes - 1 - (children[child] - num_words)] = start + child;
+                }
+            }
+            tree.node_offsets.emplace_back(start + children.size());
+        }
+        tree.compute_paths(label_edges, node_edges);
+        return tree;
+    }
+}
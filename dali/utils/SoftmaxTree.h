@@ -0,0 +1,83 @@
+#ifndef DALI_UTILS_SOFTMAX_TREE_H
+#define DALI_UTILS_SOFTMAX_TREE_H
+
+#include <vector>
+
+#include "dali/utils/OntologyBranch.h"
+#include "dali/utils/vocab.h"
+
+namespace utils {
+    /**
+    Softmax Tree
+    ------------
+
+    Tree of decisions for a hierarchical softmax: a label is reached
+    by a path of decisions from the root, each one a softmax over the
+    edges leaving a node, so that the probability of a label is the
+    product of the probabilities of the edges on its path.
+
+    Every edge of the tree is one output column (of the decoder
+    weights and bias), and the edges of a node are contiguous.
+    Paths are stored flat, so that computing a cost never walks
+    the tree (or a lattice of shared pointers):
+
+        node n has the edges (columns)
+            [node_offsets[n], node_offsets[n + 1])
+        label l has the path
+            [path_offsets[l], path_offsets[l + 1])
+        where step s leaves the node path_nodes[s] by the edge
+        path_edges[s] (a column).
+
+    Node 0 is the root. Labels without a path (not reachable from
+    the root) have an empty one.
+
+    **/
+    class SoftmaxTree {
+        public:
+            std::vector<int> node_offsets;
+            std::vector<int> path_offsets;
+            std::vector<int> path_nodes;
+            std::vector<int> path_edges;
+
+            int num_labels() const;
+            int num_nodes() const;
+            int num_columns() const;
+            int path_length(int label) const;
+            int max_depth() const;
+
+            /**
+            SoftmaxTree::from_lattice
+            -------------------------
+
+            Tree of a lattice with labels `label_vocab` (by name). Every
+            node with children is a decision node whose first edge stops
+            at the node itself (predicting its label) and whose other
+            edges lead to its children, in order (the same numbering as
+            the paths of `OntologyBranch::random_path_from_root(name, 1)`).
+            A node with several parents is reached through the parent
+            on its shortest path from `root`.
+
+            **/
+            static SoftmaxTree from_lattice(OntologyBranch::shared_branch root,
+                                            const Vocab& label_vocab);
+
+            /**
+            SoftmaxTree::huffman
+            --------------------
+
+            Huffman tree of words with frequencies `counts` where every
+            node has up to `branching` edges: frequent words get short
+            paths, and the average cost per word is close to
+            O(branching * entropy of counts).
+
+            **/
+            static SoftmaxTree huffman(const std::vector<double>& counts, int branching = 2);
+        private:
+            // paths from the edge (column) leading to each label and
+            // to each node (-1 for none).
+            void compute_paths(const std::vector<int>& label_edges,
+                               const std::vector<int>& node_edges);
+    };
+}
+
+#endif
@@ -1,8 +1,8 @@
 #include "ThreadPool.h"
 
+#include <algorithm>
 #include <string>
 
-using std::chrono::milliseconds;
 using std::function;
 using std::vector;
 using std::thread;
@@ -10,17 +10,65 @@ using Duration = std::chrono::duration<double>;
 
 __thread bool ThreadPool::in_thread_pool = false;
 __thread int ThreadPool::thread_number = -1;
+__thread ThreadPool* ThreadPool::current_pool = NULL;
 std::mutex ThreadPool::printing_lock;
 
+/* WorkQueue */
 
-ThreadPool::ThreadPool(int num_threads, Duration between_queue_checks) :
-        between_queue_checks(between_queue_checks),
-        should_terminate(false),
-        active_count(0) {
+ThreadPool::WorkQueue::WorkQueue() : size(0) {
+}
+
+void ThreadPool::WorkQueue::push(task_t&& task) {
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    tasks.push_back(std::move(task));
+    size = tasks.size();
+}
+
+bool ThreadPool::WorkQueue::pop_back(task_t& task) {
+    if (size.load() == 0) {
+        return false;
+    }
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    if (tasks.empty()) {
+        return false;
+    }
+    task = std::move(tasks.back());
+    tasks.pop_back();
+    size = tasks.size();
+    return true;
+}
+
+bool ThreadPool::WorkQueue::pop_front(task_t& task) {
+    if (size.load() == 0) {
+        return false;
+    }
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    if (tasks.empty()) {
+        return false;
+    }
+    task = std::move(tasks.front());
+    tasks.pop_front();
+    size = tasks.size();
+    return true;
+}
+
+/* ThreadPool */
+
+ThreadPool::ThreadPool(int num_threads) :
+        queued(0),
+        outstanding(0),
+        active_count(0),
+        next_queue(0),
+        sleepers(0),
+        should_terminate(false) {
     // Thread pool inception is not supported at this time.
     assert(!in_thread_pool);
 
-    ThreadPool::between_queue_checks = between_queue_checks;
+    // a pool without threads still queues tasks (they are run by
+    // threads waiting on a TaskGroup).
+    for (int queue = 0; queue < std::max(num_threads, 1); ++queue) {
+        queues.emplace_back(new WorkQueue());
+    }
     for (int thread_number = 0; thread_number < num_threads; ++thread_number) {
         pool.emplace_back(&ThreadPool::thread_body, this, thread_number);
     }
@@ -29,94 +77,148 @@ ThreadPool::ThreadPool(int num_threads, Duration between_queue_checks) :
 void ThreadPool::thread_body(int _thread_id) {
     in_thread_pool = true;
     thread_number = _thread_id;
-    bool am_i_active = false;
+    current_pool = this;
 
+    task_t task;
     while (true) {
-        function<void()> f;
-        {
-            std::lock_guard<decltype(queue_mutex)> lock(queue_mutex);
-            bool was_i_active = am_i_active;
-            if (should_terminate && work.empty())
-                break;
-            if (!work.empty()) {
-                am_i_active = true;
-                f = work.front();
-                work.pop_front();
-            } else {
-                am_i_active = false;
-            }
-
-            if (am_i_active != was_i_active) {
-                active_count += am_i_active ? 1 : -1;
-                if (active_count == 0) {
-                    // number of workers decrease so maybe all are idle
-                    is_idle.notify_all();
-                }
-            }
+        if (pop_task(task)) {
+            active_count++;
+            task();
+            task = nullptr;
+            active_count--;
+            finish_task();
+            continue;
         }
-        // Function defines implicit conversion to bool
-        // which is true only if call target was set.
-        if (static_cast<bool>(f)) {
-            f();
-        } else {
-            std::this_thread::sleep_for(between_queue_checks);
+        std::unique_lock<decltype(idle_mutex)> lock(idle_mutex);
+        if (should_terminate && queued.load() == 0) {
+            break;
+        }
+        // registered before checking for work, so that `run`
+        // either sees a sleeper or we see its task.
+        sleepers++;
+        work_available.wait(lock, [this]() {
+            return queued.load() > 0 || should_terminate;
+        });
+        sleepers--;
+    }
+}
+
+bool ThreadPool::pop_task(task_t& task) {
+    const int num_queues = queues.size();
+    int self = current_pool == this ? thread_number : -1;
+    bool found = self >= 0 && queues[self]->pop_back(task);
+    if (!found) {
+        int start = self >= 0 ? self + 1 : 0;
+        for (int i = 0; i < num_queues && !found; ++i) {
+            int victim = (start + i) % num_queues;
+            found = victim != self && queues[victim]->pop_front(task);
         }
-        std::this_thread::yield();
     }
+    if (found) {
+        queued--;
+    }
+    return found;
+}
+
+void ThreadPool::finish_task() {
+    if (--outstanding == 0) {
+        std::lock_guard<decltype(done_mutex)> lock(done_mutex);
+        is_idle.notify_all();
+    }
+}
+
+int ThreadPool::size() const {
+    return pool.size();
 }
 
 int ThreadPool::active_workers() {
-    std::lock_guard<decltype(queue_mutex)> lock(queue_mutex);
     return active_count;
 }
 
 bool ThreadPool::wait_until_idle(Duration timeout) {
-    std::unique_lock<decltype(queue_mutex)> lock(queue_mutex);
-    is_idle.wait_for(lock, timeout, [this]{
-        return active_count == 0 && work.empty();
+    std::unique_lock<decltype(done_mutex)> lock(done_mutex);
+    return is_idle.wait_for(lock, timeout, [this]{
+        return idle();
     });
-    return idle();
 }
 
 bool ThreadPool::wait_until_idle() {
-    int retries = 3;
-    while (retries--) {
-        try {
-            std::unique_lock<decltype(queue_mutex)> lock(queue_mutex);
-            is_idle.wait(lock, [this]{
-                return active_count == 0 && work.empty();
-            });
-            return idle();
-        } catch (...) {}
-    }
-    throw std::runtime_error(
-        "exceeded retries when waiting until idle."
-    );
-    return false;
+    std::unique_lock<decltype(done_mutex)> lock(done_mutex);
+    is_idle.wait(lock, [this]{
+        return idle();
+    });
+    return true;
 }
 
 bool ThreadPool::idle() const {
-    return active_count == 0 && work.empty();
+    return outstanding.load() == 0;
 }
 
 void ThreadPool::run(function<void()> f) {
-    int retries = 3;
-    while (retries--) {
-        try {
-            std::unique_lock<decltype(queue_mutex)> lock(queue_mutex);
-            work.push_back(f);
-            return;
-        } catch (...) {}
+    outstanding++;
+    int target = current_pool == this ?
+            thread_number :
+            next_queue++ % queues.size();
+    queues[target]->push(std::move(f));
+    queued++;
+    if (sleepers.load() > 0) {
+        std::lock_guard<decltype(idle_mutex)> lock(idle_mutex);
+        work_available.notify_one();
+    }
+}
+
+void ThreadPool::parallel_for(int begin, int end, int grain, function<void(int, int)> f) {
+    if (end <= begin) {
+        return;
+    }
+    grain = std::max(grain, 1);
+    const int num_chunks = (end - begin + grain - 1) / grain;
+    if (num_chunks == 1 || pool.empty()) {
+        f(begin, end);
+        return;
+    }
+    // chunks are claimed in order by whoever is free (the calling
+    // thread included) until none are left.
+    std::atomic<int> next_chunk(0);
+    auto work = [&next_chunk, &f, num_chunks, begin, end, grain]() {
+        int chunk;
+        while ((chunk = next_chunk++) < num_chunks) {
+            int chunk_begin = begin + chunk * grain;
+            f(chunk_begin, std::min(chunk_begin + grain, end));
+        }
+    };
+    TaskGroup group(*this);
+    for (int helper = 0; helper < std::min(num_chunks - 1, size()); ++helper) {
+        group.run(work);
+    }
+    std::exception_ptr error;
+    try {
+        work();
+    } catch (...) {
+        // stop handing out chunks.
+        next_chunk = num_chunks;
+        error = std::current_exception();
+    }
+    try {
+        group.wait();
+    } catch (...) {
+        if (!error) {
+            error = std::current_exception();
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
     }
-    throw std::runtime_error(
-        "exceeded retries when trying to run operation on thread pool."
-    );
 }
 
 ThreadPool::~ThreadPool() {
     // Terminates thread pool making sure that all the work
     // is completed.
-    should_terminate = true;
+    {
+        std::lock_guard<decltype(idle_mutex)> lock(idle_mutex);
+        should_terminate = true;
+    }
+    work_available.notify_all();
     for (auto& t : pool)
         t.join();
 }
@@ -130,3 +232,81 @@ void ThreadPool::print_safely(std::string message) {
     std::cout << "[thread " << get_thread_number() << "] "
               << message << std::endl;
 }
+
+/* TaskGroup */
+
+TaskGroup::State::State() : pending(0) {
+}
+
+bool TaskGroup::State::run_next() {
+    std::function<void()> task;
+    {
+        std::lock_guard<decltype(mutex)> lock(mutex);
+        if (tasks.empty()) {
+            return false;
+        }
+        task = std::move(tasks.front());
+        tasks.pop_front();
+    }
+    try {
+        task();
+    } catch (...) {
+        std::lock_guard<decltype(mutex)> lock(mutex);
+        if (!error) {
+            error = std::current_exception();
+        }
+    }
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    if (--pending == 0) {
+        done.notify_all();
+    }
+    return true;
+}
+
+TaskGroup::TaskGroup(ThreadPool& _pool) : pool(_pool), state(std::make_shared<State>()) {
+}
+
+TaskGroup::~TaskGroup() {
+    wait_for_tasks();
+}
+
+void TaskGroup::run(function<void()> f) {
+    {
+        std::lock_guard<decltype(state->mutex)> lock(state->mutex);
+        state->tasks.emplace_back(std::move(f));
+        state->pending++;
+    }
+    if (pool.size() == 0) {
+        // nobody but the waiting thread runs them.
+        return;
+    }
+    // runs one of the group's tasks, unless the waiting thread
+    // already took them all.
+    auto shared_state = state;
+    pool.run([shared_state]() {
+        shared_state->run_next();
+    });
+}
+
+void TaskGroup::wait_for_tasks() {
+    // run the tasks no worker has picked up yet, then sleep until
+    // the ones still running finish.
+    while (state->run_next()) {
+    }
+    std::unique_lock<decltype(state->mutex)> lock(state->mutex);
+    state->done.wait(lock, [this]() {
+        return state->pending == 0;
+    });
+}
+
+void TaskGroup::wait() {
+    wait_for_tasks();
+    std::exception_ptr first_error;
+    {
+        std::lock_guard<decltype(state->mutex)> lock(state->mutex);
+        std::swap(first_error, state->error);
+    }
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+}
@@ -1,47 +1,106 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <condition_variable>
 #include <deque>
+#include <exception>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
 
+class TaskGroup;
+
+/*
+ThreadPool
+----------
+
+Each worker owns a deque of tasks: it pushes the tasks it spawns
+and pops them from the back, and when its own deque is empty it
+steals from the front of the others'. Tasks submitted from outside
+the pool are spread over the workers' deques. Workers with nothing
+to do sleep on a condition variable and are woken up as soon as
+work is submitted.
+
+Besides fire-and-forget `run`, the pool offers `parallel_for` and
+task groups (see `TaskGroup`) for work that must be waited on.
+*/
 class ThreadPool {
     private:
         typedef std::chrono::duration<double> Duration;
+        typedef std::function<void()> task_t;
+
         static __thread bool in_thread_pool;
         // c++ assigns random id to each thread. This is not a thread_id
         // it's a number inside this thread pool.
         static __thread int thread_number;
+        // pool the current thread works for (NULL outside of pools).
+        static __thread ThreadPool* current_pool;
 
         static std::mutex printing_lock;
 
-        bool should_terminate;
-        std::mutex queue_mutex;
-        std::condition_variable is_idle;
-        int active_count;
+        // a worker's tasks: the owner pushes and pops at the back,
+        // thieves take from the front.
+        struct WorkQueue {
+            std::mutex mutex;
+            std::deque<task_t> tasks;
+            // tasks.size(), readable without the lock.
+            std::atomic<int> size;
+            WorkQueue();
+            void push(task_t&& task);
+            bool pop_back(task_t& task);
+            bool pop_front(task_t& task);
+        };
 
-        std::deque<std::function<void()> > work;
+        std::vector<std::unique_ptr<WorkQueue>> queues;
         std::vector<std::thread> pool;
-        Duration between_queue_checks;
+
+        // tasks sitting in a queue.
+        std::atomic<int> queued;
+        // tasks submitted and not finished yet.
+        std::atomic<int> outstanding;
+        // workers running a task.
+        std::atomic<int> active_count;
+        // where the next task from outside the pool goes.
+        std::atomic<unsigned int> next_queue;
+
+        // idle workers sleep on `work_available`.
+        std::mutex idle_mutex;
+        std::condition_variable work_available;
+        std::atomic<int> sleepers;
+        bool should_terminate;
+
+        // `wait_until_idle` sleeps on `is_idle`.
+        std::mutex done_mutex;
+        std::condition_variable is_idle;
 
         void thread_body(int _thread_id);
+        // take a task: from the back of our own queue when called by
+        // one of our workers, otherwise from the front of any queue.
+        bool pop_task(task_t& task);
+        void finish_task();
     public:
         // Creates a thread pool composed of num_threads threads.
         // threads are started immediately and exit only once ThreadPool
-        // goes out of scope. Threads periodically check for new work
-        // and the frequency of those checks is at minimum between_queue_checks
-        // (it can be higher due to thread scheduling).
-        ThreadPool(int num_threads, Duration between_queue_checks=std::chrono::milliseconds(1));
+        // goes out of scope (after running all the submitted work).
+        ThreadPool(int num_threads);
 
         // Run a function on a thread in pool.
         void run(std::function<void()> f);
 
+        // Calls `f(chunk_begin, chunk_end)` over [begin, end) cut in
+        // consecutive chunks of `grain` elements (the last one may be
+        // shorter), using the pool and the calling thread, and returns
+        // once all chunks are done. Chunk boundaries only depend on
+        // `begin`, `end` and `grain`. Exceptions thrown by `f` are
+        // rethrown (the first one, once every chunk has stopped).
+        void parallel_for(int begin, int end, int grain, std::function<void(int, int)> f);
+
         // Wait until queue is empty and all the threads have finished working.
         // If timeout is specified function waits at most timeout until the
         // threads are idle. If they indeed become idle returns true.
@@ -52,6 +111,8 @@ class ThreadPool {
         bool idle() const;
         // Return number of active busy workers.
         int active_workers();
+        // Number of threads in the pool.
+        int size() const;
 
         // Can be called from within a thread to get a thread number.
         // the number is unique for each thread in the thread pool and
@@ -63,5 +124,55 @@ class ThreadPool {
         ~ThreadPool();
 };
 
+/*
+TaskGroup
+---------
+
+Tasks submitted to a pool that can be waited on together. While
+waiting, the waiting thread runs the group's own tasks that no
+worker has picked up yet (never other tasks of the pool, which may
+block or take locks the waiter holds), so groups can be nested (a
+task may create a group and wait on it) and can be waited on from
+within the pool.
+
+    TaskGroup group(pool);
+    for (auto& batch : batches) {
+        group.run([&batch]() { process(batch); });
+    }
+    group.wait();
+*/
+class TaskGroup {
+    private:
+        // shared with the pool tasks that run the group's tasks,
+        // which may outlive the group.
+        struct State {
+            std::mutex mutex;
+            std::condition_variable done;
+            // tasks not picked up yet.
+            std::deque<std::function<void()>> tasks;
+            // tasks not finished yet.
+            int pending;
+            std::exception_ptr error;
+            State();
+            // run the oldest task not picked up yet, if any.
+            bool run_next();
+        };
+
+        ThreadPool& pool;
+        std::shared_ptr<State> state;
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator =(TaskGroup const &) = delete;
+        void wait_for_tasks();
+    public:
+        explicit TaskGroup(ThreadPool& pool);
+        // waits for the remaining tasks (errors are dropped).
+        ~TaskGroup();
+
+        void run(std::function<void()> f);
+        // Returns once every task of the group is done, and rethrows
+        // the first exception thrown by one of them.
+        void wait();
+};
 
 #endif
@@ -0,0 +1,129 @@
+#include "dali/utils/UnigramSampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+#include "dali/utils/assert2.h"
+#include "dali/utils/core_utils.h"
+#include "dali/utils/random.h"
+
+using std::string;
+using std::vector;
+
+namespace utils {
+    UnigramSampler::UnigramSampler(const vector<double>& counts, double power) :
+            probabilities(counts.size()),
+            accept(counts.size()),
+            alias(counts.size()),
+            num_nonzero(0) {
+        ASSERT2(!counts.empty(), "UnigramSampler needs at least one word.");
+        double total = 0.0;
+        for (int word = 0; word < counts.size(); ++word) {
+            ASSERT2(counts[word] >= 0.0,
+                MS() << "UnigramSampler count of word " << word << " is negative (" << counts[word] << ")");
+            probabilities[word] = std::pow(counts[word], power);
+            total += probabilities[word];
+            num_nonzero += counts[word] > 0.0;
+        }
+        ASSERT2(total > 0.0, "UnigramSampler needs a word with a positive count.");
+
+        // columns of average height 1 are filled by pairing a
+        // column below 1 with one above 1, which gives it the rest.
+        const int num_words = counts.size();
+        vector<double> heights(num_words);
+        vector<int> small, large;
+        for (int word = 0; word < num_words; ++word) {
+            probabilities[word] /= total;
+            heights[word] = probabilities[word] * num_words;
+            alias[word] = word;
+            (heights[word] < 1.0 ? small : large).emplace_back(word);
+        }
+        while (!small.empty() && !large.empty()) {
+            int below = small.back();
+            small.pop_back();
+            int above = large.back();
+            accept[below] = heights[below];
+            alias[below]  = above;
+            heights[above] -= 1.0 - heights[below];
+            if (heights[above] < 1.0) {
+                large.pop_back();
+                small.emplace_back(above);
+            }
+        }
+        // what remains is 1 up to rounding.
+        for (int word : small) {
+            accept[word] = 1.0;
+        }
+        for (int word : large) {
+            accept[word] = 1.0;
+        }
+    }
+
+    UnigramSampler UnigramSampler::zipfian(int num_words) {
+        vector<double> counts(num_words);
+        for (int word = 0; word < num_words; ++word) {
+            counts[word] = std::log((word + 2.0) / (word + 1.0));
+        }
+        return UnigramSampler(counts, 1.0);
+    }
+
+    UnigramSampler UnigramSampler::from_corpus(const Vocab& vocab,
+                                               const vector<vector<string>>& corpus,
+                                               double power) {
+        vector<double> counts(vocab.size(), 1.0);
+        for (auto& sentence : corpus) {
+            for (auto word : vocab.encode(sentence, true)) {
+                counts[word] += 1.0;
+            }
+        }
+        return UnigramSampler(counts, power);
+    }
+
+    int UnigramSampler::size() const {
+        return probabilities.size();
+    }
+
+    double UnigramSampler::probability(int word) const {
+        return probabilities[word];
+    }
+
+    double UnigramSampler::expected_count(int word, int num_tries) const {
+        // 1 - (1 - p) ^ num_tries, without cancellation for small p.
+        return -std::expm1(num_tries * std::log1p(-probabilities[word]));
+    }
+
+    int UnigramSampler::sample(std::mt19937& generator) const {
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        int column = std::min((int)(uniform(generator) * size()), size() - 1);
+        return uniform(generator) < accept[column] ? column : alias[column];
+    }
+
+    int UnigramSampler::sample() const {
+        return sample(random::generator());
+    }
+
+    NegativeSample UnigramSampler::sample_unique(int num_samples, std::mt19937& generator) const {
+        ASSERT2(num_samples <= num_nonzero,
+            MS() << "Cannot draw " << num_samples << " distinct words out of "
+                 << num_nonzero << " words that can be drawn.");
+        NegativeSample negatives;
+        negatives.num_tries = 0;
+        std::unordered_set<int> drawn;
+        while (negatives.words.size() < num_samples) {
+            int word = sample(generator);
+            ++negatives.num_tries;
+            if (drawn.insert(word).second) {
+                negatives.words.emplace_back(word);
+            }
+        }
+        for (int word : negatives.words) {
+            negatives.expected_counts.emplace_back(expected_count(word, negatives.num_tries));
+        }
+        return negatives;
+    }
+
+    NegativeSample UnigramSampler::sample_unique(int num_samples) const {
+        return sample_unique(num_samples, random::generator());
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef DALI_UTILS_UNIGRAM_SAMPLER_H
+#define DALI_UTILS_UNIGRAM_SAMPLER_H
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dali/utils/vocab.h"
+
+namespace utils {
+    /*
+    Negative Sample
+    ---------------
+
+    Distinct words drawn from a UnigramSampler (shared by every
+    example of a minibatch), with the number of times each was
+    expected to come up over the `num_tries` draws it took to find
+    them (used to correct the scores of sampled objectives).
+    */
+    struct NegativeSample {
+        std::vector<int> words;
+        std::vector<double> expected_counts;
+        int num_tries;
+    };
+
+    /**
+    Unigram Sampler
+    ---------------
+
+    Draws words with probability proportional to count^power (0.75
+    as in word2vec flattens the distribution towards rare words),
+    in constant time per draw (Walker's alias method).
+
+    Sampling uses utils::random::generator() unless given a
+    generator: threads sampling at the same time should each pass
+    their own.
+
+    **/
+    class UnigramSampler {
+        private:
+            std::vector<double> probabilities;
+            // alias method: column i keeps i with probability
+            // accept[i], else it gives alias[i].
+            std::vector<double> accept;
+            std::vector<int> alias;
+            int num_nonzero;
+        public:
+            UnigramSampler(const std::vector<double>& counts, double power = 0.75);
+
+            // Zipfian distribution over words sorted by decreasing
+            // frequency: word k has probability log((k + 2) / (k + 1)) / log(num_words + 1).
+            static UnigramSampler zipfian(int num_words);
+            // counts of the words of vocab in a tokenized corpus (with
+            // an end symbol per sentence), plus one so that every word
+            // can be drawn.
+            static UnigramSampler from_corpus(const Vocab& vocab,
+                                              const std::vector<std::vector<std::string>>& corpus,
+                                              double power = 0.75);
+
+            int size() const;
+            double probability(int word) const;
+            // expected number of draws of `word` in `num_tries` draws.
+            double expected_count(int word, int num_tries) const;
+
+            int sample(std::mt19937& generator) const;
+            int sample() const;
+            // `num_samples` distinct words.
+            NegativeSample sample_unique(int num_samples, std::mt19937& generator) const;
+            NegativeSample sample_unique(int num_samples) const;
+    };
+}
+
+#endif
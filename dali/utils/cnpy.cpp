@@ -9,6 +9,95 @@
 #include <cstring>
 #include <iomanip>
 
+#include "dali/utils/core_utils.h"
+
+namespace {
+    // reads the python dictionary of an npy header.
+    void parse_npy_dict(const std::string& header, unsigned int& word_size, char& type, std::vector<unsigned int>& shape, bool& fortran_order) {
+        int loc1, loc2;
+
+        //fortran order
+        loc1 = header.find("fortran_order")+16;
+        fortran_order = (header.substr(loc1,4) == "True" ? true : false);
+
+        //shape
+        loc1 = header.find("(");
+        loc2 = header.find(")");
+        std::string str_shape = header.substr(loc1+1,loc2-loc1-1);
+        unsigned int ndims;
+        if(str_shape[str_shape.size()-1] == ',') ndims = 1;
+        else ndims = std::count(str_shape.begin(),str_shape.end(),',')+1;
+        shape.resize(ndims);
+        for(unsigned int i = 0;i < ndims;i++) {
+            loc1 = str_shape.find(",");
+            shape[i] = atoi(str_shape.substr(0,loc1).c_str());
+            str_shape = str_shape.substr(loc1+1);
+        }
+
+        //endian, word size, data type
+        //byte order code | stands for not applicable.
+        //not sure when this applies except for byte array
+        loc1 = header.find("descr")+9;
+        bool littleEndian = (header[loc1] == '<' || header[loc1] == '|' ? true : false);
+        assert(littleEndian);
+
+        type = header[loc1+1];
+
+        std::string str_ws = header.substr(loc1+2);
+        loc2 = str_ws.find("'");
+        word_size = atoi(str_ws.substr(0,loc2).c_str());
+    }
+
+    std::shared_ptr<utils::MappedFile> map_file(const std::string& fname) {
+        if(!utils::file_exists(fname)) {
+            printf("Error: Unable to open file \"%s\".\n",fname.c_str());
+            abort();
+        }
+        return std::make_shared<utils::MappedFile>(fname);
+    }
+
+    // the arrays of the stored (uncompressed) npz file at data, the
+    // first one named varname if varname is not empty.
+    cnpy::npz_t map_npz_arrays(std::shared_ptr<utils::MappedFile> file, const std::string& varname) {
+        cnpy::npz_t arrays;
+        size_t offset = 0;
+        while(offset + 30 <= file->size) {
+            const char* local_header = file->data + offset;
+
+            //if we've reached the global header, stop reading
+            if(local_header[2] != 0x03 || local_header[3] != 0x04) break;
+
+            unsigned short flags = *(unsigned short*) &local_header[6];
+            unsigned short compression = *(unsigned short*) &local_header[8];
+            if(compression != 0 || (flags & 0x8))
+                throw std::runtime_error("npz_load: only stored (np.savez) arrays can be loaded, not compressed ones");
+
+            //read in the variable name, and erase the lagging .npy
+            unsigned short name_len = *(unsigned short*) &local_header[26];
+            unsigned short extra_field_len = *(unsigned short*) &local_header[28];
+            if(offset + 30 + name_len + extra_field_len > file->size)
+                throw std::runtime_error("npz_load: truncated file");
+            std::string vname(local_header + 30, name_len);
+            vname.erase(vname.end()-4,vname.end());
+
+            //the npy file comes after the extra field. Its size comes
+            //from its header rather than from the zip's (zip64 headers
+            //keep sizes in the extra field).
+            offset += 30 + name_len + extra_field_len;
+            cnpy::NpyArray array = cnpy::load_the_npy_file(file, file->data + offset, file->size - offset);
+            unsigned long long nbytes = array.word_size;
+            for(auto dim : array.shape) nbytes *= dim;
+            offset = (array.data - file->data) + nbytes;
+
+            if(varname.empty() || vname == varname) {
+                arrays[vname] = array;
+                if(!varname.empty()) break;
+            }
+        }
+        return arrays;
+    }
+}
+
 char cnpy::BigEndianTest() {
     unsigned char x[] = {1,0};
     short y = *(short*) x;
@@ -57,7 +146,7 @@ template<> std::vector<char>& cnpy::operator+=(std::vector<char>& lhs, const cha
     return lhs;
 }
 
-void cnpy::parse_npy_header(FILE* fp, unsigned int& word_size, unsigned int*& shape, unsigned int& ndims, bool& fortran_order) {
+void cnpy::parse_npy_header(FILE* fp, unsigned int& word_size, char& type, unsigned int*& shape, unsigned int& ndims, bool& fortran_order) {
     char buffer[256];
     size_t res = fread(buffer,sizeof(char),11,fp);
     if(res != 11)
@@ -65,38 +154,32 @@ void cnpy::parse_npy_header(FILE* fp, unsigned int& word_size, unsigned int*& sh
     std::string header = fgets(buffer,256,fp);
     assert(header[header.size()-1] == '\n');
 
-    int loc1, loc2;
-
-    //fortran order
-    loc1 = header.find("fortran_order")+16;
-    fortran_order = (header.substr(loc1,4) == "True" ? true : false);
-
-    //shape
-    loc1 = header.find("(");
-    loc2 = header.find(")");
-    std::string str_shape = header.substr(loc1+1,loc2-loc1-1);
-    if(str_shape[str_shape.size()-1] == ',') ndims = 1;
-    else ndims = std::count(str_shape.begin(),str_shape.end(),',')+1;
+    std::vector<unsigned int> parsed_shape;
+    parse_npy_dict(header, word_size, type, parsed_shape, fortran_order);
+    ndims = parsed_shape.size();
     shape = new unsigned int[ndims];
-    for(unsigned int i = 0;i < ndims;i++) {
-        loc1 = str_shape.find(",");
-        shape[i] = atoi(str_shape.substr(0,loc1).c_str());
-        str_shape = str_shape.substr(loc1+1);
-    }
-
-    //endian, word size, data type
-    //byte order code | stands for not applicable.
-    //not sure when this applies except for byte array
-    loc1 = header.find("descr")+9;
-    bool littleEndian = (header[loc1] == '<' || header[loc1] == '|' ? true : false);
-    assert(littleEndian);
-
-    //char type = header[loc1+1];
-    //assert(type == map_type(T));
+    std::copy(parsed_shape.begin(), parsed_shape.end(), shape);
+}
 
-    std::string str_ws = header.substr(loc1+2);
-    loc2 = str_ws.find("'");
-    word_size = atoi(str_ws.substr(0,loc2).c_str());
+void cnpy::parse_npy_header(const char* data, size_t size, unsigned int& word_size, char& type, std::vector<unsigned int>& shape, bool& fortran_order, size_t& header_size) {
+    //magic string, version, then the length of the dictionary: 2 bytes
+    //in version 1.0 and 4 bytes after that.
+    if(size < 10 || data[0] != (char) 0x93 || std::string(data+1,5) != "NUMPY")
+        throw std::runtime_error("parse_npy_header: not an npy file");
+    size_t dict_offset, dict_size;
+    if(data[6] == 0x01) {
+        dict_offset = 10;
+        dict_size = *(unsigned short*) &data[8];
+    } else {
+        if(size < 12)
+            throw std::runtime_error("parse_npy_header: truncated header");
+        dict_offset = 12;
+        dict_size = *(unsigned int*) &data[8];
+    }
+    header_size = dict_offset + dict_size;
+    if(header_size > size)
+        throw std::runtime_error("parse_npy_header: truncated header");
+    parse_npy_dict(std::string(data + dict_offset, dict_size), word_size, type, shape, fortran_order);
 }
 
 void cnpy::parse_zip_footer(FILE* fp, unsigned short& nrecs, unsigned int& global_header_size, unsigned int& global_header_offset)
@@ -125,13 +208,15 @@ void cnpy::parse_zip_footer(FILE* fp, unsigned short& nrecs, unsigned int& globa
 cnpy::NpyArray cnpy::load_the_npy_file(FILE* fp) {
     unsigned int* shape;
     unsigned int ndims, word_size;
+    char type;
     bool fortran_order;
-    cnpy::parse_npy_header(fp,word_size,shape,ndims,fortran_order);
+    cnpy::parse_npy_header(fp,word_size,type,shape,ndims,fortran_order);
     unsigned long long size = 1; //long long so no overflow when multiplying by word_size
     for(unsigned int i = 0;i < ndims;i++) size *= shape[i];
 
     cnpy::NpyArray arr;
     arr.word_size = word_size;
+    arr.type = type;
     arr.shape = std::vector<unsigned int>(shape,shape+ndims);
     arr.data = new char[size*word_size];
     arr.fortran_order = fortran_order;
@@ -141,106 +226,33 @@ cnpy::NpyArray cnpy::load_the_npy_file(FILE* fp) {
     return arr;
 }
 
-cnpy::npz_t cnpy::npz_load(std::string fname) {
-    FILE* fp = fopen(fname.c_str(),"rb");
-
-    if(!fp) printf("Error: Unable to open file \"%s\".\n",fname.c_str());
-    assert(fp);
-
-    cnpy::npz_t arrays;
-
-    while(1) {
-        std::vector<char> local_header(30);
-        size_t headerres = fread(&local_header[0],sizeof(char),30,fp);
-        if(headerres != 30)
-            throw std::runtime_error("npz_load: failed fread");
-
-        //if we've reached the global header, stop reading
-        if(local_header[2] != 0x03 || local_header[3] != 0x04) break;
-
-        //read in the variable name
-        unsigned short name_len = *(unsigned short*) &local_header[26];
-        std::string varname(name_len,' ');
-        size_t vname_res = fread(&varname[0],sizeof(char),name_len,fp);
-        if(vname_res != name_len)
-            throw std::runtime_error("npz_load: failed fread");
-
-        //erase the lagging .npy
-        varname.erase(varname.end()-4,varname.end());
-
-        //read in the extra field
-        unsigned short extra_field_len = *(unsigned short*) &local_header[28];
-        if(extra_field_len > 0) {
-            std::vector<char> buff(extra_field_len);
-            size_t efield_res = fread(&buff[0],sizeof(char),extra_field_len,fp);
-            if(efield_res != extra_field_len)
-                throw std::runtime_error("npz_load: failed fread");
-        }
-
-        arrays[varname] = load_the_npy_file(fp);
-    }
+cnpy::NpyArray cnpy::load_the_npy_file(std::shared_ptr<void> mapping, char* data, size_t size) {
+    size_t header_size;
+    cnpy::NpyArray arr;
+    cnpy::parse_npy_header(data,size,arr.word_size,arr.type,arr.shape,arr.fortran_order,header_size);
+    unsigned long long nbytes = arr.word_size; //long long so no overflow when multiplying by shape
+    for(auto dim : arr.shape) nbytes *= dim;
+    if(header_size + nbytes > size)
+        throw std::runtime_error("load_the_npy_file: truncated file");
+    arr.data = data + header_size;
+    arr.mapping = mapping;
+    return arr;
+}
 
-    fclose(fp);
-    return arrays;
+cnpy::npz_t cnpy::npz_load(std::string fname) {
+    return map_npz_arrays(map_file(fname), "");
 }
 
 cnpy::NpyArray cnpy::npz_load(std::string fname, std::string varname) {
-    FILE* fp = fopen(fname.c_str(),"rb");
-
-    if(!fp) {
-        printf("Error: Unable to open file \"%s\".\n",fname.c_str());
+    auto arrays = map_npz_arrays(map_file(fname), varname);
+    if(arrays.empty()) {
+        printf("npz_load: Error! Variable name %s not found in %s!\n",varname.c_str(),fname.c_str());
         abort();
     }
-
-    while(1) {
-        std::vector<char> local_header(30);
-        size_t header_res = fread(&local_header[0],sizeof(char),30,fp);
-        if(header_res != 30)
-            throw std::runtime_error("npz_load: failed fread");
-
-        //if we've reached the global header, stop reading
-        if(local_header[2] != 0x03 || local_header[3] != 0x04) break;
-
-        //read in the variable name
-        unsigned short name_len = *(unsigned short*) &local_header[26];
-        std::string vname(name_len,' ');
-        size_t vname_res = fread(&vname[0],sizeof(char),name_len,fp);
-        if(vname_res != name_len)
-            throw std::runtime_error("npz_load: failed fread");
-        vname.erase(vname.end()-4,vname.end()); //erase the lagging .npy
-
-        //read in the extra field
-        unsigned short extra_field_len = *(unsigned short*) &local_header[28];
-        fseek(fp,extra_field_len,SEEK_CUR); //skip past the extra field
-
-        if(vname == varname) {
-            NpyArray array = load_the_npy_file(fp);
-            fclose(fp);
-            return array;
-        }
-        else {
-            //skip past the data
-            unsigned int size = *(unsigned int*) &local_header[22];
-            fseek(fp,size,SEEK_CUR);
-        }
-    }
-
-    fclose(fp);
-    printf("npz_load: Error! Variable name %s not found in %s!\n",varname.c_str(),fname.c_str());
-    abort();
+    return arrays.begin()->second;
 }
 
 cnpy::NpyArray cnpy::npy_load(std::string fname) {
-
-    FILE* fp = fopen(fname.c_str(), "rb");
-
-    if(!fp) {
-        printf("Error: Unable to open file \"%s\".\n",fname.c_str());
-        abort();
-    }
-
-    NpyArray arr = load_the_npy_file(fp);
-
-    fclose(fp);
-    return arr;
+    auto file = map_file(fname);
+    return load_the_npy_file(file, file->data, file->size);
 }
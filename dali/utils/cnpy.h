@@ -15,6 +15,7 @@
 #include <cassert>
 #include <zlib.h>
 #include <map>
+#include <memory>
 
 namespace cnpy {
 
@@ -22,11 +23,23 @@ namespace cnpy {
         char* data;
         std::vector<unsigned int> shape;
         unsigned int word_size;
+        // kind of the numbers, as in the descr of the header: 'f' for
+        // floating point, 'i' and 'u' for signed and unsigned integers.
+        char type;
         bool fortran_order;
-        void destruct() {delete[] data;}
+        // set when data points into a memory mapped file (see npy_load
+        // and npz_load), which stays mapped while anyone holds on to it.
+        // Writes to data are private to the process (copy on write).
+        std::shared_ptr<void> mapping;
+        void destruct() {
+            if (mapping == nullptr) delete[] data;
+            mapping.reset();
+        }
     };
 
     NpyArray load_the_npy_file(FILE*);
+    // the npy file of `size` bytes at `data`, inside of `mapping`.
+    NpyArray load_the_npy_file(std::shared_ptr<void> mapping, char* data, size_t size);
 
     struct npz_t : public std::map<std::string, NpyArray>
     {
@@ -40,8 +53,13 @@ namespace cnpy {
     char BigEndianTest();
     char map_type(const std::type_info& t);
     template<typename T> std::vector<char> create_npy_header(const T* data, const unsigned int* shape, const unsigned int ndims);
-    void parse_npy_header(FILE* fp,unsigned int& word_size, unsigned int*& shape, unsigned int& ndims, bool& fortran_order);
+    void parse_npy_header(FILE* fp,unsigned int& word_size, char& type, unsigned int*& shape, unsigned int& ndims, bool& fortran_order);
+    // header of the npy file at data, whose array starts header_size bytes in.
+    void parse_npy_header(const char* data, size_t size, unsigned int& word_size, char& type, std::vector<unsigned int>& shape, bool& fortran_order, size_t& header_size);
     void parse_zip_footer(FILE* fp, unsigned short& nrecs, unsigned int& global_header_size, unsigned int& global_header_offset);
+    // npz_load and npy_load map the file instead of reading it: arrays
+    // point into the mapping, and pages are only read when touched.
+    // (npz arrays must be stored, as np.savez does, not compressed.)
     npz_t npz_load(std::string fname);
     NpyArray npz_load(std::string fname, std::string varname);
     NpyArray npy_load(std::string fname);
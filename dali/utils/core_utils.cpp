@@ -1,5 +1,11 @@
 #include "core_utils.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "dali/utils/ThreadPool.h"
+#include "dali/utils/parallel_parsing.h"
 #include "dali/tensor/Mat.h"
 
 using std::vector;
@@ -332,14 +338,17 @@ namespace utils {
 
     template<typename T>
     std::map<string, T> text_to_hashmap(const string& fname) {
+            // lines are parsed in parallel, and inserted in order.
+            typedef std::pair<string, T> entry_t;
+            auto entries = parallel_parsing::parse_lines<entry_t>(fname,
+                [](const char* begin, const char* end, vector<entry_t>* parsed) {
+                    const auto tokens = utils::split(string(begin, end), ' ');
+                    if (tokens.size() > 1)
+                            parsed->emplace_back(tokens[0], from_string<T>(tokens[1]));
+                });
             std::map<string, T> map;
-            if (is_gzip(fname)) {
-                    igzstream fpgz(fname.c_str(), std::ios::in | std::ios::binary);
-                    stream_to_hashmap(fpgz, map);
-            } else {
-                    std::fstream fp(fname, std::ios::in | std::ios::binary);
-                    stream_to_hashmap(fp, map);
-            }
+            for (auto& entry : entries)
+                    map[entry.first] = entry.second;
             return map;
     }
 
@@ -505,15 +514,21 @@ namespace utils {
     template std::map<string, double> text_to_hashmap(const string&);
     template std::map<string, uint>   text_to_hashmap(const string&);
 
-    void map_to_file(const std::map<string, std::vector<string>>& map, const string& fname) {
-        ofstream fp;
-        fp.open(fname.c_str(), std::ios::out);
+    std::string map_to_string(const std::map<string, std::vector<string>>& map) {
+        std::stringstream ss;
         for (auto& kv : map) {
-            fp << kv.first;
+            ss << kv.first;
             for (auto& v: kv.second)
-                fp << " " << v;
-            fp << "\n";
+                ss << " " << v;
+            ss << "\n";
         }
+        return ss.str();
+    }
+
+    void map_to_file(const std::map<string, std::vector<string>>& map, const string& fname) {
+        ofstream fp;
+        fp.open(fname.c_str(), std::ios::out);
+        fp << map_to_string(map);
     }
 
     vector<std::pair<string, string>> load_labeled_corpus(const string& fname) {
@@ -591,16 +606,15 @@ namespace utils {
     }
 
     vector<vector<string>> load_tokenized_unlabeled_corpus(const string& fname) {
-        ifstream fp(fname.c_str());
-        string l;
-        vector<vector<string>> list;
-        while (std::getline(fp, l)) {
-            auto tokenized = tokenize(string(l.begin(), l.end()));
-            if (tokenized.size() > 0 ) {
-                list.emplace_back(tokenized);
-            }
-        }
-        return list;
+        // lines are tokenized in parallel.
+        return parallel_parsing::parse_lines<vector<string>>(fname,
+            [](const char* begin, const char* end, vector<vector<string>>* list) {
+                vector<string> tokenized;
+                parallel_parsing::tokenize(begin, end, &tokenized);
+                if (tokenized.size() > 0 ) {
+                    list->emplace_back(std::move(tokenized));
+                }
+            });
     }
 
     vector<string> get_vocabulary(const tokenized_labeled_dataset& examples, int min_occurence, int data_column) {
@@ -816,6 +830,28 @@ namespace utils {
         return (stat (fname.c_str(), &buffer) == 0);
     }
 
+    MappedFile::MappedFile(const std::string& fname) : data(NULL), size(0) {
+        int fd = open(fname.c_str(), O_RDONLY);
+        ASSERT2(fd != -1, MS() << "Cannot open " << fname << ": " << strerror(errno));
+        struct stat buffer;
+        if (fstat(fd, &buffer) == 0) {
+            size = buffer.st_size;
+        }
+        if (size > 0) {
+            void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            data = mapped == MAP_FAILED ? NULL : (char*)mapped;
+        }
+        close(fd);
+        ASSERT2(size == 0 || data != NULL,
+            MS() << "Cannot map " << fname << " in memory: " << strerror(errno));
+    }
+
+    MappedFile::~MappedFile() {
+        if (data != NULL) {
+            munmap(data, size);
+        }
+    }
+
     std::string dir_parent(const std::string& path, int levels_up) {
         auto file_path_split = split(path, '/');
         assert(levels_up < file_path_split.size());
@@ -921,10 +957,6 @@ namespace utils {
     template vector<Mat<double>> reversed(const vector<Mat<double>>& vec);
 
 
-    std::unordered_map<std::string, std::atomic<int>> Timer::timers;
-    std::mutex Timer::timers_mutex;
-
-
     ThreadAverage::ThreadAverage(int num_threads) :
             num_threads(num_threads),
             thread_error(num_threads),
@@ -952,46 +984,21 @@ namespace utils {
         total_updates.store(0);
     }
 
-    Timer::Timer(std::string name, bool autostart) : name(name),
-                                                     stopped(false),
-                                                     started(false) {
-        if (timers.find(name) == timers.end()) {
-            std::lock_guard<decltype(timers_mutex)> guard(timers_mutex);
-            if (timers.find(name) == timers.end())
-                timers[name] = 0;
-        }
-        if (autostart)
-            start();
+    Timer::Timer(std::string name, bool autostart) :
+            span(profiler::intern(name), autostart, true) {
     }
 
     void Timer::start() {
-        assert(!started);
-        start_time = clock_t::now();
-        started = true;
+        span.start();
     }
 
     void Timer::stop() {
-        assert(!stopped);
-        timers[name] += std::chrono::duration_cast< std::chrono::milliseconds >
-                        (clock_t::now() - start_time).count();
-        stopped = true;
-    }
-
-    Timer::~Timer() {
-        if(!stopped)
-            stop();
+        span.stop();
     }
 
     void Timer::report() {
-        std::lock_guard<decltype(timers_mutex)> guard(timers_mutex);
-
-        for (auto& kv : timers) {
-            std::cout << "\"" << kv.first << "\" => "
-                      << std::fixed << std::setw(5) << std::setprecision(4) << std::setfill(' ')
-                      << (double) kv.second / 1000  << "s" << std::endl;
-        }
-
-        timers.clear();
+        profiler::report();
+        profiler::clear();
     }
 
     // color codes: http://www.codebuilder.me/2014/01/color-terminal-text-in-c/
@@ -33,6 +33,7 @@
 
 #include "dali/utils/gzstream.h"
 #include "dali/utils/assert2.h"
+#include "dali/utils/Profiler.h"
 #include "protobuf/corpus.pb.h"
 
 // MACRO DEFINITIONS
@@ -200,6 +201,8 @@ namespace utils {
     std::string& rtrim(std::string&);
 
     void map_to_file(const std::map<std::string, str_sequence>&, const std::string&);
+    // the contents map_to_file writes.
+    std::string map_to_string(const std::map<std::string, str_sequence>&);
 
     void ensure_directory(std::string&);
 
@@ -339,6 +342,25 @@ bool keep_empty_strings : keep empty strings [see above], defaults to false.
 
     bool file_exists(const std::string&);
 
+    /**
+    Mapped File
+    -----------
+    A file mapped in memory for as long as the object lives. The
+    mapping is copy on write: the memory can be modified, but the
+    changes stay private to the process and never reach the file.
+    **/
+    class MappedFile {
+        public:
+            char* data;
+            size_t size;
+
+            explicit MappedFile(const std::string& fname);
+            ~MappedFile();
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+    };
+
     std::string dir_parent(const std::string& path, int levels_up = 1);
 
     std::string dir_join(const std::vector<std::string>&);
@@ -391,28 +413,22 @@ bool keep_empty_strings : keep empty strings [see above], defaults to false.
     };
 
 
+    // Named profiler span (see `dali/utils/Profiler.h`), recorded
+    // even while the profiler is disabled (then only as totals).
+    // The name is looked up on every construction: time hot code
+    // with DALI_PROFILE_SPAN.
     class Timer {
-        typedef std::chrono::system_clock clock_t;
-
-        static std::unordered_map<std::string, std::atomic<int>> timers;
-        static std::mutex timers_mutex;
-
-        std::string name;
-        bool stopped;
-        bool started;
-        std::chrono::time_point<clock_t> start_time;
-
+        profiler::Span span;
         public:
             // creates timer and starts measuring time.
             Timer(std::string name, bool autostart=true);
-            // destroys timer and stops counting if the timer was not previously stopped.
-            ~Timer();
 
             // explicitly start the timer
             void start();
             // explicitly stop the timer
             void stop();
 
+            // prints the profiler's summary and clears it.
             static void report();
     };
 
@@ -9,11 +9,17 @@ An oasis of Python in lava sea of C++
 #ifndef DALI_UTILS_GENERATOR_H
 #define DALI_UTILS_GENERATOR_H
 
+#include <atomic>
+#include <condition_variable>
 #include <initializer_list>
 #include <exception>
 #include <functional>
+#include <memory>
 #include <thread>
 #include <mutex>
+#include <vector>
+
+#include "dali/utils/assert2.h"
 
 namespace utils {
 
@@ -42,16 +48,142 @@ namespace utils {
             }
     };
 
+    /*
+    PrefetchQueue<T>
+    ----------------
+
+    Bounded single producer / single consumer ring buffer used
+    to hand elements from a generator's thread to its consumer.
+    Both sides only touch their own index (and read the other's),
+    so no lock is taken while the buffer is neither full nor
+    empty. A side that has to wait spins for a little while and
+    then sleeps on a condition variable; the other side only takes
+    the mutex to wake it up when someone is actually asleep.
+    */
+    template<typename T>
+    class PrefetchQueue {
+        private:
+            std::vector<T> slots;
+            // consumer position and producer position (monotonic),
+            // kept on separate cache lines.
+            char pad0[64];
+            std::atomic<size_t> head;
+            char pad1[64];
+            std::atomic<size_t> tail;
+            char pad2[64];
+            // set by the producer when it will not push anymore.
+            std::atomic<bool> finished;
+            // set by the consumer when it will not pop anymore.
+            std::atomic<bool> closed;
+            std::atomic<int> sleepers;
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::exception_ptr error;
+
+            PrefetchQueue(const PrefetchQueue&) = delete;
+            PrefetchQueue& operator =(PrefetchQueue const &) = delete;
+
+            template<typename Predicate>
+            void wait_until(Predicate ready) {
+                for (int spin = 0; spin < 128; ++spin) {
+                    if (ready()) return;
+                    std::this_thread::yield();
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                sleepers++;
+                changed.wait(lock, ready);
+                sleepers--;
+            }
+
+            void wake_up() {
+                if (sleepers.load() > 0) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    changed.notify_all();
+                }
+            }
+        public:
+            explicit PrefetchQueue(int capacity) :
+                    slots(capacity),
+                    head(0),
+                    tail(0),
+                    finished(false),
+                    closed(false),
+                    sleepers(0) {
+                assert2(capacity > 0, "Generator prefetch depth must be strictly positive.");
+            }
+
+            // Producer side. Blocks while the buffer is full; returns
+            // false when the consumer is gone.
+            bool push(T value) {
+                const size_t position = tail.load(std::memory_order_relaxed);
+                wait_until([this, position]() {
+                    return position - head.load() < slots.size() || closed.load();
+                });
+                if (closed.load()) {
+                    return false;
+                }
+                slots[position % slots.size()] = std::move(value);
+                tail.store(position + 1);
+                wake_up();
+                return true;
+            }
+
+            // Producer side: no more elements (`error` is rethrown to
+            // the consumer once it has popped everything before it).
+            void finish(std::exception_ptr _error = std::exception_ptr()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    error = _error;
+                    finished.store(true);
+                }
+                changed.notify_all();
+            }
+
+            // Consumer side. Blocks while the buffer is empty; returns
+            // false once the producer is finished and everything was
+            // consumed.
+            bool pop(T& value) {
+                const size_t position = head.load(std::memory_order_relaxed);
+                wait_until([this, position]() {
+                    return tail.load() != position || finished.load();
+                });
+                if (tail.load() == position) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (error) {
+                        std::rethrow_exception(error);
+                    }
+                    return false;
+                }
+                value = std::move(slots[position % slots.size()]);
+                head.store(position + 1);
+                wake_up();
+                return true;
+            }
+
+            // Consumer side: stop the producer at its next push.
+            void close() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    closed.store(true);
+                }
+                changed.notify_all();
+            }
+    };
+
+    // how many elements a generator may compute ahead of its consumer.
+    struct Prefetch {
+        int depth;
+    };
+
+    const int DEFAULT_PREFETCH_DEPTH = 16;
+
     template<typename Heart>
     class Gen;
 
     template<typename OutputT>
     class GeneratorHeart {
         private:
-            OutputT value;
-            bool hasOutputted;
-            std::shared_ptr<std::mutex> mutex;
-            bool abort;
+            std::shared_ptr<PrefetchQueue<OutputT>> queue;
             class AbortException : public std::exception {};
         public:
             typedef OutputT Output;
@@ -59,79 +191,89 @@ namespace utils {
             template<typename T>
             friend class Gen;
 
-            GeneratorHeart() : hasOutputted(false), abort(false) {}
-
             void yield(OutputT v) {
-                assert2((bool)mutex, "Mutex was not present during yield.");
-                value = v;
-                hasOutputted = true;
-                while (hasOutputted) {
-                    mutex->unlock();
-                    std::this_thread::yield();
-                    mutex->lock();
-                }
-                if (abort) {
+                assert2((bool)queue, "Queue was not present during yield.");
+                if (!queue->push(std::move(v))) {
+                    // consumer is gone: unwind the generator.
                     throw AbortException();
                 }
             }
     };
 
+    /*
+    Gen<Heart>
+    ----------
+
+    Runs `Heart::run(args...)` on its own thread. Yielded elements
+    go through a PrefetchQueue, so the generator runs up to
+    `Prefetch::depth` elements ahead of the consumer. Exceptions
+    thrown by the generator are rethrown to the consumer.
+    Generators can be nested: a generator may consume another one.
+    */
     template<typename Heart>
     class Gen {
+        public:
+            typedef typename Heart::Output Output;
         private:
-            std::function<void()> callback;
             Heart heart;
-            std::shared_ptr<std::mutex> mutex;
-            std::shared_ptr<std::thread> thread_ptr;
+            std::shared_ptr<PrefetchQueue<Output>> queue;
+            std::thread thread;
+            Output value;
             bool done;
+
+            Gen(const Gen&) = delete;
+            Gen& operator =(Gen const &) = delete;
         public:
-            typedef typename Heart::Output Output;
             template<typename... ARGS>
-            Gen(ARGS... args) :
-                    done(false),
-                    mutex(std::make_shared<std::mutex>()) {
-                // Use bind instead of capture because capture does not get along with parameter packs
-                // callback=std::bind([&](Gen<Heart>* gen, ARGS... args){ gen->threadmain(args...); }, this, args...);
-                mutex->lock();
-                heart.mutex = mutex;
-                // pthread_create (&this->thread, NULL, generator_utils::invoke_callback, static_cast<void*>(&callback));
-                thread_ptr = std::make_shared<std::thread>(
-                    [this, args...]() {
-                        threadmain(args...);
-                    }
-                );
-                ++(*this);
+            Gen(ARGS... args) : Gen(Prefetch{DEFAULT_PREFETCH_DEPTH}, args...) {
             }
-            ~Gen() {
-                if (!done) {
-                    heart.abort = true;
+
+            template<typename... ARGS>
+            Gen(Prefetch prefetch, ARGS... args) :
+                    queue(std::make_shared<PrefetchQueue<Output>>(prefetch.depth)),
+                    done(false) {
+                heart.queue = queue;
+                thread = std::thread([this, args...]() {
+                    threadmain(args...);
+                });
+                try {
                     ++(*this);
+                } catch (...) {
+                    thread.join();
+                    throw;
                 }
-                thread_ptr->join();
+            }
+            ~Gen() {
+                queue->close();
+                thread.join();
             }
             template<typename... ARGS>
             void threadmain(ARGS... args) {
-                mutex->lock();
+                std::exception_ptr error;
                 try {
                     heart.run(args...);
-                } catch (typename Heart::AbortException ex) {}
-                done = true;
-                mutex->unlock();
+                } catch (typename Heart::AbortException& ex) {
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                queue->finish(error);
             }
             operator bool() {
                 return !done;
             }
             Gen<Heart>& operator++() {
-                heart.hasOutputted = false;
-                while (!heart.hasOutputted && !done) {
-                    mutex->unlock();
-                    std::this_thread::yield();
-                    mutex->lock();
+                if (!done) {
+                    try {
+                        done = !queue->pop(value);
+                    } catch (...) {
+                        done = true;
+                        throw;
+                    }
                 }
                 return *this;
             }
             Output operator*() {
-                return heart.value;
+                return value;
             }
             typedef utils::ForLooping<Gen<Heart>> ForLooping;
             ForLooping begin() { return ForLooping(this); }
@@ -158,7 +300,8 @@ namespace utils {
 
     A wrapper around Gen<LambdaGeneratorHeart<T>>, a generator built from
     a lambda. This wrapper allows easy copying, moving, and resetting
-    of a generator.
+    of a generator. Copies share the lambda but not the iteration:
+    a copy starts over from the beginning.
 
     */
     template<typename T>
@@ -167,23 +310,32 @@ namespace utils {
             typedef typename LambdaGeneratorHeart<T>::generator_t generator_t;
             typedef Gen<LambdaGeneratorHeart<T>> heart_t;
             typedef typename heart_t::ForLooping ForLooping;
-            std::shared_ptr< heart_t > genheart;
             generator_t gen;
+            int prefetch_depth;
+            std::shared_ptr< heart_t > genheart;
 
-            Generator(generator_t _gen) : gen(_gen), genheart(NULL) {};
-            Generator(const Generator<Gen<LambdaGeneratorHeart<T>>>& other) : gen(other.gen), genheart(NULL) {}
+            Generator(generator_t _gen, int _prefetch_depth = DEFAULT_PREFETCH_DEPTH) :
+                    gen(_gen), prefetch_depth(_prefetch_depth), genheart(NULL) {};
+            Generator(const Generator<T>& other) :
+                    gen(other.gen), prefetch_depth(other.prefetch_depth), genheart(NULL) {}
+            Generator<T>& operator=(const Generator<T>& other) {
+                gen            = other.gen;
+                prefetch_depth = other.prefetch_depth;
+                genheart       = NULL;
+                return *this;
+            }
 
             void reset() {genheart = NULL;}
 
             ForLooping begin() {
                 if (!genheart)
-                    genheart = std::make_shared<heart_t>(gen);
+                    genheart = std::make_shared<heart_t>(Prefetch{prefetch_depth}, gen);
                 return genheart->begin();
             };
 
             ForLooping end() {
                 if (!genheart)
-                    genheart = std::make_shared<Gen<LambdaGeneratorHeart<T>>>(gen);
+                    genheart = std::make_shared<heart_t>(Prefetch{prefetch_depth}, gen);
                 return genheart->end();
             }
 
@@ -201,7 +353,7 @@ namespace utils {
                     for (auto el : other) {
                         yield(el);
                     }
-                });
+                }, prefetch_depth);
             }
     };
 
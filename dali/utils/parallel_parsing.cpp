@@ -0,0 +1,247 @@
+#include "dali/utils/parallel_parsing.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+#include "dali/math/CpuThreading.h"
+#include "dali/utils/core_utils.h"
+#include "dali/utils/gzstream.h"
+#include "dali/utils/ThreadPool.h"
+
+using std::string;
+using std::vector;
+
+namespace utils {
+    namespace parallel_parsing {
+        namespace {
+            bool run_in_parallel() {
+                // callers already running in a pool stay on their thread.
+                return cpu_threading::num_threads() > 1 &&
+                       ThreadPool::get_thread_number() == -1;
+            }
+
+            // moves past the first `*lines` lines of [begin, end) (or
+            // fewer if there are not as many complete lines) and counts
+            // them off `*lines`.
+            const char* skip_lines(const char* begin, const char* end, int* lines) {
+                while (*lines > 0 && begin < end) {
+                    auto newline = (const char*)std::memchr(begin, '\n', end - begin);
+                    if (newline == NULL) {
+                        return end;
+                    }
+                    begin = newline + 1;
+                    --(*lines);
+                }
+                return begin;
+            }
+
+            int for_each_mapped_chunk(const string& fname,
+                                      chunk_parser_t& parse_chunk,
+                                      int max_lines,
+                                      size_t chunk_size) {
+                MappedFile file(fname);
+                const char* begin = file.data;
+                const char* end   = file.data + file.size;
+                if (max_lines != -1) {
+                    end = skip_lines(begin, end, &max_lines);
+                }
+                // chunks end after the first newline past chunk_size bytes.
+                vector<const char*> boundaries({begin});
+                while (boundaries.back() < end) {
+                    const char* cut = boundaries.back() + std::min(chunk_size, (size_t)(end - boundaries.back()));
+                    if (cut < end) {
+                        auto newline = (const char*)std::memchr(cut, '\n', end - cut);
+                        cut = newline == NULL ? end : newline + 1;
+                    }
+                    boundaries.emplace_back(cut);
+                }
+                const int num_chunks = boundaries.size() - 1;
+                auto parse_chunks = [&boundaries, &parse_chunk](int first, int last) {
+                    for (int chunk = first; chunk < last; ++chunk) {
+                        parse_chunk(chunk, boundaries[chunk], boundaries[chunk + 1]);
+                    }
+                };
+                if (num_chunks > 1 && run_in_parallel()) {
+                    cpu_threading::parallel_for(0, num_chunks, 1, parse_chunks);
+                } else {
+                    parse_chunks(0, num_chunks);
+                }
+                return num_chunks;
+            }
+
+            int for_each_gzip_chunk(const string& fname,
+                                    chunk_parser_t& parse_chunk,
+                                    int max_lines,
+                                    size_t chunk_size) {
+                igzstream stream(fname.c_str(), std::ios::in | std::ios::binary);
+                std::unique_ptr<TaskGroup> parsers;
+                if (run_in_parallel()) {
+                    parsers.reset(new TaskGroup(cpu_threading::thread_pool()));
+                }
+                int num_chunks = 0;
+                // incomplete line at the end of the previous chunk.
+                string carry;
+                bool done = false;
+                while (!done) {
+                    auto chunk = std::make_shared<string>();
+                    chunk->swap(carry);
+                    const size_t carried = chunk->size();
+                    chunk->resize(carried + chunk_size);
+                    stream.read(&(*chunk)[carried], chunk_size);
+                    chunk->resize(carried + stream.gcount());
+                    done = !stream;
+                    if (!done) {
+                        auto last_newline = chunk->rfind('\n');
+                        if (last_newline == string::npos) {
+                            // a line longer than chunk_size.
+                            carry.swap(*chunk);
+                            continue;
+                        }
+                        carry.assign(*chunk, last_newline + 1, string::npos);
+                        chunk->resize(last_newline + 1);
+                    }
+                    if (max_lines != -1) {
+                        const char* data = chunk->data();
+                        chunk->resize(skip_lines(data, data + chunk->size(), &max_lines) - data);
+                        done = done || max_lines == 0;
+                    }
+                    if (chunk->empty()) {
+                        continue;
+                    }
+                    const int index = num_chunks++;
+                    if (parsers != nullptr) {
+                        // parsed while the next chunk is decompressed.
+                        parsers->run([chunk, index, &parse_chunk]() {
+                            parse_chunk(index, chunk->data(), chunk->data() + chunk->size());
+                        });
+                    } else {
+                        parse_chunk(index, chunk->data(), chunk->data() + chunk->size());
+                    }
+                }
+                if (parsers != nullptr) {
+                    parsers->wait();
+                }
+                return num_chunks;
+            }
+
+            // powers of ten that are exact doubles.
+            const double EXACT_POWERS_OF_TEN[] = {
+                1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+            };
+            const int MAX_EXACT_POWER = 22;
+            const uint64_t MAX_EXACT_MANTISSA = (uint64_t)1 << 53;
+
+            inline bool is_digit(char c) {
+                return c >= '0' && c <= '9';
+            }
+
+            inline bool is_space(char c) {
+                return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+            }
+        }
+
+        int for_each_chunk(const string& fname,
+                           chunk_parser_t parse_chunk,
+                           int max_lines,
+                           size_t chunk_size) {
+            ASSERT2(file_exists(fname), MS() << "Cannot open " << fname);
+            if (max_lines == 0) {
+                return 0;
+            }
+            if (is_gzip(fname)) {
+                return for_each_gzip_chunk(fname, parse_chunk, max_lines, chunk_size);
+            }
+            return for_each_mapped_chunk(fname, parse_chunk, max_lines, chunk_size);
+        }
+
+        double parse_double(const char** cursor, const char* end) {
+            const char* p = *cursor;
+            while (p < end && (*p == ' ' || *p == '\t')) {
+                ++p;
+            }
+            const char* start = p;
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative = *p == '-';
+                ++p;
+            }
+            // a number with few enough digits and a small enough
+            // exponent is a single exact division or multiplication
+            // away from the correctly rounded double.
+            uint64_t mantissa = 0;
+            int significant_digits = 0;
+            int digits = 0;
+            int exponent = 0;
+            for (; p < end && is_digit(*p); ++p, ++digits) {
+                mantissa = mantissa * 10 + (*p - '0');
+                significant_digits += mantissa != 0;
+            }
+            if (p < end && *p == '.') {
+                for (++p; p < end && is_digit(*p); ++p, ++digits) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    significant_digits += mantissa != 0;
+                    --exponent;
+                }
+            }
+            bool fast = digits > 0 && significant_digits <= 19;
+            if (fast && p < end && (*p == 'e' || *p == 'E')) {
+                const char* q = p + 1;
+                bool negative_exponent = false;
+                if (q < end && (*q == '-' || *q == '+')) {
+                    negative_exponent = *q == '-';
+                    ++q;
+                }
+                if (q < end && is_digit(*q)) {
+                    int written_exponent = 0;
+                    for (; q < end && is_digit(*q); ++q) {
+                        if (written_exponent < 10000) {
+                            written_exponent = written_exponent * 10 + (*q - '0');
+                        }
+                    }
+                    exponent += negative_exponent ? -written_exponent : written_exponent;
+                    p = q;
+                }
+            }
+            if (fast && mantissa <= MAX_EXACT_MANTISSA &&
+                    exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER) {
+                double value = (double)mantissa;
+                value = exponent < 0 ? value / EXACT_POWERS_OF_TEN[-exponent]
+                                     : value * EXACT_POWERS_OF_TEN[exponent];
+                *cursor = p;
+                return negative ? -value : value;
+            }
+            // anything else (many digits, huge exponents, inf, nan)
+            // goes to strtod, on a null terminated copy of the token.
+            char token[64];
+            int length = 0;
+            for (const char* q = start; q < end && !is_space(*q) && length < 63; ++q) {
+                token[length++] = *q;
+            }
+            token[length] = '\0';
+            char* token_end;
+            double value = std::strtod(token, &token_end);
+            *cursor = start + (token_end - token);
+            return value;
+        }
+
+        void tokenize(const char* begin, const char* end, vector<string>* tokens) {
+            while (begin < end) {
+                while (begin < end && is_space(*begin)) {
+                    ++begin;
+                }
+                const char* token_end = begin;
+                while (token_end < end && !is_space(*token_end)) {
+                    ++token_end;
+                }
+                if (token_end > begin) {
+                    tokens->emplace_back(begin, token_end);
+                }
+                begin = token_end;
+            }
+        }
+    }
+}
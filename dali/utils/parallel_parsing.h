@@ -0,0 +1,127 @@
+#ifndef DALI_UTILS_PARALLEL_PARSING_H
+#define DALI_UTILS_PARALLEL_PARSING_H
+
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+Parallel parsing
+----------------
+
+Text files are cut into chunks of whole lines that are parsed on
+all cores (see cpu_threading), and the results of the chunks are
+put back together in file order: what comes out does not depend on
+the number of threads.
+
+Plain files are memory mapped and cut at the first newline after
+every `chunk_size` bytes. Gzip files are decompressed on the calling
+thread, which hands each chunk of lines to the pool as soon as it is
+decompressed, so that parsing overlaps with decompression.
+*/
+namespace utils {
+    namespace parallel_parsing {
+        // bytes per chunk (lines are never split).
+        const size_t CHUNK_SIZE = 1 << 22;
+
+        typedef std::function<void(int chunk, const char* begin, const char* end)> chunk_parser_t;
+
+        /**
+        For Each Chunk
+        --------------
+
+        Calls `parse_chunk(chunk, begin, end)` on consecutive chunks of
+        whole lines of a (possibly gzipped) file, in parallel. Chunks are
+        numbered from 0 in file order.
+
+        Inputs
+        ------
+
+        const std::string& fname : file to parse
+        chunk_parser_t parse_chunk : called once per chunk, from any thread
+        int max_lines : only parse the first `max_lines` lines (if not -1)
+        size_t chunk_size : approximate number of bytes per chunk
+
+        Outputs
+        -------
+
+        int num_chunks : number of chunks parsed
+
+        **/
+        int for_each_chunk(const std::string& fname,
+                           chunk_parser_t parse_chunk,
+                           int max_lines = -1,
+                           size_t chunk_size = CHUNK_SIZE);
+
+        // calls `f(begin, end)` on each line of [begin, end), without
+        // its '\n' (nor the '\r' of windows line endings).
+        template<typename F>
+        void for_each_line(const char* begin, const char* end, F f) {
+            while (begin < end) {
+                auto line_end = (const char*)std::memchr(begin, '\n', end - begin);
+                if (line_end == NULL) {
+                    line_end = end;
+                }
+                auto content_end = line_end;
+                if (content_end > begin && *(content_end - 1) == '\r') {
+                    --content_end;
+                }
+                f(begin, content_end);
+                begin = line_end + 1;
+            }
+        }
+
+        /**
+        Parse Lines
+        -----------
+
+        Parses every line of a (possibly gzipped) file in parallel:
+        `parse_line(begin, end, &parsed)` may append any number of
+        results to `parsed`, and the results of all the lines are
+        returned in file order.
+        **/
+        template<typename T>
+        std::vector<T> parse_lines(const std::string& fname,
+                                   std::function<void(const char*, const char*, std::vector<T>*)> parse_line,
+                                   int max_lines = -1) {
+            std::mutex chunks_mutex;
+            std::map<int, std::vector<T>> chunks;
+            for_each_chunk(fname, [&](int chunk, const char* begin, const char* end) {
+                std::vector<T> parsed;
+                for_each_line(begin, end, [&parse_line, &parsed](const char* line, const char* line_end) {
+                    parse_line(line, line_end, &parsed);
+                });
+                std::lock_guard<std::mutex> lock(chunks_mutex);
+                chunks[chunk] = std::move(parsed);
+            }, max_lines);
+
+            size_t total = 0;
+            for (auto& chunk : chunks) {
+                total += chunk.second.size();
+            }
+            std::vector<T> result;
+            result.reserve(total);
+            for (auto& chunk : chunks) {
+                for (auto& parsed : chunk.second) {
+                    result.emplace_back(std::move(parsed));
+                }
+            }
+            return result;
+        }
+
+        // Parses a decimal number starting at `*cursor` (after any
+        // spaces) and moves the cursor past it. Gives the same double
+        // as `strtod` (which it falls back to for numbers with many
+        // digits or large exponents).
+        double parse_double(const char** cursor, const char* end);
+
+        // Appends the whitespace separated tokens of [begin, end).
+        void tokenize(const char* begin, const char* end, std::vector<std::string>* tokens);
+    }
+}
+
+#endif
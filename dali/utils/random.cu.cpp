@@ -1,4 +1,7 @@
 #include "dali/utils/random.h"
+
+#include <atomic>
+
 using std::vector;
 
 namespace utils {
@@ -48,6 +51,15 @@ namespace utils {
         int random_seed      = std::random_device()();
 
         std::mt19937 generator_ = std::mt19937(random_seed);
+        std::atomic<unsigned long long> next_counter(0);
+        // bumped by set_seed, so that threads know to rewind their stream.
+        std::atomic<int> seed_generation(0);
+        std::atomic<unsigned int> next_thread_stream(0);
+
+        __thread bool thread_has_stream = false;
+        __thread unsigned int thread_stream = 0;
+        __thread int thread_generation = -1;
+        __thread unsigned long long thread_counter = 0;
 
         void reseed() {
             // replace random seed with new seed
@@ -59,10 +71,37 @@ namespace utils {
         void set_seed(int new_seed) {
             random_seed = new_seed;
             generator_ = std::mt19937(new_seed);
+            next_counter = 0;
+            seed_generation++;
         }
 
         std::mt19937& generator() {
             return generator_;
         }
+
+        unsigned int seed() {
+            return random_seed;
+        }
+
+        unsigned long long reserve_counters(unsigned long long count) {
+            return next_counter.fetch_add(count);
+        }
+
+        thread_counters_t reserve_thread_counters(unsigned long long count) {
+            if (!thread_has_stream) {
+                thread_stream = next_thread_stream++;
+                thread_has_stream = true;
+            }
+            int generation = seed_generation.load();
+            if (thread_generation != generation) {
+                thread_generation = generation;
+                thread_counter = 0;
+            }
+            thread_counters_t reserved;
+            reserved.stream = thread_stream;
+            reserved.offset = thread_counter;
+            thread_counter += count;
+            return reserved;
+        }
     }
 }
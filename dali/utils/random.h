@@ -37,6 +37,23 @@ namespace utils {
         void reseed();
         void set_seed(int new_seed);
         std::mt19937& generator();
+        // Counter based generators (e.g. Philox) are keyed by the seed
+        // and read from a position in its stream: `reserve_counters`
+        // claims `count` positions and returns the first one. set_seed
+        // and reseed rewind the stream to 0.
+        unsigned int seed();
+        unsigned long long reserve_counters(unsigned long long count);
+
+        // Each thread also has a stream of its own (numbered in the
+        // order in which threads first ask for one), so that threads
+        // sampling at the same time neither share state nor draw the
+        // same numbers. set_seed and reseed rewind every thread's
+        // stream to 0.
+        struct thread_counters_t {
+            unsigned int stream;
+            unsigned long long offset;
+        };
+        thread_counters_t reserve_thread_counters(unsigned long long count);
     }
 }
 
@@ -1,11 +1,21 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
 #include <vector>
 #include <memory>
 #include <gtest/gtest.h>
 #include <sstream>
 #include <cstdio>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include "dali/utils.h"
+#include "dali/math/CpuThreading.h"
 
 using std::chrono::milliseconds;
 using std::make_shared;
@@ -68,6 +78,79 @@ TEST(ThreadPool, thread_number) {
     }
 }
 
+TEST(ThreadPool, parallel_for) {
+    ThreadPool pool(4);
+    for (int grain : {1, 7, 1000, 5000}) {
+        vector<int> visits(1000, 0);
+        pool.parallel_for(0, 1000, grain, [&visits, grain](int begin, int end) {
+            ASSERT_EQ(begin % grain, 0);
+            ASSERT_TRUE(end - begin == grain || end == 1000);
+            for (int i = begin; i < end; ++i) {
+                visits[i]++;
+            }
+        });
+        for (auto count : visits) {
+            ASSERT_EQ(count, 1);
+        }
+    }
+    // errors reach the caller.
+    EXPECT_THROW(
+        pool.parallel_for(0, 100, 1, [](int begin, int end) {
+            if (begin == 50) {
+                throw std::runtime_error("chunk failed");
+            }
+        }),
+        std::runtime_error
+    );
+}
+
+TEST(ThreadPool, nested_task_groups) {
+    ThreadPool pool(3);
+    std::atomic<int> count(0);
+    TaskGroup outer(pool);
+    for (int i = 0; i < 10; ++i) {
+        outer.run([&pool, &count]() {
+            // waiting from within the pool runs the inner tasks meanwhile.
+            TaskGroup inner(pool);
+            for (int j = 0; j < 10; ++j) {
+                inner.run([&count]() { count++; });
+            }
+            inner.wait();
+        });
+    }
+    outer.wait();
+    ASSERT_EQ(count, 100);
+    ASSERT_TRUE(pool.wait_until_idle());
+}
+
+TEST(ThreadPool, task_group_runs_only_its_tasks) {
+    ThreadPool pool(1);
+    std::atomic<bool> release(false);
+    // keep the only worker busy so that the tasks below stay queued.
+    pool.run([&release]() {
+        while (!release) {
+            std::this_thread::yield();
+        }
+    });
+    auto waiter = std::this_thread::get_id();
+    std::atomic<bool> foreign_task_on_waiter(false);
+    pool.run([&foreign_task_on_waiter, waiter]() {
+        if (std::this_thread::get_id() == waiter) {
+            foreign_task_on_waiter = true;
+        }
+    });
+    std::atomic<int> count(0);
+    TaskGroup group(pool);
+    for (int i = 0; i < 10; ++i) {
+        group.run([&count]() { count++; });
+    }
+    group.wait();
+    ASSERT_EQ(count, 10);
+    ASSERT_FALSE(foreign_task_on_waiter);
+    release = true;
+    ASSERT_TRUE(pool.wait_until_idle());
+}
+
 TEST(utils, stream_to_redirection_list) {
     stringstream ss(
         "hello->world\n"
@@ -209,6 +292,68 @@ TEST(utils, load_tsv) {
     ASSERT_EQ(dataset.back().front().front(), ".");
 }
 
+TEST(utils, parallel_parsing) {
+    vector<string> lines;
+    for (int i = 0; i < 2000; ++i) {
+        stringstream line;
+        line << "word" << i;
+        for (int j = 0; j < i % 5; ++j) {
+            line << " " << (i - j) * 0.125 << "e-" << j;
+        }
+        lines.emplace_back(line.str());
+    }
+    string fname    = "/tmp/dali_parallel_parsing.txt";
+    string fname_gz = fname + ".gz";
+    utils::save_list(lines, fname);
+    utils::save_list(lines, fname_gz);
+
+    for (int num_threads : {1, 4}) {
+        cpu_threading::set_num_threads(num_threads);
+        for (auto& path : {fname, fname_gz}) {
+            // small chunks, merged back in file order.
+            std::mutex chunks_mutex;
+            std::map<int, vector<string>> chunks;
+            int num_chunks = utils::parallel_parsing::for_each_chunk(path,
+                [&](int chunk, const char* begin, const char* end) {
+                    vector<string> chunk_lines;
+                    utils::parallel_parsing::for_each_line(begin, end, [&chunk_lines](const char* line, const char* line_end) {
+                        chunk_lines.emplace_back(line, line_end);
+                    });
+                    std::lock_guard<std::mutex> lock(chunks_mutex);
+                    chunks[chunk] = chunk_lines;
+                }, -1, 256);
+            ASSERT_GT(num_chunks, 1);
+            ASSERT_EQ(chunks.size(), num_chunks);
+            vector<string> merged;
+            for (auto& chunk : chunks) {
+                merged.insert(merged.end(), chunk.second.begin(), chunk.second.end());
+            }
+            ASSERT_EQ(merged, lines);
+
+            auto corpus = utils::load_tokenized_unlabeled_corpus(path);
+            ASSERT_EQ(corpus.size(), lines.size());
+            for (int i = 0; i < lines.size(); ++i) {
+                ASSERT_EQ(corpus[i], utils::tokenize(lines[i]));
+                // numbers read exactly as strtod reads them.
+                const char* number = lines[i].data() + corpus[i][0].size();
+                const char* end    = lines[i].data() + lines[i].size();
+                for (int j = 1; j < corpus[i].size(); ++j) {
+                    ASSERT_EQ(utils::parallel_parsing::parse_double(&number, end),
+                              std::strtod(corpus[i][j].c_str(), NULL));
+                }
+            }
+            ASSERT_EQ(utils::parallel_parsing::parse_lines<string>(path,
+                [](const char* begin, const char* end, vector<string>* parsed) {
+                    parsed->emplace_back(begin, end);
+                }, 10),
+                vector<string>(lines.begin(), lines.begin() + 10));
+        }
+    }
+    cpu_threading::set_num_threads(0);
+    std::remove(fname.c_str());
+    std::remove(fname_gz.c_str());
+}
+
 TEST(utils, load_lattice) {
     string data_folder = STR(DALI_DATA_DIR) "/";
     auto loaded_tree = OntologyBranch::load(data_folder + "lattice.txt");
@@ -406,6 +551,69 @@ TEST(utils, recursive_generator_test) {
     ASSERT_EQ(vector<int>({1,2,3,4,5, 1,2,3,4,5, 1,2,3,4,5, 1,2,3,4,5, 1,2,3,4,5}), vals);
 }
 
+TEST(utils, nested_generators) {
+    // each level consumes a copy of the level below, on its own thread.
+    auto numbers = utils::Generator<int>([](utils::yield_t<int> yield) {
+        for (int i = 0; i < 1000; ++i) yield(i);
+    });
+    auto pairs = utils::Generator<vector<int>>([numbers](utils::yield_t<vector<int>> yield) {
+        vector<int> pair;
+        auto numbers_cpy = numbers;
+        for (auto number : numbers_cpy) {
+            pair.emplace_back(number);
+            if (pair.size() == 2) {
+                yield(pair);
+                pair.clear();
+            }
+        }
+    }, 1);
+    auto sums = utils::Generator<int>([pairs](utils::yield_t<int> yield) {
+        auto pairs_cpy = pairs;
+        for (auto pair : pairs_cpy) {
+            yield(pair[0] + pair[1]);
+        }
+    });
+    for (int pass = 0; pass < 2; ++pass) {
+        int total = 0, seen = 0;
+        for (auto sum : sums) {
+            total += sum;
+            seen++;
+        }
+        ASSERT_EQ(500, seen);
+        ASSERT_EQ(999 * 1000 / 2, total);
+        sums.reset();
+    }
+}
+
+TEST(utils, generator_early_exit_and_errors) {
+    // leaving the loop early stops a generator that never ends
+    for (int depth : {1, 4, 64}) {
+        auto endless = utils::Generator<int>([](utils::yield_t<int> yield) {
+            int i = 0;
+            while (true) yield(i++);
+        }, depth);
+        auto vals = vector<int>();
+        for (int i : endless) {
+            if (i == 10) break;
+            vals.emplace_back(i);
+        }
+        ASSERT_EQ(vector<int>({0,1,2,3,4,5,6,7,8,9}), vals);
+        endless.reset();
+    }
+
+    // errors reach the consumer after the elements yielded before them
+    auto failing = utils::Generator<int>([](utils::yield_t<int> yield) {
+        yield(1);
+        yield(2);
+        throw std::runtime_error("generator failed");
+    });
+    auto vals = vector<int>();
+    EXPECT_THROW({
+        for (int i : failing) vals.emplace_back(i);
+    }, std::runtime_error);
+    ASSERT_EQ(vector<int>({1, 2}), vals);
+}
+
 TEST(utils, combine_generators) {
     // here we take two short generators and
     // create a longer one out of the pair:
@@ -427,3 +635,204 @@ TEST(utils, combine_generators) {
 
 }
 
+
+TEST(utils, unigram_sampler) {
+    vector<double> counts = {1.0, 0.0, 3.0, 6.0};
+    utils::UnigramSampler sampler(counts, 1.0);
+    EXPECT_NEAR(sampler.probability(0), 0.1, 1e-9);
+    EXPECT_EQ(sampler.probability(1), 0.0);
+    EXPECT_NEAR(sampler.probability(3), 0.6, 1e-9);
+
+    std::mt19937 generator(1234);
+    const int num_draws = 100000;
+    vector<int> draws(counts.size(), 0);
+    for (int i = 0; i < num_draws; ++i) {
+        draws[sampler.sample(generator)]++;
+    }
+    for (int word = 0; word < counts.size(); ++word) {
+        EXPECT_NEAR((double)draws[word] / num_draws, sampler.probability(word), 0.01);
+    }
+
+    // only 3 words can be drawn:
+    auto negatives = sampler.sample_unique(3, generator);
+    std::sort(negatives.words.begin(), negatives.words.end());
+    EXPECT_EQ(negatives.words, vector<int>({0, 2, 3}));
+    EXPECT_GE(negatives.num_tries, 3);
+    EXPECT_THROW(sampler.sample_unique(4, generator), std::runtime_error);
+
+    auto zipf = utils::UnigramSampler::zipfian(1000);
+    double total = 0.0;
+    for (int word = 0; word < zipf.size(); ++word) {
+        total += zipf.probability(word);
+    }
+    EXPECT_NEAR(total, 1.0, 1e-9);
+    EXPECT_GT(zipf.probability(0), zipf.probability(1));
+    EXPECT_NEAR(zipf.expected_count(0, 1), zipf.probability(0), 1e-12);
+}
+
+TEST(utils, softmax_tree_huffman) {
+    vector<double> counts = {5.0, 1.0, 1.0, 2.0, 10.0};
+    auto tree = utils::SoftmaxTree::huffman(counts);
+    EXPECT_EQ(tree.num_labels(), 5);
+    // a binary tree over 5 words has 4 nodes and 8 edges.
+    EXPECT_EQ(tree.num_nodes(), 4);
+    EXPECT_EQ(tree.num_columns(), 8);
+    // the most frequent word is one decision away from the root.
+    EXPECT_EQ(tree.path_length(4), 1);
+    EXPECT_EQ(tree.path_length(1), 4);
+    EXPECT_EQ(tree.max_depth(), 4);
+    for (int label = 0; label < tree.num_labels(); ++label) {
+        EXPECT_EQ(tree.path_nodes[tree.path_offsets[label]], 0);
+        for (int step = tree.path_offsets[label]; step < tree.path_offsets[label + 1]; ++step) {
+            int node = tree.path_nodes[step];
+            EXPECT_GE(tree.path_edges[step], tree.node_offsets[node]);
+            EXPECT_LT(tree.path_edges[step], tree.node_offsets[node + 1]);
+        }
+    }
+
+    // every node of a ternary tree but the deepest has 3 edges.
+    auto ternary = utils::SoftmaxTree::huffman({5.0, 1.0, 1.0, 2.0, 10.0, 3.0}, 3);
+    EXPECT_EQ(ternary.num_nodes(), 3);
+    EXPECT_EQ(ternary.num_columns(), 8);
+    EXPECT_EQ(ternary.max_depth(), 3);
+}
+
+TEST(utils, softmax_tree_from_lattice) {
+    auto root   = make_shared<OntologyBranch>("root");
+    auto animal = make_shared<OntologyBranch>("animal");
+    auto plant  = make_shared<OntologyBranch>("plant");
+    auto cat    = make_shared<OntologyBranch>("cat");
+    auto catnip = make_shared<OntologyBranch>("catnip");
+    animal->add_parent(root);
+    plant->add_parent(root);
+    cat->add_parent(animal);
+    catnip->add_parent(plant);
+    // reached through animal, the first parent found.
+    catnip->add_parent(animal);
+
+    utils::Vocab labels({utils::end_symbol, "root", "animal", "plant", "cat", "catnip"}, false);
+    auto tree = utils::SoftmaxTree::from_lattice(root, labels);
+    // root: stop, animal, plant. animal: stop, cat, catnip. plant: stop, catnip.
+    EXPECT_EQ(tree.num_nodes(), 3);
+    EXPECT_EQ(tree.num_columns(), 8);
+    EXPECT_EQ(tree.path_length(0), 0);
+    EXPECT_EQ(tree.path_length(1), 1);
+    EXPECT_EQ(tree.path_edges[tree.path_offsets[1]], 0);
+
+    auto catnip_path = vector<int>(
+        tree.path_edges.begin() + tree.path_offsets[5],
+        tree.path_edges.begin() + tree.path_offsets[6]
+    );
+    EXPECT_EQ(catnip_path, vector<int>({1, 5}));
+    EXPECT_EQ(tree.path_length(3), 2);
+}
+
+TEST(utils, profiler) {
+    auto find_span = [](const vector<utils::profiler::SpanSummary>& spans, const string& name) -> utils::profiler::SpanSummary {
+        for (auto& span : spans) {
+            if (span.name == name) {
+                return span;
+            }
+        }
+        return utils::profiler::SpanSummary{name, 0, 0, 0};
+    };
+    auto run = []() {
+        DALI_PROFILE_SCOPE("profiler test outer");
+        for (int i = 0; i < 3; ++i) {
+            DALI_PROFILE_SPAN(inner, "profiler test inner");
+            std::this_thread::sleep_for(milliseconds(1));
+            inner.stop();
+        }
+    };
+    utils::profiler::clear();
+    run();
+    // nothing is recorded while disabled...
+    ASSERT_EQ(find_span(utils::profiler::summary(), "profiler test outer").count, 0);
+    // ...except timers, which then only add to totals (no events).
+    {
+        utils::Timer timer("profiler test timer");
+        for (int i = 0; i < 1000; ++i) {
+            utils::Timer inner_timer("profiler test inner timer");
+        }
+    }
+    auto timer       = find_span(utils::profiler::summary(), "profiler test timer");
+    auto inner_timer = find_span(utils::profiler::summary(), "profiler test inner timer");
+    ASSERT_EQ(timer.count, 1);
+    ASSERT_EQ(inner_timer.count, 1000);
+    EXPECT_EQ(timer.self_ns, timer.total_ns - inner_timer.total_ns);
+
+    utils::profiler::enable();
+    run();
+    std::thread other(run);
+    other.join();
+    utils::profiler::enable(false);
+
+    auto spans = utils::profiler::summary();
+    auto outer = find_span(spans, "profiler test outer");
+    auto inner = find_span(spans, "profiler test inner");
+    EXPECT_EQ(outer.count, 2);
+    EXPECT_EQ(inner.count, 6);
+    EXPECT_GE(inner.total_ns, 6000000);
+    EXPECT_EQ(inner.self_ns, inner.total_ns);
+    // the outer spans' time is mostly in their children.
+    EXPECT_GE(outer.total_ns, inner.total_ns);
+    EXPECT_EQ(outer.self_ns, outer.total_ns - inner.total_ns);
+
+    string fname = STR(DALI_DATA_DIR) "/profiler_trace.json";
+    utils::profiler::save_chrome_trace(fname);
+    std::ifstream trace(fname);
+    string contents((std::istreambuf_iterator<char>(trace)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(contents.find("{\"traceEvents\":["), 0);
+    EXPECT_NE(contents.find("\"name\":\"profiler test inner\",\"ph\":\"X\""), string::npos);
+    EXPECT_EQ(contents.find("profiler test inner timer"), string::npos);
+    std::remove(fname.c_str());
+
+    utils::profiler::clear();
+    EXPECT_EQ(find_span(utils::profiler::summary(), "profiler test outer").count, 0);
+}
+
+TEST(utils, profiler_counts_ops) {
+    auto find_op = [](const string& name, utils::profiler::Direction direction) -> utils::profiler::OpSummary {
+        for (auto& op : utils::profiler::op_summary()) {
+            if (op.name == name && op.direction == direction) {
+                return op;
+            }
+        }
+        return utils::profiler::OpSummary{name, direction, 0, {0.0, 0.0, 0.0}, 0, {{0, 0, 0, 0}}, 0};
+    };
+    auto forward = [](int n) {
+        DALI_COUNT_OP("counted test op", FORWARD, 2 * n, 3 * n, n, n, 2);
+    };
+    auto backward = [](int n) {
+        DALI_COUNT_OP("counted test op", BACKWARD, 4 * n, 5 * n, 2 * n, n, 2);
+    };
+    utils::profiler::clear();
+    forward(10);
+    // nothing is counted while disabled.
+    ASSERT_EQ(find_op("counted test op", utils::profiler::FORWARD).calls, 0);
+
+    utils::profiler::count_ops();
+    forward(10);
+    forward(10);
+    forward(20);
+    backward(10);
+    utils::profiler::count_ops(false);
+
+    auto fwd = find_op("counted test op", utils::profiler::FORWARD);
+    EXPECT_EQ(fwd.calls, 3);
+    EXPECT_EQ(fwd.work.flops, 80.0);
+    EXPECT_EQ(fwd.work.bytes_read, 120.0);
+    EXPECT_EQ(fwd.work.bytes_written, 40.0);
+    // the most common shape.
+    EXPECT_EQ(fwd.shape[0], 10);
+    EXPECT_EQ(fwd.shape[1], 2);
+    EXPECT_EQ(fwd.shape[2], 0);
+    EXPECT_EQ(fwd.shape_calls, 2);
+
+    auto bwd = find_op("counted test op", utils::profiler::BACKWARD);
+    EXPECT_EQ(bwd.calls, 1);
+    EXPECT_EQ(bwd.work.flops, 40.0);
+
+    utils::profiler::clear();
+    EXPECT_EQ(find_op("counted test op", utils::profiler::FORWARD).calls, 0);
+}
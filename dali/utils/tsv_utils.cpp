@@ -1,5 +1,9 @@
 #include "dali/utils/tsv_utils.h"
 
+#include <cstring>
+
+#include "dali/utils/parallel_parsing.h"
+
 using std::vector;
 using std::string;
 using std::ifstream;
@@ -36,21 +40,32 @@ namespace utils {
     }
 
     tokenized_labeled_dataset load_tsv(const string& fname, int expected_columns, const char& delimiter) {
-        auto tsv = generate_tsv_rows(fname, delimiter);
-        // row by row
-        tokenized_labeled_dataset rows;
-        int row_number = 0;
-        for (auto row : tsv) {
-            row_number++;
-            if (expected_columns > 0) {
-                assert2(
-                    row.size() == expected_columns,
-                    MS() << "File TSV Row at row "
-                         << row_number
-                         << " has unexpected number of columns (" << row.size() << ")."
-                );
-            }
-            rows.emplace_back(row);
+        assert2(file_exists(fname), "Cannot open tsv file.");
+        // rows are parsed in parallel (in the same way as
+        // generate_tsv_rows), then checked in order.
+        auto rows = parallel_parsing::parse_lines<row_t>(fname,
+            [delimiter](const char* begin, const char* end, vector<row_t>* parsed) {
+                row_t row;
+                while (begin < end) {
+                    auto cell_end = (const char*)std::memchr(begin, delimiter, end - begin);
+                    if (cell_end == NULL) {
+                        cell_end = end;
+                    }
+                    row.emplace_back();
+                    parallel_parsing::tokenize(begin, cell_end, &row.back());
+                    begin = cell_end + 1;
+                }
+                if (row.size() > 0) {
+                    parsed->emplace_back(std::move(row));
+                }
+            });
+        for (int row_number = 1; expected_columns > 0 && row_number <= rows.size(); ++row_number) {
+            assert2(
+                rows[row_number - 1].size() == expected_columns,
+                MS() << "File TSV Row at row "
+                     << row_number
+                     << " has unexpected number of columns (" << rows[row_number - 1].size() << ")."
+            );
         }
         return rows;
     }
@@ -0,0 +1,147 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dali/utils.h"
+
+using std::string;
+using std::vector;
+
+DEFINE_int32(rows,        200000, "How many rows each generator yields ?");
+DEFINE_int32(columns,     4,      "How many tokens per yielded row ?");
+DEFINE_int32(work,        200,    "Busy work per row, on both the producer and the consumer side.");
+DEFINE_int32(passes,      3,      "How many passes to time (best is reported) ?");
+
+typedef vector<string> row_t;
+
+// Generator handing over one element at a time through a mutex
+// (how utils::Gen worked before it had a prefetch queue), kept
+// here as the baseline.
+namespace baseline {
+    template<typename T>
+    class Generator {
+        private:
+            std::function<void(std::function<void(T)>)> gen;
+            std::mutex mutex;
+            std::thread thread;
+            T value;
+            bool has_outputted;
+            bool done;
+        public:
+            explicit Generator(std::function<void(std::function<void(T)>)> _gen) :
+                    gen(_gen), has_outputted(false), done(false) {
+                mutex.lock();
+                thread = std::thread([this]() {
+                    mutex.lock();
+                    gen([this](T v) {
+                        value = v;
+                        has_outputted = true;
+                        while (has_outputted) {
+                            mutex.unlock();
+                            std::this_thread::yield();
+                            mutex.lock();
+                        }
+                    });
+                    done = true;
+                    mutex.unlock();
+                });
+                next();
+            }
+            ~Generator() {
+                mutex.unlock();
+                thread.join();
+            }
+            bool next() {
+                has_outputted = false;
+                while (!has_outputted && !done) {
+                    mutex.unlock();
+                    std::this_thread::yield();
+                    mutex.lock();
+                }
+                return !done;
+            }
+            T operator*() {
+                return value;
+            }
+            operator bool() {
+                return !done;
+            }
+    };
+}
+
+volatile int sink = 0;
+
+void busy_work(int amount) {
+    for (int i = 0; i < amount; ++i) {
+        sink = sink + i;
+    }
+}
+
+void produce_rows(utils::yield_t<row_t> yield) {
+    for (int i = 0; i < FLAGS_rows; ++i) {
+        row_t row;
+        for (int c = 0; c < FLAGS_columns; ++c) {
+            row.emplace_back(std::to_string(i * FLAGS_columns + c));
+        }
+        busy_work(FLAGS_work);
+        yield(row);
+    }
+}
+
+template<typename Function>
+void report(const string& name, Function consume_all) {
+    double best = 0.0;
+    for (int pass = 0; pass < FLAGS_passes; ++pass) {
+        auto start = std::chrono::high_resolution_clock::now();
+        int seen = consume_all();
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        utils::assert2(seen == FLAGS_rows, "Generator lost rows.");
+        best = std::max(best, seen / elapsed.count());
+    }
+    std::cout << std::setw(24) << std::left << name
+              << std::setw(14) << std::right << std::fixed << std::setprecision(0) << best
+              << " rows/s" << std::endl;
+}
+
+int main (int argc,  char* argv[]) {
+    GFLAGS_NAMESPACE::SetUsageMessage(
+        "\n"
+        "Generator benchmark\n"
+        "-------------------\n"
+        "\n"
+        "Measures how many rows per second flow from a generator thread\n"
+        "to its consumer, with the former one-element handoff and with\n"
+        "utils::Generator at several prefetch depths. Both sides do some\n"
+        "busy work per row (--work) so that overlapping them pays off.\n"
+    );
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+
+    report("baseline (handoff)", []() {
+        int seen = 0;
+        baseline::Generator<row_t> gen(produce_rows);
+        while (gen) {
+            auto row = *gen;
+            busy_work(FLAGS_work);
+            seen++;
+            gen.next();
+        }
+        return seen;
+    });
+
+    for (int depth : {1, 4, 16, 256}) {
+        report("prefetch depth " + std::to_string(depth), [depth]() {
+            int seen = 0;
+            auto gen = utils::Generator<row_t>(produce_rows, depth);
+            for (auto row : gen) {
+                busy_work(FLAGS_work);
+                seen++;
+            }
+            return seen;
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dali/core.h"
+#include "dali/utils.h"
+#include "dali/data_processing/Glove.h"
+
+using std::string;
+using std::vector;
+using utils::Vocab;
+
+typedef float REAL_t;
+
+DEFINE_string(glove,  STR(DALI_DATA_DIR) "/glove/test_data.txt", "Glove text file to load.");
+DEFINE_string(binary, "", "Where to write its binary version (defaults to the text file + .bin).");
+DEFINE_int32(repeats, 5,  "How many loads to time ?");
+DEFINE_int32(relevant_words, 10000, "Size of the vocabulary for load_relevant_vectors.");
+
+template<typename Load>
+double seconds_per_load(Load load) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int repeat = 0; repeat < FLAGS_repeats; ++repeat) {
+        load();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count() / FLAGS_repeats;
+}
+
+void report(const string& name, double text, double binary) {
+    std::cout << std::setw(24) << std::left << name
+              << std::setw(12) << std::right << std::fixed << std::setprecision(4) << text
+              << std::setw(12) << binary
+              << std::setw(10) << std::setprecision(1) << text / binary << "x" << std::endl;
+}
+
+int main (int argc,  char* argv[]) {
+    GFLAGS_NAMESPACE::SetUsageMessage(
+        "\n"
+        "Glove loading benchmark\n"
+        "-----------------------\n"
+        "\n"
+        "Converts a Glove text file to the binary embedding format and\n"
+        "measures how long loading the vectors takes from each, for the\n"
+        "whole file (mapped for floats, copied for doubles) and for the\n"
+        "rows of a smaller vocabulary (load_relevant_vectors).\n"
+    );
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+    string binary_fname = FLAGS_binary.empty() ? FLAGS_glove + ".bin" : FLAGS_binary;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    int num_words = glove::convert_to_binary(FLAGS_glove, binary_fname);
+    std::chrono::duration<double> conversion = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "converted " << num_words << " words to " << binary_fname
+              << " in " << std::setprecision(2) << std::fixed << conversion.count() << "s" << std::endl;
+
+    // every other word of the file, up to relevant_words.
+    Mat<REAL_t> text_mat;
+    Vocab text_vocab;
+    glove::load(FLAGS_glove, &text_mat, &text_vocab);
+    vector<string> relevant_words;
+    for (int word = 0; word < text_vocab.index2word.size() && relevant_words.size() < FLAGS_relevant_words; word += 2) {
+        relevant_words.emplace_back(text_vocab.index2word[word]);
+    }
+    Vocab relevant_vocab(relevant_words);
+
+    std::cout << std::setw(24) << std::left << "load"
+              << std::setw(12) << std::right << "text (s)"
+              << std::setw(12) << "binary (s)"
+              << std::setw(11) << "speedup" << std::endl;
+
+    report("float",
+        seconds_per_load([]() { glove::load<REAL_t>(FLAGS_glove); }),
+        seconds_per_load([&binary_fname]() { glove::load<REAL_t>(binary_fname); })
+    );
+    report("double",
+        seconds_per_load([]() { glove::load<double>(FLAGS_glove); }),
+        seconds_per_load([&binary_fname]() { glove::load<double>(binary_fname); })
+    );
+    report("relevant vectors",
+        seconds_per_load([&relevant_vocab]() {
+            Mat<REAL_t> target;
+            glove::load_relevant_vectors(FLAGS_glove, &target, relevant_vocab);
+        }),
+        seconds_per_load([&relevant_vocab, &binary_fname]() {
+            Mat<REAL_t> target;
+            glove::load_relevant_vectors(binary_fname, &target, relevant_vocab);
+        })
+    );
+    // mapping is lazy: touching every vector is part of the cost.
+    report("float, summed",
+        seconds_per_load([]() { std::get<0>(glove::load<REAL_t>(FLAGS_glove)).w().sum(); }),
+        seconds_per_load([&binary_fname]() { std::get<0>(glove::load<REAL_t>(binary_fname)).w().sum(); })
+    );
+    return 0;
+}
@@ -14,6 +14,7 @@
 #include "dali/utils/NlpUtils.h"
 #include "dali/utils/stacked_model_builder.h"
 #include "dali/models/StackedModel.h"
+#include "dali/tensor/Roofline.h"
 #include "dali/visualizer/visualizer.h"
 #ifdef DALI_USE_CUDA
     #include "dali/utils/gpu_utils.h"
@@ -21,6 +22,7 @@
 
 DEFINE_int32(minibatch,            100,  "What size should be used for the minibatches ?");
 DEFINE_bool(sparse,                true, "Use sparse embedding");
+DEFINE_bool(packed,                false,"Train on packed minibatches: each timestep only runs the sentences that have not ended yet.");
 DEFINE_double(cutoff,              -1.0,  "KL Divergence error where stopping is acceptable");
 DEFINE_int32(patience,             5,    "How many unimproving epochs to wait through before witnessing progress ?");
 DEFINE_int32(num_reconstructions,  5,    "How many sentences to demo after each epoch.");
@@ -28,6 +30,9 @@ DEFINE_double(dropout,             0.3,  "How many Hintons to include in the neu
 DEFINE_int32(max_sentence_length,  19,   "How many sentences to demo after each epoch.");
 DEFINE_bool(show_reconstructions,  true, "Show example reconstructions during phase.");
 DEFINE_bool(show_wps,              false,"LSTM's memory cell also control gate outputs");
+DEFINE_bool(profile,               false,"Time the training steps and ops, and report them after each epoch.");
+DEFINE_string(trace,               "",   "Where to save a Chrome trace of each profiled epoch.");
+DEFINE_bool(roofline,              false,"Count the work of every op, and report it against the machine's peak after each epoch.");
 #ifdef DALI_USE_CUDA
     DEFINE_int32(device,           0,    "Which gpu to use for computation.");
 #endif
@@ -211,10 +216,24 @@ beam_search_results_t the_beam_search(
     // state comprises of last input embedding and lstm state
     beam_search_state_t initial_state = make_tuple(model.embedding[last_index], state);
 
-    auto candidate_scores = [&model](beam_search_state_t state) {
-        auto& input_vector = std::get<0>(state);
-        auto& lstm_state   = std::get<1>(state);
-        return MatOps<REAL_t>::softmax_rowwise(model.decode(input_vector, lstm_state)).log();
+    // decode every hypothesis of the beam in a single pass
+    auto candidate_scores = [&model](const vector<beam_search_state_t>& states) {
+        vector<Mat<REAL_t>> input_vectors;
+        for (auto& state : states) {
+            input_vectors.emplace_back(std::get<0>(state));
+        }
+        typename StackedModel<REAL_t>::state_type lstm_state;
+        for (int layer = 0; layer < std::get<1>(states[0]).size(); ++layer) {
+            vector<Mat<REAL_t>> memories, hiddens;
+            for (auto& state : states) {
+                memories.emplace_back(std::get<1>(state)[layer].memory);
+                hiddens.emplace_back(std::get<1>(state)[layer].hidden);
+            }
+            lstm_state.emplace_back(MatOps<REAL_t>::vstack(memories), MatOps<REAL_t>::vstack(hiddens));
+        }
+        return MatOps<REAL_t>::softmax_rowwise(
+            model.decode(MatOps<REAL_t>::vstack(input_vectors), lstm_state)
+        ).log();
     };
 
     auto make_choice = [&model](beam_search_state_t state, uint candidate) {
@@ -226,7 +245,7 @@ beam_search_results_t the_beam_search(
         return make_tuple(input_vector, lstm_state);
     };
 
-    auto beams = beam_search::beam_search<REAL_t, beam_search_state_t>(
+    auto beams = beam_search::batched_beam_search<REAL_t, beam_search_state_t>(
         initial_state,
         beam_width,
         candidate_scores,
@@ -254,6 +273,12 @@ int main( int argc, char* argv[]) {
     );
 
     GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+    utils::profiler::enable(FLAGS_profile);
+    utils::MachinePeak machine_peak{0.0, 0.0};
+    if (FLAGS_roofline) {
+        machine_peak = utils::measure_machine_peak<REAL_t>();
+        utils::profiler::count_ops();
+    }
 
 #ifdef DALI_USE_CUDA
     gpu_utils::set_default_gpu(FLAGS_device);
@@ -301,6 +326,18 @@ int main( int argc, char* argv[]) {
         word_vocab.size(),
         true);
 
+    // only the rows of the embedding seen in a minibatch get updated.
+    model.embedding.set_sparse_gradient(FLAGS_sparse);
+
+    // the same minibatches, sorted by sentence length once and for all
+    // (see PackedBatch).
+    vector<PackedBatch<REAL_t>> packed_training;
+    if (FLAGS_packed) {
+        for (auto& minibatch : training) {
+            packed_training.emplace_back(minibatch);
+        }
+    }
+
     auto parameters = model.parameters();
     auto solver     = Solver::construct(FLAGS_solver, parameters, (REAL_t) FLAGS_learning_rate);
 
@@ -340,10 +377,10 @@ int main( int argc, char* argv[]) {
                 auto thread_parameters = thread_model.parameters();
                 auto& minibatch = training[batch_id];
 
-                auto error = thread_model.masked_predict_cost(
-                    minibatch, FLAGS_dropout,
-                    1 // sequence forecasting problem - predict target one step ahead
-                );
+                // sequence forecasting problem - predict target one step ahead
+                auto error = FLAGS_packed ?
+                    thread_model.masked_predict_cost(packed_training[batch_id], FLAGS_dropout, 1) :
+                    thread_model.masked_predict_cost(minibatch, FLAGS_dropout, 1);
                 error.grad();
 
                 graph::backward(); // backpropagate
@@ -436,11 +473,19 @@ int main( int argc, char* argv[]) {
                   << " patience = " << patience << std::endl;
         maybe_save_model(&model);
 
+        if (!FLAGS_trace.empty()) {
+            utils::profiler::save_chrome_trace(FLAGS_trace);
+        }
+        if (FLAGS_roofline) {
+            utils::roofline_report(machine_peak);
+        }
         Timer::report();
 
 
         ELOG(memory_bank<REAL_t>::num_cpu_allocations);
         ELOG(memory_bank<REAL_t>::total_cpu_memory);
+        ELOG(memory_bank<REAL_t>::cpu_memory_high_water_mark);
+        ELOG(memory_bank<REAL_t>::cpu_pool_hit_rate());
         #ifdef DALI_USE_CUDA
             ELOG(memory_bank<REAL_t>::num_gpu_allocations);
             ELOG(memory_bank<REAL_t>::total_gpu_memory);
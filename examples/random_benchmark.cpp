@@ -0,0 +1,84 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dali/core.h"
+#include "dali/utils.h"
+#include "dali/math/TensorRandom.h"
+
+using std::string;
+using std::vector;
+
+typedef float REAL_t;
+
+DEFINE_int32(repeats, 200, "How many fills to time per size ?");
+DEFINE_int32(threads, 1,   "Threads used by CPU ops (0 means one per core).");
+
+// How TensorOps::random filled cpu tensors before it had persistent
+// per-thread streams: a generator constructed and seeded per call.
+namespace baseline {
+    void uniform(mshadow::Tensor<mshadow::cpu, 2, REAL_t> t, REAL_t lower, REAL_t upper) {
+        mshadow::Random<mshadow::cpu, REAL_t> generator(utils::randint(0, 999999));
+        generator.SampleUniform(&t, lower, upper);
+    }
+
+    void gaussian(mshadow::Tensor<mshadow::cpu, 2, REAL_t> t, REAL_t mean, REAL_t std) {
+        mshadow::Random<mshadow::cpu, REAL_t> generator(utils::randint(0, 999999));
+        generator.SampleGaussian(&t, mean, std);
+    }
+}
+
+template<typename Fill>
+double samples_per_second(int size, Fill fill) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int repeat = 0; repeat < FLAGS_repeats; ++repeat) {
+        fill();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return (double)size * FLAGS_repeats / elapsed.count();
+}
+
+void report(const string& name, int size, double baseline, double philox) {
+    std::cout << std::setw(10) << std::left << name
+              << std::setw(10) << std::right << size
+              << std::setw(14) << std::fixed << std::setprecision(1) << baseline / 1e6
+              << std::setw(14) << philox / 1e6
+              << std::setw(10) << std::setprecision(2) << philox / baseline << "x" << std::endl;
+}
+
+int main (int argc,  char* argv[]) {
+    GFLAGS_NAMESPACE::SetUsageMessage(
+        "\n"
+        "Random benchmark\n"
+        "----------------\n"
+        "\n"
+        "Measures how many uniform and gaussian samples per second\n"
+        "fill cpu tensors of various sizes, with a generator seeded per\n"
+        "call (the former path) and with the per-thread philox streams\n"
+        "of TensorOps::random.\n"
+    );
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+    cpu_threading::set_num_threads(FLAGS_threads);
+
+    std::cout << std::setw(10) << std::left << "sampler"
+              << std::setw(10) << std::right << "size"
+              << std::setw(14) << "baseline M/s"
+              << std::setw(14) << "philox M/s"
+              << std::setw(11) << "speedup" << std::endl;
+
+    for (int size : vector<int>({20, 1000, 100000, 1000000})) {
+        Mat<REAL_t> mat(1, size);
+        auto data = MAT(mat).mutable_cpu_data();
+        report("uniform", size,
+            samples_per_second(size, [&data]() { baseline::uniform(data, -1.0, 1.0); }),
+            samples_per_second(size, [&data]() { TensorOps::random::uniform(data, (REAL_t)-1.0, (REAL_t)1.0); })
+        );
+        report("gaussian", size,
+            samples_per_second(size, [&data]() { baseline::gaussian(data, 0.0, 1.0); }),
+            samples_per_second(size, [&data]() { TensorOps::random::gaussian(data, (REAL_t)0.0, (REAL_t)1.0); })
+        );
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "dali/core.h"
+#include "dali/utils.h"
+
+using std::vector;
+
+typedef float REAL_t;
+
+DEFINE_int32(nodes,       1000000, "How many nodes to record per pass ?");
+DEFINE_int32(passes,      5,       "How many record + backward passes to time ?");
+DEFINE_int32(hidden_size, 10,      "Hidden size used by the end to end benchmark.");
+
+// Same payload and amount of work as the closure below, recorded as a node.
+struct noop_node {
+    Mat<REAL_t> matrix1;
+    Mat<REAL_t> matrix2;
+    Mat<REAL_t> out;
+    int* counter;
+    void backward() {
+        (*counter)++;
+    }
+};
+
+// The tape as it was before nodes: a vector of closures, run in
+// reverse order and cleared.
+struct function_tape {
+    std::vector<std::function<void()>> backprop;
+
+    void emplace_back(std::function<void()>&& f) {
+        backprop.emplace_back(f);
+    }
+
+    void backward() {
+        for (auto it = backprop.rbegin(); it != backprop.rend(); ++it)
+            (*it)();
+        backprop.clear();
+    }
+};
+
+template<typename Record, typename Backward>
+double nodes_per_second(const std::string& name, int nodes_per_pass, Record record_pass, Backward backward) {
+    double best = 0.0;
+    for (int pass = 0; pass < FLAGS_passes; ++pass) {
+        auto start = std::chrono::high_resolution_clock::now();
+        record_pass();
+        backward();
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        best = std::max(best, nodes_per_pass / elapsed.count());
+    }
+    std::cout << std::setw(24) << std::left << name
+              << std::setw(14) << std::right << std::fixed << std::setprecision(0) << best
+              << " nodes/s" << std::endl;
+    return best;
+}
+
+int main (int argc,  char* argv[]) {
+    GFLAGS_NAMESPACE::SetUsageMessage(
+        "\n"
+        "Tape benchmark\n"
+        "--------------\n"
+        "\n"
+        "Measures how many tape entries can be recorded and\n"
+        "backpropagated per second: with the former tape (a vector\n"
+        "of std::function), with closures (graph::emplace_back) and\n"
+        "with arena allocated nodes (graph::emplace_node).\n"
+    );
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+
+    Mat<REAL_t> a(1, 1), b(1, 1), c(1, 1);
+    int counter = 0;
+    auto tape_backward = []() { graph::backward(); };
+
+    function_tape old_tape;
+    auto functions = nodes_per_second("std::function tape", FLAGS_nodes, [&]() {
+        for (int i = 0; i < FLAGS_nodes; ++i) {
+            old_tape.emplace_back([a, b, c, &counter]() mutable {
+                counter++;
+            });
+        }
+    }, [&old_tape]() { old_tape.backward(); });
+    nodes_per_second("closures", FLAGS_nodes, [&]() {
+        for (int i = 0; i < FLAGS_nodes; ++i) {
+            graph::emplace_back([a, b, c, &counter]() mutable {
+                counter++;
+            });
+        }
+    }, tape_backward);
+    auto nodes = nodes_per_second("nodes", FLAGS_nodes, [&]() {
+        for (int i = 0; i < FLAGS_nodes; ++i) {
+            graph::emplace_node<noop_node>(a, b, c, &counter);
+        }
+    }, tape_backward);
+    std::cout << "speedup: " << std::setprecision(2) << nodes / functions << "x" << std::endl;
+
+    // end to end: small elementwise ops where tape overhead dominates.
+    Mat<REAL_t> x(1, FLAGS_hidden_size, weights<REAL_t>::uniform(1.0));
+    Mat<REAL_t> y(1, FLAGS_hidden_size, weights<REAL_t>::uniform(1.0));
+    int steps = FLAGS_nodes / 10;
+    nodes_per_second("small ops (end to end)", steps * 3, [&]() {
+        for (int i = 0; i < steps; ++i) {
+            auto z = (x * y + x).sigmoid();
+        }
+    }, tape_backward);
+    Mat<REAL_t> W(FLAGS_hidden_size, FLAGS_hidden_size, weights<REAL_t>::uniform(1.0));
+    nodes_per_second("mul + sum (end to end)", steps * 3, [&]() {
+        for (int i = 0; i < steps; ++i) {
+            auto z = x.dot(W).tanh().sum();
+        }
+    }, tape_backward);
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dali/utils.h"
+
+using std::string;
+using std::vector;
+
+DEFINE_int32(threads,     4,      "Threads per pool.");
+DEFINE_int32(round_trips, 200,    "How many submit-and-wait round trips to time ?");
+DEFINE_int32(tasks,       200000, "How many tiny tasks to push through for throughput ?");
+DEFINE_int32(work,        50,     "Busy work per task.");
+
+// Single queue pool polled by every worker every millisecond (how
+// ThreadPool worked before it had per-worker deques), kept here as
+// the baseline.
+namespace baseline {
+    class ThreadPool {
+        private:
+            bool should_terminate;
+            std::mutex queue_mutex;
+            std::condition_variable is_idle;
+            int active_count;
+            std::deque<std::function<void()>> work;
+            std::vector<std::thread> pool;
+
+            void thread_body() {
+                bool am_i_active = false;
+                while (true) {
+                    std::function<void()> f;
+                    {
+                        std::lock_guard<std::mutex> lock(queue_mutex);
+                        bool was_i_active = am_i_active;
+                        if (should_terminate && work.empty())
+                            break;
+                        if (!work.empty()) {
+                            am_i_active = true;
+                            f = work.front();
+                            work.pop_front();
+                        } else {
+                            am_i_active = false;
+                        }
+                        if (am_i_active != was_i_active) {
+                            active_count += am_i_active ? 1 : -1;
+                            if (active_count == 0) {
+                                is_idle.notify_all();
+                            }
+                        }
+                    }
+                    if (static_cast<bool>(f)) {
+                        f();
+                    } else {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                    std::this_thread::yield();
+                }
+            }
+        public:
+            explicit ThreadPool(int num_threads) : should_terminate(false), active_count(0) {
+                for (int i = 0; i < num_threads; ++i) {
+                    pool.emplace_back(&ThreadPool::thread_body, this);
+                }
+            }
+            void run(std::function<void()> f) {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                work.push_back(f);
+            }
+            void wait_until_idle() {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                is_idle.wait(lock, [this]{
+                    return active_count == 0 && work.empty();
+                });
+            }
+            ~ThreadPool() {
+                {
+                    std::lock_guard<std::mutex> lock(queue_mutex);
+                    should_terminate = true;
+                }
+                for (auto& t : pool)
+                    t.join();
+            }
+    };
+}
+
+volatile int sink = 0;
+
+void busy_work(int amount) {
+    for (int i = 0; i < amount; ++i) {
+        sink = sink + i;
+    }
+}
+
+double seconds_since(std::chrono::high_resolution_clock::time_point start) {
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count();
+}
+
+void report(const string& name, double value, const string& unit) {
+    std::cout << std::setw(34) << std::left << name
+              << std::setw(14) << std::right << std::fixed << std::setprecision(1) << value
+              << " " << unit << std::endl;
+}
+
+template<typename Pool>
+void benchmark(const string& name, Pool& pool) {
+    std::atomic<int> done(0);
+    // latency: one task at a time, waiting for it each time.
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int trip = 0; trip < FLAGS_round_trips; ++trip) {
+        pool.run([&done]() { done++; });
+        pool.wait_until_idle();
+    }
+    report(name + " round trip", 1e6 * seconds_since(start) / FLAGS_round_trips, "us");
+
+    // throughput: many small tasks in flight.
+    start = std::chrono::high_resolution_clock::now();
+    for (int task = 0; task < FLAGS_tasks; ++task) {
+        pool.run([&done]() {
+            busy_work(FLAGS_work);
+            done++;
+        });
+    }
+    pool.wait_until_idle();
+    report(name + " throughput", FLAGS_tasks / seconds_since(start), "tasks/s");
+    utils::assert2(done == FLAGS_round_trips + FLAGS_tasks, "Pool lost tasks.");
+}
+
+int main (int argc,  char* argv[]) {
+    GFLAGS_NAMESPACE::SetUsageMessage(
+        "\n"
+        "Thread pool benchmark\n"
+        "---------------------\n"
+        "\n"
+        "Measures the latency of a submit-and-wait round trip and the\n"
+        "throughput of many small tasks, for the former polling pool and\n"
+        "for ThreadPool, and the cost of a small ThreadPool::parallel_for.\n"
+    );
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+
+    {
+        baseline::ThreadPool pool(FLAGS_threads);
+        benchmark("baseline (polling)", pool);
+    }
+    {
+        ThreadPool pool(FLAGS_threads);
+        benchmark("work stealing", pool);
+
+        vector<int> values(1 << 16, 1);
+        std::atomic<long> total(0);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int trip = 0; trip < FLAGS_round_trips; ++trip) {
+            pool.parallel_for(0, values.size(), 4096, [&values, &total](int begin, int end) {
+                long partial = 0;
+                for (int i = begin; i < end; ++i) {
+                    partial += values[i];
+                }
+                total += partial;
+            });
+        }
+        report("parallel_for (64k, grain 4096)", 1e6 * seconds_since(start) / FLAGS_round_trips, "us");
+        utils::assert2(total == (long)values.size() * FLAGS_round_trips, "parallel_for lost chunks.");
+    }
+    return 0;
+}